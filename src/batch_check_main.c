@@ -0,0 +1,166 @@
+// Checks the SIMD batch engine (see chip8_batch.h) against the normal interpreter. Runs a ROM
+// on many lanes of a batch and on the same number of VMs that run one at a time, presses random
+// keys on every lane, and compares the state of every lane after each frame.
+//
+// Usage: ryce8-batch-check [--lanes <N>] [--frames <N>] [--ipf <N>] [--seed <N>] <ROM_FILE_PATH> <VIP | SUPER>
+//
+// Exits with 1 if any lane ends up different. Each lane is only reported the first time.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_batch.h"
+
+#define CHECK_DEFAULT_LANES 100
+#define CHECK_DEFAULT_FRAMES 600
+#define CHECK_DEFAULT_INSTRUCTIONS_PER_FRAME 20
+
+//only the first few mismatches are printed
+#define CHECK_MAX_REPORTS 10
+
+
+static int check_parse_uint(const char *str, uint64_t max, uint64_t *out) {
+  char *end = NULL;
+  *out = strtoull(str, &end, 0);
+  return *str != '\0' && *str != '-' && *end == '\0' && *out <= max;
+}
+
+// Random keys, the same on every run. About one frame in 8, a lane holds down a single key.
+static uint16_t check_random_keys(uint64_t *rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+  return (*rng & 7) == 0 ? (uint16_t)(1 << ((*rng >> 3) & 0xF)) : 0;
+}
+
+int main(int argc, char **argv) {
+  uint64_t num_lanes = CHECK_DEFAULT_LANES;
+  uint64_t num_frames = CHECK_DEFAULT_FRAMES;
+  uint64_t instructions_per_frame = CHECK_DEFAULT_INSTRUCTIONS_PER_FRAME;
+  uint64_t seed = 0;
+  char *rom_file = NULL;
+  char *type_name = NULL;
+
+  for(int i = 1; i < argc; i++) {
+    uint64_t *value = NULL;
+    uint64_t max = UINT32_MAX;
+    if(strcmp(argv[i], "--lanes") == 0) {
+      value = &num_lanes;
+      max = 65536;
+    } else if(strcmp(argv[i], "--frames") == 0) {
+      value = &num_frames;
+    } else if(strcmp(argv[i], "--ipf") == 0) {
+      value = &instructions_per_frame;
+      max = UINT16_MAX;
+    } else if(strcmp(argv[i], "--seed") == 0) {
+      value = &seed;
+      max = UINT64_MAX;
+    } else if(rom_file == NULL) {
+      rom_file = argv[i];
+      continue;
+    } else if(type_name == NULL) {
+      type_name = argv[i];
+      continue;
+    } else {
+      printf("Error: Too many arguments!\n");
+      return 1;
+    }
+
+    i++;
+    uint64_t min = value == &seed ? 0 : 1;
+    if(i >= argc || !check_parse_uint(argv[i], max, value) || *value < min) {
+      printf("Error: Invalid argument after %s! Argument must be an integer between %llu and %llu.\n", argv[i - 1], (unsigned long long)min, (unsigned long long)max);
+      return 1;
+    }
+  }
+
+  enum chip8_emu_type type;
+  if(rom_file == NULL || type_name == NULL) {
+    printf("Usage: ryce8-batch-check [--lanes <N>] [--frames <N>] [--ipf <N>] [--seed <N>] <ROM_FILE_PATH> <VIP | SUPER>\n");
+    return 1;
+  } else if(strcmp(type_name, "VIP") == 0) {
+    type = CHIP8_VARIANT_VIP;
+  } else if(strcmp(type_name, "SUPER") == 0) {
+    type = CHIP8_VARIANT_SUPER;
+  } else {
+    printf("Error: Invalid variant %s! Variant must be VIP or SUPER.\n", type_name);
+    return 1;
+  }
+
+  FILE *rom = fopen(rom_file, "rb");
+  if(rom == NULL) {
+    printf("Error: Cannot open ROM file %s!\n", rom_file);
+    return 1;
+  }
+
+  struct chip8_batch b;
+  if(!chip8_batch_init(&b, type, (uint32_t)num_lanes)) {
+    printf("Error: Not enough memory for %llu lanes!\n", (unsigned long long)num_lanes);
+    fclose(rom);
+    return 1;
+  }
+
+  int res = chip8_batch_load(&b, rom, seed);
+  fclose(rom);
+  if(!res) {
+    printf("Error: Cannot load ROM file %s!\n", rom_file);
+    chip8_batch_free(&b);
+    return 1;
+  }
+
+  //the reference VMs start out as copies of the lanes, and are run by the normal interpreter
+  struct chip8 *refs = chip8_create_array(type, (uint32_t)num_lanes);
+  uint8_t *halted = calloc(num_lanes, 1);
+  uint8_t *differs = calloc(num_lanes, 1);
+  if(refs == NULL || halted == NULL || differs == NULL) {
+    printf("Error: Not enough memory for %llu lanes!\n", (unsigned long long)num_lanes);
+    chip8_destroy_array(refs, (uint32_t)num_lanes);
+    free(halted);
+    free(differs);
+    chip8_batch_free(&b);
+    return 1;
+  }
+
+  for(uint32_t l = 0; l < num_lanes; l++) {
+    chip8_fork(chip8_array_at(b.vms, l), chip8_array_at(refs, l));
+  }
+
+  uint64_t rng = seed * 2654435761ULL + 1;
+  uint64_t num_mismatches = 0;
+  for(uint64_t frame = 0; frame < num_frames; frame++) {
+    for(uint32_t l = 0; l < num_lanes; l++) {
+      uint16_t keys = check_random_keys(&rng);
+      chip8_batch_set_keyboard(&b, l, keys);
+      chip8_set_keyboard(&chip8_array_at(refs, l)->core, keys);
+    }
+
+    chip8_batch_run_frame(&b, (uint16_t)instructions_per_frame);
+
+    for(uint32_t l = 0; l < num_lanes; l++) {
+      struct chip8 *ref = chip8_array_at(refs, l);
+      if(!halted[l] && (!chip8_wrapper_run_frame(ref, (uint32_t)instructions_per_frame) || chip8_wrapper_has_exited(ref))) {
+        halted[l] = 1;
+      }
+
+      if(!differs[l] && (halted[l] != b.halted[l] || chip8_wrapper_state_hash(ref) != chip8_wrapper_state_hash(chip8_array_at(b.vms, l)))) {
+        if(num_mismatches < CHECK_MAX_REPORTS) {
+          printf("Lane %u differs after frame %llu (halted: batch %u, interpreter %u)\n", l, (unsigned long long)frame, b.halted[l], halted[l]);
+        }
+        differs[l] = 1;
+        num_mismatches++;
+      }
+    }
+  }
+
+  printf("%s: %llu lanes, %llu frames, %llu lanes differ (%llu instructions ran on groups of lanes, %llu on single lanes)\n",
+         rom_file, (unsigned long long)num_lanes, (unsigned long long)num_frames, (unsigned long long)num_mismatches,
+         (unsigned long long)b.num_vector_instructions, (unsigned long long)b.num_scalar_instructions);
+
+  chip8_destroy_array(refs, (uint32_t)num_lanes);
+  free(halted);
+  free(differs);
+  chip8_batch_free(&b);
+  return num_mismatches == 0 ? 0 : 1;
+}
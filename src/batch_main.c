@@ -0,0 +1,416 @@
+// Headless batch runner. Runs a list of jobs ("run ROM X on variant Y for T frames") on
+// every CPU core, and prints the final state hash of each job along with how busy each
+// worker thread was.
+//
+// Usage: ryce8-batch [--threads <N>] [--slice <FRAMES>] [--detect-quirks] [--record <DIR>] [--record-format <gif | apng>] [--record-scale <N>] <JOB_FILE>
+//
+// Each line of the job file holds one job:
+//    <ROM_FILE_PATH> <VIP | SUPER> <FRAMES> [INSTRUCTIONS_PER_FRAME] [SEED]
+// Empty lines and lines starting with # are skipped.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_thread_pool.h"
+#include "chip8_quirks.h"
+#include "chip8_recorder.h"
+
+#define BATCH_DEFAULT_INSTRUCTIONS_PER_FRAME 10
+#define BATCH_DEFAULT_SLICE_FRAMES 60
+
+//how long every quirk combination runs for with --detect-quirks (10 emulated seconds)
+#define BATCH_DETECT_QUIRKS_FRAMES 600
+
+//with --record, there is one encoder thread for every this many worker threads
+#define BATCH_WORKERS_PER_ENCODER 4
+
+struct batch_job {
+  char rom_file[FILENAME_MAX];
+  enum chip8_emu_type type;
+  uint32_t num_frames;
+  uint32_t instructions_per_frame;
+  uint64_t seed;
+
+  //font and ROM the job starts from. Jobs that run the same ROM share the same image.
+  struct chip8_shared_ram *image;
+  struct chip8 *vm;
+
+  uint32_t frames_done;
+  uint8_t halted;
+
+  //with --record, every frame the job runs is added to this
+  struct chip8_recording *recording;
+};
+
+struct batch {
+  struct batch_job *jobs;
+  uint32_t num_jobs;
+
+  //the VMs of every job, with one array per variant, so each array only holds VMs of the same size.
+  struct chip8 *vms[CHIP8_NUM_VARIANTS];
+  uint32_t num_vms[CHIP8_NUM_VARIANTS];
+  uint32_t slice_frames;
+
+  //jobs whose recording fell behind are parked here until the encoder made room
+  struct chip8_thread_pool *pool;
+};
+
+
+static int batch_parse_uint(const char *str, uint64_t max, uint64_t *out) {
+  char *end = NULL;
+  *out = strtoull(str, &end, 0);
+  return *str != '\0' && *str != '-' && *end == '\0' && *out <= max;
+}
+
+static int batch_parse_type(const char *str, enum chip8_emu_type *type) {
+  if(strcmp(str, "VIP") == 0) {
+    *type = CHIP8_VARIANT_VIP;
+  } else if(strcmp(str, "SUPER") == 0) {
+    *type = CHIP8_VARIANT_SUPER;
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+// Read every job from the job file. Returns 0 if a line is invalid.
+static int batch_read_jobs(struct batch *b, FILE *file) {
+  char line[FILENAME_MAX + 128];
+  uint32_t line_num = 0;
+  uint32_t capacity = 0;
+
+  b->jobs = NULL;
+  b->num_jobs = 0;
+
+  while(fgets(line, sizeof(line), file) != NULL) {
+    line_num++;
+
+    //read one field more than a job can have, to catch lines with too many fields.
+    char *fields[6];
+    int num_fields = 0;
+    for(char *tok = strtok(line, " \t\r\n"); tok != NULL && num_fields < 6; tok = strtok(NULL, " \t\r\n")) {
+      fields[num_fields++] = tok;
+    }
+
+    if(num_fields == 0 || fields[0][0] == '#') {
+      continue;
+    }
+
+    if(b->num_jobs == capacity) {
+      capacity = capacity == 0 ? 16 : capacity * 2;
+      struct batch_job *jobs = realloc(b->jobs, capacity * sizeof(struct batch_job));
+      if(jobs == NULL) {
+        printf("Error: Out of memory!\n");
+        return 0;
+      }
+      b->jobs = jobs;
+    }
+
+    struct batch_job *job = &b->jobs[b->num_jobs];
+    uint64_t frames;
+    uint64_t ipf = BATCH_DEFAULT_INSTRUCTIONS_PER_FRAME;
+    uint64_t seed = 0;
+
+    if(num_fields < 3 || num_fields > 5 || strlen(fields[0]) >= sizeof(job->rom_file) ||
+       !batch_parse_type(fields[1], &job->type) ||
+       !batch_parse_uint(fields[2], UINT32_MAX, &frames) ||
+       (num_fields > 3 && !batch_parse_uint(fields[3], UINT32_MAX, &ipf)) ||
+       (num_fields > 4 && !batch_parse_uint(fields[4], UINT64_MAX, &seed))) {
+      printf("Error: Invalid job on line %u! Expected <ROM_FILE_PATH> <VIP | SUPER> <FRAMES> [INSTRUCTIONS_PER_FRAME] [SEED]\n", line_num);
+      return 0;
+    }
+
+    strcpy(job->rom_file, fields[0]);
+    job->num_frames = frames;
+    job->instructions_per_frame = ipf;
+    job->seed = seed;
+    job->image = NULL;
+    job->frames_done = 0;
+    job->halted = 0;
+    job->recording = NULL;
+    b->num_jobs++;
+  }
+
+  return 1;
+}
+
+// Load the ROM of a job, unless an earlier job already loaded it.
+static struct chip8_shared_ram *batch_load_image(struct batch *b, uint32_t i) {
+  struct batch_job *job = &b->jobs[i];
+  const struct chip8_core *core = &job->vm->core;
+
+  for(uint32_t j = 0; j < i; j++) {
+    struct chip8_shared_ram *image = b->jobs[j].image;
+    if(image != NULL && image->size == core->ram_size && strcmp(b->jobs[j].rom_file, job->rom_file) == 0) {
+      return chip8_retain_image(image);
+    }
+  }
+
+  FILE *rom = fopen(job->rom_file, "rb");
+  if(rom == NULL) {
+    return NULL;
+  }
+
+  struct chip8_shared_ram *image = chip8_load_image(core, rom);
+  fclose(rom);
+  return image;
+}
+
+// Called by an encoder once a parked job can run again.
+static void batch_resume_job(void *ctx, uint32_t i) {
+  struct batch *b = ctx;
+  chip8_thread_pool_resume(b->pool, i);
+}
+
+// Run the next slice of frames of a job.
+static int batch_run_slice(void *ctx, uint32_t i) {
+  struct batch *b = ctx;
+  struct batch_job *job = &b->jobs[i];
+  struct chip8 *vm = job->vm;
+
+  if(job->halted) {
+    return 0;
+  }
+
+  uint32_t end = job->frames_done + b->slice_frames;
+  if(end > job->num_frames || end < job->frames_done) end = job->num_frames;
+
+  while(job->frames_done < end) {
+    //every frame ends up in the recording, so if the encoder fell behind, the job is parked and
+    //this worker moves on to other jobs. The encoder puts the job back once it made room.
+    if(job->recording != NULL && chip8_recording_space(job->recording) == 0 &&
+       chip8_recording_park(job->recording, batch_resume_job, b, i)) {
+      return CHIP8_THREAD_POOL_PARKED;
+    }
+
+    if(!chip8_wrapper_run_frame(vm, job->instructions_per_frame) || chip8_wrapper_has_exited(vm)) {
+      job->halted = 1;
+      return 0;
+    }
+    job->frames_done++;
+
+    if(job->recording != NULL) {
+      chip8_recording_add_frame(job->recording, &vm->core);
+    }
+  }
+
+  return job->frames_done < job->num_frames;
+}
+
+// Start recording a job to <DIR>/<JOB NUMBER>-<ROM FILE NAME>.gif (or .png). Jobs that cannot be recorded still run.
+static void batch_open_recording(struct batch *b, uint32_t i, struct chip8_recorder *recorder, const char *dir,
+                                 enum chip8_recorder_format format, uint8_t scale) {
+  struct batch_job *job = &b->jobs[i];
+  if(job->halted) {
+    return;
+  }
+
+  const char *name = job->rom_file;
+  for(const char *c = job->rom_file; *c != '\0'; c++) {
+    if(*c == '/' || *c == '\\') {
+      name = c + 1;
+    }
+  }
+
+  char path[2 * FILENAME_MAX];
+  if(snprintf(path, sizeof(path), "%s/%u-%s.%s", dir, i, name, format == CHIP8_RECORDER_GIF ? "gif" : "png") >= (int)sizeof(path)) {
+    printf("Error: Path of the recording of job %u is too long!\n", i);
+    return;
+  }
+
+  //the same colors as the window
+  job->recording = chip8_recorder_open(recorder, path, format, chip8_fb_width(job->vm), chip8_fb_height(job->vm), scale,
+    0x0000FF00, 0x00000000, CHIP8_RECORDER_DEFAULT_QUEUE_SIZE);
+  if(job->recording == NULL) {
+    printf("Error: Cannot create %s!\n", path);
+  }
+}
+
+int main(int argc, char **argv) {
+  char *job_file = NULL;
+  uint64_t num_threads = chip8_thread_num_cpus();
+  uint64_t slice_frames = BATCH_DEFAULT_SLICE_FRAMES;
+  uint8_t detect_quirks = 0;
+  char *record_dir = NULL;
+  enum chip8_recorder_format record_format = CHIP8_RECORDER_GIF;
+  uint64_t record_scale = CHIP8_RECORDER_DEFAULT_SCALE;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--threads") == 0) {
+      i++;
+      if(i >= argc || !batch_parse_uint(argv[i], 1024, &num_threads) || num_threads == 0) {
+        printf("Error: Invalid argument after --threads! Argument must be an integer between 1 and 1024.\n");
+        return 1;
+      }
+    } else if(strcmp(argv[i], "--slice") == 0) {
+      i++;
+      if(i >= argc || !batch_parse_uint(argv[i], UINT32_MAX, &slice_frames) || slice_frames == 0) {
+        printf("Error: Invalid argument after --slice! Argument must be a positive integer.\n");
+        return 1;
+      }
+    } else if(strcmp(argv[i], "--detect-quirks") == 0) {
+      detect_quirks = 1;
+    } else if(strcmp(argv[i], "--record") == 0) {
+      i++;
+      if(i >= argc) {
+        printf("Error: Missing argument after --record! Argument must be the directory to write the recordings to.\n");
+        return 1;
+      }
+      record_dir = argv[i];
+    } else if(strcmp(argv[i], "--record-format") == 0) {
+      i++;
+      if(i < argc && strcmp(argv[i], "gif") == 0) {
+        record_format = CHIP8_RECORDER_GIF;
+      } else if(i < argc && strcmp(argv[i], "apng") == 0) {
+        record_format = CHIP8_RECORDER_APNG;
+      } else {
+        printf("Error: Invalid argument after --record-format! Argument must be gif or apng.\n");
+        return 1;
+      }
+    } else if(strcmp(argv[i], "--record-scale") == 0) {
+      i++;
+      if(i >= argc || !batch_parse_uint(argv[i], CHIP8_RECORDER_MAX_SCALE, &record_scale) || record_scale == 0) {
+        printf("Error: Invalid argument after --record-scale! Argument must be an integer between 1 and %d.\n", CHIP8_RECORDER_MAX_SCALE);
+        return 1;
+      }
+    } else if(job_file == NULL) {
+      job_file = argv[i];
+    } else {
+      printf("Error: You cannot use multiple job files!\n");
+      return 1;
+    }
+  }
+
+  if(job_file == NULL) {
+    printf("Usage: ryce8-batch [--threads <N>] [--slice <FRAMES>] [--detect-quirks] [--record <DIR>] [--record-format <gif | apng>] [--record-scale <N>] <JOB_FILE>\n");
+    return 1;
+  }
+
+  FILE *file = fopen(job_file, "r");
+  if(file == NULL) {
+    printf("Error: Cannot open job file %s!\n", job_file);
+    return 1;
+  }
+
+  struct batch b = {0};
+  int res = batch_read_jobs(&b, file);
+  fclose(file);
+  if(!res) {
+    free(b.jobs);
+    return 1;
+  }
+
+  b.slice_frames = slice_frames;
+
+  for(uint32_t i = 0; i < b.num_jobs; i++) {
+    b.num_vms[b.jobs[i].type]++;
+  }
+
+  for(int type = 0; type < CHIP8_NUM_VARIANTS; type++) {
+    if(b.num_vms[type] == 0) {
+      continue;
+    }
+
+    b.vms[type] = chip8_create_array(type, b.num_vms[type]);
+    if(b.vms[type] == NULL) {
+      printf("Error: Out of memory!\n");
+      return 1;
+    }
+  }
+
+  uint32_t next_vm[CHIP8_NUM_VARIANTS] = {0};
+  for(uint32_t i = 0; i < b.num_jobs; i++) {
+    struct batch_job *job = &b.jobs[i];
+    struct chip8 *vm = chip8_array_at(b.vms[job->type], next_vm[job->type]++);
+
+    job->vm = vm;
+    chip8_wrapper_set_seed(vm, job->seed);
+
+    job->image = batch_load_image(&b, i);
+    if(job->image == NULL || !chip8_wrapper_reset_from_image(vm, job->image)) {
+      printf("Error: Cannot load ROM %s!\n", job->rom_file);
+      job->halted = 1;
+    }
+  }
+
+  struct chip8_thread_pool pool;
+  if(!chip8_thread_pool_init(&pool, num_threads)) {
+    printf("Error: Cannot create threads!\n");
+    return 1;
+  }
+  b.pool = &pool;
+
+  //every job's quirk combinations run in parallel, one job after another
+  if(detect_quirks) {
+    for(uint32_t i = 0; i < b.num_jobs; i++) {
+      struct batch_job *job = &b.jobs[i];
+      struct chip8_quirks_result result;
+
+      if(job->halted || !chip8_quirks_detect(job->vm, &pool, BATCH_DETECT_QUIRKS_FRAMES, job->instructions_per_frame, &result)) {
+        continue;
+      }
+
+      job->vm->core.quirks = result.quirks;
+      printf("%s %s quirks=0x%02X\n", job->rom_file, CHIP8_VARIANTS[job->type].name, result.quirks);
+      chip8_quirks_result_free(&result);
+    }
+    chip8_thread_pool_reset_stats(&pool);
+  }
+
+  struct chip8_recorder recorder;
+  if(record_dir != NULL) {
+    if(!chip8_recorder_init(&recorder, (num_threads + BATCH_WORKERS_PER_ENCODER - 1) / BATCH_WORKERS_PER_ENCODER)) {
+      printf("Error: Cannot create threads!\n");
+      return 1;
+    }
+
+    for(uint32_t i = 0; i < b.num_jobs; i++) {
+      batch_open_recording(&b, i, &recorder, record_dir, record_format, record_scale);
+    }
+  }
+
+  chip8_thread_pool_run_jobs(&pool, b.num_jobs, batch_run_slice, &b);
+
+  //the encoder finishes every recording once it is closed
+  if(record_dir != NULL) {
+    for(uint32_t i = 0; i < b.num_jobs; i++) {
+      if(b.jobs[i].recording != NULL) {
+        chip8_recording_close(b.jobs[i].recording);
+      }
+    }
+
+    if(!chip8_recorder_destroy(&recorder)) {
+      printf("Error: Failed to write some of the recordings!\n");
+    }
+  }
+
+  for(uint32_t i = 0; i < b.num_jobs; i++) {
+    struct batch_job *job = &b.jobs[i];
+    printf("%s %s frames=%u/%u %s hash=%016llx\n", job->rom_file, CHIP8_VARIANTS[job->type].name, 
+      job->frames_done, job->num_frames, job->halted ? "halted" : "ok", (unsigned long long)chip8_wrapper_state_hash(job->vm));
+  }
+
+  for(uint32_t i = 0; i < pool.num_workers; i++) {
+    struct chip8_worker_stats *stats = &pool.workers[i].stats;
+    uint64_t total = stats->busy_nanos + stats->idle_nanos;
+
+    printf("worker %u: busy %.1f ms, idle %.1f ms (%.1f%% busy), %llu slices, %llu steals\n", i,
+      stats->busy_nanos / 1e6, stats->idle_nanos / 1e6, total == 0 ? 0.0 : 100.0 * stats->busy_nanos / total,
+      (unsigned long long)stats->num_slices, (unsigned long long)stats->num_steals);
+  }
+
+  chip8_thread_pool_destroy(&pool);
+  for(int type = 0; type < CHIP8_NUM_VARIANTS; type++) {
+    chip8_destroy_array(b.vms[type], b.num_vms[type]);
+  }
+  for(uint32_t i = 0; i < b.num_jobs; i++) {
+    if(b.jobs[i].image != NULL) {
+      chip8_release_image(b.jobs[i].image);
+    }
+  }
+  free(b.jobs);
+
+  return 0;
+}
@@ -1,32 +1,61 @@
 #include "chip8.h"
 #include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
 
+#define CHIP8_VARIANT_SIZE(variant) (sizeof(struct chip8) + ROUND_UP_CACHE_LINE(sizeof(variant)))
+#define CHIP8_VARIANT_STATE_SIZE(variant) (sizeof(struct chip8) + offsetof(variant, alloc_ram))
+#define ROUND_UP_CACHE_LINE(n) (((n) + CHIP8_CACHE_LINE - 1) / CHIP8_CACHE_LINE * CHIP8_CACHE_LINE)
+
+const struct chip8_variant_info CHIP8_VARIANTS[CHIP8_NUM_VARIANTS] = {
+  [CHIP8_VARIANT_VIP] = {"VIP", CHIP8_VARIANT_SIZE(struct vip_chip8), CHIP8_VARIANT_STATE_SIZE(struct vip_chip8)},
+  [CHIP8_VARIANT_SUPER] = {"SUPER", CHIP8_VARIANT_SIZE(struct schip8), CHIP8_VARIANT_STATE_SIZE(struct schip8)},
+
+  //not implemented yet
+  [CHIP8_VARIANT_XO] = {"XO", 0, 0},
+};
+
+
+// Set up a VM. vm must have room for chip8_vm_size(type) bytes, so this should only be
+// called on memory from chip8_create() or chip8_create_array() of the same type.
 void chip8_wrapper_init(struct chip8 *vm, enum chip8_emu_type type) {
   vm->emu = type;
+  chip8_set_seed(&vm->core, 0);
+  vm->core.watch_addr = CHIP8_NO_WATCH;
+  vm->core.watch_hit = 0;
 
   switch(vm->emu) {
     case CHIP8_VARIANT_VIP: {
-      vm->vm.vip.core = &vm->core;
-      vip_chip8_init(&vm->vm.vip);
+      chip8_vip(vm)->core = &vm->core;
+      vip_chip8_init(chip8_vip(vm));
       break;
     }
     case CHIP8_VARIANT_SUPER: {
-      vm->vm.super.core = &vm->core;
-      schip8_init(&vm->vm.super);
+      chip8_super(vm)->core = &vm->core;
+      schip8_init(chip8_super(vm));
       break;
     }
     case CHIP8_VARIANT_XO: {
       assert(0);
     }
   }
+
+  //no program has been loaded yet. With pc past the end of RAM, running the VM fails until it is reset.
+  vm->core.pc = vm->core.ram_size;
+
+  //nothing has been drawn yet, so every row needs to be drawn once
+  vm->core.fb_generation = 0;
+  chip8_mark_fb_dirty(&vm->core);
 }
 
 int chip8_wrapper_process_instruction(struct chip8 *vm) {
   switch(vm->emu) {
-    case CHIP8_VARIANT_VIP: return vip_chip8_process_instruction(&vm->vm.vip); break;
-    case CHIP8_VARIANT_SUPER: return schip8_process_instruction(&vm->vm.super); break;
+    case CHIP8_VARIANT_VIP: return vip_chip8_process_instruction(chip8_vip(vm)); break;
+    case CHIP8_VARIANT_SUPER: return schip8_process_instruction(chip8_super(vm)); break;
     case CHIP8_VARIANT_XO: assert(0); return 0;
   }
+  return 0;
 }
 
 void chip8_wrapper_update_timer(struct chip8 *vm, uint64_t delta_millis) {
@@ -34,11 +63,168 @@ void chip8_wrapper_update_timer(struct chip8 *vm, uint64_t delta_millis) {
 }
 
 
+// Run a single 60Hz frame: num_instructions instructions, then one tick of the timers.
+// Returns 0 if an instruction could not be processed. In that case, the timers are not updated.
+int chip8_wrapper_run_frame(struct chip8 *vm, uint32_t num_instructions) {
+  for(uint32_t i = 0; i < num_instructions; i++) {
+    if(!chip8_wrapper_process_instruction(vm)) {
+      return 0;
+    }
+  }
+
+  chip8_tick_timers(&vm->core);
+  return 1;
+}
+
+// Returns 1 if the program asked the interpreter to exit (SCHIP 00FD).
+int chip8_wrapper_has_exited(const struct chip8 *vm) {
+  switch(vm->emu) {
+    case CHIP8_VARIANT_SUPER: return chip8_super(vm)->will_exit;
+    default: return 0;
+  }
+}
+
+void chip8_wrapper_set_seed(struct chip8 *vm, uint64_t seed) {
+  chip8_set_seed(&vm->core, seed);
+}
 
 int chip8_wrapper_reset(struct chip8 *vm, FILE *file) {
   switch(vm->emu) {
-    case CHIP8_VARIANT_VIP: return vip_chip8_reset(&vm->vm.vip, file); break;
-    case CHIP8_VARIANT_SUPER: return schip8_reset(&vm->vm.super, file); break;
+    case CHIP8_VARIANT_VIP: return vip_chip8_reset(chip8_vip(vm), file); break;
+    case CHIP8_VARIANT_SUPER: return schip8_reset(chip8_super(vm), file); break;
+    case CHIP8_VARIANT_XO: assert(0); return 0;
+  }
+  return 0;
+}
+
+// Reset the VM to the start of a ROM image made by chip8_load_image(). Unlike chip8_wrapper_reset(), 
+// the ROM is not read or copied, which makes this cheap enough to reset thousands of VMs.
+int chip8_wrapper_reset_from_image(struct chip8 *vm, struct chip8_shared_ram *image) {
+  switch(vm->emu) {
+    case CHIP8_VARIANT_VIP: return vip_chip8_reset_from_image(chip8_vip(vm), image); break;
+    case CHIP8_VARIANT_SUPER: return schip8_reset_from_image(chip8_super(vm), image); break;
+    case CHIP8_VARIANT_XO: assert(0); return 0;
+  }
+  return 0;
+}
+
+// Reset the VM to the start of a ROM that is already in memory, for programs that
+// do not load ROMs from files. The VM only copies the ROM into its own RAM once it writes to RAM.
+int chip8_wrapper_reset_from_buffer(struct chip8 *vm, const uint8_t *rom, size_t len) {
+  struct chip8_shared_ram *image = chip8_load_image_from_buffer(&vm->core, rom, len);
+  if(image == NULL) {
+    return 0;
+  }
+
+  int res = chip8_wrapper_reset_from_image(vm, image);
+
+  //the VM holds its own reference to the image now
+  chip8_release_image(image);
+  return res;
+}
+
+// Point the VM's core at the memory that belongs to this VM.
+// This must be called whenever a VM is copied to a new location.
+void chip8_wrapper_bind(struct chip8 *vm) {
+  switch(vm->emu) {
+    case CHIP8_VARIANT_VIP: {
+      chip8_vip(vm)->core = &vm->core;
+      vip_chip8_bind(chip8_vip(vm));
+      break;
+    }
+    case CHIP8_VARIANT_SUPER: {
+      chip8_super(vm)->core = &vm->core;
+      schip8_bind(chip8_super(vm));
+      break;
+    }
+    case CHIP8_VARIANT_XO: {
+      assert(0);
+    }
+  }
+}
+
+// Copy the entire state of src into dst (which must be a VM of the same variant), so that both VMs continue independently
+// from the same point. RAM is not copied. Instead, both VMs share the RAM of src until
+// one of them writes to it.
+//
+// Note that src is modified, since its RAM becomes shared with dst.
+// Returns 0 if the shared RAM could not be allocated.
+int chip8_fork(struct chip8 *src, struct chip8 *dst) {
+  if(!chip8_share_ram(&src->core)) {
+    return 0;
+  }
+
+  //the private RAM of src is the last thing in the VM, and it is not used anymore
+  memcpy(dst, src, CHIP8_VARIANTS[src->emu].state_size);
+  chip8_wrapper_bind(dst);
+
+  return 1;
+}
+
+// Allocate and set up a VM of the given variant. Returns NULL if the variant is not supported
+// or there is not enough memory. The VM still needs to be reset before it can run.
+struct chip8 *chip8_create(enum chip8_emu_type type) {
+  return chip8_create_array(type, 1);
+}
+
+// Free a VM made by chip8_create(), including any resources it holds.
+void chip8_destroy(struct chip8 *vm) {
+  chip8_destroy_array(vm, 1);
+}
+
+// Allocate count VMs of the same variant in one contiguous block, so running all of them
+// walks through memory in order. Use chip8_array_at() to get each VM.
+struct chip8 *chip8_create_array(enum chip8_emu_type type, uint32_t count) {
+  size_t size = chip8_vm_size(type);
+  if(size == 0 || count == 0) {
+    return NULL;
+  }
+
+  struct chip8 *vms = aligned_malloc(CHIP8_CACHE_LINE, (size_t)count * size);
+  if(vms == NULL) {
+    return NULL;
+  }
+
+  //until it is reset, a VM is all zeros like the static VM of the frontend, so saving or hashing it reads no garbage
+  memset(vms, 0, (size_t)count * size);
+  for(uint32_t i = 0; i < count; i++) {
+    chip8_wrapper_init((struct chip8*)((uint8_t*)vms + i * size), type);
+  }
+
+  return vms;
+}
+
+void chip8_destroy_array(struct chip8 *vms, uint32_t count) {
+  if(vms == NULL) {
+    return;
+  }
+
+  for(uint32_t i = 0; i < count; i++) {
+    chip8_wrapper_release(chip8_array_at(vms, i));
+  }
+  aligned_free(vms);
+}
+
+// Free any resources held by the VM. The VM must be reset before it is used again.
+void chip8_wrapper_release(struct chip8 *vm) {
+  chip8_release_ram(&vm->core);
+}
+
+// Hash of the full state of the VM, including the state that only exists on some variants.
+uint64_t chip8_wrapper_state_hash(const struct chip8 *vm) {
+  uint64_t h = chip8_state_hash(&vm->core);
+
+  switch(vm->emu) {
+    case CHIP8_VARIANT_VIP: return h;
+    case CHIP8_VARIANT_SUPER: {
+      uint64_t flags = 0;
+      for(uint8_t i = 0; i < 8; i++) {
+        flags |= (uint64_t)chip8_super(vm)->rpl_flags[i] << (8*i);
+      }
+      h = mix64(h ^ flags);
+      return mix64(h ^ ((uint64_t)chip8_super(vm)->res << 8 | chip8_super(vm)->will_exit));
+    }
     case CHIP8_VARIANT_XO: assert(0); return 0;
   }
+  return 0;
 }
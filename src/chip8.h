@@ -11,28 +11,118 @@ enum chip8_emu_type {
   CHIP8_VARIANT_XO,
 };
 
+#define CHIP8_NUM_VARIANTS 3
+
+//colors of the display the frontend can be given, one for every combination of 4 bit planes
+#define CHIP8_NUM_COLORS 16
+
 struct chip8_init {
   char *rom_file;
   enum chip8_emu_type type;
+
+  //if has_seed is 0, the frontend picks a seed for the RNG on its own.
+  uint8_t has_seed;
+  uint64_t seed;
+
+  //if detect_quirks is 1, the quirks are picked by running the ROM with every combination of them (see chip8_quirks.h).
+  uint8_t detect_quirks;
+
+  //if grid_cols is not 0, grid_cols x grid_rows copies of the ROM run side by side (see chip8_sdl_grid.h).
+  uint16_t grid_cols;
+  uint16_t grid_rows;
+
+  //if low_power is 1, the window is only redrawn when something on it changed, and the
+  //frontend sleeps between frames instead of running as fast as it can.
+  uint8_t low_power;
+
+  //smoothing filter for the display (enum chip8_filter, see chip8_filter.h). 0 draws plain pixels.
+  uint8_t filter;
+
+  //phosphor emulation to hide flicker (see chip8_phosphor.h). blend_frames of 0 or 1 and a
+  //phosphor_decay of 0 turn it off.
+  uint8_t blend_frames;
+  uint8_t phosphor_decay;
+
+  //if record_file is not NULL, the display is recorded to it as a GIF (or an APNG, for .png files, see chip8_recorder.h).
+  char *record_file;
+
+  //colors of the display as 0x00RRGGBB. colors[0] is the background, and colors[1] is used for
+  //pixels that are on. The others are for displays with more than one plane (see chip8_sdl_palette).
+  uint32_t colors[CHIP8_NUM_COLORS];
 };
 
+// A VM is allocated as this header, followed (on the next cache line) by the state
+// of its variant, so every VM only takes up as much memory as its own variant needs.
+// The registers that every instruction touches (the core) sit in the first few cache lines,
+// and the framebuffer, stack and RAM come after them.
+//
+// Because of that, VMs must be made with chip8_create() or chip8_create_array(), and
+// the variant state must be accessed with chip8_vip() or chip8_super().
 struct chip8 {
-  enum chip8_emu_type emu;
+  _Alignas(CHIP8_CACHE_LINE) enum chip8_emu_type emu;
   struct chip8_core core;
+};
+
+struct chip8_variant_info {
+  const char *name;
 
-  union {
-    struct vip_chip8 vip;
-    struct schip8 super;
-    //struct xo_chip8 xo;
+  //number of bytes taken up by a VM of this variant, including the header. Always a multiple of CHIP8_CACHE_LINE.
+  size_t size;
 
-  } vm;
+  //number of bytes before the VM's private RAM. If the RAM is shared, this is all that needs to be copied.
+  size_t state_size;
 };
 
+extern const struct chip8_variant_info CHIP8_VARIANTS[CHIP8_NUM_VARIANTS];
+
+static inline struct vip_chip8 *chip8_vip(const struct chip8 *vm) {
+  return (struct vip_chip8*)(vm + 1);
+}
+
+static inline struct schip8 *chip8_super(const struct chip8 *vm) {
+  return (struct schip8*)(vm + 1);
+}
+
+static inline size_t chip8_vm_size(enum chip8_emu_type type) {
+  return CHIP8_VARIANTS[type].size;
+}
+
+// Get VM i of an array made by chip8_create_array(). Every VM in the array has the same variant,
+// so they are all the same size.
+static inline struct chip8 *chip8_array_at(struct chip8 *vms, uint32_t i) {
+  return (struct chip8*)((uint8_t*)vms + (size_t)i * chip8_vm_size(vms->emu));
+}
+
+// Size of the display in pixels. Every row of the framebuffer (vm->core.fb) is stored as
+// width/64 64-bit words, with the leftmost pixel in the highest bit of the first word.
+// SUPER-CHIP always stores the 128x64 display, even in low resolution mode.
+static inline uint16_t chip8_fb_width(const struct chip8 *vm) {
+  return vm->emu == CHIP8_VARIANT_VIP ? 64 : 128;
+}
+
+static inline uint16_t chip8_fb_height(const struct chip8 *vm) {
+  return vm->emu == CHIP8_VARIANT_VIP ? 32 : 64;
+}
+
+struct chip8 *chip8_create(enum chip8_emu_type type);
+void chip8_destroy(struct chip8 *vm);
+struct chip8 *chip8_create_array(enum chip8_emu_type type, uint32_t count);
+void chip8_destroy_array(struct chip8 *vms, uint32_t count);
 
 void chip8_wrapper_init(struct chip8 *vm, enum chip8_emu_type type);
 int chip8_wrapper_process_instruction(struct chip8 *vm);
 void chip8_wrapper_update_timer(struct chip8 *vm, uint64_t delta_millis);
+int chip8_wrapper_run_frame(struct chip8 *vm, uint32_t num_instructions);
+int chip8_wrapper_has_exited(const struct chip8 *vm);
+void chip8_wrapper_set_seed(struct chip8 *vm, uint64_t seed);
 
 int chip8_wrapper_reset(struct chip8 *vm, FILE *file);
+int chip8_wrapper_reset_from_image(struct chip8 *vm, struct chip8_shared_ram *image);
+int chip8_wrapper_reset_from_buffer(struct chip8 *vm, const uint8_t *rom, size_t len);
+
+int chip8_fork(struct chip8 *src, struct chip8 *dst);
+void chip8_wrapper_bind(struct chip8 *vm);
+void chip8_wrapper_release(struct chip8 *vm);
+uint64_t chip8_wrapper_state_hash(const struct chip8 *vm);
 
 #endif// CHIP8_H
@@ -0,0 +1,767 @@
+#include "chip8_batch.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_simd.h"
+
+_Static_assert(CHIP8_BATCH_VEC_LANES % VEC8_LANES == 0, "lane arrays must be padded to a multiple of the vector width");
+
+//a group is small if it has less than 1/CHIP8_BATCH_SMALL_GROUP of the lanes that are still running.
+//Small groups run on the normal interpreter, and after CHIP8_BATCH_MAX_SMALL_GROUPS of them in a row, 
+//the lanes have drifted too far apart for grouping to be worth it.
+#define CHIP8_BATCH_SMALL_GROUP 8
+#define CHIP8_BATCH_MAX_SMALL_GROUPS 32
+
+//if more than 1/CHIP8_BATCH_MAX_SCALAR_SHARE of the instructions of a frame ran on single lanes,
+//grouping costs more than it saves, so the next frames run every lane on its own. That starts out at
+//CHIP8_BATCH_MIN_SCALAR_FRAMES frames, and doubles every time grouping did not pay off again, up to CHIP8_BATCH_MAX_SCALAR_FRAMES.
+#define CHIP8_BATCH_MAX_SCALAR_SHARE 8
+#define CHIP8_BATCH_MIN_SCALAR_FRAMES 30
+#define CHIP8_BATCH_MAX_SCALAR_FRAMES 960
+
+
+static inline size_t chip8_batch_round_up(size_t size) {
+  return (size + CHIP8_CACHE_LINE - 1) & ~(size_t)(CHIP8_CACHE_LINE - 1);
+}
+
+static inline uint8_t vec8_hmin(vec8 a) {
+  _Alignas(CHIP8_CACHE_LINE) uint8_t bytes[VEC8_LANES];
+  vec8_store(bytes, a);
+
+  uint8_t res = 0xFF;
+  for(int i = 0; i < VEC8_LANES; i++) {
+    res = bytes[i] < res ? bytes[i] : res;
+  }
+  return res;
+}
+
+//lanes that still have instructions left to run this frame
+static inline vec8 chip8_batch_active(const struct chip8_batch *b, uint32_t i) {
+  vec8 left = vec8_or(vec8_load(b->budget_lo + i), vec8_load(b->budget_hi + i));
+  return vec8_xor(vec8_eq(left, vec8_set1(0)), vec8_set1(0xFF));
+}
+
+static inline size_t chip8_batch_written_size(const struct chip8_batch *b) {
+  return (b->vms->core.ram_size / CHIP8_BATCH_RAM_BLOCK + 63) / 64 * sizeof(uint64_t);
+}
+
+// Set up the lane arrays for num_lanes lanes that run the VMs in vms.
+static int chip8_batch_init_arrays(struct chip8_batch *b, struct chip8 *vms, uint32_t num_lanes) {
+  b->num_lanes = num_lanes;
+  b->stride = (num_lanes + CHIP8_BATCH_VEC_LANES - 1) / CHIP8_BATCH_VEC_LANES * CHIP8_BATCH_VEC_LANES;
+  b->vms = vms;
+
+  //every lane array starts on its own cache line, so aligned vector loads work on all of them.
+  size_t lane_size = chip8_batch_round_up(b->stride);
+  uint8_t *p = aligned_malloc(CHIP8_CACHE_LINE, 30 * lane_size);
+  b->written = calloc(1, chip8_batch_written_size(b));
+  if(p == NULL || b->written == NULL) {
+    aligned_free(p);
+    return 0;
+  }
+
+  memset(p, 0, 30 * lane_size);
+  b->alloc = p;
+  for(int i = 0; i < 16; i++) {
+    b->V[i] = p; p += lane_size;
+  }
+  b->I_lo = p; p += lane_size;
+  b->I_hi = p; p += lane_size;
+  b->pc_lo = p; p += lane_size;
+  b->pc_hi = p; p += lane_size;
+  b->DT = p; p += lane_size;
+  b->ST = p; p += lane_size;
+  b->budget_lo = p; p += lane_size;
+  b->budget_hi = p; p += lane_size;
+  b->halted = p; p += lane_size;
+  b->keys_lo = p; p += lane_size;
+  b->keys_hi = p; p += lane_size;
+  b->keys_set = p; p += lane_size;
+  b->mask = p; p += lane_size;
+  b->cond = p;
+
+  //padding lanes never run
+  for(uint32_t i = num_lanes; i < b->stride; i++) {
+    b->halted[i] = 1;
+  }
+
+  b->scalar_backoff = CHIP8_BATCH_MIN_SCALAR_FRAMES;
+
+  return 1;
+}
+
+int chip8_batch_init(struct chip8_batch *b, enum chip8_emu_type type, uint32_t num_lanes) {
+  memset(b, 0, sizeof(*b));
+
+  //one extra slot for the VM that holds the settings of the variant
+  b->start = chip8_create_array(type, num_lanes + 1);
+
+  if(b->start == NULL || !chip8_batch_init_arrays(b, chip8_array_at(b->start, 1), num_lanes)) {
+    chip8_batch_free(b);
+    return 0;
+  }
+
+  return 1;
+}
+
+// Run the num_lanes VMs in vms (an array from chip8_create_array(), or a part of one) as the lanes.
+// The VMs stay with the caller, who loads and resets them, and sets b->halted of each lane.
+// Call chip8_batch_set_image() once every lane was reset from a ROM. chip8_batch_load() and 
+// chip8_batch_reset() cannot be used on such a batch.
+int chip8_batch_init_lanes(struct chip8_batch *b, struct chip8 *vms, uint32_t num_lanes) {
+  memset(b, 0, sizeof(*b));
+
+  if(vms == NULL || num_lanes == 0 || !chip8_batch_init_arrays(b, vms, num_lanes)) {
+    chip8_batch_free(b);
+    return 0;
+  }
+
+  return 1;
+}
+
+void chip8_batch_free(struct chip8_batch *b) {
+  chip8_destroy_array(b->start, b->num_lanes + 1);
+  if(b->image != NULL) {
+    chip8_release_image(b->image);
+  }
+
+  aligned_free(b->alloc);
+  free(b->written);
+  memset(b, 0, sizeof(*b));
+}
+
+// Tell the batch that every lane was just reset from image, so no lane wrote to RAM yet.
+// The batch keeps its own reference to image.
+void chip8_batch_set_image(struct chip8_batch *b, struct chip8_shared_ram *image) {
+  chip8_retain_image(image);
+  if(b->image != NULL) {
+    chip8_release_image(b->image);
+  }
+  b->image = image;
+  memset(b->written, 0, chip8_batch_written_size(b));
+}
+
+// Load a ROM and reset every lane. Lane i uses the RNG seed (seed + i).
+int chip8_batch_load(struct chip8_batch *b, FILE *rom, uint64_t seed) {
+  b->seed = seed;
+
+  struct chip8_shared_ram *image = chip8_load_image(&b->start->core, rom);
+  if(image == NULL) {
+    return 0;
+  }
+
+  chip8_batch_set_image(b, image);
+  chip8_release_image(image);
+  chip8_wrapper_reset_from_image(b->start, image);
+
+  for(uint32_t i = 0; i < b->num_lanes; i++) {
+    if(!chip8_batch_reset(b, i)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// Reset a single lane back to the start of the ROM.
+int chip8_batch_reset(struct chip8_batch *b, uint32_t lane) {
+  struct chip8 *vm = chip8_array_at(b->vms, lane);
+
+  if(!chip8_wrapper_reset_from_image(vm, b->image)) {
+    return 0;
+  }
+
+  chip8_set_seed(&vm->core, b->seed + lane);
+  b->halted[lane] = 0;
+  b->keys_set[lane] = 0;
+  return 1;
+}
+
+// Set the keyboard state of a lane (see chip8_set_keyboard()) once it runs next.
+void chip8_batch_set_keyboard(struct chip8_batch *b, uint32_t lane, uint16_t keys) {
+  b->keys_lo[lane] = keys & 0xFF;
+  b->keys_hi[lane] = keys >> 8;
+  b->keys_set[lane] = 1;
+}
+
+// Called right before a lane runs, so its VM is only touched once per frame.
+static inline void chip8_batch_apply_keyboard(struct chip8_batch *b, uint32_t l) {
+  if(b->keys_set[l]) {
+    chip8_set_keyboard(&chip8_array_at(b->vms, l)->core, ((uint16_t)b->keys_hi[l] << 8) | b->keys_lo[l]);
+    b->keys_set[l] = 0;
+  }
+}
+
+
+//copy V, I, PC and the timers of a lane between its VM and the lane arrays.
+static inline void chip8_batch_gather_lane(struct chip8_batch *b, uint32_t l) {
+  const struct chip8_core *core = &chip8_array_at(b->vms, l)->core;
+  for(int r = 0; r < 16; r++) {
+    b->V[r][l] = core->V[r];
+  }
+  b->I_lo[l] = core->I & 0xFF;
+  b->I_hi[l] = core->I >> 8;
+  b->pc_lo[l] = core->pc & 0xFF;
+  b->pc_hi[l] = core->pc >> 8;
+  b->DT[l] = core->delay_timer;
+  b->ST[l] = core->sound_timer;
+}
+
+static inline void chip8_batch_scatter_lane(struct chip8_batch *b, uint32_t l) {
+  struct chip8_core *core = &chip8_array_at(b->vms, l)->core;
+  for(int r = 0; r < 16; r++) {
+    core->V[r] = b->V[r][l];
+  }
+  core->I = ((uint16_t)b->I_hi[l] << 8) | b->I_lo[l];
+  core->pc = ((uint16_t)b->pc_hi[l] << 8) | b->pc_lo[l];
+  core->delay_timer = b->DT[l];
+  core->sound_timer = b->ST[l];
+}
+
+static inline uint16_t chip8_batch_budget(const struct chip8_batch *b, uint32_t l) {
+  return ((uint16_t)b->budget_hi[l] << 8) | b->budget_lo[l];
+}
+
+static inline void chip8_batch_set_budget(struct chip8_batch *b, uint32_t l, uint16_t budget) {
+  b->budget_lo[l] = budget & 0xFF;
+  b->budget_hi[l] = budget >> 8;
+}
+
+// Fx33 and Fx55 are the only instructions that write to RAM. Mark the blocks they 
+// are about to write to, since the lane may run different code there from now on.
+static void chip8_batch_mark_written(struct chip8_batch *b, const struct chip8_core *core) {
+  uint8_t wait_for_keyboard = core->key_interrupt_flags & CHIP8_KEY_INT_FLAG_WAITING;
+  if(wait_for_keyboard || core->pc + 1 >= core->ram_size) {
+    return;
+  }
+
+  uint8_t high = core->ram[core->pc];
+  uint8_t low = core->ram[core->pc + 1];
+  if((high >> 4) != 0xF || (low != 0x33 && low != 0x55)) {
+    return;
+  }
+
+  uint16_t count = low == 0x33 ? 3 : (high & 0x0F) + 1;
+  for(uint16_t i = 0; i < count; i++) {
+    uint32_t block = ((core->I + i) % core->ram_size) / CHIP8_BATCH_RAM_BLOCK;
+    b->written[block / 64] |= (uint64_t)1 << (block % 64);
+  }
+}
+
+static inline int chip8_batch_was_written(const struct chip8_batch *b, uint16_t addr) {
+  uint32_t block = addr / CHIP8_BATCH_RAM_BLOCK;
+  return (b->written[block / 64] >> (block % 64)) & 1;
+}
+
+// Lanes that ran on their own did not keep track of what they wrote to RAM. Find the blocks
+// that hold something else than the image in any lane, since only those can hold different code.
+static void chip8_batch_find_written(struct chip8_batch *b) {
+  if(b->image == NULL) {
+    memset(b->written, 0xFF, chip8_batch_written_size(b));
+    return;
+  }
+
+  memset(b->written, 0, chip8_batch_written_size(b));
+  uint32_t num_blocks = b->vms->core.ram_size / CHIP8_BATCH_RAM_BLOCK;
+
+  for(uint32_t l = 0; l < b->num_lanes; l++) {
+    const uint8_t *ram = chip8_array_at(b->vms, l)->core.ram;
+
+    //a lane that still shares the RAM of the image never wrote to it
+    if(ram == b->image->data) {
+      continue;
+    }
+
+    for(uint32_t block = 0; block < num_blocks; block++) {
+      uint32_t offset = block * CHIP8_BATCH_RAM_BLOCK;
+      if(memcmp(ram + offset, b->image->data + offset, CHIP8_BATCH_RAM_BLOCK) != 0) {
+        b->written[block / 64] |= (uint64_t)1 << (block % 64);
+      }
+    }
+  }
+}
+
+// Run a single instruction on a single lane with the normal interpreter.
+static void chip8_batch_run_scalar(struct chip8_batch *b, uint32_t l) {
+  struct chip8 *vm = chip8_array_at(b->vms, l);
+
+  chip8_batch_scatter_lane(b, l);
+  chip8_batch_mark_written(b, &vm->core);
+
+  if(!chip8_wrapper_process_instruction(vm)) {
+    b->halted[l] = 1;
+    chip8_batch_set_budget(b, l, 0);
+  } else {
+    chip8_batch_set_budget(b, l, chip8_batch_budget(b, l) - 1);
+  }
+
+  chip8_batch_gather_lane(b, l);
+  b->num_scalar_instructions++;
+}
+
+// Returns 1 if the instruction can run on a whole group at once. That is every instruction that only
+// reads and writes V, I, PC and the timers, plus calls, returns and Cxkk, which use the stack and RNG of each lane's VM.
+static inline int chip8_batch_is_vector_op(uint8_t high, uint8_t low) {
+  switch(high >> 4) {
+    case 0x0: return high == 0x00 && low == 0xEE;
+    case 0x1: case 0x2: case 0x3: case 0x4: case 0x6: case 0x7: case 0xA: case 0xC: return 1;
+    case 0x5: case 0x9: return (low & 0x0F) == 0;
+    case 0x8: {
+      uint8_t op = low & 0x0F;
+      return op <= 7 || op == 0xE;
+    }
+    case 0xF: return low == 0x07 || low == 0x15 || low == 0x18 || low == 0x1E || low == 0x29;
+    default: return 0;
+  }
+}
+
+// Vx op= Vy on every selected lane, including the VF flag.
+// The flag is computed the same way as chip8_ins_8, which reads Vy AFTER Vx was written.
+static void chip8_batch_vector_8(struct chip8_batch *b, uint8_t high, uint8_t low, uint16_t quirks) {
+  uint8_t x = high & 0x0F;
+  uint8_t y = low >> 4;
+  uint8_t op = low & 0x0F;
+
+  uint8_t *Vx = b->V[x];
+  uint8_t *Vy = b->V[y];
+  uint8_t *VF = b->V[15];
+  const vec8 one = vec8_set1(1);
+  const vec8 zero = vec8_set1(0);
+
+  for(uint32_t i = 0; i < b->stride; i += VEC8_LANES) {
+    vec8 m = vec8_load(b->mask + i);
+    vec8 a = vec8_load(Vx + i);
+    vec8 c = vec8_load(Vy + i);
+    vec8 r;
+    vec8 f = zero;
+    int set_flag = 1;
+
+    switch(op) {
+      case 0x0: r = c; set_flag = 0; break;
+      case 0x1: r = vec8_or(a, c); set_flag = quirks & CHIP8_QUIRK_RESET_VF; break;
+      case 0x2: r = vec8_and(a, c); set_flag = quirks & CHIP8_QUIRK_RESET_VF; break;
+      case 0x3: r = vec8_xor(a, c); set_flag = quirks & CHIP8_QUIRK_RESET_VF; break;
+
+      //there was a carry if the saturated sum is not the wrapped sum
+      case 0x4:
+        r = vec8_add(a, c);
+        f = vec8_xor(vec8_and(vec8_eq(vec8_adds(a, c), r), one), one);
+        break;
+
+      //no borrow if Vx >= Vy, which is max(Vx, Vy) == Vx
+      case 0x5: {
+        r = vec8_sub(a, c);
+        vec8 c_after = x == y ? r : c;
+        f = vec8_and(vec8_eq(vec8_max(a, c_after), a), one);
+        break;
+      }
+
+      case 0x6: {
+        vec8 src = (quirks & CHIP8_QUIRK_SHIFT_VY) ? c : a;
+        r = vec8_shr1(src);
+        f = vec8_and(a, one); //the flag always comes from Vx, even with the SHIFT_VY quirk
+        break;
+      }
+
+      case 0x7: {
+        r = vec8_sub(c, a);
+        vec8 c_after = x == y ? r : c;
+        f = vec8_and(vec8_eq(vec8_max(c_after, a), c_after), one);
+        break;
+      }
+
+      default: { // 0xE
+        vec8 src = (quirks & CHIP8_QUIRK_SHIFT_VY) ? c : a;
+        r = vec8_add(src, src);
+        f = vec8_shr7(a);
+        break;
+      }
+    }
+
+    vec8_store(Vx + i, vec8_select(m, a, r));
+
+    //reload VF, since x may be 15
+    if(set_flag) {
+      vec8_store(VF + i, vec8_select(m, vec8_load(VF + i), f));
+    }
+  }
+}
+
+// Fx07, Fx15, Fx18, Fx1E and Fx29 on every selected lane.
+static void chip8_batch_vector_F(struct chip8_batch *b, uint8_t x, uint8_t low) {
+  uint8_t *Vx = b->V[x];
+  const vec8 all = vec8_set1(0xFF);
+
+  //5 * Vx does not fit in a byte, and fonts are rarely picked, so set I lane by lane
+  if(low == 0x29) {
+    for(uint32_t l = 0; l < b->num_lanes; l++) {
+      if(b->mask[l]) {
+        uint16_t addr = CHIP8_HEX_FONT_START + (CHIP8_HEX_FONT_SIZE * Vx[l]);
+        b->I_lo[l] = addr & 0xFF;
+        b->I_hi[l] = addr >> 8;
+      }
+    }
+    return;
+  }
+
+  for(uint32_t i = 0; i < b->stride; i += VEC8_LANES) {
+    vec8 m = vec8_load(b->mask + i);
+    vec8 a = vec8_load(Vx + i);
+
+    switch(low) {
+      case 0x07: vec8_store(Vx + i, vec8_select(m, a, vec8_load(b->DT + i))); break;
+      case 0x15: vec8_store(b->DT + i, vec8_select(m, vec8_load(b->DT + i), a)); break;
+      case 0x18: vec8_store(b->ST + i, vec8_select(m, vec8_load(b->ST + i), a)); break;
+
+      //I += Vx, with the same add with carry as the PC below. Lanes that are not selected add 0.
+      default: {
+        vec8 I_lo = vec8_load(b->I_lo + i);
+        vec8 add = vec8_and(m, a);
+        vec8 sum = vec8_add(I_lo, add);
+        vec8 carry = vec8_xor(vec8_eq(vec8_adds(I_lo, add), sum), all);
+        vec8_store(b->I_lo + i, sum);
+        vec8_store(b->I_hi + i, vec8_sub(vec8_load(b->I_hi + i), carry));
+        break;
+      }
+    }
+  }
+}
+
+// Calls and returns, which push and pop on the stack of each lane's VM. A lane that would overflow
+// or underflow its stack leaves the group, and fails on the normal interpreter.
+static void chip8_batch_call_return(struct chip8_batch *b, uint8_t is_call) {
+  for(uint32_t l = 0; l < b->num_lanes; l++) {
+    if(!b->mask[l]) {
+      continue;
+    }
+
+    struct chip8_core *core = &chip8_array_at(b->vms, l)->core;
+    if(is_call ? core->sp >= core->stack_size : core->sp == 0) {
+      b->mask[l] = 0;
+      chip8_batch_run_scalar(b, l);
+      continue;
+    }
+
+    if(is_call) {
+      core->stack[core->sp] = (((uint16_t)b->pc_hi[l] << 8) | b->pc_lo[l]) + 2;
+      core->sp++;
+    } else {
+      core->sp--;
+      b->pc_lo[l] = core->stack[core->sp] & 0xFF;
+      b->pc_hi[l] = core->stack[core->sp] >> 8;
+    }
+  }
+}
+
+// Run an instruction (that passed chip8_batch_is_vector_op) on every lane selected in b->mask.
+// Returns the number of lanes it ran on.
+static uint32_t chip8_batch_run_vector(struct chip8_batch *b, uint8_t high, uint8_t low, uint16_t quirks) {
+  uint8_t x = high & 0x0F;
+  uint8_t y = low >> 4;
+  uint16_t nnn = (((uint16_t)high & 0x0F) << 8) | low;
+  uint32_t stride = b->stride;
+  const vec8 zero = vec8_set1(0);
+  const vec8 all = vec8_set1(0xFF);
+
+  //set if cond holds a mask of the lanes that skip the next instruction
+  int is_skip = 0;
+
+  switch(high >> 4) {
+    case 0x3: case 0x4: case 0x5: case 0x9: {
+      uint8_t is_equal_skip = (high >> 4) == 0x3 || (high >> 4) == 0x5;
+      uint8_t is_immediate = (high >> 4) == 0x3 || (high >> 4) == 0x4;
+      vec8 kk = vec8_set1(low);
+
+      for(uint32_t i = 0; i < stride; i += VEC8_LANES) {
+        vec8 other = is_immediate ? kk : vec8_load(b->V[y] + i);
+        vec8 eq = vec8_eq(vec8_load(b->V[x] + i), other);
+        vec8_store(b->cond + i, is_equal_skip ? eq : vec8_xor(eq, all));
+      }
+      is_skip = 1;
+      break;
+    }
+
+    case 0x6: case 0x7: {
+      uint8_t *Vx = b->V[x];
+      vec8 kk = vec8_set1(low);
+      for(uint32_t i = 0; i < stride; i += VEC8_LANES) {
+        vec8 m = vec8_load(b->mask + i);
+        vec8 a = vec8_load(Vx + i);
+        vec8 r = (high >> 4) == 0x6 ? kk : vec8_add(a, kk);
+        vec8_store(Vx + i, vec8_select(m, a, r));
+      }
+      break;
+    }
+
+    case 0x0: case 0x2: chip8_batch_call_return(b, (high >> 4) == 0x2); break;
+    case 0x8: chip8_batch_vector_8(b, high, low, quirks); break;
+    case 0xF: chip8_batch_vector_F(b, x, low); break;
+
+    //every lane draws from the RNG of its own VM
+    case 0xC: {
+      for(uint32_t l = 0; l < b->num_lanes; l++) {
+        if(b->mask[l]) {
+          b->V[x][l] = (xoshiro256_next(&chip8_array_at(b->vms, l)->core.rng) >> 56) & low;
+        }
+      }
+      break;
+    }
+
+    case 0xA: {
+      vec8 lo = vec8_set1(nnn & 0xFF);
+      vec8 hi = vec8_set1(nnn >> 8);
+      for(uint32_t i = 0; i < stride; i += VEC8_LANES) {
+        vec8 m = vec8_load(b->mask + i);
+        vec8_store(b->I_lo + i, vec8_select(m, vec8_load(b->I_lo + i), lo));
+        vec8_store(b->I_hi + i, vec8_select(m, vec8_load(b->I_hi + i), hi));
+      }
+      break;
+    }
+  }
+
+  //move every selected lane to the next instruction, and take one instruction out of its budget.
+  //returns already moved each lane to where it came from.
+  uint8_t is_jump = (high >> 4) == 0x1 || (high >> 4) == 0x2;
+  uint8_t is_return = (high >> 4) == 0x0;
+  uint32_t num_ran = 0;
+  vec8 jump_lo = vec8_set1(nnn & 0xFF);
+  vec8 jump_hi = vec8_set1(nnn >> 8);
+  vec8 two = vec8_set1(2);
+
+  for(uint32_t i = 0; i < stride; i += VEC8_LANES) {
+    vec8 m = vec8_load(b->mask + i);
+    vec8 pc_lo = vec8_load(b->pc_lo + i);
+    vec8 pc_hi = vec8_load(b->pc_hi + i);
+
+    if(is_jump) {
+      pc_lo = vec8_select(m, pc_lo, jump_lo);
+      pc_hi = vec8_select(m, pc_hi, jump_hi);
+    } else if(!is_return) {
+      vec8 step = vec8_and(m, two);
+      if(is_skip) {
+        step = vec8_add(step, vec8_and(vec8_and(m, vec8_load(b->cond + i)), two));
+      }
+
+      //add with carry. There was a carry if the saturated sum is not the wrapped sum,
+      //and subtracting the 0xFF mask adds 1 to the high byte.
+      vec8 sum = vec8_add(pc_lo, step);
+      vec8 carry = vec8_xor(vec8_eq(vec8_adds(pc_lo, step), sum), all);
+      pc_lo = sum;
+      pc_hi = vec8_sub(pc_hi, carry);
+    }
+
+    vec8_store(b->pc_lo + i, pc_lo);
+    vec8_store(b->pc_hi + i, pc_hi);
+
+    //subtract with borrow, adding the 0xFF mask subtracts 1.
+    vec8 budget_lo = vec8_load(b->budget_lo + i);
+    vec8 borrow = vec8_and(m, vec8_eq(budget_lo, zero));
+    vec8_store(b->budget_lo + i, vec8_add(budget_lo, m));
+    vec8_store(b->budget_hi + i, vec8_add(vec8_load(b->budget_hi + i), borrow));
+    num_ran += popcount32(vec8_movemask(m));
+  }
+
+  b->num_vector_instructions += num_ran;
+  return num_ran;
+}
+
+// Put the lanes with the lowest PC in b->mask. 
+// Returns the number of lanes in the group, and the number of lanes with instructions left in *num_active.
+static uint32_t chip8_batch_find_group(struct chip8_batch *b, uint16_t *group_pc, uint32_t *num_active) {
+  uint32_t stride = b->stride;
+  const vec8 all = vec8_set1(0xFF);
+
+  //inactive lanes are treated as if they are at PC 0xFFFF. If an active lane really is at 0xFFFF, 
+  //it still ends up in the group below.
+  vec8 min_hi = all;
+  uint32_t active_count = 0;
+  for(uint32_t i = 0; i < stride; i += VEC8_LANES) {
+    vec8 active = chip8_batch_active(b, i);
+    min_hi = vec8_min(min_hi, vec8_or(vec8_load(b->pc_hi + i), vec8_xor(active, all)));
+    active_count += popcount32(vec8_movemask(active));
+  }
+
+  *num_active = active_count;
+  if(active_count == 0) {
+    return 0;
+  }
+
+  vec8 hi = vec8_set1(vec8_hmin(min_hi));
+  vec8 min_lo = all;
+  for(uint32_t i = 0; i < stride; i += VEC8_LANES) {
+    vec8 candidate = vec8_and(chip8_batch_active(b, i), vec8_eq(vec8_load(b->pc_hi + i), hi));
+    min_lo = vec8_min(min_lo, vec8_or(vec8_load(b->pc_lo + i), vec8_xor(candidate, all)));
+  }
+
+  vec8 lo = vec8_set1(vec8_hmin(min_lo));
+  uint32_t group_size = 0;
+  for(uint32_t i = 0; i < stride; i += VEC8_LANES) {
+    vec8 m = vec8_and(chip8_batch_active(b, i), vec8_and(vec8_eq(vec8_load(b->pc_hi + i), hi), vec8_eq(vec8_load(b->pc_lo + i), lo)));
+    vec8_store(b->mask + i, m);
+    group_size += popcount32(vec8_movemask(m));
+  }
+
+  *group_pc = ((uint16_t)vec8_hmin(hi) << 8) | vec8_hmin(lo);
+  return group_size;
+}
+
+// Run every lane that has not used up its budget yet on its own until it does.
+static void chip8_batch_finish_scalar(struct chip8_batch *b) {
+  for(uint32_t l = 0; l < b->num_lanes; l++) {
+    uint16_t budget = chip8_batch_budget(b, l);
+    if(budget == 0) {
+      continue;
+    }
+
+    struct chip8 *vm = chip8_array_at(b->vms, l);
+    chip8_batch_scatter_lane(b, l);
+
+    for(; budget > 0; budget--) {
+      chip8_batch_mark_written(b, &vm->core);
+      b->num_scalar_instructions++;
+
+      if(!chip8_wrapper_process_instruction(vm)) {
+        b->halted[l] = 1;
+        break;
+      }
+    }
+
+    chip8_batch_set_budget(b, l, 0);
+    chip8_batch_gather_lane(b, l);
+  }
+}
+
+// Run every lane until it used up its budget, running the lanes that are at the same
+// instruction together. Returns the number of instructions that ran on groups of lanes,
+// counting each lane of a group.
+static uint64_t chip8_batch_run_groups(struct chip8_batch *b) {
+  uint32_t num_lanes = b->num_lanes;
+  uint16_t quirks = b->vms->core.quirks;
+  uint16_t ram_size = b->vms->core.ram_size;
+
+  uint32_t num_small_groups = 0;
+  uint64_t num_grouped = 0;
+
+  while(1) {
+    //group together the lanes with the lowest PC. Since lanes that branched ahead wait for
+    //the others, lanes that went down different sides of an if statement meet up again afterwards.
+    uint16_t pc;
+    uint32_t num_active;
+    uint32_t group_size = chip8_batch_find_group(b, &pc, &num_active);
+
+    if(num_active == 0) {
+      break;
+    }
+
+    uint32_t lead = 0;
+    while(!b->mask[lead]) {
+      lead++;
+    }
+
+    //the last byte of RAM is not a full instruction, let the interpreter deal with it.
+    if(pc + 1 >= ram_size) {
+      chip8_batch_run_scalar(b, lead);
+      continue;
+    }
+
+    const uint8_t *lead_ram = chip8_array_at(b->vms, lead)->core.ram;
+    uint8_t high = lead_ram[pc];
+    uint8_t low = lead_ram[pc + 1];
+
+    //if a lane wrote to the RAM holding this instruction, it may hold different code than the others.
+    if(chip8_batch_was_written(b, pc) || chip8_batch_was_written(b, pc + 1)) {
+      for(uint32_t l = lead + 1; l < num_lanes; l++) {
+        const uint8_t *ram = chip8_array_at(b->vms, l)->core.ram;
+        if(b->mask[l] && (ram[pc] != high || ram[pc + 1] != low)) {
+          b->mask[l] = 0;
+          group_size--;
+        }
+      }
+    }
+
+    //once the lanes drifted apart, finding groups costs more than running each lane on its own.
+    //Try again later, lanes often end up back in the same place (like waiting on a timer).
+    uint8_t is_small = group_size * CHIP8_BATCH_SMALL_GROUP < num_active;
+    num_small_groups = is_small ? num_small_groups + 1 : 0;
+    if(num_small_groups > CHIP8_BATCH_MAX_SMALL_GROUPS) {
+      chip8_batch_finish_scalar(b);
+      break;
+    }
+
+    if(!is_small && chip8_batch_is_vector_op(high, low)) {
+      num_grouped += chip8_batch_run_vector(b, high, low, quirks);
+    } else {
+      for(uint32_t l = lead; l < num_lanes; l++) {
+        if(b->mask[l]) {
+          chip8_batch_run_scalar(b, l);
+        }
+      }
+    }
+  }
+
+  return num_grouped;
+}
+
+// Run a single 60Hz frame on every lane that is not halted: num_instructions 
+// instructions, then one tick of the timers.
+//
+// Results are the same as calling chip8_wrapper_run_frame() on every lane. A lane is halted
+// if that would have returned 0, or if the program exited. Halted lanes stop running until they are reset.
+// After this returns, every lane VM (b->vms) is up to date.
+void chip8_batch_run_frame(struct chip8_batch *b, uint16_t num_instructions) {
+  uint32_t num_lanes = b->num_lanes;
+
+  //the lane arrays are only used while looking for groups, every lane can run on its VM directly
+  if(b->scalar_frames > 0) {
+    for(uint32_t l = 0; l < num_lanes; l++) {
+      struct chip8 *vm = chip8_array_at(b->vms, l);
+      chip8_batch_apply_keyboard(b, l);
+
+      if(!b->halted[l]) {
+        b->halted[l] = !chip8_wrapper_run_frame(vm, num_instructions) || chip8_wrapper_has_exited(vm);
+        b->num_scalar_instructions += num_instructions;
+      }
+    }
+
+    b->scalar_frames--;
+    if(b->scalar_frames == 0) {
+      chip8_batch_find_written(b);
+    }
+    return;
+  }
+
+  for(uint32_t l = 0; l < num_lanes; l++) {
+    chip8_batch_apply_keyboard(b, l);
+    chip8_batch_gather_lane(b, l);
+  }
+  for(uint32_t l = 0; l < b->stride; l++) {
+    chip8_batch_set_budget(b, l, b->halted[l] ? 0 : num_instructions);
+  }
+
+  uint64_t num_scalar = b->num_scalar_instructions;
+  uint64_t num_grouped = chip8_batch_run_groups(b);
+  num_scalar = b->num_scalar_instructions - num_scalar;
+
+  if(num_scalar * CHIP8_BATCH_MAX_SCALAR_SHARE > num_grouped + num_scalar) {
+    b->scalar_frames = b->scalar_backoff;
+    b->scalar_backoff = b->scalar_backoff * 2 > CHIP8_BATCH_MAX_SCALAR_FRAMES ? CHIP8_BATCH_MAX_SCALAR_FRAMES : b->scalar_backoff * 2;
+  } else {
+    b->scalar_backoff = CHIP8_BATCH_MIN_SCALAR_FRAMES;
+  }
+
+  //tick the timers of every lane that is still running, they stop at 0
+  const vec8 one = vec8_set1(1);
+  for(uint32_t i = 0; i < b->stride; i += VEC8_LANES) {
+    vec8 tick = vec8_and(vec8_eq(vec8_load(b->halted + i), vec8_set1(0)), one);
+    vec8_store(b->DT + i, vec8_subs(vec8_load(b->DT + i), tick));
+    vec8_store(b->ST + i, vec8_subs(vec8_load(b->ST + i), tick));
+  }
+
+  for(uint32_t l = 0; l < num_lanes; l++) {
+    chip8_batch_scatter_lane(b, l);
+
+    if(!b->halted[l]) {
+      b->halted[l] = chip8_wrapper_has_exited(chip8_array_at(b->vms, l));
+    }
+  }
+}
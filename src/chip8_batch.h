@@ -0,0 +1,103 @@
+#ifndef CHIP8_BATCH_H
+#define CHIP8_BATCH_H
+
+#include "chip8.h"
+
+// Runs many VMs (lanes) of the same ROM in lockstep, using SIMD instructions (AVX2 or SSE2 if the
+// compiler targets them) to run one instruction on many lanes at once.
+//
+// The registers that almost every instruction touches (V, I, PC and the timers) are stored as a 
+// structure-of-arrays, so register Vx of every lane sits next to each other in memory:
+//    V[x][lane], I_lo[lane], pc_lo[lane], DT[lane], ...
+// 16-bit values are split into a low and high byte array, so every lane array can be 
+// worked on with the same byte-sized vector instructions.
+// Every other part of a lane (RAM, framebuffer, stack, RNG, ...) lives in a regular VM.
+//
+// Each step, the lanes with the lowest PC are grouped together. If the instruction at that
+// PC only touches V, I, PC and the timers, it runs on every lane of the group at once. Calls,
+// returns and Cxkk also run on the whole group, each lane using the stack or RNG of its VM.
+// Lanes that are not in the group are masked off, and lanes that took a different branch join
+// back in once they reach the same PC. All other instructions (drawing, keys, loads and stores)
+// run on each lane of the group separately, using the normal interpreter. While most instructions
+// end up running on single lanes, every lane runs on its own for a while, without looking for groups.
+//
+// Note that all lanes must use the same quirks.
+//
+// A batch either creates its own lane VMs and loads the ROM into them (chip8_batch_init()), or
+// runs VMs that belong to someone else (chip8_batch_init_lanes()), like a chunk of the envs of a
+// chip8_vec_env.
+
+//number of lanes processed by a single SIMD instruction. Lane arrays are padded to a multiple of this.
+#define CHIP8_BATCH_VEC_LANES 32
+
+//RAM is tracked in blocks of this many bytes to know which lanes may be running different code.
+#define CHIP8_BATCH_RAM_BLOCK 16
+
+struct chip8_batch {
+  uint32_t num_lanes;
+  uint32_t stride; //num_lanes rounded up to CHIP8_BATCH_VEC_LANES
+
+  //hot registers of every lane
+  uint8_t *V[16];
+  uint8_t *I_lo;
+  uint8_t *I_hi;
+  uint8_t *pc_lo;
+  uint8_t *pc_hi;
+  uint8_t *DT; //delay timer
+  uint8_t *ST; //sound timer
+
+  //number of instructions each lane still has to run in the current frame
+  uint8_t *budget_lo;
+  uint8_t *budget_hi;
+
+  //1 if the lane hit an instruction it could not process, or if its program exited.
+  uint8_t *halted;
+
+  //keyboard state given with chip8_batch_set_keyboard(), which is passed on to the lane VM when
+  //the lane runs next. keys_set is 1 if there is one.
+  uint8_t *keys_lo;
+  uint8_t *keys_hi;
+  uint8_t *keys_set;
+
+  //scratch space, one byte per lane
+  uint8_t *mask;
+  uint8_t *cond;
+
+  //the rest of the state of every lane
+  struct chip8 *vms;
+
+  //font and ROM that every lane is reset from, and a VM reset from it that holds
+  //the settings of the variant. start is NULL if the lane VMs belong to someone else.
+  struct chip8_shared_ram *image;
+  struct chip8 *start;
+  uint64_t seed;
+
+  //one bit per CHIP8_BATCH_RAM_BLOCK bytes of RAM that any lane may have written to since the ROM was loaded.
+  //Every other block still holds the image in every lane, so the code in it is the same for every lane.
+  uint64_t *written;
+
+  void *alloc;
+
+  //number of frames left that run every lane on its own, because lanes were not running the same code,
+  //and how many frames that will be the next time it happens
+  uint32_t scalar_frames;
+  uint32_t scalar_backoff;
+
+  //number of instructions that ran on groups of lanes at once, and on single lanes.
+  //An instruction that ran on a group counts once for every lane in it.
+  uint64_t num_vector_instructions;
+  uint64_t num_scalar_instructions;
+};
+
+int chip8_batch_init(struct chip8_batch *b, enum chip8_emu_type type, uint32_t num_lanes);
+int chip8_batch_init_lanes(struct chip8_batch *b, struct chip8 *vms, uint32_t num_lanes);
+void chip8_batch_free(struct chip8_batch *b);
+void chip8_batch_set_image(struct chip8_batch *b, struct chip8_shared_ram *image);
+
+int chip8_batch_load(struct chip8_batch *b, FILE *rom, uint64_t seed);
+int chip8_batch_reset(struct chip8_batch *b, uint32_t lane);
+
+void chip8_batch_set_keyboard(struct chip8_batch *b, uint32_t lane, uint16_t keys);
+void chip8_batch_run_frame(struct chip8_batch *b, uint16_t num_instructions);
+
+#endif// CHIP8_BATCH_H
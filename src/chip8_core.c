@@ -3,7 +3,6 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
-#include <time.h>
 
 
 
@@ -199,15 +198,76 @@ uint8_t chip8_key_to_num(enum chip8_key key) {
   }
 }
 
-int chip8_load_rom(struct chip8_core *vm, FILE *file) {
+// Turn the VM's RAM into a shared block, so that other VMs can read from it
+// without copying it. If the RAM is already shared, this only adds a reference.
+// Returns 0 if the shared block could not be allocated.
+int chip8_share_ram(struct chip8_core *vm) {
+  if(vm->shared_ram != NULL) {
+    refcount_add(&vm->shared_ram->refs);
+    return 1;
+  }
+
+  struct chip8_shared_ram *shared = malloc(sizeof(*shared) + vm->ram_size);
+  if(shared == NULL) {
+    return 0;
+  }
+
+  //one reference for this VM, and one for whoever asked to share it
+  refcount_init(&shared->refs, 2);
+  shared->size = vm->ram_size;
+  shared->hash = vm->ram_hash;
+  memcpy(shared->data, vm->ram, vm->ram_size);
+
+  vm->shared_ram = shared;
+  vm->ram = shared->data;
+  return 1;
+}
+
+// Drop this VM's reference to its shared RAM (if any) WITHOUT copying its contents.
+// Afterwards, the VM reads from its private RAM again.
+void chip8_release_ram(struct chip8_core *vm) {
+  struct chip8_shared_ram *shared = vm->shared_ram;
+
+  vm->shared_ram = NULL;
+  vm->ram = vm->private_ram;
+
+  if(shared != NULL) {
+    chip8_release_image(shared);
+  }
+}
+
+// Add a reference to a shared block of RAM. Drop it again with chip8_release_image().
+struct chip8_shared_ram *chip8_retain_image(struct chip8_shared_ram *image) {
+  refcount_add(&image->refs);
+  return image;
+}
+
+// Drop a reference to a shared block of RAM, and free it if it was the last one.
+void chip8_release_image(struct chip8_shared_ram *image) {
+  if(refcount_sub(&image->refs)) {
+    free(image);
+  }
+}
+
+// Give this VM its own copy of its shared RAM. Called before the first write to shared RAM.
+void chip8_unshare_ram(struct chip8_core *vm) {
+  if(vm->shared_ram == NULL) {
+    return;
+  }
+
+  memcpy(vm->private_ram, vm->shared_ram->data, vm->ram_size);
+  chip8_release_ram(vm);
+}
+
+static int chip8_read_rom(uint8_t *ram, uint16_t ram_size, FILE *file) {
 
   //only read the number of bytes that the Chip8 can hold into RAM. The rest of the 
   //file is ignored. If the ROM is smaller than the max number of bytes, the ROM
   //will still load successfully, but the uninitialized half of RAM will hold an undefined
   //set of bytes.
 
-  const size_t max_bytes = vm->ram_size - CHIP8_PROG_START;
-  size_t num_bytes_read = fread(vm->ram + CHIP8_PROG_START, max_bytes, 1, file);
+  const size_t max_bytes = ram_size - CHIP8_PROG_START;
+  size_t num_bytes_read = fread(ram + CHIP8_PROG_START, max_bytes, 1, file);
 
   if(ferror(file)) {
     return 0;
@@ -215,13 +275,141 @@ int chip8_load_rom(struct chip8_core *vm, FILE *file) {
   return 1;
 }
 
+int chip8_load_rom(struct chip8_core *vm, FILE *file) {
+  return chip8_read_rom(vm->ram, vm->ram_size, file);
+}
 
-int chip8_reset(struct chip8_core *vm, FILE *file) {
-  //set seed for randomness
-  srand(time(NULL));
+// An image with just the font in it.
+static struct chip8_shared_ram *chip8_new_image(const struct chip8_core *vm) {
+  struct chip8_shared_ram *image = malloc(sizeof(*image) + vm->ram_size);
+  if(image == NULL) {
+    return NULL;
+  }
+
+  refcount_init(&image->refs, 1);
+  image->size = vm->ram_size;
+
+  memset(image->data, 0, vm->ram_size);
+  memcpy(&image->data[CHIP8_HEX_FONT_START], FONT_DATA_HEX, sizeof(FONT_DATA_HEX));
+  return image;
+}
+
+static void chip8_hash_image(struct chip8_shared_ram *image) {
+  image->hash = 0;
+  for(uint16_t i = 0; i < image->size; i++) {
+    image->hash ^= chip8_ram_hash_key(i, image->data[i]);
+  }
+}
+
+// Build the RAM that a VM has right after a reset (font and ROM) once, so that many VMs can
+// be reset from it with chip8_reset_from_image() without copying it. 
+// The image is sized for the same variant as vm. The caller owns one reference to the image,
+// which it drops with chip8_release_image().
+// Returns NULL if the image could not be allocated or the ROM could not be read.
+//
+// Each VM only gets its own copy of RAM once it writes to it. Since the RAM of every
+// variant is 4K, which is also the size of a memory page on most systems, copying the
+// whole RAM on the first write does the same work as mapping the image copy-on-write 
+// with mmap(MAP_PRIVATE), without needing anything platform-specific. 
+// As long as a VM only reads RAM, its private RAM is never touched.
+struct chip8_shared_ram *chip8_load_image(const struct chip8_core *vm, FILE *file) {
+  struct chip8_shared_ram *image = chip8_new_image(vm);
+  if(image == NULL) {
+    return NULL;
+  }
+
+  if(file != NULL && !chip8_read_rom(image->data, image->size, file)) {
+    free(image);
+    return NULL;
+  }
+
+  chip8_hash_image(image);
+  return image;
+}
+
+// Same as chip8_load_image(), but the ROM is already in memory. Like with files, only the part
+// of the ROM that fits into RAM is used.
+struct chip8_shared_ram *chip8_load_image_from_buffer(const struct chip8_core *vm, const uint8_t *rom, size_t len) {
+  struct chip8_shared_ram *image = chip8_new_image(vm);
+  if(image == NULL) {
+    return NULL;
+  }
+
+  const size_t max_bytes = image->size - CHIP8_PROG_START;
+  memcpy(&image->data[CHIP8_PROG_START], rom, len < max_bytes ? len : max_bytes);
+
+  chip8_hash_image(image);
+  return image;
+}
+
+
+// Recompute the RAM and framebuffer hashes from scratch.
+// Only needed when RAM or the framebuffer was modified without going through
+// chip8_write_ram() and chip8_write_fb(), like when loading a ROM.
+void chip8_rehash(struct chip8_core *vm) {
+  vm->ram_hash = 0;
+  for(uint16_t i = 0; i < vm->ram_size; i++) {
+    vm->ram_hash ^= chip8_ram_hash_key(i, vm->ram[i]);
+  }
+
+  vm->fb_hash = 0;
+  for(uint16_t i = 0; i < vm->fb_size / sizeof(uint64_t); i++) {
+    vm->fb_hash ^= chip8_fb_hash_key(i, vm->fb[i]);
+  }
+
+  chip8_mark_fb_dirty(vm);
+}
+
+// A 64-bit hash of the full machine state (registers, timers, stack, RAM, and framebuffer).
+// Two VMs with the same hash are almost certainly in the same state, which is useful for 
+// detecting programs that are stuck in a loop, or for comparing runs against each other.
+//
+// RAM and the framebuffer are hashed incrementally as they are written, so this only 
+// has to mix in the registers.
+uint64_t chip8_state_hash(const struct chip8_core *vm) {
+  uint64_t v_low = 0, v_high = 0;
+  for(uint8_t i = 0; i < 8; i++) {
+    v_low |= (uint64_t)vm->V[i] << (8*i);
+    v_high |= (uint64_t)vm->V[i + 8] << (8*i);
+  }
+
+  uint64_t h = vm->ram_hash ^ mix64(vm->fb_hash);
+  h = mix64(h ^ v_low);
+  h = mix64(h ^ v_high);
+  h = mix64(h ^ ((uint64_t)vm->I << 48 | (uint64_t)vm->pc << 32 | (uint64_t)vm->sp << 16 
+    | (uint64_t)vm->delay_timer << 8 | vm->sound_timer));
+
+  for(uint8_t i = 0; i < vm->sp && i < vm->stack_size; i++) {
+    h = mix64(h ^ vm->stack[i]);
+  }
+
+  return h;
+}
+
+void chip8_clear_fb(struct chip8_core *vm) {
+  //only rows that had pixels on are marked as changed
+  uint64_t dirty = 0;
+  for(uint16_t i = 0; i < vm->fb_size / sizeof(uint64_t); i++) {
+    if(vm->fb[i] != 0) {
+      dirty |= (uint64_t)1 << (i >> vm->fb_row_shift);
+    }
+  }
+  if(dirty != 0) {
+    vm->fb_dirty |= dirty;
+    vm->fb_generation++;
+  }
 
-  //turn off all pixels in framebuffer
   memset(vm->fb, 0, vm->fb_size);
+  vm->fb_hash = 0;
+}
+
+//reset everything except RAM
+static void chip8_reset_registers(struct chip8_core *vm) {
+  //restart the random sequence so that a reset always replays the same way.
+  xoshiro256_seed(&vm->rng, vm->rng_seed);
+
+  //turn off all pixels in framebuffer
+  chip8_clear_fb(vm);
 
   vm->delay_timer = 0;
   vm->sound_timer = 0;
@@ -235,9 +423,18 @@ int chip8_reset(struct chip8_core *vm, FILE *file) {
   //optional, zero out registers
   vm->I = 0;
   memset(vm->V, 0, sizeof(vm->V));
+}
+
+int chip8_reset(struct chip8_core *vm, FILE *file) {
+  chip8_reset_registers(vm);
 
   uint8_t has_no_error = 1;
 
+  //the whole RAM is about to be rewritten, so there is no need to copy shared RAM.
+  chip8_release_ram(vm);
+
+  //clear RAM so that the bytes after the ROM are the same on every reset.
+  memset(vm->ram, 0, vm->ram_size);
 
   // load font
   memcpy(&vm->ram[CHIP8_HEX_FONT_START], FONT_DATA_HEX, sizeof(FONT_DATA_HEX));
@@ -246,10 +443,44 @@ int chip8_reset(struct chip8_core *vm, FILE *file) {
     has_no_error = chip8_load_rom(vm, file);
   }
 
+  chip8_rehash(vm);
+
   return has_no_error;
 }
 
+// Same as chip8_reset(), but the VM shares the RAM of an image made by chip8_load_image() 
+// instead of loading the ROM into its own RAM, so nothing gets copied.
+// Returns 0 if the image was made for a variant with a different amount of RAM.
+int chip8_reset_from_image(struct chip8_core *vm, struct chip8_shared_ram *image) {
+  if(image->size != vm->ram_size) {
+    return 0;
+  }
+
+  chip8_reset_registers(vm);
+
+  //take the new reference first, in case the VM already shares this image
+  chip8_retain_image(image);
+  chip8_release_ram(vm);
+
+  vm->shared_ram = image;
+  vm->ram = image->data;
+  vm->ram_hash = image->hash;
+
+  return 1;
+}
+
+
 
+// Run a single 60Hz cycle of the delay and sound timers.
+void chip8_tick_timers(struct chip8_core *vm) {
+  //if either timer is non-zero, decrement by 1
+  if(vm->delay_timer != 0) {
+    vm->delay_timer--;
+  }
+  if(vm->sound_timer != 0) {
+    vm->sound_timer--;
+  } 
+}
 
 void chip8_update_timer(struct chip8_core *vm, uint64_t delta_time_millis) {
   vm->millis_timer60hz += delta_time_millis;
@@ -261,23 +492,22 @@ void chip8_update_timer(struct chip8_core *vm, uint64_t delta_time_millis) {
     vm->millis_timer60hz -= 17;
     //vm->millis_timer60hz = 0;
     
-    //every 16 milliseconds, if either timer is non-zero, decrement by 1
-    if(vm->delay_timer != 0) {
-      vm->delay_timer--;
-    }
-    if(vm->sound_timer != 0) {
-      vm->sound_timer--;
-    } 
+    //every 16 milliseconds, update the timers
+    chip8_tick_timers(vm);
   }
 }
 
 static inline int chip8_ins_0(struct chip8_core *vm, uint8_t high, uint8_t low) {
   //CLS (0x00E0) - clear screen
   if(high == 0x00 & low == 0xE0) {
-    memset(vm->fb, 0, vm->fb_size);
+    chip8_clear_fb(vm);
   } 
   //RET (0x00EE) - return from subroutine by popping address off the stack and setting the PC to that address.
   else if(high == 0x00 & low == 0xEE) {
+    //returning with an empty stack means the program went off the rails
+    if(vm->sp == 0) {
+      return 0;
+    }
     vm->sp--;
     vm->pc = vm->stack[vm->sp];
   }
@@ -298,6 +528,11 @@ static inline int chip8_ins_1(struct chip8_core *vm, uint8_t high, uint8_t low)
 static inline int chip8_ins_2(struct chip8_core *vm, uint8_t high, uint8_t low) {
   uint16_t loc = (((uint16_t)high & 0x0F) << 8) | low;
 
+  //the real interpreters would overwrite memory past the stack here, so treat it as an invalid instruction
+  if(vm->sp >= vm->stack_size) {
+    return 0;
+  }
+
   //SP is zero indexed, so we insert, then increment
   vm->stack[vm->sp] = vm->pc;
   vm->sp++;
@@ -505,13 +740,15 @@ static inline int chip8_ins_B(struct chip8_core *vm, uint8_t high, uint8_t low)
 //RND (Cxkk) - Set Vx = RANDOM_BYTE & kk
 static inline int chip8_ins_C(struct chip8_core *vm, uint8_t high, uint8_t low) {
   uint8_t x = high & 0x0F;
-  uint8_t random = rand();
+  //use the high bits, they are the strongest bits of xoshiro256**
+  uint8_t random = xoshiro256_next(&vm->rng) >> 56;
   vm->V[x] = random & low;
 
   return 1;
 }
 
-void chip8_draw_64x32(uint64_t *fb, uint8_t *V, uint16_t I, uint8_t *ram, uint8_t high, uint8_t low) {
+void chip8_draw_64x32(struct chip8_core *vm, uint8_t high, uint8_t low) {
+  uint8_t *V = vm->V;
   uint8_t x = high & 0x0F;
   uint8_t y = low >> 4;
   uint8_t n = low & 0x0F;
@@ -555,7 +792,7 @@ void chip8_draw_64x32(uint64_t *fb, uint8_t *V, uint16_t I, uint8_t *ram, uint8_
     //uint8_t fby = (vm->V[y] + i) % (CHIP8_HEIGHT);
 
     //grab copy of row
-    uint64_t old_row = fb[fby];
+    uint64_t old_row = vm->fb[fby];
 
     //create mask for bits we are going to draw to. 
     //Dont use bit rotation since we want to perform X-coord clipping on sprite row.
@@ -566,7 +803,7 @@ void chip8_draw_64x32(uint64_t *fb, uint8_t *V, uint16_t I, uint8_t *ram, uint8_
 
     //create a empty 64-bit row, get an 8-bit row from our sprite, and
     //shift our sprite's row into the empty row
-    uint8_t sprite_row_data = ram[I + i];
+    uint8_t sprite_row_data = chip8_read_ram(vm, vm->I + i);
     
     uint64_t sprite_row = ((uint64_t)sprite_row_data << 56) >> fbx;
 
@@ -589,7 +826,7 @@ void chip8_draw_64x32(uint64_t *fb, uint8_t *V, uint16_t I, uint8_t *ram, uint8_
 
 
     //draw row to framebuffer
-    fb[fby] ^= sprite_row;
+    chip8_write_fb(vm, fby, vm->fb[fby] ^ sprite_row);
 
 
     //implements clipping behavior of sprites for Y where the X and Y inside the DXYN instruction
@@ -607,7 +844,7 @@ void chip8_draw_64x32(uint64_t *fb, uint8_t *V, uint16_t I, uint8_t *ram, uint8_
 //DRW (Dxyn) - Draw n-byte sprite starting at memory location I at (Vx, Vy), 
 //set VF = 1 if collision with another 
 static inline int chip8_ins_D(struct chip8_core *vm, uint8_t high, uint8_t low) {
-  chip8_draw_64x32(vm->fb, vm->V, vm->I, vm->ram, high, low);
+  chip8_draw_64x32(vm, high, low);
   return 1;
 }
 
@@ -723,14 +960,14 @@ static inline int chip8_ins_F(struct chip8_core *vm, uint8_t high, uint8_t low)
       uint8_t i = 3;
       while(vx != 0) {
         i--;
-        vm->ram[vm->I+i] = vx % 10;
+        chip8_write_ram(vm, vm->I+i, vx % 10);
         vx /= 10;
       }
 
       // if we have not set all 3 digits, set the rest to 0.
       while(i != 0) {
         i--;
-        vm->ram[vm->I+i] = 0;
+        chip8_write_ram(vm, vm->I+i, 0);
       }
 
       break;
@@ -740,7 +977,7 @@ static inline int chip8_ins_F(struct chip8_core *vm, uint8_t high, uint8_t low)
     //LD (Fx55) - Store registers V0 through Vx in memory starting at I.
     case 0x55: {
       for(uint8_t i = 0; i <= x; i++) {
-        vm->ram[vm->I + i] = vm->V[i];
+        chip8_write_ram(vm, vm->I + i, vm->V[i]);
       }
 
       if(vm->quirks & CHIP8_QUIRK_INCREMENT_I) vm->I += x + 1;
@@ -750,7 +987,7 @@ static inline int chip8_ins_F(struct chip8_core *vm, uint8_t high, uint8_t low)
     //LD (Fx65) - Read registers V0 through Vx in memory starting at I
     case 0x65: {
       for(uint8_t i = 0; i <= x; i++) {
-        vm->V[i] = vm->ram[vm->I + i];
+        vm->V[i] = chip8_read_ram(vm, vm->I + i);
       }
       if(vm->quirks & CHIP8_QUIRK_INCREMENT_I) vm->I += x + 1;
 
@@ -777,6 +1014,11 @@ int chip8_process_instruction(struct chip8_core *vm) {
   }
 
 
+  //a program that ran off the end of RAM (or a VM that was never reset) has nothing left to run
+  if(vm->pc >= vm->ram_size - 1) {
+    return 0;
+  }
+
   uint8_t high = vm->ram[vm->pc];  //MSB
   uint8_t low = vm->ram[vm->pc+1]; //LSB
 
@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "util.h"
+
 
 //the original display resolution of the CHIP8 VM
 #define CHIP8_WIDTH 64
@@ -15,8 +17,15 @@
 #define CHIP8_HEX_FONT_START 0
 #define CHIP8_HEX_FONT_SIZE 5
 
-//store stack at end of 512-byte section
-#define CHIP8_STACK_START 480 //enough to store max of 16 16-bit addresses, which is the max stack size of XO-CHIP and SCHIP8.
+//the max stack size of XO-CHIP and SCHIP8.
+#define CHIP8_MAX_STACK_SIZE 16
+
+//size of a cache line on the machines we care about. Used to keep separate VM
+//instances from sharing cache lines when they are stored next to each other.
+#define CHIP8_CACHE_LINE 64
+
+//value of watch_addr when no address in RAM is being watched.
+#define CHIP8_NO_WATCH 0xFFFFFFFF
 
 
 //This lists all of the CHIP-8 quirks between the following CHIP-8 specifications:
@@ -78,18 +87,38 @@ enum chip8_key {
 extern const uint8_t FONT_DATA_HEX[5 * 16];
 
 
+// A block of RAM that is shared by several VMs (for example after forking a VM, or
+// a ROM image that many VMs are reset from).
+// The VMs only read from this block. The first time one of them writes to RAM, it copies
+// the block into its own private RAM and drops its reference to the shared block
+// (copy-on-write). The block is freed once the last VM drops its reference.
+struct chip8_shared_ram {
+  refcount_t refs;
+  uint16_t size;
+  uint64_t hash; //same as chip8_core.ram_hash for this RAM
+  uint8_t data[];
+};
+
+
 //these are properties that ALL SUPPORTED CHIP-8 variants have.
 
 struct chip8_core {
 
-  //our stack can be stored within the 512 bytes of RAM.
+  //the stack is kept outside of RAM so that CALL does not count as a write to RAM.
+  //This lets VMs share their RAM for much longer after a fork.
   uint16_t *stack;
   uint8_t stack_size;
 
 
   //note that memory is fully allocated here since XO-CHIP has 64K while VIP CHIP8 and SCHIP8
   //have 4K
+  //
+  //ram always points to the memory the VM reads from. This is either private_ram, or
+  //the data of shared_ram if the RAM is currently shared with other VMs. 
+  //NEVER write to ram directly, use chip8_write_ram() instead.
   uint8_t *ram;
+  uint8_t *private_ram;
+  struct chip8_shared_ram *shared_ram; //NULL if RAM is not shared
   uint16_t ram_size; //we will store how many bytes of RAM we use here.
 
   /* Registers */
@@ -121,6 +150,24 @@ struct chip8_core {
   uint64_t *fb;
   uint16_t fb_size;
 
+
+  //running hashes of RAM and the framebuffer, updated on every write so that
+  //the state hash never has to look at all of RAM (see chip8_state_hash()).
+  //
+  //Both hashes are the XOR of a key for every byte of RAM (or every 64-bit word of the 
+  //framebuffer), so changing a value only needs the key of the old value to be XORed out 
+  //and the key of the new value to be XORed in.
+  uint64_t ram_hash;
+  uint64_t fb_hash;
+
+  //bit r is set if row r of the framebuffer changed since the last chip8_take_fb_dirty(),
+  //and fb_generation goes up whenever the framebuffer changes. Frontends use these to only
+  //convert the rows that changed, or to skip frames where nothing changed at all.
+  //These are not part of the machine state, so they are not saved or hashed.
+  uint64_t fb_dirty;
+  uint64_t fb_generation;
+  uint8_t fb_row_shift; //every row of the framebuffer is (1 << fb_row_shift) 64-bit words
+
   // Misc
 
 
@@ -141,6 +188,20 @@ struct chip8_core {
 
   uint16_t quirks; 
 
+  //every instance owns its own random number generator for the RND (Cxkk) instruction.
+  //Since the generator is part of the machine state, copying the state also copies
+  //the random sequence, and running the same ROM with the same seed and the same inputs
+  //always produces the same result.
+  struct xoshiro256 rng;
+
+  //the seed that the RNG is set to whenever the VM is reset.
+  uint64_t rng_seed;
+
+
+  //Debugging. If watch_addr is a valid address, watch_hit is set to 1 whenever
+  //that address in RAM is written to. Set watch_addr to CHIP8_NO_WATCH to disable this.
+  uint32_t watch_addr;
+  uint8_t watch_hit;
   
 
 };
@@ -158,11 +219,108 @@ static inline void chip8_remove_key(struct chip8_core *vm, enum chip8_key key) {
   vm->last_released_key = key;
 }
 
-void chip8_draw_64x32(uint64_t *fb, uint8_t *V, uint16_t I, uint8_t *ram, uint8_t high, uint8_t low);
+// The hash key of a single byte of RAM. Bytes that are 0 have a key of 0, so
+// the mostly empty RAM of a freshly reset VM is cheap to hash.
+static inline uint64_t chip8_ram_hash_key(uint16_t addr, uint8_t val) {
+  return val ? mix64((((uint64_t)addr << 8) | val) + 0x9E3779B97F4A7C15) : 0;
+}
+
+// The hash key of a single 64-bit word of the framebuffer. Just like RAM, empty words have a key of 0.
+static inline uint64_t chip8_fb_hash_key(uint16_t word, uint64_t val) {
+  return val ? mix64(val + (word + 1) * 0xD6E8FEB86659FD93) : 0;
+}
+
+int chip8_share_ram(struct chip8_core *vm);
+void chip8_unshare_ram(struct chip8_core *vm);
+void chip8_release_ram(struct chip8_core *vm);
+
+struct chip8_shared_ram *chip8_load_image(const struct chip8_core *vm, FILE *file);
+struct chip8_shared_ram *chip8_load_image_from_buffer(const struct chip8_core *vm, const uint8_t *rom, size_t len);
+struct chip8_shared_ram *chip8_retain_image(struct chip8_shared_ram *image);
+void chip8_release_image(struct chip8_shared_ram *image);
+
+// All reads of RAM at an address the program picked (like I) must go through here. I can point
+// anywhere, so addresses past the end of RAM wrap around instead of reading past the end of the VM.
+static inline uint8_t chip8_read_ram(const struct chip8_core *vm, uint16_t addr) {
+  return vm->ram[addr % vm->ram_size];
+}
+
+// All writes to RAM must go through here so that shared RAM gets copied before
+// it is modified. Addresses wrap around like in chip8_read_ram().
+static inline void chip8_write_ram(struct chip8_core *vm, uint16_t addr, uint8_t val) {
+  addr %= vm->ram_size;
+
+  if(vm->shared_ram != NULL) {
+    chip8_unshare_ram(vm);
+  }
+  if(addr == vm->watch_addr) {
+    vm->watch_hit = 1;
+  }
+  vm->ram_hash ^= chip8_ram_hash_key(addr, vm->ram[addr]) ^ chip8_ram_hash_key(addr, val);
+  vm->ram[addr] = val;
+}
+
+// All writes to the framebuffer must go through here so that the framebuffer hash
+// and the dirty rows stay up to date. word is the index of the 64-bit word in the framebuffer.
+static inline void chip8_write_fb(struct chip8_core *vm, uint16_t word, uint64_t val) {
+  const uint64_t old = vm->fb[word];
+  if(old == val) {
+    return;
+  }
+
+  vm->fb_hash ^= chip8_fb_hash_key(word, old) ^ chip8_fb_hash_key(word, val);
+  vm->fb[word] = val;
+  vm->fb_dirty |= (uint64_t)1 << (word >> vm->fb_row_shift);
+  vm->fb_generation++;
+}
+
+// Mark every row of the framebuffer as changed, for when it was modified without chip8_write_fb().
+static inline void chip8_mark_fb_dirty(struct chip8_core *vm) {
+  const uint32_t num_rows = (vm->fb_size / sizeof(uint64_t)) >> vm->fb_row_shift;
+  vm->fb_dirty = num_rows >= 64 ? UINT64_MAX : ((uint64_t)1 << num_rows) - 1;
+  vm->fb_generation++;
+}
+
+// Get the rows that changed since the last call, and start over. Only one consumer (for example
+// the frontend) should take the dirty rows of a VM. Others can compare fb_generation instead.
+static inline uint64_t chip8_take_fb_dirty(struct chip8_core *vm) {
+  const uint64_t dirty = vm->fb_dirty;
+  vm->fb_dirty = 0;
+  return dirty;
+}
+
+// Set the state of all 16 keys at once. Bits are set the same way as keyboard_inputs.
+// Keys that were pressed before and are not pressed anymore are released one by one, 
+// so that the Fx0A instruction still sees the key release.
+static inline void chip8_set_keyboard(struct chip8_core *vm, uint16_t keys) {
+  uint16_t released = vm->keyboard_inputs & ~keys;
+
+  for(uint16_t key = 1; released != 0; key <<= 1) {
+    if(released & key) {
+      chip8_remove_key(vm, key);
+      released &= ~key;
+    }
+  }
+
+  vm->keyboard_inputs = keys;
+}
+
+static inline void chip8_set_seed(struct chip8_core *vm, uint64_t seed) {
+  vm->rng_seed = seed;
+  xoshiro256_seed(&vm->rng, seed);
+}
+
+void chip8_draw_64x32(struct chip8_core *vm, uint8_t high, uint8_t low);
+void chip8_clear_fb(struct chip8_core *vm);
 
 int chip8_process_instruction(struct chip8_core *core);
 void chip8_update_timer(struct chip8_core *vm, uint64_t delta_time_millis);
+void chip8_tick_timers(struct chip8_core *vm);
 int chip8_reset(struct chip8_core *vm, FILE *file);
+int chip8_reset_from_image(struct chip8_core *vm, struct chip8_shared_ram *image);
+
+void chip8_rehash(struct chip8_core *vm);
+uint64_t chip8_state_hash(const struct chip8_core *vm);
 
 
 
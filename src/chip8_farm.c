@@ -0,0 +1,327 @@
+#include "chip8_farm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+//how many times chip8_farm_read_fb() tries to read a screen before it gives up
+#define CHIP8_FARM_READ_TRIES 4096
+
+#define ROUND_UP_CACHE_LINE(n) (((n) + CHIP8_CACHE_LINE - 1) / CHIP8_CACHE_LINE * CHIP8_CACHE_LINE)
+
+static int chip8_farm_map(struct chip8_farm *farm, int fd, size_t size) {
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(addr == MAP_FAILED) {
+    return 0;
+  }
+
+  farm->header = addr;
+  farm->size = size;
+  return 1;
+}
+
+// Create a new region called name (for example "/ryce8"), holding num_slots VMs that are
+// all reset to the ROM in rom. VM i gets the seed seed + i, and every VM runs forever
+// (see chip8_farm_set_target()) with all keys up.
+// Returns 0 if the region already exists or could not be created.
+int chip8_farm_create(struct chip8_farm *farm, const char *name, enum chip8_emu_type type, uint32_t num_slots, uint32_t instructions_per_frame, FILE *rom, uint64_t seed) {
+  const size_t vm_size = chip8_vm_size(type);
+  if(vm_size == 0 || num_slots == 0) {
+    return 0;
+  }
+
+  struct chip8_farm_header header = {0};
+  header.magic = CHIP8_FARM_MAGIC;
+  header.version = CHIP8_FARM_VERSION;
+  header.emu = type;
+  header.num_slots = num_slots;
+  header.instructions_per_frame = instructions_per_frame;
+  header.slots_offset = ROUND_UP_CACHE_LINE(sizeof(struct chip8_farm_header));
+  header.vm_offset = sizeof(struct chip8_farm_slot);
+  header.vm_size = ROUND_UP_CACHE_LINE(vm_size);
+  header.slot_size = header.vm_offset + 2 * header.vm_size;
+
+  const size_t size = header.slots_offset + (size_t)num_slots * header.slot_size;
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(fd < 0) {
+    return 0;
+  }
+  if(ftruncate(fd, size) != 0 || !chip8_farm_map(farm, fd, size)) {
+    shm_unlink(name);
+    return 0;
+  }
+
+  //the VMs are set up in place, in copy 0 of every slot. The first one loads the image that all of them are reset from.
+  //Copy 1 is filled in once the VM runs its first frame.
+  struct chip8_shared_ram *image = NULL;
+
+  for(uint32_t i = 0; i < num_slots; i++) {
+    struct chip8 *vm = (struct chip8*)((uint8_t*)farm->header + header.slots_offset + (size_t)i * header.slot_size + header.vm_offset);
+    chip8_wrapper_init(vm, type);
+    chip8_wrapper_set_seed(vm, seed + i);
+
+    if(image == NULL) {
+      image = chip8_load_image(&vm->core, rom);
+    }
+    if(image == NULL || !chip8_wrapper_reset_from_image(vm, image)) {
+      if(image != NULL) {
+        chip8_release_image(image);
+      }
+      chip8_farm_close(farm);
+      shm_unlink(name);
+      return 0;
+    }
+
+    //the image only exists in this process, so every VM needs its RAM inside the region
+    chip8_unshare_ram(&vm->core);
+
+    if(i == 0) {
+      header.fb_offset = (uint8_t*)vm->core.fb - (uint8_t*)vm + header.vm_offset;
+      header.fb_size = vm->core.fb_size;
+      header.fb_width = chip8_fb_width(vm);
+      header.fb_height = chip8_fb_height(vm);
+    }
+  }
+  chip8_release_image(image);
+
+  //the region starts out zeroed, so only the target needs to be set
+  *farm->header = header;
+  for(uint32_t i = 0; i < num_slots; i++) {
+    atomic_store_explicit(&chip8_farm_slot(farm, i)->target_frame, CHIP8_FARM_RUN_FOREVER, memory_order_relaxed);
+  }
+
+  return 1;
+}
+
+// Any process that maps the region can write the header, so none of it is trusted. Every offset
+// and size has to stay inside the region (of size bytes), without overflowing on the way.
+static int chip8_farm_header_valid(const struct chip8_farm_header *h, size_t size) {
+  if(h->magic != CHIP8_FARM_MAGIC || h->version != CHIP8_FARM_VERSION || h->emu >= CHIP8_NUM_VARIANTS) {
+    return 0;
+  }
+  if(h->num_slots == 0 || h->slots_offset < sizeof(struct chip8_farm_header) || h->slots_offset > size ||
+     h->vm_offset < sizeof(struct chip8_farm_slot) || h->vm_offset > size || h->vm_size < chip8_vm_size(h->emu) || h->vm_size > size ||
+     h->slot_size != h->vm_offset + 2 * h->vm_size || h->slot_size > (size - h->slots_offset) / h->num_slots) {
+    return 0;
+  }
+
+  //the screen has to lie inside copy 0 of the VM, so it lies inside copy 1 as well
+  return h->fb_size != 0 && h->fb_size <= CHIP8_FARM_MAX_FB_SIZE && h->fb_size % sizeof(uint64_t) == 0 &&
+         h->fb_offset >= h->vm_offset && h->fb_offset <= h->vm_offset + h->vm_size - h->fb_size &&
+         (uint32_t)h->fb_width / 64 * h->fb_height * sizeof(uint64_t) == h->fb_size;
+}
+
+// Map an existing region. Returns 0 if it does not exist or was not made by chip8_farm_create().
+int chip8_farm_open(struct chip8_farm *farm, const char *name) {
+  int fd = shm_open(name, O_RDWR, 0);
+  if(fd < 0) {
+    return 0;
+  }
+
+  off_t size = lseek(fd, 0, SEEK_END);
+  if(size < (off_t)sizeof(struct chip8_farm_header) || !chip8_farm_map(farm, fd, size)) {
+    close(fd);
+    return 0;
+  }
+
+  if(!chip8_farm_header_valid(farm->header, farm->size)) {
+    chip8_farm_close(farm);
+    return 0;
+  }
+  return 1;
+}
+
+void chip8_farm_close(struct chip8_farm *farm) {
+  if(farm->header != NULL) {
+    munmap(farm->header, farm->size);
+    farm->header = NULL;
+  }
+}
+
+// Remove the region. Processes that still have it mapped keep using it until they close it.
+int chip8_farm_unlink(const char *name) {
+  return shm_unlink(name) == 0;
+}
+
+// When process pid started, counted in whatever unit the system uses. Returns 0 if that cannot be found out.
+static uint64_t chip8_farm_start_time(pid_t pid) {
+#if defined(__linux__)
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+  FILE *file = fopen(path, "r");
+  if(file == NULL) {
+    return 0;
+  }
+
+  char stat[1024];
+  size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+  fclose(file);
+  stat[len] = '\0';
+
+  //the start time is field 22. Field 2 is the name of the program in parentheses, which can
+  //hold spaces itself, so the fields are counted from the last ')'.
+  char *field = strrchr(stat, ')');
+  for(int i = 0; i < 20 && field != NULL; i++) {
+    field = strchr(field + 1, ' ');
+  }
+  return field == NULL ? 0 : strtoull(field + 1, NULL, 10);
+#elif defined(__APPLE__)
+  struct kinfo_proc info;
+  size_t size = sizeof(info);
+  int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_PID, pid};
+  if(sysctl(mib, 4, &info, &size, NULL, 0) != 0 || size == 0) {
+    return 0;
+  }
+  return (uint64_t)info.kp_proc.p_starttime.tv_sec * 1000000 + info.kp_proc.p_starttime.tv_usec;
+#else
+  (void)pid;
+  return 0;
+#endif
+}
+
+// What a worker process is stored as in chip8_farm_slot.owner: its pid in the low 32 bits, and
+// the low 32 bits of when it started in the high 32 bits. Once a worker is gone, its pid can be
+// given to a new process, which is not taken for the worker since it started at another time.
+uint64_t chip8_farm_owner_id(pid_t pid) {
+  return (uint64_t)(uint32_t)pid | (uint64_t)(uint32_t)chip8_farm_start_time(pid) << 32;
+}
+
+static int chip8_farm_is_alive(uint64_t owner) {
+  const pid_t pid = chip8_farm_owner_pid(owner);
+  if(kill(pid, 0) != 0 && errno == ESRCH) {
+    return 0;
+  }
+
+  //without a start time, all there is to go by is the pid
+  const uint32_t start = owner >> 32;
+  return start == 0 || (uint32_t)chip8_farm_start_time(pid) == start;
+}
+
+// Take over VM i for the worker owner (from chip8_farm_owner_id()). This works if nobody runs the VM,
+// or if the worker that ran it has died. Returns 0 if another live worker is running it.
+int chip8_farm_claim(struct chip8_farm *farm, uint32_t i, uint64_t owner) {
+  struct chip8_farm_slot *slot = chip8_farm_slot(farm, i);
+  uint64_t current = atomic_load_explicit(&slot->owner, memory_order_acquire);
+
+  if(current == owner) {
+    return 1;
+  }
+  if(current != 0 && chip8_farm_is_alive(current)) {
+    return 0;
+  }
+  if(!atomic_compare_exchange_strong_explicit(&slot->owner, &current, owner, memory_order_acq_rel, memory_order_acquire)) {
+    return 0;
+  }
+
+  //a worker that died in the middle of a frame left seq odd. It ran the frame on the copy
+  //that is not active, so the active copy is still the VM as it was at the end of the last frame.
+  //Put status and frame back to match it, the new worker runs the frame again.
+  const uint32_t active = atomic_load_explicit(&slot->active, memory_order_relaxed);
+  uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+  if(seq & 1) {
+    atomic_store_explicit(&slot->status, atomic_load_explicit(&slot->copy_status[active], memory_order_relaxed), memory_order_relaxed);
+    atomic_store_explicit(&slot->frame, atomic_load_explicit(&slot->copy_frame[active], memory_order_relaxed), memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+  }
+
+  chip8_wrapper_bind(chip8_farm_vm(farm, i, active));
+  return 1;
+}
+
+void chip8_farm_release(struct chip8_farm *farm, uint32_t i, uint64_t owner) {
+  atomic_compare_exchange_strong_explicit(&chip8_farm_slot(farm, i)->owner, &owner, 0, memory_order_release, memory_order_relaxed);
+}
+
+// Run the next frame of VM i, which must have been claimed by this process.
+// Returns 1 if a frame was run, or 0 if the VM has reached its target frame or stopped.
+int chip8_farm_run_frame(struct chip8_farm *farm, uint32_t i) {
+  struct chip8_farm_slot *slot = chip8_farm_slot(farm, i);
+
+  const uint64_t frame = atomic_load_explicit(&slot->frame, memory_order_relaxed);
+  if(atomic_load_explicit(&slot->status, memory_order_relaxed) != CHIP8_FARM_RUNNING ||
+     frame >= atomic_load_explicit(&slot->target_frame, memory_order_acquire)) {
+    return 0;
+  }
+
+  const uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+  atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  //the frame runs on a copy of the active VM. The VM keeps its RAM private, so copying
+  //it only leaves the pointers inside it pointing at the active copy.
+  const uint32_t active = atomic_load_explicit(&slot->active, memory_order_relaxed);
+  const uint32_t next = active ^ 1;
+  struct chip8 *vm = chip8_farm_vm(farm, i, next);
+  memcpy(vm, chip8_farm_vm(farm, i, active), chip8_vm_size(farm->header->emu));
+  chip8_wrapper_bind(vm);
+
+  chip8_set_keyboard(&vm->core, atomic_load_explicit(&slot->keys, memory_order_relaxed));
+
+  uint32_t status = CHIP8_FARM_RUNNING;
+  if(!chip8_wrapper_run_frame(vm, farm->header->instructions_per_frame)) {
+    status = CHIP8_FARM_HALTED;
+  } else if(chip8_wrapper_has_exited(vm)) {
+    status = CHIP8_FARM_EXITED;
+  }
+
+  atomic_store_explicit(&slot->copy_status[next], status, memory_order_relaxed);
+  atomic_store_explicit(&slot->copy_frame[next], frame + 1, memory_order_relaxed);
+  atomic_store_explicit(&slot->active, next, memory_order_release);
+
+  atomic_store_explicit(&slot->status, status, memory_order_relaxed);
+  atomic_store_explicit(&slot->frame, frame + 1, memory_order_relaxed);
+  atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+  return 1;
+}
+
+// Set which keys are held down in VM i, starting from its next frame.
+void chip8_farm_set_keys(struct chip8_farm *farm, uint32_t i, uint16_t keys) {
+  atomic_store_explicit(&chip8_farm_slot(farm, i)->keys, keys, memory_order_relaxed);
+}
+
+// Let VM i run until it has run target_frame frames in total. Controllers that step VMs in lockstep
+// wait for frame to reach the target, read the screen, set the keys, and move the target forward.
+void chip8_farm_set_target(struct chip8_farm *farm, uint32_t i, uint64_t target_frame) {
+  atomic_store_explicit(&chip8_farm_slot(farm, i)->target_frame, target_frame, memory_order_release);
+}
+
+// Copy the screen of VM i (header->fb_size bytes) into fb, along with the number of frames
+// it had run at that point, without ever stopping the worker.
+// Returns 0 if the worker stayed in the middle of a frame the whole time (for example because it died).
+int chip8_farm_read_fb(const struct chip8_farm *farm, uint32_t i, uint64_t *fb, uint64_t *frame) {
+  struct chip8_farm_slot *slot = chip8_farm_slot(farm, i);
+
+  for(uint32_t tries = 0; tries < CHIP8_FARM_READ_TRIES; tries++) {
+    uint32_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    const uint32_t active = atomic_load_explicit(&slot->active, memory_order_acquire);
+
+    const uint8_t *src = (const uint8_t*)slot + farm->header->fb_offset + active * farm->header->vm_size;
+    memcpy(fb, src, farm->header->fb_size);
+    *frame = atomic_load_explicit(&slot->copy_frame[active], memory_order_relaxed);
+
+    //a frame that is being run writes to the other copy. The one that was read is only
+    //written again once the next frame starts, which makes seq odd for the second time.
+    atomic_thread_fence(memory_order_acquire);
+    if(atomic_load_explicit(&slot->seq, memory_order_relaxed) - before <= 2 - (before & 1)) {
+      return 1;
+    }
+
+    //the worker ran a whole frame and started the next one while the screen was copied
+    if(tries % 64 == 63) {
+      sched_yield();
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+#ifndef CHIP8_FARM_H
+#define CHIP8_FARM_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "chip8.h"
+
+// A farm of VMs that live in a named shared memory region (shm_open), so that several
+// processes can work on them at once without sockets or serializing anything:
+//  - worker processes run the VMs, each one in its own set of slots.
+//  - controller processes (for example Python scripts that mmap the region) read the
+//    framebuffers and set the keys and how far every VM should run.
+//
+// Everything a VM needs lives in its slot (the VM keeps its RAM private), so a worker that
+// crashes can be replaced by a new one that picks up the VMs where they were.
+// Pointers inside a VM are only valid in the process that is running it, which is why a
+// worker calls chip8_wrapper_bind() on every VM it takes over.
+//
+// Layout (all offsets in bytes from the start of the region, numbers in the byte order of the machine):
+//   header:        struct chip8_farm_header at offset 0
+//   slot i:        struct chip8_farm_slot at slots_offset + i * slot_size
+//   copy c of VM:  at slot + vm_offset + c * vm_size (c is 0 or 1)
+//   screen of c:   fb_size bytes at slot + fb_offset + c * vm_size. Rows of fb_width / 64 64-bit words, leftmost pixel in the highest bit.
+//
+// Every slot holds two copies of its VM. The active one (slot->active) is the VM as it was at the
+// end of the last frame. The worker runs the next frame on a copy of it in the other one, and
+// makes that one active once the frame is done. A worker that dies in the middle of a frame
+// leaves the active copy as it was, so the new worker runs the frame again from the start.
+//
+// Every slot has a sequence counter (seq) that the worker makes odd while it runs the VM, and
+// even again once it is done. Readers read seq, then active and its screen, then seq again. The
+// screen is good unless the worker started another frame after the one it was in when seq was first
+// read, since only that frame writes to the copy that was read (see chip8_farm_read_fb()).
+// Nobody ever waits on a lock, and readers do not wait for frames to finish.
+
+#define CHIP8_FARM_MAGIC 0x4D52414638454352ULL // "RCE8FARM"
+#define CHIP8_FARM_VERSION 2
+
+//target_frame of a VM that should run forever
+#define CHIP8_FARM_RUN_FOREVER UINT64_MAX
+
+//the biggest screen there is (SUPER-CHIP hires, 128x64 pixels), so readers can keep a screen on the stack
+#define CHIP8_FARM_MAX_FB_SIZE (128 * 64 / 8)
+
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the farm needs lock-free 64-bit atomics, since they are shared between processes");
+
+enum chip8_farm_status {
+  CHIP8_FARM_RUNNING = 0,
+  CHIP8_FARM_HALTED = 1, //hit an instruction it could not process
+  CHIP8_FARM_EXITED = 2, //the program asked to exit (SUPER-CHIP 00FD)
+};
+
+struct chip8_farm_header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t emu; //enum chip8_emu_type
+  uint32_t num_slots;
+  uint32_t instructions_per_frame;
+  uint64_t slots_offset;
+  uint64_t slot_size;
+  uint64_t vm_offset;
+  uint64_t vm_size;
+  uint64_t fb_offset;
+  uint32_t fb_size;
+  uint16_t fb_width;
+  uint16_t fb_height;
+};
+
+struct chip8_farm_slot {
+  //written by the worker that runs the VM
+  _Alignas(CHIP8_CACHE_LINE) _Atomic uint32_t seq;
+  _Atomic uint32_t status;
+  _Atomic uint64_t frame;
+  _Atomic uint32_t active; //the copy of the VM that holds the last frame that was finished
+
+  //status and frame of each copy, so status and frame can be put back when a worker died in the middle of a frame
+  _Atomic uint32_t copy_status[2];
+  _Atomic uint64_t copy_frame[2];
+
+  //the worker running this VM (see chip8_farm_owner_id()), 0 if none
+  _Atomic uint64_t owner;
+
+  //written by controllers. These get their own cache line, so that a controller
+  //does not slow down the worker.
+  _Alignas(CHIP8_CACHE_LINE) _Atomic uint32_t keys; //same bits as chip8_core.keyboard_inputs
+  _Atomic uint64_t target_frame; //the VM runs until frame reaches this
+};
+
+// A mapping of the region in this process.
+struct chip8_farm {
+  struct chip8_farm_header *header;
+  size_t size;
+};
+
+static inline struct chip8_farm_slot *chip8_farm_slot(const struct chip8_farm *farm, uint32_t i) {
+  return (struct chip8_farm_slot*)((uint8_t*)farm->header + farm->header->slots_offset + (size_t)i * farm->header->slot_size);
+}
+
+static inline struct chip8 *chip8_farm_vm(const struct chip8_farm *farm, uint32_t i, uint32_t copy) {
+  return (struct chip8*)((uint8_t*)chip8_farm_slot(farm, i) + farm->header->vm_offset + copy * farm->header->vm_size);
+}
+
+static inline pid_t chip8_farm_owner_pid(uint64_t owner) {
+  return (pid_t)(owner & 0xFFFFFFFF);
+}
+
+int chip8_farm_create(struct chip8_farm *farm, const char *name, enum chip8_emu_type type, uint32_t num_slots, uint32_t instructions_per_frame, FILE *rom, uint64_t seed);
+int chip8_farm_open(struct chip8_farm *farm, const char *name);
+void chip8_farm_close(struct chip8_farm *farm);
+int chip8_farm_unlink(const char *name);
+
+uint64_t chip8_farm_owner_id(pid_t pid);
+int chip8_farm_claim(struct chip8_farm *farm, uint32_t i, uint64_t owner);
+void chip8_farm_release(struct chip8_farm *farm, uint32_t i, uint64_t owner);
+int chip8_farm_run_frame(struct chip8_farm *farm, uint32_t i);
+
+void chip8_farm_set_keys(struct chip8_farm *farm, uint32_t i, uint16_t keys);
+void chip8_farm_set_target(struct chip8_farm *farm, uint32_t i, uint64_t target_frame);
+int chip8_farm_read_fb(const struct chip8_farm *farm, uint32_t i, uint64_t *fb, uint64_t *frame);
+
+#endif// CHIP8_FARM_H
@@ -0,0 +1,211 @@
+#include "chip8_filter.h"
+#include <assert.h>
+
+#include "chip8_core.h"
+#include "chip8_simd.h"
+
+#define CHIP8_FILTER_MAX_WORDS_PER_ROW (CHIP8_FILTER_MAX_WIDTH / 64)
+
+_Static_assert(32 % VEC64_LANES == 0, "every display height must be a multiple of the vector width");
+
+// The framebuffer stored one column of words at a time (so the same word of neighbouring rows
+// sits next to each other, and a vector load gets it for several rows), with a border around it:
+//  - row 0 and row height + 1 repeat the first and last row.
+//  - column 0 has the leftmost pixel of every row in its lowest bit, and the last column has the
+//    rightmost pixel in its highest bit, so shifting them in as the neighbours of the edge pixels
+//    repeats the edge pixels.
+struct chip8_filter_columns {
+  uint64_t c[CHIP8_FILTER_MAX_WORDS_PER_ROW + 2][CHIP8_FILTER_MAX_HEIGHT + 2];
+};
+
+static void chip8_filter_load_columns(struct chip8_filter_columns *cols, const uint64_t *fb, uint32_t words_per_row, uint32_t height) {
+  for(uint32_t w = 0; w < words_per_row; w++) {
+    uint64_t *col = cols->c[w + 1];
+
+    for(uint32_t r = 0; r < height; r++) {
+      col[r + 1] = fb[r * words_per_row + w];
+    }
+    col[0] = col[1];
+    col[height + 1] = col[height];
+  }
+
+  for(uint32_t r = 0; r < height + 2; r++) {
+    cols->c[0][r] = cols->c[1][r] >> 63;
+    cols->c[words_per_row + 1][r] = cols->c[words_per_row][r] << 63;
+  }
+}
+
+// The pixels to the left of the pixels in v. left_word is the word to the left of v in the same row.
+static inline vec64 chip8_filter_left(vec64 v, vec64 left_word) {
+  return vec64_or(vec64_shr(v, 1), vec64_shl(left_word, 63));
+}
+
+static inline vec64 chip8_filter_right(vec64 v, vec64 right_word) {
+  return vec64_or(vec64_shl(v, 1), vec64_shr(right_word, 63));
+}
+
+// x where mask is set, p everywhere else.
+static inline vec64 chip8_filter_select(vec64 mask, vec64 x, vec64 p) {
+  return vec64_xor(p, vec64_and(mask, vec64_xor(x, p)));
+}
+
+// Set where a == b, and c != d, and e != f (the condition every rule of the filters is built from).
+static inline vec64 chip8_filter_rule(vec64 a, vec64 b, vec64 c, vec64 d, vec64 e, vec64 f) {
+  return vec64_andnot(vec64_xor(a, b), vec64_and(vec64_xor(c, d), vec64_xor(e, f)));
+}
+
+// Move bit i of the low 32 bits of every lane to bit 2i.
+static inline vec64 chip8_filter_spread2(vec64 x) {
+  x = vec64_and(vec64_or(x, vec64_shl(x, 16)), vec64_set1(0x0000FFFF0000FFFFULL));
+  x = vec64_and(vec64_or(x, vec64_shl(x, 8)), vec64_set1(0x00FF00FF00FF00FFULL));
+  x = vec64_and(vec64_or(x, vec64_shl(x, 4)), vec64_set1(0x0F0F0F0F0F0F0F0FULL));
+  x = vec64_and(vec64_or(x, vec64_shl(x, 2)), vec64_set1(0x3333333333333333ULL));
+  return vec64_and(vec64_or(x, vec64_shl(x, 1)), vec64_set1(0x5555555555555555ULL));
+}
+
+// Move bit i of the low 16 bits of every lane to bit 3i.
+static inline vec64 chip8_filter_spread3(vec64 x) {
+  x = vec64_and(vec64_or(x, vec64_shl(x, 16)), vec64_set1(0x0000FF0000FFULL));
+  x = vec64_and(vec64_or(x, vec64_shl(x, 8)), vec64_set1(0x00F00F00F00FULL));
+  x = vec64_and(vec64_or(x, vec64_shl(x, 4)), vec64_set1(0x0C30C30C30C3ULL));
+  return vec64_and(vec64_or(x, vec64_shl(x, 2)), vec64_set1(0x249249249249ULL));
+}
+
+// Write the lanes of v to word (word) of rows row, row + row_step, row + 2*row_step, ...
+static inline void chip8_filter_store(uint64_t *out, uint32_t out_words_per_row, uint32_t row, uint32_t row_step, uint32_t word, vec64 v) {
+  _Alignas(CHIP8_CACHE_LINE) uint64_t lanes[VEC64_LANES];
+  vec64_store(lanes, v);
+
+  for(uint32_t i = 0; i < VEC64_LANES; i++) {
+    out[(row + i * row_step) * out_words_per_row + word] = lanes[i];
+  }
+}
+
+// Scale2x (also known as EPX): every pixel P becomes 2x2 pixels, based on its neighbours:
+//      A        E0 E1
+//    C P B  ->  E2 E3
+//      D
+// E0 is A if C == A, C != D and A != B, or P otherwise. E1, E2 and E3 are the same rule
+// turned towards their own corner. The output is (2 * width) x (2 * height).
+void chip8_filter_scale2x(const uint64_t *fb, uint32_t width, uint32_t height, uint64_t *out) {
+  assert(width % 64 == 0 && width <= CHIP8_FILTER_MAX_WIDTH);
+  assert(height % VEC64_LANES == 0 && height <= CHIP8_FILTER_MAX_HEIGHT);
+
+  const uint32_t words_per_row = width / 64;
+  const uint32_t out_words_per_row = 2 * words_per_row;
+  const vec64 low_half = vec64_set1(0xFFFFFFFFULL);
+
+  struct chip8_filter_columns cols;
+  chip8_filter_load_columns(&cols, fb, words_per_row, height);
+
+  for(uint32_t w = 1; w <= words_per_row; w++) {
+    for(uint32_t r = 0; r < height; r += VEC64_LANES) {
+      const vec64 P = vec64_load(&cols.c[w][r + 1]);
+      const vec64 A = vec64_load(&cols.c[w][r]);
+      const vec64 D = vec64_load(&cols.c[w][r + 2]);
+      const vec64 C = chip8_filter_left(P, vec64_load(&cols.c[w - 1][r + 1]));
+      const vec64 B = chip8_filter_right(P, vec64_load(&cols.c[w + 1][r + 1]));
+
+      const vec64 E0 = chip8_filter_select(chip8_filter_rule(C, A, C, D, A, B), A, P);
+      const vec64 E1 = chip8_filter_select(chip8_filter_rule(A, B, A, C, B, D), B, P);
+      const vec64 E2 = chip8_filter_select(chip8_filter_rule(D, C, D, B, C, A), C, P);
+      const vec64 E3 = chip8_filter_select(chip8_filter_rule(B, D, B, A, D, C), D, P);
+
+      //every input word becomes 2 words in each of the 2 output rows, with the left pixels in the odd bits
+      const uint32_t word = 2 * (w - 1);
+      chip8_filter_store(out, out_words_per_row, 2 * r, 2, word,
+        vec64_or(vec64_shl(chip8_filter_spread2(vec64_shr(E0, 32)), 1), chip8_filter_spread2(vec64_shr(E1, 32))));
+      chip8_filter_store(out, out_words_per_row, 2 * r, 2, word + 1,
+        vec64_or(vec64_shl(chip8_filter_spread2(vec64_and(E0, low_half)), 1), chip8_filter_spread2(vec64_and(E1, low_half))));
+      chip8_filter_store(out, out_words_per_row, 2 * r + 1, 2, word,
+        vec64_or(vec64_shl(chip8_filter_spread2(vec64_shr(E2, 32)), 1), chip8_filter_spread2(vec64_shr(E3, 32))));
+      chip8_filter_store(out, out_words_per_row, 2 * r + 1, 2, word + 1,
+        vec64_or(vec64_shl(chip8_filter_spread2(vec64_and(E2, low_half)), 1), chip8_filter_spread2(vec64_and(E3, low_half))));
+    }
+  }
+}
+
+// Interleave 3 words of pixels (x0 leftmost) into one 192-pixel output row, and write its 3 words.
+static inline void chip8_filter_store3(uint64_t *out, uint32_t out_words_per_row, uint32_t row, uint32_t word, vec64 x0, vec64 x1, vec64 x2) {
+  const vec64 low16 = vec64_set1(0xFFFFULL);
+  vec64 chunks[4];
+
+  //16 input pixels at a time become 48 output pixels
+#define CHIP8_FILTER_CHUNK(k, shift) \
+  chunks[k] = vec64_or(vec64_or( \
+    vec64_shl(chip8_filter_spread3(vec64_and(vec64_shr(x0, shift), low16)), 2), \
+    vec64_shl(chip8_filter_spread3(vec64_and(vec64_shr(x1, shift), low16)), 1)), \
+    chip8_filter_spread3(vec64_and(vec64_shr(x2, shift), low16)))
+
+  CHIP8_FILTER_CHUNK(0, 48);
+  CHIP8_FILTER_CHUNK(1, 32);
+  CHIP8_FILTER_CHUNK(2, 16);
+  CHIP8_FILTER_CHUNK(3, 0);
+#undef CHIP8_FILTER_CHUNK
+
+  chip8_filter_store(out, out_words_per_row, row, 3, word, vec64_or(vec64_shl(chunks[0], 16), vec64_shr(chunks[1], 32)));
+  chip8_filter_store(out, out_words_per_row, row, 3, word + 1, vec64_or(vec64_shl(chunks[1], 32), vec64_shr(chunks[2], 16)));
+  chip8_filter_store(out, out_words_per_row, row, 3, word + 2, vec64_or(vec64_shl(chunks[2], 48), chunks[3]));
+}
+
+// Scale3x: every pixel E becomes 3x3 pixels, based on all 8 of its neighbours:
+//    A B C      E0 E1 E2
+//    D E F  ->  E3 E4 E5
+//    G H I      E6 E7 E8
+// The corners follow the same rule as Scale2x, and the edges only take the color of their
+// neighbour if one of the corners next to them does, and the pixel across from it differs from E.
+// The output is (3 * width) x (3 * height).
+void chip8_filter_scale3x(const uint64_t *fb, uint32_t width, uint32_t height, uint64_t *out) {
+  assert(width % 64 == 0 && width <= CHIP8_FILTER_MAX_WIDTH);
+  assert(height % VEC64_LANES == 0 && height <= CHIP8_FILTER_MAX_HEIGHT);
+
+  const uint32_t words_per_row = width / 64;
+  const uint32_t out_words_per_row = 3 * words_per_row;
+
+  struct chip8_filter_columns cols;
+  chip8_filter_load_columns(&cols, fb, words_per_row, height);
+
+  for(uint32_t w = 1; w <= words_per_row; w++) {
+    for(uint32_t r = 0; r < height; r += VEC64_LANES) {
+      const vec64 B = vec64_load(&cols.c[w][r]);
+      const vec64 E = vec64_load(&cols.c[w][r + 1]);
+      const vec64 H = vec64_load(&cols.c[w][r + 2]);
+      const vec64 A = chip8_filter_left(B, vec64_load(&cols.c[w - 1][r]));
+      const vec64 D = chip8_filter_left(E, vec64_load(&cols.c[w - 1][r + 1]));
+      const vec64 G = chip8_filter_left(H, vec64_load(&cols.c[w - 1][r + 2]));
+      const vec64 C = chip8_filter_right(B, vec64_load(&cols.c[w + 1][r]));
+      const vec64 F = chip8_filter_right(E, vec64_load(&cols.c[w + 1][r + 1]));
+      const vec64 I = chip8_filter_right(H, vec64_load(&cols.c[w + 1][r + 2]));
+
+      //one rule per corner
+      const vec64 top_left = chip8_filter_rule(D, B, D, H, B, F);
+      const vec64 top_right = chip8_filter_rule(B, F, B, D, F, H);
+      const vec64 bottom_left = chip8_filter_rule(D, H, D, B, H, F);
+      const vec64 bottom_right = chip8_filter_rule(H, F, H, D, F, B);
+
+      const vec64 E0 = chip8_filter_select(top_left, D, E);
+      const vec64 E1 = chip8_filter_select(vec64_or(vec64_and(top_left, vec64_xor(E, C)), vec64_and(top_right, vec64_xor(E, A))), B, E);
+      const vec64 E2 = chip8_filter_select(top_right, F, E);
+      const vec64 E3 = chip8_filter_select(vec64_or(vec64_and(top_left, vec64_xor(E, G)), vec64_and(bottom_left, vec64_xor(E, A))), D, E);
+      const vec64 E5 = chip8_filter_select(vec64_or(vec64_and(top_right, vec64_xor(E, I)), vec64_and(bottom_right, vec64_xor(E, C))), F, E);
+      const vec64 E6 = chip8_filter_select(bottom_left, D, E);
+      const vec64 E7 = chip8_filter_select(vec64_or(vec64_and(bottom_left, vec64_xor(E, I)), vec64_and(bottom_right, vec64_xor(E, G))), H, E);
+      const vec64 E8 = chip8_filter_select(bottom_right, F, E);
+
+      const uint32_t word = 3 * (w - 1);
+      chip8_filter_store3(out, out_words_per_row, 3 * r, word, E0, E1, E2);
+      chip8_filter_store3(out, out_words_per_row, 3 * r + 1, word, E3, E, E5);
+      chip8_filter_store3(out, out_words_per_row, 3 * r + 2, word, E6, E7, E8);
+    }
+  }
+}
+
+// Run filter on fb and write the result to out, which must have room for
+// CHIP8_FILTER_MAX_OUT_WORDS words. Returns 0 if filter is CHIP8_FILTER_NONE (out is left as it is).
+int chip8_filter_run(enum chip8_filter filter, const uint64_t *fb, uint32_t width, uint32_t height, uint64_t *out) {
+  switch(filter) {
+    case CHIP8_FILTER_SCALE2X: chip8_filter_scale2x(fb, width, height, out); return 1;
+    case CHIP8_FILTER_SCALE3X: chip8_filter_scale3x(fb, width, height, out); return 1;
+    default: return 0;
+  }
+}
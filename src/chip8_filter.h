@@ -0,0 +1,44 @@
+#ifndef CHIP8_FILTER_H
+#define CHIP8_FILTER_H
+
+#include <stdint.h>
+
+// Pixel art upscaling filters (Scale2x, which gives the same result as EPX, and Scale3x) that
+// smooth the edges of sprites instead of drawing every pixel as a plain square.
+//
+// They work on the framebuffer as it is stored (rows of 64-bit words, leftmost pixel in the
+// highest bit) and write a bigger framebuffer in the same layout, so the result can be drawn
+// like any other framebuffer. Since a pixel is only on or off, comparing two pixels is an XOR,
+// so the rules of the filters are run on 64 pixels at once with bitwise operations on whole
+// words, and on several rows at once with SIMD instructions (AVX2 or SSE2 if the compiler
+// targets them). No pixel is ever looked at on its own.
+//
+// Pixels outside the display count as the same color as the closest pixel inside it.
+
+enum chip8_filter {
+  CHIP8_FILTER_NONE = 0,
+  CHIP8_FILTER_SCALE2X = 1,
+  CHIP8_FILTER_SCALE3X = 2,
+};
+
+//largest framebuffer the filters work on (SUPER-CHIP, 128x64)
+#define CHIP8_FILTER_MAX_WIDTH 128
+#define CHIP8_FILTER_MAX_HEIGHT 64
+
+//number of 64-bit words the output of any filter can take up
+#define CHIP8_FILTER_MAX_OUT_WORDS (9 * CHIP8_FILTER_MAX_WIDTH * CHIP8_FILTER_MAX_HEIGHT / 64)
+
+// How many times larger the output of the filter is in each direction.
+static inline uint32_t chip8_filter_scale(enum chip8_filter filter) {
+  switch(filter) {
+    case CHIP8_FILTER_SCALE2X: return 2;
+    case CHIP8_FILTER_SCALE3X: return 3;
+    default: return 1;
+  }
+}
+
+void chip8_filter_scale2x(const uint64_t *fb, uint32_t width, uint32_t height, uint64_t *out);
+void chip8_filter_scale3x(const uint64_t *fb, uint32_t width, uint32_t height, uint64_t *out);
+int chip8_filter_run(enum chip8_filter filter, const uint64_t *fb, uint32_t width, uint32_t height, uint64_t *out);
+
+#endif// CHIP8_FILTER_H
@@ -0,0 +1,179 @@
+#include "chip8_obs.h"
+#include <string.h>
+
+// CHIP8_OBS_EXPAND[b] holds the 8 pixels of byte b as 0/1 bytes, leftmost (highest) bit first.
+#define CHIP8_OBS_BITS(b) {((b) >> 7) & 1, ((b) >> 6) & 1, ((b) >> 5) & 1, ((b) >> 4) & 1, ((b) >> 3) & 1, ((b) >> 2) & 1, ((b) >> 1) & 1, (b) & 1}
+#define CHIP8_OBS_BITS4(b) CHIP8_OBS_BITS(b), CHIP8_OBS_BITS((b) + 1), CHIP8_OBS_BITS((b) + 2), CHIP8_OBS_BITS((b) + 3)
+#define CHIP8_OBS_BITS16(b) CHIP8_OBS_BITS4(b), CHIP8_OBS_BITS4((b) + 4), CHIP8_OBS_BITS4((b) + 8), CHIP8_OBS_BITS4((b) + 12)
+#define CHIP8_OBS_BITS64(b) CHIP8_OBS_BITS16(b), CHIP8_OBS_BITS16((b) + 16), CHIP8_OBS_BITS16((b) + 32), CHIP8_OBS_BITS16((b) + 48)
+
+static const uint8_t CHIP8_OBS_EXPAND[256][8] = {
+  CHIP8_OBS_BITS64(0), CHIP8_OBS_BITS64(64), CHIP8_OBS_BITS64(128), CHIP8_OBS_BITS64(192),
+};
+
+// Same as CHIP8_OBS_EXPAND, but for the 4 pixels of a nibble where every pixel is doubled.
+#define CHIP8_OBS_BITS_X2(n) {((n) >> 3) & 1, ((n) >> 3) & 1, ((n) >> 2) & 1, ((n) >> 2) & 1, ((n) >> 1) & 1, ((n) >> 1) & 1, (n) & 1, (n) & 1}
+
+static const uint8_t CHIP8_OBS_EXPAND_X2[16][8] = {
+  CHIP8_OBS_BITS_X2(0), CHIP8_OBS_BITS_X2(1), CHIP8_OBS_BITS_X2(2), CHIP8_OBS_BITS_X2(3),
+  CHIP8_OBS_BITS_X2(4), CHIP8_OBS_BITS_X2(5), CHIP8_OBS_BITS_X2(6), CHIP8_OBS_BITS_X2(7),
+  CHIP8_OBS_BITS_X2(8), CHIP8_OBS_BITS_X2(9), CHIP8_OBS_BITS_X2(10), CHIP8_OBS_BITS_X2(11),
+  CHIP8_OBS_BITS_X2(12), CHIP8_OBS_BITS_X2(13), CHIP8_OBS_BITS_X2(14), CHIP8_OBS_BITS_X2(15),
+};
+
+// Number of bytes chip8_obs_write() writes for this VM and format.
+size_t chip8_obs_size(const struct chip8 *vm, enum chip8_obs_format format) {
+  const size_t num_pixels = (size_t)chip8_fb_width(vm) * chip8_fb_height(vm);
+
+  switch(format) {
+    case CHIP8_OBS_PACKED: return num_pixels / 8;
+    case CHIP8_OBS_U8: return num_pixels;
+    case CHIP8_OBS_U8_64X32: return 64 * 32;
+    case CHIP8_OBS_U8_128X64: return 128 * 64;
+  }
+  return 0;
+}
+
+// OR each pair of neighbouring bits together, and squeeze the 32 results into the low half.
+// The leftmost pair ends up in bit 31.
+static inline uint64_t chip8_obs_pool_pairs(uint64_t x) {
+  x = (x | (x >> 1)) & 0x5555555555555555;
+  x = (x | (x >> 1)) & 0x3333333333333333;
+  x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0F;
+  x = (x | (x >> 4)) & 0x00FF00FF00FF00FF;
+  x = (x | (x >> 8)) & 0x0000FFFF0000FFFF;
+  x = (x | (x >> 16)) & 0x00000000FFFFFFFF;
+  return x;
+}
+
+// Store v with its highest byte first, whatever the byte order of the machine.
+static inline void chip8_obs_store_be64(uint8_t *out, uint64_t v) {
+  out[0] = v >> 56; out[1] = v >> 48; out[2] = v >> 40; out[3] = v >> 32;
+  out[4] = v >> 24; out[5] = v >> 16; out[6] = v >> 8; out[7] = v;
+}
+
+static void chip8_obs_expand(const uint64_t *words, uint32_t num_words, uint8_t *out) {
+  for(uint32_t w = 0; w < num_words; w++, out += 64) {
+    const uint64_t v = words[w];
+    memcpy(out, CHIP8_OBS_EXPAND[v >> 56], 8);
+    memcpy(out + 8, CHIP8_OBS_EXPAND[(v >> 48) & 0xFF], 8);
+    memcpy(out + 16, CHIP8_OBS_EXPAND[(v >> 40) & 0xFF], 8);
+    memcpy(out + 24, CHIP8_OBS_EXPAND[(v >> 32) & 0xFF], 8);
+    memcpy(out + 32, CHIP8_OBS_EXPAND[(v >> 24) & 0xFF], 8);
+    memcpy(out + 40, CHIP8_OBS_EXPAND[(v >> 16) & 0xFF], 8);
+    memcpy(out + 48, CHIP8_OBS_EXPAND[(v >> 8) & 0xFF], 8);
+    memcpy(out + 56, CHIP8_OBS_EXPAND[v & 0xFF], 8);
+  }
+}
+
+// Every pixel becomes a 2x2 block, so each byte is written to 2 rows of 128 bytes. Both rows are
+// expanded from the table, since copying the first row would read back bytes that were just stored.
+static inline void chip8_obs_expand_x2_byte(uint8_t *out, uint8_t b) {
+  memcpy(out, CHIP8_OBS_EXPAND_X2[b >> 4], 8);
+  memcpy(out + 8, CHIP8_OBS_EXPAND_X2[b & 0xF], 8);
+  memcpy(out + 128, CHIP8_OBS_EXPAND_X2[b >> 4], 8);
+  memcpy(out + 136, CHIP8_OBS_EXPAND_X2[b & 0xF], 8);
+}
+
+// Write 64x32 rows (one word each) as 128x64 bytes.
+static void chip8_obs_expand_x2(const uint64_t *rows, uint8_t *out) {
+  for(uint32_t r = 0; r < 32; r++, out += 256) {
+    const uint64_t v = rows[r];
+    chip8_obs_expand_x2_byte(out, v >> 56);
+    chip8_obs_expand_x2_byte(out + 16, v >> 48);
+    chip8_obs_expand_x2_byte(out + 32, v >> 40);
+    chip8_obs_expand_x2_byte(out + 48, v >> 32);
+    chip8_obs_expand_x2_byte(out + 64, v >> 24);
+    chip8_obs_expand_x2_byte(out + 80, v >> 16);
+    chip8_obs_expand_x2_byte(out + 96, v >> 8);
+    chip8_obs_expand_x2_byte(out + 112, v);
+  }
+}
+
+// Convert framebuffer words (in the layout of vm's framebuffer) into format.
+static void chip8_obs_convert(const struct chip8 *vm, const uint64_t *fb, enum chip8_obs_format format, uint8_t *out) {
+  const uint32_t num_words = vm->core.fb_size / sizeof(uint64_t);
+  const uint8_t is_hires = chip8_fb_width(vm) == 128;
+
+  switch(format) {
+    case CHIP8_OBS_PACKED: {
+      for(uint32_t w = 0; w < num_words; w++) {
+        chip8_obs_store_be64(out + 8*w, fb[w]);
+      }
+      break;
+    }
+    case CHIP8_OBS_U8: {
+      chip8_obs_expand(fb, num_words, out);
+      break;
+    }
+    case CHIP8_OBS_U8_64X32: {
+      if(!is_hires) {
+        chip8_obs_expand(fb, num_words, out);
+        break;
+      }
+
+      //every 128-pixel row is 2 words, so 2x2 blocks come from words 4r to 4r+3
+      uint64_t rows[32];
+      for(uint32_t r = 0; r < 32; r++) {
+        uint64_t left = fb[4*r] | fb[4*r + 2];
+        uint64_t right = fb[4*r + 1] | fb[4*r + 3];
+        rows[r] = chip8_obs_pool_pairs(left) << 32 | chip8_obs_pool_pairs(right);
+      }
+      chip8_obs_expand(rows, 32, out);
+      break;
+    }
+    case CHIP8_OBS_U8_128X64: {
+      if(is_hires) {
+        chip8_obs_expand(fb, num_words, out);
+      } else {
+        chip8_obs_expand_x2(fb, out);
+      }
+      break;
+    }
+  }
+}
+
+// Write the current display of vm into out in the given format.
+// Returns the number of bytes written, or 0 if out is smaller than chip8_obs_size().
+size_t chip8_obs_write(const struct chip8 *vm, enum chip8_obs_format format, uint8_t *out, size_t cap) {
+  size_t size = chip8_obs_size(vm, format);
+  if(size == 0 || cap < size) {
+    return 0;
+  }
+
+  chip8_obs_convert(vm, vm->core.fb, format, out);
+  return size;
+}
+
+// Same as chip8_obs_write(), but a pixel is lit if it was lit in any of the last num_frames
+// frames (including this one). Games that flicker sprites by drawing them every other frame
+// look solid this way. The current frame is added to hist, so this must be called once per frame.
+size_t chip8_obs_write_pooled(const struct chip8 *vm, struct chip8_obs_history *hist, uint8_t num_frames, enum chip8_obs_format format, uint8_t *out, size_t cap) {
+  size_t size = chip8_obs_size(vm, format);
+  if(size == 0 || cap < size || num_frames == 0 || num_frames > CHIP8_OBS_MAX_POOL) {
+    return 0;
+  }
+
+  const uint32_t num_words = vm->core.fb_size / sizeof(uint64_t);
+  const uint8_t num_slots = CHIP8_OBS_MAX_POOL - 1;
+
+  uint64_t fb[128];
+  memcpy(fb, vm->core.fb, vm->core.fb_size);
+
+  uint8_t num_old = num_frames - 1 < hist->count ? num_frames - 1 : hist->count;
+  for(uint8_t i = 1; i <= num_old; i++) {
+    const uint64_t *old = hist->frames[(hist->next + num_slots - i) % num_slots];
+    for(uint32_t w = 0; w < num_words; w++) {
+      fb[w] |= old[w];
+    }
+  }
+
+  memcpy(hist->frames[hist->next], vm->core.fb, vm->core.fb_size);
+  hist->next = (hist->next + 1) % num_slots;
+  if(hist->count < num_slots) {
+    hist->count++;
+  }
+
+  chip8_obs_convert(vm, fb, format, out);
+  return size;
+}
@@ -0,0 +1,44 @@
+#ifndef CHIP8_OBS_H
+#define CHIP8_OBS_H
+
+#include "chip8.h"
+
+// Writes the display of a VM straight into a buffer in the format a program (for example
+// a training loop) wants, so it does not have to unpack the framebuffer on its own.
+// Bits are expanded to bytes with lookup tables, 8 pixels at a time.
+
+enum chip8_obs_format {
+  //1 bit per pixel at the resolution of the VM, 8 pixels per byte, with the leftmost pixel in the highest bit.
+  CHIP8_OBS_PACKED,
+
+  //1 byte per pixel (0 or 1) at the resolution of the VM.
+  CHIP8_OBS_U8,
+
+  //1 byte per pixel at 64x32. A 128x64 display is max-pooled down (a pixel is lit if any of its 2x2 block is).
+  CHIP8_OBS_U8_64X32,
+
+  //1 byte per pixel at 128x64. Every pixel of a 64x32 display becomes a 2x2 block.
+  CHIP8_OBS_U8_128X64,
+};
+
+//max number of frames chip8_obs_write_pooled() can combine
+#define CHIP8_OBS_MAX_POOL 4
+
+// The last few framebuffers of a VM, for chip8_obs_write_pooled().
+// Clear it with chip8_obs_history_clear() whenever the VM is reset.
+struct chip8_obs_history {
+  uint64_t frames[CHIP8_OBS_MAX_POOL - 1][128];
+  uint8_t next;
+  uint8_t count;
+};
+
+static inline void chip8_obs_history_clear(struct chip8_obs_history *hist) {
+  hist->next = 0;
+  hist->count = 0;
+}
+
+size_t chip8_obs_size(const struct chip8 *vm, enum chip8_obs_format format);
+size_t chip8_obs_write(const struct chip8 *vm, enum chip8_obs_format format, uint8_t *out, size_t cap);
+size_t chip8_obs_write_pooled(const struct chip8 *vm, struct chip8_obs_history *hist, uint8_t num_frames, enum chip8_obs_format format, uint8_t *out, size_t cap);
+
+#endif// CHIP8_OBS_H
@@ -0,0 +1,117 @@
+#include "chip8_pacer.h"
+
+// refresh_nanos is what the display claims its refresh interval is (0 if it does not know, which
+// is taken as 60Hz). vsync is 1 if presents wait for the display.
+void chip8_pacer_init(struct chip8_pacer *p, uint64_t now, uint64_t refresh_nanos, uint8_t vsync) {
+  if(refresh_nanos < CHIP8_PACER_MIN_REFRESH_NANOS || refresh_nanos > CHIP8_PACER_MAX_REFRESH_NANOS) {
+    refresh_nanos = CHIP8_PACER_NANOS_PER_FRAME;
+  }
+
+  p->vsync = vsync;
+  p->refresh_nanos = refresh_nanos;
+  p->num_samples = 0;
+  p->next_sample = 0;
+  p->last_present_nanos = 0;
+  p->skipped = 0;
+  p->next_present_nanos = 0;
+  chip8_pacer_restart(p, now);
+}
+
+// Start counting emulated time again from now, for example after the emulator was paused.
+// The next frame is due right away.
+void chip8_pacer_restart(struct chip8_pacer *p, uint64_t now) {
+  p->start_nanos = now;
+  p->frames = 0;
+}
+
+// Number of frames that have to be emulated now to catch up with the clock. They are counted as
+// emulated, so the caller must run all of them.
+uint32_t chip8_pacer_frames_due(struct chip8_pacer *p, uint64_t now) {
+  if(now < p->start_nanos) {
+    return 0;
+  }
+
+  const uint64_t due = (now - p->start_nanos) * CHIP8_PACER_FPS / CHIP8_PACER_NANOS_PER_SECOND + 1;
+  if(due <= p->frames) {
+    return 0;
+  }
+
+  uint64_t owed = due - p->frames;
+  if(owed > CHIP8_PACER_MAX_DEBT_FRAMES) {
+    //too far behind to ever catch up, carry on from now
+    chip8_pacer_restart(p, now);
+    owed = 1;
+  }
+
+  p->frames += owed;
+  return owed;
+}
+
+// Returns 1 if the frame that was just emulated should be presented, or 0 if the time is better
+// spent emulating, because the emulator would be too far behind once the present came back.
+int chip8_pacer_should_present(struct chip8_pacer *p, uint64_t now) {
+  //how long ago the newest emulated frame was due
+  const uint64_t newest = p->frames == 0 ? p->start_nanos : chip8_pacer_frame_nanos(p, p->frames - 1);
+  const uint64_t lag = now > newest ? now - newest : 0;
+
+  //with vsync, a present waits for the next refresh. Waiting longer than a frame is no reason to
+  //skip every present on a slow display, since catching up only takes one more frame then.
+  uint64_t cost = 0;
+  if(p->vsync) {
+    cost = p->refresh_nanos < CHIP8_PACER_NANOS_PER_FRAME ? p->refresh_nanos : CHIP8_PACER_NANOS_PER_FRAME;
+  }
+
+  if(lag + cost > CHIP8_PACER_MAX_LAG_NANOS && p->skipped < CHIP8_PACER_MAX_SKIPPED_PRESENTS) {
+    p->skipped++;
+    return 0;
+  }
+  return 1;
+}
+
+// Call right after every present returns.
+void chip8_pacer_presented(struct chip8_pacer *p, uint64_t now) {
+  //with vsync, back to back presents come back once per refresh
+  if(p->vsync && p->last_present_nanos != 0 && p->skipped == 0) {
+    const uint64_t interval = now - p->last_present_nanos;
+
+    if(interval >= CHIP8_PACER_MIN_REFRESH_NANOS && interval <= CHIP8_PACER_MAX_REFRESH_NANOS) {
+      p->samples[p->next_sample] = interval;
+      p->next_sample = (p->next_sample + 1) % CHIP8_PACER_REFRESH_SAMPLES;
+      if(p->num_samples < CHIP8_PACER_REFRESH_SAMPLES) {
+        p->num_samples++;
+      }
+
+      //the median, so the odd present that came back late (or was late to start) does not count
+      if(p->num_samples >= CHIP8_PACER_REFRESH_SAMPLES / 2) {
+        uint64_t sorted[CHIP8_PACER_REFRESH_SAMPLES];
+        for(uint32_t i = 0; i < p->num_samples; i++) {
+          uint64_t v = p->samples[i];
+          uint32_t j = i;
+          for(; j > 0 && sorted[j - 1] > v; j--) {
+            sorted[j] = sorted[j - 1];
+          }
+          sorted[j] = v;
+        }
+        p->refresh_nanos = sorted[p->num_samples / 2];
+      }
+    }
+  }
+
+  p->last_present_nanos = now;
+  p->skipped = 0;
+
+  //a present that was late moves the schedule, instead of being followed by presents that catch up
+  p->next_present_nanos += p->refresh_nanos;
+  if(p->next_present_nanos < now) {
+    p->next_present_nanos = now;
+  }
+}
+
+// Without vsync, when the next present should happen so the window is not drawn more often than
+// the display refreshes. Returns 0 if presents wait for vsync by themselves.
+uint64_t chip8_pacer_next_present(const struct chip8_pacer *p) {
+  if(p->vsync) {
+    return 0;
+  }
+  return p->next_present_nanos;
+}
@@ -0,0 +1,83 @@
+#ifndef CHIP8_PACER_H
+#define CHIP8_PACER_H
+
+#include <stdint.h>
+
+// Keeps the emulator at exactly 60 emulated frames per real second, no matter how often the
+// frontend gets to run, and decides when showing a frame is worth the time it takes.
+//
+// Emulated time is counted from a fixed starting point, so rounding never adds up: frame n
+// (counting from 0) is due at start + n / 60 seconds, and chip8_pacer_frames_due() returns
+// every frame that is owed. Frames are never dropped to catch up. Only when the emulator is more
+// than CHIP8_PACER_MAX_DEBT_FRAMES behind (the machine was suspended, or a debugger stopped it)
+// is the missing time given up on, so that the game does not race for seconds afterwards.
+//
+// Frontends that emulate on the same thread that presents (the --grid) skip presents instead
+// while they are behind (see chip8_pacer_should_present()). How long a present takes is
+// measured from how often presents come back when they wait for vsync.
+//
+// Times are in nanoseconds, from any monotonic clock (SDL_GetTicksNS(), CLOCK_MONOTONIC, ...).
+
+#define CHIP8_PACER_NANOS_PER_SECOND 1000000000ULL
+#define CHIP8_PACER_FPS 60
+#define CHIP8_PACER_NANOS_PER_FRAME (CHIP8_PACER_NANOS_PER_SECOND / CHIP8_PACER_FPS)
+
+//one emulated second
+#define CHIP8_PACER_MAX_DEBT_FRAMES 60
+
+//a present is skipped if the emulator would be this far behind after it
+#define CHIP8_PACER_MAX_LAG_NANOS (2 * CHIP8_PACER_NANOS_PER_FRAME)
+
+//but never this many in a row, so the window keeps moving even on a machine that is too slow
+#define CHIP8_PACER_MAX_SKIPPED_PRESENTS 6
+
+//the refresh interval is the median of this many presents
+#define CHIP8_PACER_REFRESH_SAMPLES 16
+
+//intervals between presents outside of this range (20Hz to 500Hz) are not refreshes of the display
+#define CHIP8_PACER_MIN_REFRESH_NANOS (CHIP8_PACER_NANOS_PER_SECOND / 500)
+#define CHIP8_PACER_MAX_REFRESH_NANOS (CHIP8_PACER_NANOS_PER_SECOND / 20)
+
+struct chip8_pacer {
+  //emulated time 0, and how many frames were emulated since
+  uint64_t start_nanos;
+  uint64_t frames;
+
+  //1 if presents wait for vsync, so they can be used to measure the display
+  uint8_t vsync;
+
+  //time between refreshes of the display. Starts out as what the display claims, and is
+  //measured once there are enough samples (vsync only).
+  uint64_t refresh_nanos;
+  uint64_t samples[CHIP8_PACER_REFRESH_SAMPLES];
+  uint32_t num_samples;
+  uint32_t next_sample;
+
+  //when the last present came back (0 before the first one), and how many were skipped since
+  uint64_t last_present_nanos;
+  uint32_t skipped;
+
+  //without vsync, when the next present is due. Presents are spaced out on a fixed schedule,
+  //so the time it takes to draw does not add up.
+  uint64_t next_present_nanos;
+};
+
+void chip8_pacer_init(struct chip8_pacer *p, uint64_t now, uint64_t refresh_nanos, uint8_t vsync);
+void chip8_pacer_restart(struct chip8_pacer *p, uint64_t now);
+uint32_t chip8_pacer_frames_due(struct chip8_pacer *p, uint64_t now);
+
+int chip8_pacer_should_present(struct chip8_pacer *p, uint64_t now);
+void chip8_pacer_presented(struct chip8_pacer *p, uint64_t now);
+uint64_t chip8_pacer_next_present(const struct chip8_pacer *p);
+
+// When emulated frame (frames) is due.
+static inline uint64_t chip8_pacer_frame_nanos(const struct chip8_pacer *p, uint64_t frames) {
+  return p->start_nanos + frames * CHIP8_PACER_NANOS_PER_SECOND / CHIP8_PACER_FPS;
+}
+
+// When the next frame that has not been emulated yet is due.
+static inline uint64_t chip8_pacer_next_frame(const struct chip8_pacer *p) {
+  return chip8_pacer_frame_nanos(p, p->frames);
+}
+
+#endif// CHIP8_PACER_H
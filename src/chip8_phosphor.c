@@ -0,0 +1,92 @@
+#include "chip8_phosphor.h"
+#include <assert.h>
+#include <string.h>
+
+#include "chip8_simd.h"
+
+_Static_assert((64 * 32) % VEC8_LANES == 0, "every display must be a multiple of the vector width");
+
+void chip8_phosphor_init(struct chip8_phosphor *p, uint16_t width, uint16_t height, uint8_t num_frames, uint8_t decay) {
+  assert((uint32_t)width * height <= CHIP8_PHOSPHOR_MAX_PIXELS);
+  assert(num_frames >= 1 && num_frames <= CHIP8_PHOSPHOR_MAX_FRAMES);
+
+  p->width = width;
+  p->height = height;
+  p->num_frames = num_frames;
+  p->decay = decay;
+
+  for(uint32_t b = 0; b < 256; b++) {
+    for(uint32_t i = 0; i < 8; i++) {
+      p->expand[b][i] = (b >> (7 - i)) & 1 ? 0xFF : 0x00;
+    }
+  }
+}
+
+// Start over from fb, as if it had been on the screen for a long time.
+void chip8_phosphor_reset(struct chip8_phosphor *p, const uint64_t *fb) {
+  const uint32_t num_words = (uint32_t)p->width * p->height / 64;
+
+  for(uint32_t k = 0; k < p->num_frames; k++) {
+    memcpy(p->history[k], fb, num_words * sizeof(uint64_t));
+  }
+  memcpy(p->blended, fb, num_words * sizeof(uint64_t));
+  p->next = 0;
+
+  for(uint32_t w = 0; w < num_words; w++) {
+    for(uint32_t i = 0; i < 8; i++) {
+      memcpy(&p->intensity[w * 64 + i * 8], p->expand[(fb[w] >> (56 - 8 * i)) & 0xFF], 8);
+    }
+  }
+}
+
+// Add the next emulated frame. Returns 1 if blended or intensity changed.
+int chip8_phosphor_update(struct chip8_phosphor *p, const uint64_t *fb) {
+  const uint32_t num_words = (uint32_t)p->width * p->height / 64;
+
+  memcpy(p->history[p->next], fb, num_words * sizeof(uint64_t));
+  p->next = (p->next + 1) % p->num_frames;
+
+  uint64_t changed = 0;
+  for(uint32_t w = 0; w < num_words; w++) {
+    uint64_t v = 0;
+    for(uint32_t k = 0; k < p->num_frames; k++) {
+      v |= p->history[k][w];
+    }
+
+    changed |= v ^ p->blended[w];
+    p->blended[w] = v;
+  }
+
+  if(p->decay == 0) {
+    return changed != 0;
+  }
+
+  //every pixel that is on goes back to full intensity
+  _Alignas(CHIP8_CACHE_LINE) uint8_t lit[CHIP8_PHOSPHOR_MAX_PIXELS];
+  for(uint32_t w = 0; w < num_words; w++) {
+    const uint64_t v = p->blended[w];
+    for(uint32_t i = 0; i < 8; i++) {
+      memcpy(&lit[w * 64 + i * 8], p->expand[(v >> (56 - 8 * i)) & 0xFF], 8);
+    }
+  }
+
+  const vec8 decay = vec8_set1(p->decay);
+  vec8 diff = vec8_zero();
+
+  for(uint32_t i = 0; i < num_words * 64; i += VEC8_LANES) {
+    const vec8 old = vec8_load(&p->intensity[i]);
+    const vec8 val = vec8_or(vec8_subs(old, decay), vec8_load(&lit[i]));
+
+    diff = vec8_or(diff, vec8_xor(old, val));
+    vec8_store(&p->intensity[i], val);
+  }
+
+  _Alignas(CHIP8_CACHE_LINE) uint8_t diff_bytes[VEC8_LANES];
+  vec8_store(diff_bytes, diff);
+  for(uint32_t i = 0; i < VEC8_LANES; i++) {
+    if(diff_bytes[i] != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
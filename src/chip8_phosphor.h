@@ -0,0 +1,52 @@
+#ifndef CHIP8_PHOSPHOR_H
+#define CHIP8_PHOSPHOR_H
+
+#include <stdint.h>
+
+#include "chip8_core.h"
+
+// Hides the flicker of CHIP-8 games. Sprites are drawn with XOR, so games erase a sprite and
+// draw it again somewhere else, and a sprite that is erased in one frame and drawn in the next
+// blinks. Two ways of hiding this are supported, and they can be used together:
+//  - blending: a pixel is on if it was on in any of the last num_frames emulated frames.
+//  - decay: every pixel has an intensity (0 to 255) that fades by (decay) every emulated frame,
+//    and is set back to 255 whenever the pixel is on, like the phosphor of an old CRT screen.
+// Both work on whole framebuffers at once (64 pixels per word for blending, and 16 or 32
+// intensities per SIMD instruction for decay), and are run once per emulated frame instead
+// of drawing every frame the emulator runs.
+
+#define CHIP8_PHOSPHOR_MAX_FRAMES 8
+
+//largest framebuffer (SUPER-CHIP, 128x64)
+#define CHIP8_PHOSPHOR_MAX_PIXELS (128 * 64)
+#define CHIP8_PHOSPHOR_MAX_WORDS (CHIP8_PHOSPHOR_MAX_PIXELS / 64)
+
+struct chip8_phosphor {
+  uint16_t width;
+  uint16_t height;
+
+  //number of frames blended together (1 shows only the newest one)
+  uint8_t num_frames;
+
+  //intensity lost every frame. 0 turns off decay, so intensity is not kept up to date.
+  uint8_t decay;
+
+  //the last num_frames framebuffers, and where the next one goes
+  _Alignas(CHIP8_CACHE_LINE) uint64_t history[CHIP8_PHOSPHOR_MAX_FRAMES][CHIP8_PHOSPHOR_MAX_WORDS];
+  uint8_t next;
+
+  //OR of every framebuffer in history
+  _Alignas(CHIP8_CACHE_LINE) uint64_t blended[CHIP8_PHOSPHOR_MAX_WORDS];
+
+  //one byte per pixel, row by row
+  _Alignas(CHIP8_CACHE_LINE) uint8_t intensity[CHIP8_PHOSPHOR_MAX_PIXELS];
+
+  //the 8 intensities (0 or 255) of every byte of a framebuffer row, leftmost (highest) bit first
+  uint8_t expand[256][8];
+};
+
+void chip8_phosphor_init(struct chip8_phosphor *p, uint16_t width, uint16_t height, uint8_t num_frames, uint8_t decay);
+void chip8_phosphor_reset(struct chip8_phosphor *p, const uint64_t *fb);
+int chip8_phosphor_update(struct chip8_phosphor *p, const uint64_t *fb);
+
+#endif// CHIP8_PHOSPHOR_H
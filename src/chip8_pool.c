@@ -0,0 +1,72 @@
+#include "chip8_pool.h"
+#include <stdlib.h>
+
+
+static uint32_t chip8_pool_index(const struct chip8_pool *pool, const struct chip8 *vm) {
+  return ((const uint8_t*)vm - (const uint8_t*)pool->slots) / chip8_vm_size(pool->type);
+}
+
+int chip8_pool_init(struct chip8_pool *pool, enum chip8_emu_type type, uint32_t capacity) {
+  pool->slots = chip8_create_array(type, capacity);
+  pool->free_slots = malloc((size_t)capacity * sizeof(uint32_t));
+
+  if(pool->slots == NULL || pool->free_slots == NULL) {
+    chip8_destroy_array(pool->slots, capacity);
+    free(pool->free_slots);
+    return 0;
+  }
+
+  pool->type = type;
+  pool->capacity = capacity;
+  pool->num_free = capacity;
+
+  //hand out the lowest slots first so that VMs that are in use stay close together.
+  for(uint32_t i = 0; i < capacity; i++) {
+    pool->free_slots[i] = capacity - 1 - i;
+  }
+
+  return 1;
+}
+
+// Free the pool. Every VM that is still in use gets released first.
+void chip8_pool_destroy(struct chip8_pool *pool) {
+  //slots that are not in use hold nothing, so releasing them again does no harm
+  chip8_destroy_array(pool->slots, pool->capacity);
+  free(pool->free_slots);
+  pool->slots = NULL;
+  pool->free_slots = NULL;
+  pool->capacity = 0;
+  pool->num_free = 0;
+}
+
+// Returns a VM slot, or NULL if the pool is full.
+// The VM must be reset or set up with chip8_fork() before it is used.
+struct chip8 *chip8_pool_acquire(struct chip8_pool *pool) {
+  if(pool->num_free == 0) {
+    return NULL;
+  }
+
+  pool->num_free--;
+  return chip8_array_at(pool->slots, pool->free_slots[pool->num_free]);
+}
+
+// Acquire a slot and fork src into it. Returns NULL if the pool is full or the fork failed.
+struct chip8 *chip8_pool_fork(struct chip8_pool *pool, struct chip8 *src) {
+  struct chip8 *dst = chip8_pool_acquire(pool);
+  if(dst == NULL) {
+    return NULL;
+  }
+
+  if(!chip8_fork(src, dst)) {
+    pool->free_slots[pool->num_free++] = chip8_pool_index(pool, dst);
+    return NULL;
+  }
+
+  return dst;
+}
+
+// Release the VM's resources and give its slot back to the pool.
+void chip8_release(struct chip8_pool *pool, struct chip8 *vm) {
+  chip8_wrapper_release(vm);
+  pool->free_slots[pool->num_free++] = chip8_pool_index(pool, vm);
+}
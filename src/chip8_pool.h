@@ -0,0 +1,29 @@
+#ifndef CHIP8_POOL_H
+#define CHIP8_POOL_H
+
+#include "chip8.h"
+
+// A fixed-size pool of VM slots stored in one contiguous, cache-line aligned
+// block of memory. Acquiring and releasing a slot are both O(1), so VMs can be
+// forked and thrown away very quickly (for example when searching a game tree).
+// Every VM in a pool has the same variant, so each slot is exactly as large as that variant needs.
+//
+// Note that a pool is NOT thread-safe. Use one pool per thread.
+struct chip8_pool {
+  struct chip8 *slots;
+  uint32_t capacity;
+  enum chip8_emu_type type;
+
+  //stack of indices of the slots that are not in use
+  uint32_t *free_slots;
+  uint32_t num_free;
+};
+
+int chip8_pool_init(struct chip8_pool *pool, enum chip8_emu_type type, uint32_t capacity);
+void chip8_pool_destroy(struct chip8_pool *pool);
+
+struct chip8 *chip8_pool_acquire(struct chip8_pool *pool);
+struct chip8 *chip8_pool_fork(struct chip8_pool *pool, struct chip8 *src);
+void chip8_release(struct chip8_pool *pool, struct chip8 *vm);
+
+#endif// CHIP8_POOL_H
@@ -0,0 +1,175 @@
+#include "chip8_quirks.h"
+#include <stdlib.h>
+
+//the screen is checked for garbage every this many frames
+#define CHIP8_QUIRKS_SAMPLE_FRAMES 10
+
+//the input script waits this long for title screens, then holds every key for this long
+#define CHIP8_QUIRKS_WAIT_FRAMES 60
+#define CHIP8_QUIRKS_KEY_FRAMES 20
+
+struct chip8_quirks_job {
+  struct chip8 *vms;
+  struct chip8_quirks_candidate *candidates;
+  uint32_t num_frames;
+  uint32_t instructions_per_frame;
+};
+
+// The quirks that are worth trying on a variant. Only quirks that the interpreter
+// actually looks at are tried, since the others can't change how a ROM runs.
+uint16_t chip8_quirks_tested(enum chip8_emu_type type) {
+  const uint16_t common = CHIP8_QUIRK_SHIFT_VY | CHIP8_QUIRK_INCREMENT_I | CHIP8_QUIRK_RESET_VF | CHIP8_QUIRK_BXNN;
+
+  switch(type) {
+    case CHIP8_VARIANT_VIP: return common;
+    case CHIP8_VARIANT_SUPER: return common | CHIP8_QUIRK_HALF_PIXEL_SCROLL_LOW_RES;
+    case CHIP8_VARIANT_XO: return 0;
+  }
+  return 0;
+}
+
+// Keys held down on each frame. After waiting a bit, every key is pressed and released in turn,
+// which gets most games past their title screen and moving.
+static uint16_t chip8_quirks_script(uint32_t frame) {
+  if(frame < CHIP8_QUIRKS_WAIT_FRAMES) {
+    return 0;
+  }
+
+  uint32_t step = (frame - CHIP8_QUIRKS_WAIT_FRAMES) / CHIP8_QUIRKS_KEY_FRAMES;
+
+  //every other step releases all keys
+  if(step & 1) {
+    return 0;
+  }
+  return 1 << ((step / 2) % 16);
+}
+
+// A screen looks like garbage when most of it is lit, or when neighbouring pixels flip a lot
+// more than they do in sprites and text (for example when a ROM draws its own code as a sprite).
+static int chip8_quirks_is_garbage(const struct chip8 *vm) {
+  const uint32_t num_words = vm->core.fb_size / sizeof(uint64_t);
+  const uint32_t num_pixels = num_words * 64;
+
+  uint32_t lit = 0;
+  uint32_t edges = 0;
+  for(uint32_t w = 0; w < num_words; w++) {
+    uint64_t row = vm->core.fb[w];
+    lit += popcount64(row);
+    edges += popcount64(row ^ (row << 1));
+  }
+
+  return lit * 10 > num_pixels * 6 || edges * 10 > num_pixels * 3;
+}
+
+static void chip8_quirks_run(void *ctx, uint32_t begin, uint32_t end) {
+  struct chip8_quirks_job *job = ctx;
+
+  for(uint32_t i = begin; i < end; i++) {
+    struct chip8 *vm = chip8_array_at(job->vms, i);
+    struct chip8_quirks_candidate *c = &job->candidates[i];
+
+    c->frames_run = 0;
+    c->garbage_frames = 0;
+    c->crashed = 0;
+
+    for(uint32_t frame = 0; frame < job->num_frames; frame++) {
+      chip8_set_keyboard(&vm->core, chip8_quirks_script(frame));
+
+      //invalid instructions and stack over/underflow both stop the run
+      if(!chip8_wrapper_run_frame(vm, job->instructions_per_frame)) {
+        c->crashed = 1;
+        break;
+      }
+      if(chip8_wrapper_has_exited(vm)) {
+        break;
+      }
+      c->frames_run++;
+
+      if(frame % CHIP8_QUIRKS_SAMPLE_FRAMES == CHIP8_QUIRKS_SAMPLE_FRAMES - 1 && chip8_quirks_is_garbage(vm)) {
+        c->garbage_frames++;
+      }
+    }
+  }
+}
+
+static int chip8_quirks_compare(const void *a, const void *b) {
+  const struct chip8_quirks_candidate *x = a;
+  const struct chip8_quirks_candidate *y = b;
+
+  if(x->score != y->score) {
+    return x->score > y->score ? -1 : 1;
+  }
+  return (int)x->quirks - (int)y->quirks;
+}
+
+// Find the quirks that vm's ROM runs best with. vm should be freshly reset, and its own
+// quirks are used as the default when several combinations run equally well.
+// Every combination runs num_frames frames on pool.
+//
+// vm itself is not run or changed (apart from its RAM becoming shared with the copies),
+// so the caller decides whether to apply result->quirks.
+// Returns 0 if there is not enough memory.
+int chip8_quirks_detect(struct chip8 *vm, struct chip8_thread_pool *pool, uint32_t num_frames, uint32_t instructions_per_frame, struct chip8_quirks_result *result) {
+  const uint16_t tested = chip8_quirks_tested(vm->emu);
+  const uint16_t defaults = vm->core.quirks;
+
+  result->quirks = defaults;
+  result->candidates = NULL;
+  result->num_candidates = 0;
+
+  //one candidate for every subset of the tested quirks
+  const uint32_t count = (uint32_t)1 << popcount32(tested);
+
+  struct chip8_quirks_job job;
+  job.vms = chip8_create_array(vm->emu, count);
+  job.candidates = calloc(count, sizeof(*job.candidates));
+  job.num_frames = num_frames;
+  job.instructions_per_frame = instructions_per_frame;
+
+  if(job.vms == NULL || job.candidates == NULL) {
+    chip8_destroy_array(job.vms, count);
+    free(job.candidates);
+    return 0;
+  }
+
+  //walk through every subset of the tested bits
+  uint16_t subset = 0;
+  for(uint32_t i = 0; i < count; i++) {
+    struct chip8 *dst = chip8_array_at(job.vms, i);
+
+    if(!chip8_fork(vm, dst)) {
+      chip8_destroy_array(job.vms, count);
+      free(job.candidates);
+      return 0;
+    }
+
+    dst->core.quirks = (defaults & ~tested) | subset;
+    job.candidates[i].quirks = dst->core.quirks;
+    subset = (subset - tested) & tested;
+  }
+
+  chip8_thread_pool_run(pool, count, 1, chip8_quirks_run, &job);
+
+  for(uint32_t i = 0; i < count; i++) {
+    struct chip8_quirks_candidate *c = &job.candidates[i];
+
+    //a frame that looked like garbage counts as if it did not run at all. A run that crashed always
+    //loses to one that did not, and quirks closer to the defaults win ties.
+    int64_t good_frames = (int64_t)c->frames_run - (int64_t)c->garbage_frames * CHIP8_QUIRKS_SAMPLE_FRAMES;
+    c->score = (good_frames - c->crashed * (int64_t)num_frames) * 16 - popcount32(c->quirks ^ defaults);
+  }
+
+  qsort(job.candidates, count, sizeof(*job.candidates), chip8_quirks_compare);
+  chip8_destroy_array(job.vms, count);
+
+  result->quirks = job.candidates[0].quirks;
+  result->candidates = job.candidates;
+  result->num_candidates = count;
+  return 1;
+}
+
+void chip8_quirks_result_free(struct chip8_quirks_result *result) {
+  free(result->candidates);
+  result->candidates = NULL;
+  result->num_candidates = 0;
+}
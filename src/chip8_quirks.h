@@ -0,0 +1,39 @@
+#ifndef CHIP8_QUIRKS_H
+#define CHIP8_QUIRKS_H
+
+#include "chip8.h"
+#include "chip8_thread_pool.h"
+
+// Guesses which quirks a ROM expects, for ROMs that don't come with a known profile.
+//
+// A copy of the VM is forked for every combination of the quirks that change how programs
+// run on its variant. All copies run in parallel for a few emulated seconds with the same
+// scripted input, and every run is scored on whether it kept running (no invalid instructions
+// and no stack over/underflow) and on whether its screen looked like a game instead of garbage.
+
+struct chip8_quirks_candidate {
+  uint16_t quirks;
+
+  //number of frames the candidate ran before it hit an invalid instruction or exited (or all of them)
+  uint32_t frames_run;
+  uint8_t crashed;
+
+  //number of sampled frames where the screen looked like garbage
+  uint32_t garbage_frames;
+
+  int64_t score;
+};
+
+struct chip8_quirks_result {
+  uint16_t quirks;
+
+  //every combination that was tried, from best to worst
+  struct chip8_quirks_candidate *candidates;
+  uint32_t num_candidates;
+};
+
+uint16_t chip8_quirks_tested(enum chip8_emu_type type);
+int chip8_quirks_detect(struct chip8 *vm, struct chip8_thread_pool *pool, uint32_t num_frames, uint32_t instructions_per_frame, struct chip8_quirks_result *result);
+void chip8_quirks_result_free(struct chip8_quirks_result *result);
+
+#endif// CHIP8_QUIRKS_H
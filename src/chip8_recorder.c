@@ -0,0 +1,857 @@
+#include "chip8_recorder.h"
+#include <stdlib.h>
+#include <string.h>
+
+//browsers show GIF frames with a delay under 2 centiseconds much slower, so shorter frames are skipped
+#define CHIP8_RECORDER_GIF_MIN_DELAY 2
+
+#define CHIP8_RECORDER_LZW_MAX_CODE 4095
+
+static uint32_t chip8_recorder_crc_table[256];
+
+static void chip8_recorder_init_crc_table(void) {
+  for(uint32_t n = 0; n < 256; n++) {
+    uint32_t c = n;
+    for(uint32_t k = 0; k < 8; k++) {
+      c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+    }
+    chip8_recorder_crc_table[n] = c;
+  }
+}
+
+static uint32_t chip8_recorder_crc(uint32_t crc, const uint8_t *data, size_t len) {
+  crc = ~crc;
+  for(size_t i = 0; i < len; i++) {
+    crc = chip8_recorder_crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void chip8_recorder_put16le(uint8_t *p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+}
+
+static void chip8_recorder_put32be(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = (v >> 16) & 0xFF;
+  p[2] = (v >> 8) & 0xFF;
+  p[3] = v & 0xFF;
+}
+
+// Index of the highest set bit, counted from the left (0 is the top bit). v must not be 0.
+static uint32_t chip8_recorder_first_bit(uint64_t v) {
+  uint32_t i = 0;
+  for(; !(v & ((uint64_t)1 << 63)); v <<= 1) {
+    i++;
+  }
+  return i;
+}
+
+static uint32_t chip8_recorder_last_bit(uint64_t v) {
+  uint32_t i = 63;
+  for(; !(v & 1); v >>= 1) {
+    i--;
+  }
+  return i;
+}
+
+
+
+/* GIF */
+
+// Writes LZW codes least significant bit first, in sub-blocks of up to 255 bytes.
+struct chip8_recorder_lzw_writer {
+  FILE *file;
+  uint32_t bits;
+  uint32_t num_bits;
+  uint8_t block[256];
+  uint32_t block_len;
+};
+
+static void chip8_recorder_lzw_flush_block(struct chip8_recorder_lzw_writer *w) {
+  if(w->block_len == 0) {
+    return;
+  }
+  fputc(w->block_len, w->file);
+  fwrite(w->block, 1, w->block_len, w->file);
+  w->block_len = 0;
+}
+
+static void chip8_recorder_lzw_write(struct chip8_recorder_lzw_writer *w, uint32_t code, uint32_t width) {
+  w->bits |= code << w->num_bits;
+  w->num_bits += width;
+
+  while(w->num_bits >= 8) {
+    w->block[w->block_len++] = w->bits & 0xFF;
+    w->bits >>= 8;
+    w->num_bits -= 8;
+
+    if(w->block_len == 255) {
+      chip8_recorder_lzw_flush_block(w);
+    }
+  }
+}
+
+// Compress pixels (indices of min_code_size bits) with the variable width LZW of GIF.
+static void chip8_recorder_lzw(struct chip8_recorder_worker *worker, FILE *file, const uint8_t *pixels, size_t len, uint32_t min_code_size) {
+  uint32_t *table = worker->lzw_table;
+  const uint32_t table_mask = sizeof(worker->lzw_table) / sizeof(uint32_t) - 1;
+
+  struct chip8_recorder_lzw_writer w;
+  w.file = file;
+  w.bits = 0;
+  w.num_bits = 0;
+  w.block_len = 0;
+
+  const uint32_t clear = 1 << min_code_size;
+  uint32_t width = min_code_size + 1;
+  uint32_t hi = clear + 1; //highest code handed out so far
+  uint32_t overflow = clear << 1; //codes from here on need one more bit
+
+  fputc(min_code_size, file);
+  memset(table, 0, sizeof(worker->lzw_table));
+  chip8_recorder_lzw_write(&w, clear, width);
+
+  uint32_t code = pixels[0];
+  for(size_t i = 1; i < len; i++) {
+    const uint32_t key = code << 8 | pixels[i];
+    uint32_t hash = (key ^ (key >> 12) * 31) & (table_mask);
+
+    uint8_t found = 0;
+    for(; table[hash] != 0; hash = (hash + 1) & (table_mask)) {
+      if(table[hash] >> 12 == key) {
+        code = table[hash] & 0xFFF;
+        found = 1;
+        break;
+      }
+    }
+    if(found) {
+      continue;
+    }
+
+    chip8_recorder_lzw_write(&w, code, width);
+    code = pixels[i];
+
+    hi++;
+    if(hi == overflow) {
+      width++;
+      overflow <<= 1;
+    }
+
+    //out of codes, start over with an empty table
+    if(hi == CHIP8_RECORDER_LZW_MAX_CODE) {
+      chip8_recorder_lzw_write(&w, clear, width);
+      width = min_code_size + 1;
+      hi = clear + 1;
+      overflow = clear << 1;
+      memset(table, 0, sizeof(worker->lzw_table));
+      continue;
+    }
+
+    table[hash] = key << 12 | hi;
+  }
+
+  //the decoder adds a code for the last one as well, which can make the end code one bit wider
+  chip8_recorder_lzw_write(&w, code, width);
+  hi++;
+  if(hi == overflow && width < 12) {
+    width++;
+  }
+  chip8_recorder_lzw_write(&w, clear + 1, width);
+
+  if(w.num_bits > 0) {
+    w.block[w.block_len++] = w.bits & 0xFF;
+  }
+  chip8_recorder_lzw_flush_block(&w);
+  fputc(0, file);
+}
+
+static void chip8_recorder_gif_header(struct chip8_recording *r) {
+  uint8_t header[13 + 6 + 19];
+  const uint32_t w = r->width * r->scale;
+  const uint32_t h = r->height * r->scale;
+
+  memcpy(header, "GIF89a", 6);
+  chip8_recorder_put16le(header + 6, w);
+  chip8_recorder_put16le(header + 8, h);
+  header[10] = 0x80; //a global palette of 2 colors
+  header[11] = 0; //background color
+  header[12] = 0; //no aspect ratio
+
+  for(uint32_t i = 0; i < 2; i++) {
+    header[13 + i * 3] = (r->palette[i] >> 16) & 0xFF;
+    header[14 + i * 3] = (r->palette[i] >> 8) & 0xFF;
+    header[15 + i * 3] = r->palette[i] & 0xFF;
+  }
+
+  //loop forever
+  static const uint8_t loop[19] = {0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00};
+  memcpy(header + 19, loop, sizeof(loop));
+
+  fwrite(header, 1, sizeof(header), r->file);
+}
+
+static void chip8_recorder_gif_frame(struct chip8_recorder_worker *worker, struct chip8_recording *r,
+                                     uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t delay) {
+  uint8_t header[8 + 10];
+
+  //graphics control extension: leave the frame in place for the next one to draw over
+  header[0] = 0x21;
+  header[1] = 0xF9;
+  header[2] = 4;
+  header[3] = 1 << 2;
+  chip8_recorder_put16le(header + 4, delay > 0xFFFF ? 0xFFFF : delay);
+  header[6] = 0;
+  header[7] = 0;
+
+  header[8] = 0x2C;
+  chip8_recorder_put16le(header + 9, x);
+  chip8_recorder_put16le(header + 11, y);
+  chip8_recorder_put16le(header + 13, w);
+  chip8_recorder_put16le(header + 15, h);
+  header[17] = 0;
+
+  fwrite(header, 1, sizeof(header), r->file);
+
+  //GIF needs at least 2 bits per code, even with 2 colors
+  chip8_recorder_lzw(worker, r->file, worker->pixels, (size_t)w * h, 2);
+}
+
+
+
+/* APNG */
+
+// Writes deflate data least significant bit first.
+struct chip8_recorder_bit_writer {
+  uint8_t *out;
+  size_t len;
+  uint32_t bits;
+  uint32_t num_bits;
+};
+
+static void chip8_recorder_write_bits(struct chip8_recorder_bit_writer *w, uint32_t value, uint32_t num_bits) {
+  w->bits |= value << w->num_bits;
+  w->num_bits += num_bits;
+
+  while(w->num_bits >= 8) {
+    w->out[w->len++] = w->bits & 0xFF;
+    w->bits >>= 8;
+    w->num_bits -= 8;
+  }
+}
+
+// Huffman codes are written starting with their highest bit.
+static void chip8_recorder_write_code(struct chip8_recorder_bit_writer *w, uint32_t code, uint32_t num_bits) {
+  uint32_t reversed = 0;
+  for(uint32_t i = 0; i < num_bits; i++) {
+    reversed |= ((code >> i) & 1) << (num_bits - 1 - i);
+  }
+  chip8_recorder_write_bits(w, reversed, num_bits);
+}
+
+// A literal or length symbol, with the fixed Huffman codes of deflate.
+static void chip8_recorder_write_symbol(struct chip8_recorder_bit_writer *w, uint32_t sym) {
+  if(sym < 144) {
+    chip8_recorder_write_code(w, 0x30 + sym, 8);
+  } else if(sym < 256) {
+    chip8_recorder_write_code(w, 0x190 + sym - 144, 9);
+  } else if(sym < 280) {
+    chip8_recorder_write_code(w, sym - 256, 7);
+  } else {
+    chip8_recorder_write_code(w, 0xC0 + sym - 280, 8);
+  }
+}
+
+// A match of len (3 to 258) bytes, 1 byte back.
+static void chip8_recorder_write_run(struct chip8_recorder_bit_writer *w, uint32_t len) {
+  static const uint16_t base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const uint8_t extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+  uint32_t i = 28;
+  while(base[i] > len) {
+    i--;
+  }
+
+  chip8_recorder_write_symbol(w, 257 + i);
+  chip8_recorder_write_bits(w, len - base[i], extra[i]);
+  chip8_recorder_write_code(w, 0, 5); //distance 1
+}
+
+// zlib stream of a single deflate block. Runs of the same byte become matches 1 byte back,
+// which is all it takes for framebuffers (mostly empty, and even more so after the Up filter).
+static size_t chip8_recorder_deflate(const uint8_t *data, size_t len, uint8_t *out) {
+  struct chip8_recorder_bit_writer w = {out, 0, 0, 0};
+
+  out[w.len++] = 0x78;
+  out[w.len++] = 0x01;
+
+  chip8_recorder_write_bits(&w, 1, 1); //last block
+  chip8_recorder_write_bits(&w, 1, 2); //fixed Huffman codes
+
+  for(size_t i = 0; i < len;) {
+    size_t run = 0;
+    if(i > 0) {
+      while(i + run < len && run < 258 && data[i + run] == data[i - 1]) {
+        run++;
+      }
+    }
+
+    if(run >= 3) {
+      chip8_recorder_write_run(&w, run);
+      i += run;
+    } else {
+      chip8_recorder_write_symbol(&w, data[i]);
+      i++;
+    }
+  }
+
+  chip8_recorder_write_symbol(&w, 256);
+  if(w.num_bits > 0) {
+    chip8_recorder_write_bits(&w, 0, 8 - w.num_bits);
+  }
+
+  uint32_t a = 1, b = 0;
+  for(size_t i = 0; i < len; i++) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  chip8_recorder_put32be(out + w.len, b << 16 | a);
+  return w.len + 4;
+}
+
+static void chip8_recorder_png_chunk(FILE *file, const char *type, const uint8_t *data, size_t len) {
+  uint8_t head[8];
+  chip8_recorder_put32be(head, len);
+  memcpy(head + 4, type, 4);
+
+  uint8_t tail[4];
+  chip8_recorder_put32be(tail, chip8_recorder_crc(chip8_recorder_crc(0, head + 4, 4), data, len));
+
+  fwrite(head, 1, 8, file);
+  if(len > 0) {
+    fwrite(data, 1, len, file);
+  }
+  fwrite(tail, 1, 4, file);
+}
+
+static void chip8_recorder_apng_actl(struct chip8_recording *r) {
+  uint8_t actl[8];
+  chip8_recorder_put32be(actl, r->num_written);
+  chip8_recorder_put32be(actl + 4, 0); //loop forever
+  chip8_recorder_png_chunk(r->file, "acTL", actl, sizeof(actl));
+}
+
+static void chip8_recorder_apng_header(struct chip8_recording *r) {
+  static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  fwrite(signature, 1, sizeof(signature), r->file);
+
+  uint8_t ihdr[13];
+  chip8_recorder_put32be(ihdr, r->width * r->scale);
+  chip8_recorder_put32be(ihdr + 4, r->height * r->scale);
+  ihdr[8] = 1; //bits per pixel
+  ihdr[9] = 3; //palette
+  ihdr[10] = 0;
+  ihdr[11] = 0;
+  ihdr[12] = 0;
+  chip8_recorder_png_chunk(r->file, "IHDR", ihdr, sizeof(ihdr));
+
+  //the number of frames is filled in once the recording is done
+  r->actl_offset = ftell(r->file);
+  chip8_recorder_apng_actl(r);
+
+  uint8_t plte[6];
+  for(uint32_t i = 0; i < 2; i++) {
+    plte[i * 3] = (r->palette[i] >> 16) & 0xFF;
+    plte[i * 3 + 1] = (r->palette[i] >> 8) & 0xFF;
+    plte[i * 3 + 2] = r->palette[i] & 0xFF;
+  }
+  chip8_recorder_png_chunk(r->file, "PLTE", plte, sizeof(plte));
+}
+
+static void chip8_recorder_apng_frame(struct chip8_recorder_worker *worker, struct chip8_recording *r,
+                                      uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t delay) {
+  uint8_t fctl[26];
+  chip8_recorder_put32be(fctl, r->sequence++);
+  chip8_recorder_put32be(fctl + 4, w);
+  chip8_recorder_put32be(fctl + 8, h);
+  chip8_recorder_put32be(fctl + 12, x);
+  chip8_recorder_put32be(fctl + 16, y);
+  fctl[20] = (delay > 0xFFFF ? 0xFFFF : delay) >> 8;
+  fctl[21] = (delay > 0xFFFF ? 0xFFFF : delay) & 0xFF;
+  fctl[22] = 0;
+  fctl[23] = CHIP8_RECORDER_FPS;
+  fctl[24] = 0; //leave the frame in place
+  fctl[25] = 0; //replace the pixels under it
+  chip8_recorder_png_chunk(r->file, "fcTL", fctl, sizeof(fctl));
+
+  //pack 8 pixels per byte, and store every row as the difference to the one above (the Up filter)
+  const uint32_t row_bytes = (w + 7) / 8;
+  uint8_t *rows = worker->rows;
+  for(uint32_t row = 0; row < h; row++) {
+    uint8_t *out = rows + (size_t)row * (row_bytes + 1);
+    const uint8_t *pixels = worker->pixels + (size_t)row * w;
+
+    out[0] = 2;
+    memset(out + 1, 0, row_bytes);
+    for(uint32_t i = 0; i < w; i++) {
+      out[1 + i / 8] |= pixels[i] << (7 - i % 8);
+    }
+  }
+  for(uint32_t row = h - 1; row > 0; row--) {
+    uint8_t *out = rows + (size_t)row * (row_bytes + 1);
+    const uint8_t *above = out - (row_bytes + 1);
+    for(uint32_t i = 1; i <= row_bytes; i++) {
+      out[i] -= above[i];
+    }
+  }
+
+  //room for the sequence number in front, which fdAT needs
+  uint8_t *data = worker->compressed;
+  const size_t len = chip8_recorder_deflate(rows, (size_t)h * (row_bytes + 1), data + 4);
+
+  //the first frame is the image that programs without APNG support show
+  if(r->num_written == 0) {
+    chip8_recorder_png_chunk(r->file, "IDAT", data + 4, len);
+  } else {
+    chip8_recorder_put32be(data, r->sequence++);
+    chip8_recorder_png_chunk(r->file, "fdAT", data, len + 4);
+  }
+}
+
+
+
+/* Encoder */
+
+static uint64_t chip8_recorder_centis(uint64_t frame) {
+  return (frame * 100 + CHIP8_RECORDER_FPS / 2) / CHIP8_RECORDER_FPS;
+}
+
+// Write the pending frame, which is shown until end_frame. Only the part that differs from
+// the canvas is written. Returns 0 if the frame is too short to be written (only for GIF,
+// unless it is the last frame).
+static int chip8_recorder_write_pending(struct chip8_recorder_worker *worker, struct chip8_recording *r, uint64_t end_frame, uint8_t last) {
+  uint32_t delay;
+
+  if(r->format == CHIP8_RECORDER_GIF) {
+    delay = chip8_recorder_centis(end_frame) - chip8_recorder_centis(r->written_frame);
+    if(delay < CHIP8_RECORDER_GIF_MIN_DELAY) {
+      if(!last) {
+        return 0;
+      }
+      delay = CHIP8_RECORDER_GIF_MIN_DELAY;
+    }
+  } else {
+    delay = end_frame > r->written_frame ? end_frame - r->written_frame : 1;
+  }
+
+  //find the rectangle that changed
+  const uint32_t words_per_row = r->width / 64;
+  uint32_t x0 = 0, y0 = 0, x1 = r->width - 1, y1 = r->height - 1;
+
+  if(r->num_written > 0) {
+    uint64_t cols[128 / 64] = {0}; //the columns that changed, for the widest display
+    y0 = r->height;
+    y1 = 0;
+
+    for(uint32_t y = 0; y < r->height; y++) {
+      uint64_t row = 0;
+      for(uint32_t w = 0; w < words_per_row; w++) {
+        const uint64_t diff = r->pending[y * words_per_row + w] ^ r->canvas[y * words_per_row + w];
+        cols[w] |= diff;
+        row |= diff;
+      }
+
+      if(row != 0) {
+        y0 = y < y0 ? y : y0;
+        y1 = y;
+      }
+    }
+
+    if(y0 > y1) {
+      //nothing changed (a frame that was skipped came and went), but the time still has to pass
+      x0 = y0 = x1 = y1 = 0;
+    } else {
+      uint32_t first = 0, last_word = words_per_row - 1;
+      while(cols[first] == 0) {
+        first++;
+      }
+      while(cols[last_word] == 0) {
+        last_word--;
+      }
+      x0 = first * 64 + chip8_recorder_first_bit(cols[first]);
+      x1 = last_word * 64 + chip8_recorder_last_bit(cols[last_word]);
+    }
+  }
+
+  //one byte per pixel, scaled up
+  const uint32_t s = r->scale;
+  const uint32_t w = (x1 - x0 + 1) * s;
+  const uint32_t h = (y1 - y0 + 1) * s;
+  uint8_t *out = worker->pixels;
+
+  for(uint32_t y = y0; y <= y1; y++) {
+    const uint64_t *row = &r->pending[y * words_per_row];
+    uint8_t *first_row = out;
+
+    for(uint32_t x = x0; x <= x1; x++) {
+      const uint8_t bit = (row[x / 64] >> (63 - x % 64)) & 1;
+      for(uint32_t i = 0; i < s; i++) {
+        *out++ = bit;
+      }
+    }
+    for(uint32_t i = 1; i < s; i++, out += w) {
+      memcpy(out, first_row, w);
+    }
+  }
+
+  if(r->format == CHIP8_RECORDER_GIF) {
+    chip8_recorder_gif_frame(worker, r, x0 * s, y0 * s, w, h, delay);
+  } else {
+    chip8_recorder_apng_frame(worker, r, x0 * s, y0 * s, w, h, delay);
+  }
+
+  memcpy(r->canvas, r->pending, sizeof(r->canvas));
+  r->written_frame = end_frame;
+  r->num_written++;
+  return 1;
+}
+
+static void chip8_recorder_add(struct chip8_recorder_worker *worker, struct chip8_recording *r, uint64_t frame, const uint64_t *fb) {
+  const size_t size = (size_t)r->width * r->height / 8;
+
+  if(!r->has_pending) {
+    memcpy(r->pending, fb, size);
+    r->written_frame = frame;
+    r->has_pending = 1;
+    return;
+  }
+
+  //the same as the frame before, which is just shown for longer
+  if(memcmp(r->pending, fb, size) == 0) {
+    return;
+  }
+
+  //a frame that is too short is replaced by the next one, which takes its place in time
+  chip8_recorder_write_pending(worker, r, frame, 0);
+  memcpy(r->pending, fb, size);
+}
+
+static void chip8_recorder_finish(struct chip8_recorder_worker *worker, struct chip8_recording *r) {
+  //a recording without any frames still gets one
+  if(!r->has_pending) {
+    r->has_pending = 1;
+    r->written_frame = 0;
+  }
+
+  chip8_recorder_write_pending(worker, r, r->end_frame > r->written_frame ? r->end_frame : r->written_frame + 1, 1);
+
+  if(r->format == CHIP8_RECORDER_GIF) {
+    fputc(0x3B, r->file);
+  } else {
+    chip8_recorder_png_chunk(r->file, "IEND", NULL, 0);
+
+    //now that the number of frames is known
+    if(fseek(r->file, r->actl_offset, SEEK_SET) == 0) {
+      chip8_recorder_apng_actl(r);
+    } else {
+      r->failed = 1;
+    }
+  }
+
+  if(ferror(r->file)) {
+    r->failed = 1;
+  }
+  if(fclose(r->file) != 0) {
+    r->failed = 1;
+  }
+  r->file = NULL;
+  r->done = 1;
+}
+
+// Encode every frame waiting in the queue of a recording. Returns 1 if there were any.
+static int chip8_recorder_drain(struct chip8_recorder_worker *worker, struct chip8_recording *r) {
+  //check closed first, so every frame added before closing is already in the queue
+  const uint8_t closed = atomic_load_explicit(&r->closed, memory_order_acquire);
+  const uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  const size_t num_words = (size_t)r->width * r->height / 64;
+
+  if(head == tail && !closed) {
+    return 0;
+  }
+
+  const uint8_t had_frames = head != tail;
+  for(; head != tail; head++) {
+    const uint64_t *entry = &r->queue[(size_t)(head & (r->queue_size - 1)) * (num_words + 1)];
+    chip8_recorder_add(worker, r, entry[0], entry + 1);
+
+    //hand the slot back right away
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+  }
+
+  //resume the VM if it was parked because its queue was full. Pairs with the fence in chip8_recording_park().
+  if(had_frames) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&r->parked, memory_order_relaxed) && atomic_exchange(&r->parked, 0)) {
+      r->wake(r->wake_ctx, r->wake_id);
+    }
+  }
+
+  if(closed) {
+    chip8_recorder_finish(worker, r);
+  }
+  return 1;
+}
+
+// Returns 1 if an encoder has something to do: frames or a closed recording waiting, or the recorder is stopping.
+// Called with the lock held.
+static int chip8_recorder_has_work(const struct chip8_recorder_worker *worker) {
+  const struct chip8_recorder *rec = worker->recorder;
+  if(atomic_load(&rec->stop)) {
+    return 1;
+  }
+
+  for(uint32_t i = worker->index; i < rec->num_recordings; i += rec->num_workers) {
+    const struct chip8_recording *r = rec->recordings[i];
+    if(!r->done && (atomic_load_explicit(&r->closed, memory_order_acquire) ||
+       atomic_load_explicit(&r->tail, memory_order_acquire) != atomic_load_explicit(&r->head, memory_order_relaxed))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Wait until a frame is added, a recording is closed, or the recorder stops.
+static void chip8_recorder_sleep(struct chip8_recorder_worker *worker) {
+  struct chip8_recorder *rec = worker->recorder;
+
+  chip8_mutex_lock(&rec->lock);
+  atomic_fetch_add(&rec->num_sleeping, 1);
+  //pairs with the fence in chip8_recorder_notify()
+  atomic_thread_fence(memory_order_seq_cst);
+  if(!chip8_recorder_has_work(worker)) {
+    chip8_cond_wait(&rec->work, &rec->lock);
+  }
+  atomic_fetch_sub(&rec->num_sleeping, 1);
+  chip8_mutex_unlock(&rec->lock);
+}
+
+void chip8_recorder_wake(struct chip8_recorder *rec) {
+  chip8_mutex_lock(&rec->lock);
+  chip8_cond_broadcast(&rec->work);
+  chip8_mutex_unlock(&rec->lock);
+}
+
+static void chip8_recorder_thread(void *arg) {
+  struct chip8_recorder_worker *worker = arg;
+  struct chip8_recorder *rec = worker->recorder;
+
+  for(;;) {
+    const uint8_t stop = atomic_load(&rec->stop);
+    uint8_t busy = 0;
+    uint8_t left = 0;
+
+    chip8_mutex_lock(&rec->lock);
+    const uint32_t num_recordings = rec->num_recordings;
+    chip8_mutex_unlock(&rec->lock);
+
+    for(uint32_t i = worker->index; i < num_recordings; i += rec->num_workers) {
+      chip8_mutex_lock(&rec->lock);
+      struct chip8_recording *r = rec->recordings[i];
+      chip8_mutex_unlock(&rec->lock);
+
+      if(r->done) {
+        continue;
+      }
+
+      busy |= chip8_recorder_drain(worker, r);
+      left |= !r->done;
+    }
+
+    //only stop once every recording was closed and written
+    if(stop && !left) {
+      break;
+    }
+
+    if(!busy) {
+      chip8_recorder_sleep(worker);
+    }
+  }
+}
+
+// Start num_threads encoder threads. Returns 0 if they could not be started.
+int chip8_recorder_init(struct chip8_recorder *rec, uint32_t num_threads) {
+  chip8_recorder_init_crc_table();
+
+  rec->recordings = NULL;
+  rec->num_recordings = 0;
+  rec->capacity = 0;
+  rec->num_workers = 0;
+  atomic_init(&rec->stop, 0);
+  atomic_init(&rec->num_sleeping, 0);
+
+  rec->workers = calloc(num_threads, sizeof(struct chip8_recorder_worker));
+  if(rec->workers == NULL) {
+    return 0;
+  }
+  chip8_mutex_init(&rec->lock);
+  chip8_cond_init(&rec->work);
+
+  //workers only look at num_workers once they see a recording, and the lock makes sure it is set by then
+  chip8_mutex_lock(&rec->lock);
+  for(uint32_t i = 0; i < num_threads; i++) {
+    struct chip8_recorder_worker *worker = &rec->workers[i];
+    worker->recorder = rec;
+    worker->index = i;
+
+    if(!chip8_thread_create(&worker->thread, chip8_recorder_thread, worker)) {
+      break;
+    }
+    rec->num_workers++;
+  }
+  chip8_mutex_unlock(&rec->lock);
+
+  if(rec->num_workers != num_threads) {
+    chip8_recorder_destroy(rec);
+    return 0;
+  }
+  return 1;
+}
+
+// Wait until every recording was closed and written, then stop the encoder threads and free everything.
+// Returns 1 if every recording was written without errors.
+int chip8_recorder_destroy(struct chip8_recorder *rec) {
+  int ok = 1;
+
+  atomic_store(&rec->stop, 1);
+  chip8_recorder_wake(rec);
+  for(uint32_t i = 0; i < rec->num_workers; i++) {
+    chip8_thread_join(rec->workers[i].thread);
+  }
+
+  for(uint32_t i = 0; i < rec->num_recordings; i++) {
+    struct chip8_recording *r = rec->recordings[i];
+    ok &= !r->failed;
+    if(r->file != NULL) {
+      fclose(r->file);
+    }
+    free(r->queue);
+    aligned_free(r);
+  }
+
+  free(rec->recordings);
+  free(rec->workers);
+  chip8_mutex_destroy(&rec->lock);
+  chip8_cond_destroy(&rec->work);
+  rec->recordings = NULL;
+  rec->workers = NULL;
+  rec->num_recordings = 0;
+  rec->num_workers = 0;
+  return ok;
+}
+
+// Pick the format from the extension of path: .png and .apng are APNG, everything else is GIF.
+enum chip8_recorder_format chip8_recorder_format_from_path(const char *path) {
+  const char *dot = strrchr(path, '.');
+  if(dot != NULL && (strcmp(dot, ".png") == 0 || strcmp(dot, ".apng") == 0)) {
+    return CHIP8_RECORDER_APNG;
+  }
+  return CHIP8_RECORDER_GIF;
+}
+
+// Start recording a display of width x height pixels (width is a multiple of 64) to path. Every
+// pixel becomes scale x scale pixels in the recording, with the colors on and off (0x00RRGGBB).
+// queue_size (a power of 2) is how many changed frames can wait for the encoder before frames
+// are dropped. Returns NULL if the file could not be created.
+struct chip8_recording *chip8_recorder_open(struct chip8_recorder *rec, const char *path, enum chip8_recorder_format format,
+  uint16_t width, uint16_t height, uint8_t scale, uint32_t on, uint32_t off, uint32_t queue_size) {
+
+  if(scale < 1 || scale > CHIP8_RECORDER_MAX_SCALE || (queue_size & (queue_size - 1)) != 0 || queue_size == 0) {
+    return NULL;
+  }
+
+  struct chip8_recording *r = aligned_malloc(CHIP8_CACHE_LINE, sizeof(struct chip8_recording));
+  if(r == NULL) {
+    return NULL;
+  }
+  memset(r, 0, sizeof(*r));
+
+  r->queue = malloc((size_t)queue_size * ((size_t)width * height / 64 + 1) * sizeof(uint64_t));
+  r->file = fopen(path, "wb");
+  if(r->queue == NULL || r->file == NULL) {
+    goto fail;
+  }
+
+  atomic_init(&r->tail, 0);
+  atomic_init(&r->head, 0);
+  atomic_init(&r->closed, 0);
+  atomic_init(&r->parked, 0);
+  r->recorder = rec;
+  r->queue_size = queue_size;
+  r->force = 1;
+  r->format = format;
+  r->width = width;
+  r->height = height;
+  r->scale = scale;
+  r->palette[0] = off;
+  r->palette[1] = on;
+
+  if(format == CHIP8_RECORDER_GIF) {
+    chip8_recorder_gif_header(r);
+  } else {
+    chip8_recorder_apng_header(r);
+  }
+
+  chip8_mutex_lock(&rec->lock);
+  if(rec->num_recordings == rec->capacity) {
+    uint32_t capacity = rec->capacity == 0 ? 16 : rec->capacity * 2;
+    struct chip8_recording **recordings = realloc(rec->recordings, capacity * sizeof(*recordings));
+    if(recordings == NULL) {
+      chip8_mutex_unlock(&rec->lock);
+      goto fail;
+    }
+    rec->recordings = recordings;
+    rec->capacity = capacity;
+  }
+  rec->recordings[rec->num_recordings++] = r;
+  chip8_mutex_unlock(&rec->lock);
+  return r;
+
+fail:
+  if(r->file != NULL) {
+    fclose(r->file);
+    remove(path);
+  }
+  free(r->queue);
+  aligned_free(r);
+  return NULL;
+}
+
+// Called by the VM's thread once it added its last frame. The encoder finishes the file
+// on its own, and the recording must not be used anymore.
+void chip8_recording_close(struct chip8_recording *r) {
+  struct chip8_recorder *rec = r->recorder;
+  r->end_frame = r->frame;
+  atomic_store_explicit(&r->closed, 1, memory_order_release);
+  chip8_recorder_notify(rec);
+}
+
+// Called by the VM's thread when the queue is full, instead of waiting for the encoder. Returns 1
+// if the encoder will call wake(ctx, id) once it made room, and the VM's thread should run
+// something else until then. Returns 0 if there is room already, and the VM can go on.
+int chip8_recording_park(struct chip8_recording *r, void (*wake)(void *ctx, uint32_t id), void *ctx, uint32_t id) {
+  r->wake = wake;
+  r->wake_ctx = ctx;
+  r->wake_id = id;
+  atomic_store(&r->parked, 1);
+
+  //pairs with the fence in chip8_recorder_drain(): either the encoder sees parked, or this sees the room it made
+  atomic_thread_fence(memory_order_seq_cst);
+  if(chip8_recording_space(r) == 0) {
+    return 1;
+  }
+
+  //the encoder made room in the meantime. If it also saw parked, it resumes the VM itself.
+  return !atomic_exchange(&r->parked, 0);
+}
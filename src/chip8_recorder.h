@@ -0,0 +1,193 @@
+#ifndef CHIP8_RECORDER_H
+#define CHIP8_RECORDER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include "chip8_thread.h"
+
+#include "chip8_core.h"
+
+// Records what a VM shows as an animated GIF or APNG, without any external library.
+//
+// The thread running the VM calls chip8_recording_add_frame() once per emulated frame. That only
+// copies the framebuffer into a queue when it changed, and never waits: if the queue is full, the
+// frame is dropped, and the next one that fits shows up a little later in the recording. Threads
+// that would rather not drop frames park the VM with chip8_recording_park() and run something else
+// until the encoder made room.
+//
+// Encoder threads empty the queues. Consecutive frames that look the same become a single frame
+// that is shown for longer, and every frame after the first only stores the rectangle that changed.
+// GIF frames are compressed with LZW, and APNG frames with deflate (fixed Huffman codes, with runs
+// of the same byte as matches). Both use a palette of 2 colors, 1 bit per pixel.
+//
+// One recorder (a set of encoder threads) can encode many recordings at once, for example one
+// for every job of ryce8-batch.
+
+enum chip8_recorder_format {
+  CHIP8_RECORDER_GIF,
+  CHIP8_RECORDER_APNG,
+};
+
+//frames the VM runs per second, which is what delays in the recording are counted in
+#define CHIP8_RECORDER_FPS 60
+
+#define CHIP8_RECORDER_MAX_SCALE 8
+#define CHIP8_RECORDER_DEFAULT_SCALE 4
+
+//largest framebuffer (SUPER-CHIP, 128x64)
+#define CHIP8_RECORDER_MAX_WORDS 128
+
+#define CHIP8_RECORDER_DEFAULT_QUEUE_SIZE 256
+
+struct chip8_recording {
+  //the queue. Each entry is the number of the frame, followed by the framebuffer.
+  //tail is only written by the VM's thread, head only by the encoder.
+  _Alignas(CHIP8_CACHE_LINE) _Atomic uint32_t tail;
+  _Alignas(CHIP8_CACHE_LINE) _Atomic uint32_t head;
+
+  //set by chip8_recorder_open(), and never changed after that
+  struct chip8_recorder *recorder;
+  uint64_t *queue;
+  uint32_t queue_size; //a power of 2
+  enum chip8_recorder_format format;
+  uint16_t width;
+  uint16_t height;
+  uint8_t scale;
+  uint32_t palette[2];
+
+  //only used by the VM's thread
+  _Alignas(CHIP8_CACHE_LINE) uint64_t frame;
+  uint64_t seen_generation;
+  uint8_t force; //add the next frame even if the generation did not change
+  uint64_t dropped;
+
+  //set by chip8_recording_park(). Whoever clears parked first (the VM's thread or the encoder) resumes the VM.
+  void (*wake)(void *ctx, uint32_t id);
+  void *wake_ctx;
+  uint32_t wake_id;
+  _Atomic uint8_t parked;
+
+  //set once the VM's thread is done. end_frame is how many frames were recorded in total.
+  uint64_t end_frame;
+  _Atomic uint8_t closed;
+
+  //only used by the encoder
+  _Alignas(CHIP8_CACHE_LINE) FILE *file;
+  uint8_t failed;
+  uint8_t done;
+
+  //the frame that was read last, which is written once it is known how long it is shown for
+  uint64_t pending[CHIP8_RECORDER_MAX_WORDS];
+  uint8_t has_pending;
+
+  //what the frames written so far add up to, how many were written, and the frame they reach up to
+  uint64_t canvas[CHIP8_RECORDER_MAX_WORDS];
+  uint64_t written_frame;
+  uint32_t num_written;
+
+  //APNG only: sequence number of the next chunk, and where the frame count has to be filled in
+  uint32_t sequence;
+  long actl_offset;
+};
+
+// Scratch space of an encoder thread.
+struct chip8_recorder_worker {
+  struct chip8_recorder *recorder;
+  uint32_t index;
+  chip8_thread thread;
+
+  //GIF only: the LZW codes. Every entry is (prefix code << 8 | next pixel) << 12 | code, or 0 if it is empty.
+  uint32_t lzw_table[8192];
+
+  //one byte per pixel of the part of the frame that is encoded (0 or 1)
+  uint8_t pixels[128 * CHIP8_RECORDER_MAX_SCALE * 64 * CHIP8_RECORDER_MAX_SCALE];
+
+  //APNG only: filtered rows, and the compressed data
+  uint8_t rows[(128 * CHIP8_RECORDER_MAX_SCALE / 8 + 1) * 64 * CHIP8_RECORDER_MAX_SCALE];
+  uint8_t compressed[(128 * CHIP8_RECORDER_MAX_SCALE / 8 + 1) * 64 * CHIP8_RECORDER_MAX_SCALE * 2];
+};
+
+struct chip8_recorder {
+  //encoder thread i looks after the recordings r where r % num_workers == i
+  struct chip8_recorder_worker *workers;
+  uint32_t num_workers;
+
+  chip8_mutex lock;
+
+  //encoders that have nothing to do wait on this. It is only broadcast (with lock held) when
+  //num_sleeping says that an encoder waits, so adding a frame does not take the lock otherwise.
+  chip8_cond work;
+  _Atomic uint32_t num_sleeping;
+
+  struct chip8_recording **recordings;
+  uint32_t num_recordings;
+  uint32_t capacity;
+
+  _Atomic uint8_t stop;
+};
+
+int chip8_recorder_init(struct chip8_recorder *rec, uint32_t num_threads);
+int chip8_recorder_destroy(struct chip8_recorder *rec);
+
+struct chip8_recording *chip8_recorder_open(struct chip8_recorder *rec, const char *path, enum chip8_recorder_format format,
+  uint16_t width, uint16_t height, uint8_t scale, uint32_t on, uint32_t off, uint32_t queue_size);
+void chip8_recording_close(struct chip8_recording *r);
+int chip8_recording_park(struct chip8_recording *r, void (*wake)(void *ctx, uint32_t id), void *ctx, uint32_t id);
+void chip8_recorder_wake(struct chip8_recorder *rec);
+enum chip8_recorder_format chip8_recorder_format_from_path(const char *path);
+
+// Number of frames that can still be added without any being dropped.
+static inline uint32_t chip8_recording_space(const struct chip8_recording *r) {
+  const uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  const uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  return r->queue_size - (tail - head);
+}
+
+// Wake up the encoders if any of them ran out of work. Called after a frame was added or a recording was closed.
+static inline void chip8_recorder_notify(struct chip8_recorder *rec) {
+  //pairs with the fence in chip8_recorder_sleep(): either the encoder sees the new frame, or this sees it sleeping
+  atomic_thread_fence(memory_order_seq_cst);
+  if(atomic_load_explicit(&rec->num_sleeping, memory_order_relaxed) != 0) {
+    chip8_recorder_wake(rec);
+  }
+}
+
+// Make the next chip8_recording_add_frame() add its frame, for example after the VM was replaced
+// by a save state, whose fb_generation has nothing to do with the one before.
+static inline void chip8_recording_force_frame(struct chip8_recording *r) {
+  r->force = 1;
+}
+
+// Called by the VM's thread after every emulated frame. Never waits for the encoder: if the queue
+// is full, the frame is dropped. Callers that would rather not drop frames check chip8_recording_space()
+// first, and park the VM with chip8_recording_park() if there is none.
+static inline void chip8_recording_add_frame(struct chip8_recording *r, const struct chip8_core *core) {
+  const uint64_t frame = r->frame++;
+
+  if(!r->force && core->fb_generation == r->seen_generation) {
+    return;
+  }
+
+  const uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  const uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  if(tail - head == r->queue_size) {
+    //try again next frame
+    r->dropped++;
+    return;
+  }
+
+  const size_t num_words = (size_t)r->width * r->height / 64;
+  uint64_t *entry = &r->queue[(size_t)(tail & (r->queue_size - 1)) * (num_words + 1)];
+  entry[0] = frame;
+  for(size_t i = 0; i < num_words; i++) {
+    entry[i + 1] = core->fb[i];
+  }
+
+  r->seen_generation = core->fb_generation;
+  r->force = 0;
+  atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+  chip8_recorder_notify(r->recorder);
+}
+
+#endif// CHIP8_RECORDER_H
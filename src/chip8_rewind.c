@@ -0,0 +1,319 @@
+#include "chip8_rewind.h"
+#include "chip8_state.h"
+#include "lz.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHIP8_REWIND_MIN_INTERVAL 1000
+#define CHIP8_REWIND_MAX_INTERVAL 1000000
+
+static uint64_t chip8_rewind_now_nanos(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void chip8_rewind_set_interval(struct chip8_rewind *rw) {
+  uint64_t interval = rw->ins_per_milli * CHIP8_REWIND_TARGET_MILLIS;
+  if(interval < CHIP8_REWIND_MIN_INTERVAL) interval = CHIP8_REWIND_MIN_INTERVAL;
+  if(interval > CHIP8_REWIND_MAX_INTERVAL) interval = CHIP8_REWIND_MAX_INTERVAL;
+  rw->interval = interval;
+}
+
+// Update the measured replay speed after replaying num_ins instructions in (nanos) nanoseconds.
+static void chip8_rewind_measure(struct chip8_rewind *rw, uint64_t num_ins, uint64_t nanos) {
+  //short replays are mostly overhead, and don't say much about the replay speed
+  if(num_ins < CHIP8_REWIND_MIN_INTERVAL) {
+    return;
+  }
+
+  uint64_t speed = num_ins * 1000000 / (nanos ? nanos : 1);
+
+  //smooth out the measurements, so that a single slow replay does not cause a big jump
+  rw->ins_per_milli = rw->ins_per_milli ? (3 * rw->ins_per_milli + speed) / 4 : speed;
+  chip8_rewind_set_interval(rw);
+}
+
+// When there is no room for more checkpoints, every other checkpoint in the older half
+// is thrown away. Recent history stays dense while older history gets sparser, so the
+// memory used stays fixed no matter how long the session is.
+static void chip8_rewind_thin_checkpoints(struct chip8_rewind *rw) {
+  uint32_t half = rw->num_checkpoints / 2;
+  uint32_t kept = 0;
+
+  for(uint32_t i = 0; i < rw->num_checkpoints; i++) {
+    //always keep the oldest checkpoint, since nothing before it can be rebuilt.
+    if(i < half && (i % 2) == 1) {
+      free(rw->checkpoints[i].data);
+      continue;
+    }
+    rw->checkpoints[kept++] = rw->checkpoints[i];
+  }
+
+  rw->num_checkpoints = kept;
+}
+
+static int chip8_rewind_checkpoint(struct chip8_rewind *rw, const struct chip8 *vm) {
+  uint8_t state[CHIP8_STATE_MAX_SIZE];
+  size_t len = chip8_state_save(vm, state, sizeof(state));
+  if(len == 0) {
+    return 0;
+  }
+
+  size_t cap = lz_compress_bound(len);
+  uint8_t *data = malloc(cap);
+  if(data == NULL) {
+    return 0;
+  }
+
+  size_t compressed_len = lz_compress(state, len, data, cap);
+
+  //give back the memory we didn't need
+  uint8_t *shrunk = realloc(data, compressed_len);
+  if(shrunk != NULL) {
+    data = shrunk;
+  }
+
+  if(rw->num_checkpoints == CHIP8_REWIND_MAX_CHECKPOINTS) {
+    chip8_rewind_thin_checkpoints(rw);
+  }
+
+  struct chip8_rewind_checkpoint *cp = &rw->checkpoints[rw->num_checkpoints++];
+  cp->ins = rw->ins;
+  cp->data = data;
+  cp->len = compressed_len;
+
+  rw->next_checkpoint = rw->ins + rw->interval;
+  return 1;
+}
+
+static int chip8_rewind_restore(const struct chip8_rewind_checkpoint *cp, struct chip8 *vm) {
+  uint8_t state[CHIP8_STATE_MAX_SIZE];
+  size_t len;
+
+  if(!lz_decompress(cp->data, cp->len, state, sizeof(state), &len)) {
+    return 0;
+  }
+  return chip8_state_load(vm, state, len);
+}
+
+static int chip8_rewind_log(struct chip8_rewind *rw, enum chip8_rewind_event_type type, uint64_t value) {
+  if(rw->num_events == rw->events_capacity) {
+    size_t capacity = rw->events_capacity ? 2 * rw->events_capacity : 1024;
+    struct chip8_rewind_event *events = realloc(rw->events, capacity * sizeof(*events));
+    if(events == NULL) {
+      return 0;
+    }
+    rw->events = events;
+    rw->events_capacity = capacity;
+  }
+
+  struct chip8_rewind_event *e = &rw->events[rw->num_events++];
+  e->ins = rw->ins;
+  e->type = type;
+  e->value = value;
+  return 1;
+}
+
+static void chip8_rewind_apply(const struct chip8_rewind_event *e, struct chip8 *vm) {
+  switch(e->type) {
+    case CHIP8_REWIND_EVENT_KEY_DOWN: chip8_set_key(&vm->core, e->value); break;
+    case CHIP8_REWIND_EVENT_KEY_UP: chip8_remove_key(&vm->core, e->value); break;
+    case CHIP8_REWIND_EVENT_TICK: chip8_tick_timers(&vm->core); break;
+  }
+}
+
+// Start recording vm. vm must already be reset.
+int chip8_rewind_init(struct chip8_rewind *rw, struct chip8 *vm) {
+  rw->ins = 0;
+  rw->events = NULL;
+  rw->num_events = 0;
+  rw->events_capacity = 0;
+  rw->num_checkpoints = 0;
+  rw->ins_per_milli = 0;
+  rw->interval = 10 * CHIP8_REWIND_MIN_INTERVAL;
+
+  return chip8_rewind_checkpoint(rw, vm);
+}
+
+void chip8_rewind_free(struct chip8_rewind *rw) {
+  for(uint32_t i = 0; i < rw->num_checkpoints; i++) {
+    free(rw->checkpoints[i].data);
+  }
+  free(rw->events);
+
+  rw->num_checkpoints = 0;
+  rw->events = NULL;
+  rw->num_events = 0;
+  rw->events_capacity = 0;
+}
+
+int chip8_rewind_process_instruction(struct chip8_rewind *rw, struct chip8 *vm) {
+  if(!chip8_wrapper_process_instruction(vm)) {
+    return 0;
+  }
+
+  rw->ins++;
+
+  //checkpoints are taken right after an instruction, before any of the events that
+  //happen before the next instruction.
+  if(rw->ins >= rw->next_checkpoint) {
+    //if we run out of memory, keep running without the checkpoint.
+    chip8_rewind_checkpoint(rw, vm);
+  }
+
+  return 1;
+}
+
+void chip8_rewind_set_key(struct chip8_rewind *rw, struct chip8 *vm, enum chip8_key key) {
+  chip8_rewind_log(rw, CHIP8_REWIND_EVENT_KEY_DOWN, key);
+  chip8_set_key(&vm->core, key);
+}
+
+void chip8_rewind_remove_key(struct chip8_rewind *rw, struct chip8 *vm, enum chip8_key key) {
+  chip8_rewind_log(rw, CHIP8_REWIND_EVENT_KEY_UP, key);
+  chip8_remove_key(&vm->core, key);
+}
+
+// Tick the timers once, at the end of an emulated frame (like chip8_wrapper_run_frame()).
+void chip8_rewind_tick_timers(struct chip8_rewind *rw, struct chip8 *vm) {
+  chip8_rewind_log(rw, CHIP8_REWIND_EVENT_TICK, 0);
+  chip8_tick_timers(&vm->core);
+}
+
+// Index of the newest checkpoint taken at or before instruction (ins).
+static uint32_t chip8_rewind_find_checkpoint(const struct chip8_rewind *rw, uint64_t ins) {
+  uint32_t lo = 0, hi = rw->num_checkpoints;
+  while(hi - lo > 1) {
+    uint32_t mid = (lo + hi) / 2;
+    if(rw->checkpoints[mid].ins <= ins) lo = mid;
+    else                                hi = mid;
+  }
+  return lo;
+}
+
+// Index of the first event that happened after (ins) instructions.
+static size_t chip8_rewind_find_event(const struct chip8_rewind *rw, uint64_t ins) {
+  size_t lo = 0, hi = rw->num_events;
+  while(lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if(rw->events[mid].ins < ins) lo = mid + 1;
+    else                          hi = mid;
+  }
+  return lo;
+}
+
+// Rebuild the state of the VM after (target) instructions by loading the checkpoint cp
+// and executing forward. Events that happened after exactly (target) instructions are applied as well.
+// If last_write is not NULL, it is set to the number of instructions executed before the last
+// instruction that wrote to vm->core.watch_addr (or UINT64_MAX if there was no write).
+static int chip8_rewind_replay(struct chip8_rewind *rw, struct chip8 *vm, uint32_t cp, uint64_t target, uint64_t *last_write) {
+  uint32_t watch_addr = vm->core.watch_addr;
+  uint64_t start = chip8_rewind_now_nanos();
+
+  if(!chip8_rewind_restore(&rw->checkpoints[cp], vm)) {
+    return 0;
+  }
+
+  uint64_t ins = rw->checkpoints[cp].ins;
+  size_t e = chip8_rewind_find_event(rw, ins);
+
+  vm->core.watch_addr = watch_addr;
+  if(last_write != NULL) *last_write = UINT64_MAX;
+
+  while(1) {
+    while(e < rw->num_events && rw->events[e].ins == ins) {
+      chip8_rewind_apply(&rw->events[e], vm);
+      e++;
+    }
+
+    if(ins >= target) break;
+
+    vm->core.watch_hit = 0;
+
+    if(!chip8_wrapper_process_instruction(vm)) {
+      return 0;
+    }
+
+    if(vm->core.watch_hit && last_write != NULL) {
+      *last_write = ins;
+    }
+    ins++;
+  }
+
+  chip8_rewind_measure(rw, target - rw->checkpoints[cp].ins, chip8_rewind_now_nanos() - start);
+  return 1;
+}
+
+// Forget everything that happened after (ins) instructions, since the recording 
+// continues from there.
+static void chip8_rewind_truncate(struct chip8_rewind *rw, uint64_t ins) {
+  while(rw->num_checkpoints > 1 && rw->checkpoints[rw->num_checkpoints - 1].ins > ins) {
+    free(rw->checkpoints[--rw->num_checkpoints].data);
+  }
+  rw->num_events = chip8_rewind_find_event(rw, ins + 1);
+
+  rw->ins = ins;
+  rw->next_checkpoint = rw->checkpoints[rw->num_checkpoints - 1].ins + rw->interval;
+}
+
+// Step the VM back by n instructions. Returns the number of instructions that were actually 
+// stepped back, which is less than n if the recording does not go back far enough.
+uint64_t chip8_rewind_step_back(struct chip8_rewind *rw, struct chip8 *vm, uint64_t n) {
+  uint64_t oldest = rw->checkpoints[0].ins;
+  if(n > rw->ins - oldest) {
+    n = rw->ins - oldest;
+  }
+
+  uint64_t target = rw->ins - n;
+
+  uint32_t watch_addr = vm->core.watch_addr;
+  vm->core.watch_addr = CHIP8_NO_WATCH;
+
+  int ok = chip8_rewind_replay(rw, vm, chip8_rewind_find_checkpoint(rw, target), target, NULL);
+
+  vm->core.watch_addr = watch_addr;
+  if(!ok) {
+    return 0;
+  }
+
+  chip8_rewind_truncate(rw, target);
+  return n;
+}
+
+// Step the VM back to right before the last instruction that wrote to addr in RAM.
+// Returns 0 if no instruction in the recording wrote to addr, in which case the VM
+// is left unchanged.
+int chip8_rewind_to_last_write(struct chip8_rewind *rw, struct chip8 *vm, uint16_t addr) {
+  uint64_t now = rw->ins;
+  uint32_t watch_addr = vm->core.watch_addr;
+
+  vm->core.watch_addr = addr;
+
+  //search the time between each pair of checkpoints, starting with the most recent
+  uint64_t end = now;
+  uint64_t found = UINT64_MAX;
+
+  for(int64_t cp = chip8_rewind_find_checkpoint(rw, now); cp >= 0 && found == UINT64_MAX; cp--) {
+    if(!chip8_rewind_replay(rw, vm, cp, end, &found)) {
+      break;
+    }
+    end = rw->checkpoints[cp].ins;
+  }
+
+  vm->core.watch_addr = CHIP8_NO_WATCH;
+
+  //the VM has to be put back in the right state either way
+  uint64_t target = found != UINT64_MAX ? found : now;
+  int ok = chip8_rewind_replay(rw, vm, chip8_rewind_find_checkpoint(rw, target), target, NULL);
+
+  vm->core.watch_addr = watch_addr;
+
+  if(!ok || found == UINT64_MAX) {
+    return 0;
+  }
+
+  chip8_rewind_truncate(rw, target);
+  return 1;
+}
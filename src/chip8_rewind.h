@@ -0,0 +1,72 @@
+#ifndef CHIP8_REWIND_H
+#define CHIP8_REWIND_H
+
+#include "chip8.h"
+
+// Records a running VM so that it can be stepped backwards.
+//
+// Every few thousand instructions, a compressed checkpoint of the VM is stored in memory.
+// All inputs that reach the VM (key presses and timer ticks) are logged along with
+// the number of instructions that were executed before they happened. Since the VM is 
+// deterministic (see chip8_set_seed()), any earlier point in time can be rebuilt by 
+// loading the nearest checkpoint before it and executing forward with the logged inputs.
+//
+// While recording, ALL instructions and inputs must go through the chip8_rewind_* functions.
+
+//how long stepping back should take at most.
+#define CHIP8_REWIND_TARGET_MILLIS 2
+
+#define CHIP8_REWIND_MAX_CHECKPOINTS 512
+
+enum chip8_rewind_event_type {
+  CHIP8_REWIND_EVENT_KEY_DOWN,
+  CHIP8_REWIND_EVENT_KEY_UP,
+  CHIP8_REWIND_EVENT_TICK, //one 60Hz tick of the timers
+};
+
+// An input that happened after (ins) instructions were executed.
+struct chip8_rewind_event {
+  uint64_t ins;
+  uint64_t value; //the key, for key presses
+  enum chip8_rewind_event_type type;
+};
+
+struct chip8_rewind_checkpoint {
+  uint64_t ins; //number of instructions executed when the checkpoint was taken
+  uint8_t *data; //compressed save state
+  size_t len;
+};
+
+struct chip8_rewind {
+  //number of instructions executed since recording started
+  uint64_t ins;
+
+  struct chip8_rewind_event *events;
+  size_t num_events;
+  size_t events_capacity;
+
+  //sorted from oldest to newest
+  struct chip8_rewind_checkpoint checkpoints[CHIP8_REWIND_MAX_CHECKPOINTS];
+  uint32_t num_checkpoints;
+
+  //number of instructions between checkpoints. This is adjusted based on how fast 
+  //instructions can be replayed, so that stepping back always takes about CHIP8_REWIND_TARGET_MILLIS.
+  uint64_t interval;
+  uint64_t next_checkpoint;
+
+  //measured replay speed
+  uint64_t ins_per_milli;
+};
+
+int chip8_rewind_init(struct chip8_rewind *rw, struct chip8 *vm);
+void chip8_rewind_free(struct chip8_rewind *rw);
+
+int chip8_rewind_process_instruction(struct chip8_rewind *rw, struct chip8 *vm);
+void chip8_rewind_set_key(struct chip8_rewind *rw, struct chip8 *vm, enum chip8_key key);
+void chip8_rewind_remove_key(struct chip8_rewind *rw, struct chip8 *vm, enum chip8_key key);
+void chip8_rewind_tick_timers(struct chip8_rewind *rw, struct chip8 *vm);
+
+uint64_t chip8_rewind_step_back(struct chip8_rewind *rw, struct chip8 *vm, uint64_t n);
+int chip8_rewind_to_last_write(struct chip8_rewind *rw, struct chip8 *vm, uint16_t addr);
+
+#endif// CHIP8_REWIND_H
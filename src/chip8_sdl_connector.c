@@ -21,159 +21,26 @@
 #include "chip8_sdl_connector.h"
 #include "chip8_core.h"
 #include "schip8.h"
+#include "chip8_quirks.h"
 
 
-#define CHIP8_SDL_PIXEL_SIZE 2
 #define CHIP8_SDL_PIXELS_BETWEEN_DEBUG_CHARS 2
 
+//how long every quirk combination runs for when detecting quirks (10 emulated seconds)
+#define CHIP8_SDL_DETECT_QUIRKS_FRAMES 600
+#define CHIP8_SDL_DETECT_QUIRKS_INSTRUCTIONS_PER_FRAME 10
 
 
 
-void chip8_sdl_draw_vip_chip8(struct chip8_sdl_app_state *state, int start_x, int start_y) {
-  SDL_FRect rect;
 
-  //TODO: Add support for rendering 128x64 resolution
-
-  //define borders of the rectangle where our emulator renders pixels. Make sure
-  //that pixels stay within the frame by making the frame slightly larger than where the pixels are rendered.
-  rect.x = start_x - 1;
-  rect.y = start_y - 1;
-  rect.h = 2 + CHIP8_SDL_PIXEL_SIZE * CHIP8_HEIGHT;
-  rect.w = 2 + CHIP8_SDL_PIXEL_SIZE * CHIP8_WIDTH;
-
-
-  //render the frame holding our pixels
-  SDL_SetRenderDrawColor(state->renderer, 0, 0, 255, 255);
-
-
-  //SDL_RenderDrawRectF()
-  //Watch out, SDL3 changes many functions within SDL2, including SDL_RenderDrawRectF().
-  // Since most tutorials are in SDL2, make sure to double check the SDL3 docs when using
-  // an outdated tutorial.
-
-  //Note that the rectangle outline is 1 pixel thick
-  SDL_RenderRect(state->renderer, &rect);
-
-
-  rect.h = CHIP8_SDL_PIXEL_SIZE;
-  rect.w = CHIP8_SDL_PIXEL_SIZE;
-  rect.x = start_x;
-  rect.y = start_y;
-
-  //32 rows, 64 columns
-  for(uint8_t r = 0; r < CHIP8_HEIGHT; r++) {
-    uint64_t columns = state->chip.core.fb[r];
-
-    //we shift to right until the set bit is pushed out
-    for(uint64_t c = (uint64_t)1 << 63; c != 0; c >>= 1) {
-      //is on
-      if(columns & c) {
-        SDL_SetRenderDrawColor(state->renderer, 0, 255, 0, 255);
-      } else {
-        SDL_SetRenderDrawColor(state->renderer, 0, 0, 0, 255);
-      }
-
-
-      SDL_RenderFillRect(state->renderer, &rect);
-
-      rect.x += CHIP8_SDL_PIXEL_SIZE;
-
-    }
-
-    rect.x = start_x;
-    rect.y += CHIP8_SDL_PIXEL_SIZE;
-  }
-
-}
-
-void chip8_sdl_draw_schip8(struct chip8_sdl_app_state *state, int start_x, int start_y) {
-  SDL_FRect rect;
-
-  const uint8_t pixel_size = CHIP8_SDL_PIXEL_SIZE/2;
-
-  //define borders of the rectangle where our emulator renders pixels. Make sure
-  //that pixels stay within the frame by making the frame slightly larger than where the pixels are rendered.
-  rect.x = start_x - 1;
-  rect.y = start_y - 1;
-  rect.h = 2 + pixel_size * CHIP8_HEIGHT*2;
-  rect.w = 2 + pixel_size * CHIP8_WIDTH*2;
-
-
-  //render the frame holding our pixels
-  SDL_SetRenderDrawColor(state->renderer, 0, 0, 255, 255);
-
-
-  //SDL_RenderDrawRectF()
-  //Watch out, SDL3 changes many functions within SDL2, including SDL_RenderDrawRectF().
-  // Since most tutorials are in SDL2, make sure to double check the SDL3 docs when using
-  // an outdated tutorial.
-
-  //Note that the rectangle outline is 1 pixel thick
-  SDL_RenderRect(state->renderer, &rect);
-
-
-  rect.h = pixel_size;
-  rect.w = pixel_size;
-  rect.x = start_x;
-  rect.y = start_y;
-
-  //64 rows, 128 columns
-  for(uint8_t i = 0; i < 64; i++) {
-    uint64_t column_left = state->chip.vm.super.fb.x128_64[i].msb;
-    uint64_t column_right = state->chip.vm.super.fb.x128_64[i].lsb;
-
-    //we shift to right until the set bit is pushed out
-    for(uint64_t c = (uint64_t)1 << 63; c != 0; c >>= 1) {
-      //is on
-      if(column_left & c) {
-        SDL_SetRenderDrawColor(state->renderer, 0, 255, 0, 255);
-      } else {
-        SDL_SetRenderDrawColor(state->renderer, 0, 0, 0, 255);
-      }
-
-
-      SDL_RenderFillRect(state->renderer, &rect);
-
-      rect.x += pixel_size;
-
-    }
-
-    for(uint64_t c = (uint64_t)1 << 63; c != 0; c >>= 1) {
-      //is on
-      if(column_right & c) {
-        SDL_SetRenderDrawColor(state->renderer, 0, 255, 0, 255);
-      } else {
-        SDL_SetRenderDrawColor(state->renderer, 0, 0, 0, 255);
-      }
-
-
-      SDL_RenderFillRect(state->renderer, &rect);
-
-      rect.x += pixel_size;
-
-    }
-
-    rect.x = start_x;
-    rect.y += pixel_size;
-  }
-
-}
-
-void chip8_sdl_draw_chip8(struct chip8_sdl_app_state *state, int start_x, int start_y) {
-  switch(state->chip.emu) {
-    case CHIP8_VARIANT_VIP: chip8_sdl_draw_vip_chip8(state, start_x, start_y); break;
-    case CHIP8_VARIANT_SUPER: chip8_sdl_draw_schip8(state, start_x, start_y); break;
-    case CHIP8_VARIANT_XO: break;
-  }
-}
-
-void chip8_sdl_draw_debug_keys(struct chip8_sdl_app_state *state, int start_x, int start_y) {
+void chip8_sdl_draw_debug_keys(struct chip8_sdl_app_state *state, uint16_t held_keys, int start_x, int start_y) {
   const char keys[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
 
   int x = start_x;
   for(uint16_t i = 1, k = 0; k < 16; i <<= 1, k++) {
-    if(state->chip.core.keyboard_inputs & i) {
-      SDL_SetRenderDrawColor(state->renderer, 0, 255, 0, 255);
+    //held keys are drawn in the color of pixels that are on
+    if(held_keys & i) {
+      chip8_sdl_set_draw_color(state->renderer, state->screen.palette.colors[1]);
     } else {
       SDL_SetRenderDrawColor(state->renderer, 0, 0, 255, 255);
     }
@@ -217,6 +84,26 @@ int chip8_sdl_key_to_chip8_key(const SDL_KeyboardEvent *e, enum chip8_key *c8_ke
   }
 }
 
+// Handles the debugger keys and save state keys. Returns 0 if the key is not one of them.
+int chip8_sdl_debug_key(struct chip8_sdl_app_state *state, SDL_Scancode scancode) {
+  enum chip8_sdl_command_type type;
+
+  switch(scancode) {
+    case SDL_SCANCODE_F5: type = CHIP8_SDL_COMMAND_SAVE_STATE; break;
+    case SDL_SCANCODE_F9: type = CHIP8_SDL_COMMAND_LOAD_STATE; break;
+    case SDL_SCANCODE_F6: type = CHIP8_SDL_COMMAND_PAUSE; break;
+    case SDL_SCANCODE_F7: type = CHIP8_SDL_COMMAND_STEP_BACK; break;
+    case SDL_SCANCODE_F8: type = CHIP8_SDL_COMMAND_STEP_FORWARD; break;
+    case SDL_SCANCODE_F10: type = CHIP8_SDL_COMMAND_RUN_TO_LAST_WRITE; break;
+    default: return 0;
+  }
+
+  if(!chip8_sdl_emu_send(&state->emu, type, 0)) {
+    SDL_Log("The emulator is too busy, ignoring key");
+  }
+  return 1;
+}
+
 void chip8_sdl_add_more_audio(struct chip8_sdl_app_state *state) {
   static float samples[512];  /* this will feed 512 samples each frame until we get to our maximum. */
   int i;
@@ -246,13 +133,62 @@ void chip8_sdl_add_more_audio(struct chip8_sdl_app_state *state) {
   SDL_PutAudioStreamData(state->stream, samples, sizeof (samples));
 }
 
+// Pick the quirks the ROM runs best with, and print how every combination did.
+// The caller must free result.
+static int chip8_sdl_detect_quirks(struct chip8 *chip, struct chip8_quirks_result *result) {
+  struct chip8_thread_pool pool;
+  if(!chip8_thread_pool_init(&pool, SDL_GetNumLogicalCPUCores())) {
+    return 0;
+  }
+
+  int res = chip8_quirks_detect(chip, &pool, CHIP8_SDL_DETECT_QUIRKS_FRAMES, CHIP8_SDL_DETECT_QUIRKS_INSTRUCTIONS_PER_FRAME, result);
+  chip8_thread_pool_destroy(&pool);
+
+  if(!res) {
+    return 0;
+  }
+
+  for(uint32_t i = 0; i < result->num_candidates; i++) {
+    struct chip8_quirks_candidate *c = &result->candidates[i];
+    printf("quirks 0x%02X: %u frames%s, %u garbage screens\n", c->quirks, c->frames_run, c->crashed ? " (crashed)" : "", c->garbage_frames);
+  }
+  printf("Using quirks 0x%02X\n", result->quirks);
+
+  chip->core.quirks = result->quirks;
+  return 1;
+}
+
+// Show grid_cols x grid_rows copies of the ROM. If quirks were detected, the copies run every
+// combination that was tried, best first (row by row). Otherwise, they run with different seeds.
+static int chip8_sdl_init_grid(struct chip8_sdl_app_state *state, struct chip8_init *init, struct chip8_quirks_result *detected) {
+  uint16_t *quirks = NULL;
+
+  if(detected->num_candidates != 0) {
+    quirks = malloc(detected->num_candidates * sizeof(*quirks));
+    if(quirks == NULL) {
+      return 0;
+    }
+
+    for(uint32_t i = 0; i < detected->num_candidates; i++) {
+      quirks[i] = detected->candidates[i].quirks;
+    }
+  }
+
+  int res = chip8_sdl_grid_init(&state->grid, state->renderer, state->chip, init->grid_cols, init->grid_rows, quirks, detected->num_candidates,
+    init->colors);
+  free(quirks);
+
+  if(res) {
+    state->show_grid = 1;
+    printf("Showing %ux%u copies of the ROM\n", init->grid_cols, init->grid_rows);
+  }
+  return res;
+}
+
 /* This function runs once at startup. */
 int chip8_sdl_app_init(void **appstate, struct chip8_init *init, SDL_Window *window, SDL_Renderer *renderer, SDL_AudioStream *stream) {
   //https://wiki.libsdl.org/SDL3/SDL_AppInit
 
-  //set seed for RNG
-  srand(time(NULL));
-
   //to avoid making this global, we will declare a local static variable.
   //Static variables are more efficient than heap-allocating, and since we only
   //need a single instance of chip8_sdl_app_state, we will safely give its pointer to SDL.
@@ -260,7 +196,14 @@ int chip8_sdl_app_init(void **appstate, struct chip8_init *init, SDL_Window *win
   static struct chip8_sdl_app_state state;
 
 
-  chip8_wrapper_init(&state.chip, init->type);
+  state.chip = chip8_create(init->type);
+  if(state.chip == NULL) {
+    printf("Error, Failed to allocate memory for the emulator!\n");
+    return 0;
+  }
+
+  //unless the user asked for a specific seed, every run gets a different random sequence.
+  chip8_wrapper_set_seed(state.chip, init->has_seed ? init->seed : (uint64_t) time(NULL));
 
   FILE *f = fopen(init->rom_file, "r");
   if(f == NULL) {
@@ -269,22 +212,92 @@ int chip8_sdl_app_init(void **appstate, struct chip8_init *init, SDL_Window *win
   }
 
 
-  if(!chip8_wrapper_reset(&state.chip, f)) {
+  if(!chip8_wrapper_reset(state.chip, f)) {
     fclose(f);
     printf("Error, Failed to load ROM!\n");
     return 0;
   }
   fclose(f);
 
+  struct chip8_quirks_result detected = {0};
+  if(init->detect_quirks && !chip8_sdl_detect_quirks(state.chip, &detected)) {
+    printf("Error, Failed to detect quirks!\n");
+    return 0;
+  }
 
-
-  //make sure to run SDL_GetTicks AFTER everything is initialized. This prevents
-  //the Chip8's timers from running until after everything else is loaded.
-  state.last_frame_elapsed_millis = SDL_GetTicks();
   state.renderer = renderer;
   state.window = window;
   state.stream = stream;
 
+  if(init->grid_cols != 0) {
+    int res = chip8_sdl_init_grid(&state, init, &detected);
+    chip8_quirks_result_free(&detected);
+
+    if(!res) {
+      printf("Error, Failed to set up the grid!\n");
+      return 0;
+    }
+  } else {
+    chip8_quirks_result_free(&detected);
+
+    if(!chip8_sdl_screen_init(&state.screen, renderer, state.chip, init->filter, init->colors)) {
+      printf("Error, Failed to set up the display!\n");
+      return 0;
+    }
+  }
+  state.paused = 0;
+  state.low_power = init->low_power;
+  state.redraw = 1;
+
+
+
+  //the emulation thread runs on its own clock, so waiting for vsync never slows the game down.
+  //Without vsync, presents are spaced out to the refresh rate the display claims to have.
+  const int vsync = SDL_SetRenderVSync(renderer, 1);
+  uint64_t refresh_nanos = 0;
+  const SDL_DisplayMode *mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(window));
+  if(mode != NULL && mode->refresh_rate_numerator != 0) {
+    refresh_nanos = SDL_NS_PER_SECOND * mode->refresh_rate_denominator / mode->refresh_rate_numerator;
+  }
+
+  //make sure to start the clock AFTER everything is initialized. This prevents
+  //the grid from having to catch up on the time it took to load.
+  chip8_pacer_init(&state.pacer, SDL_GetTicksNS(), refresh_nanos, vsync);
+  state.next_frame_nanos = SDL_GetTicksNS();
+
+  if(!state.show_grid) {
+    char state_file[FILENAME_MAX];
+    snprintf(state_file, sizeof(state_file), "%s.state", init->rom_file);
+
+    struct chip8_recording *recording = NULL;
+    if(init->record_file != NULL) {
+      if(!chip8_recorder_init(&state.recorder, 1)) {
+        printf("Error, Failed to start recording!\n");
+        return 0;
+      }
+      state.recording = 1;
+
+      recording = chip8_recorder_open(&state.recorder, init->record_file, chip8_recorder_format_from_path(init->record_file),
+        chip8_fb_width(state.chip), chip8_fb_height(state.chip), CHIP8_RECORDER_DEFAULT_SCALE,
+        init->colors[1], init->colors[0], CHIP8_RECORDER_DEFAULT_QUEUE_SIZE);
+      if(recording == NULL) {
+        printf("Error, Could not create %s!\n", init->record_file);
+        return 0;
+      }
+    }
+
+    if(!chip8_sdl_emu_start(&state.emu, state.chip, state_file, init->blend_frames, init->phosphor_decay, recording)) {
+      if(recording != NULL) {
+        chip8_recording_close(recording);
+      }
+      printf("Error, Failed to start the emulator!\n");
+      return 0;
+    }
+
+    //the emulation thread owns the VM from now on
+    state.chip = NULL;
+  }
+
 
 
   //when initialized, make SDL keep a pointer to our app state.
@@ -308,11 +321,25 @@ SDL_AppResult chip8_sdl_app_event(void *appstate, SDL_Event *event) {
     case SDL_EVENT_KEY_DOWN: {
       enum chip8_key key;
       if(chip8_sdl_key_to_chip8_key(&event->key, &key)) {
-        chip8_set_key(&state->chip.core, key);
+        if(state->show_grid) {
+          chip8_sdl_grid_set_key(&state->grid, key);
+        } else if(!chip8_sdl_emu_send(&state->emu, CHIP8_SDL_COMMAND_KEY_DOWN, key)) {
+          SDL_Log("The emulator is too busy, ignoring key");
+        }
       } 
       else if(event->key.scancode == SDL_SCANCODE_ESCAPE) {
         return SDL_APP_SUCCESS;  /* end the program, reporting success to the OS. */
       } 
+      else if(state->show_grid) {
+        //the grid can only be paused
+        if(event->key.scancode == SDL_SCANCODE_F6) {
+          state->paused = !state->paused;
+          SDL_Log(state->paused ? "Paused" : "Resumed");
+        }
+      }
+      else if(chip8_sdl_debug_key(state, event->key.scancode)) {
+        //handled by the emulation thread
+      }
       
       //ignore all other keypresses
 
@@ -322,7 +349,11 @@ SDL_AppResult chip8_sdl_app_event(void *appstate, SDL_Event *event) {
     case SDL_EVENT_KEY_UP: {
       enum chip8_key key;
       if(chip8_sdl_key_to_chip8_key(&event->key, &key)) {
-        chip8_remove_key(&state->chip.core, key);
+        if(state->show_grid) {
+          chip8_sdl_grid_remove_key(&state->grid, key);
+        } else if(!chip8_sdl_emu_send(&state->emu, CHIP8_SDL_COMMAND_KEY_UP, key)) {
+          SDL_Log("The emulator is too busy, ignoring key");
+        }
       }
 
       //ignore all other keypresses
@@ -330,6 +361,9 @@ SDL_AppResult chip8_sdl_app_event(void *appstate, SDL_Event *event) {
       break;
     }
 
+    //the window lost what was drawn on it, so it must be drawn again even if nothing changed
+    case SDL_EVENT_WINDOW_EXPOSED: state->redraw = 1; break;
+
     case SDL_EVENT_QUIT: return SDL_APP_SUCCESS;  /* end the program, reporting success to the OS. */
 
     default: break;
@@ -338,31 +372,156 @@ SDL_AppResult chip8_sdl_app_event(void *appstate, SDL_Event *event) {
   return SDL_APP_CONTINUE;
 }
 
+// Sleep until the next 60Hz frame (--low-power only). Events that come in while sleeping
+// are handled right after.
+static void chip8_sdl_wait_for_next_frame(struct chip8_sdl_app_state *state) {
+  Uint64 now = SDL_GetTicksNS();
+  if(state->next_frame_nanos > now) {
+    SDL_DelayNS(state->next_frame_nanos - now);
+    now = state->next_frame_nanos;
+  }
+
+  state->next_frame_nanos += CHIP8_SDL_EMU_NANOS_PER_FRAME;
+  if(state->next_frame_nanos <= now) {
+    state->next_frame_nanos = now + CHIP8_SDL_EMU_NANOS_PER_FRAME;
+  }
+}
+
+// Without vsync, wait until the display refreshes again, so the window is not drawn more often
+// than it can be shown. With vsync, SDL_RenderPresent() already waits.
+static void chip8_sdl_wait_for_refresh(struct chip8_sdl_app_state *state) {
+  const Uint64 next = chip8_pacer_next_present(&state->pacer);
+  const Uint64 now = SDL_GetTicksNS();
+  if(next > now) {
+    SDL_DelayPrecise(next - now);
+  }
+}
+
+// Present the window, and tell the pacer when it came back (which measures the refresh rate with vsync).
+static void chip8_sdl_present(struct chip8_sdl_app_state *state) {
+  SDL_RenderPresent(state->renderer);
+  chip8_pacer_presented(&state->pacer, SDL_GetTicksNS());
+}
+
+// Returns 1 if the window was resized or exposed since the last time it was presented.
+static int chip8_sdl_window_changed(struct chip8_sdl_app_state *state) {
+  int w = 0, h = 0;
+  SDL_GetRenderOutputSize(state->renderer, &w, &h);
+
+  const int changed = state->redraw || w != state->presented_w || h != state->presented_h;
+  state->redraw = 0;
+  state->presented_w = w;
+  state->presented_h = h;
+  return changed;
+}
+
+// Returns 1 if the display, the keys that are held down or the window changed since the last
+// time the window was presented.
+static int chip8_sdl_display_changed(struct chip8_sdl_app_state *state, const struct chip8_sdl_frame *frame) {
+  //always check the window, so that its size is remembered
+  int changed = chip8_sdl_window_changed(state);
+  changed |= frame->generation != state->presented_generation;
+  changed |= frame->keys != state->presented_keys;
+
+  state->presented_generation = frame->generation;
+  state->presented_keys = frame->keys;
+  return changed;
+}
+
+// Draw the title, the display and the keys that are held down, and present them.
+static void chip8_sdl_draw_window(struct chip8_sdl_app_state *state, const struct chip8_sdl_frame *frame) {
+  const char *message = "RYCE8";
+  int w = 0, h = 0;
+  float x, y;
+  const float scale = 4.0f;
+
+
+  /* Center the message and scale it up */
+  SDL_GetRenderOutputSize(state->renderer, &w, &h);
+  SDL_SetRenderScale(state->renderer, scale, scale);
+
+  x = ((w / scale) - SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE * SDL_strlen(message)) / 2;
+  y = ((h / scale) - SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE) / 8; // top 1/8th of screen
+
+  /* Draw the message */
+  chip8_sdl_set_draw_color(state->renderer, state->screen.palette.colors[0]);
+  SDL_RenderClear(state->renderer); //clear entire screen with the background color of the display
+  SDL_SetRenderDrawColor(state->renderer, 255, 255, 255, 255);
+  SDL_RenderDebugText(state->renderer, x, y, message);
+
+  //the display fills the space between the title and the keys
+  const float keys_y = 7 * ( (h / scale) - (SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + CHIP8_SDL_PIXELS_BETWEEN_DEBUG_CHARS)) / 8; //top 3/4th of screen
+
+  SDL_FRect area;
+  area.x = 0;
+  area.y = (y + SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + CHIP8_SDL_PIXELS_BETWEEN_DEBUG_CHARS) * scale;
+  area.w = w;
+  area.h = (keys_y - CHIP8_SDL_PIXELS_BETWEEN_DEBUG_CHARS) * scale - area.y;
+
+  // draw chip8 framebuffer. The texture is drawn in window pixels, so the scale of the text is undone first.
+  const int updated = frame->shaded
+    ? chip8_sdl_screen_update_shades(&state->screen, frame->intensity, frame->generation)
+    : chip8_sdl_screen_update(&state->screen, frame->fb, frame->generation);
+  if(!updated) {
+    SDL_Log("Couldn't update the display texture: %s", SDL_GetError());
+  }
+  SDL_SetRenderScale(state->renderer, 1.0f, 1.0f);
+  chip8_sdl_screen_draw(&state->screen, state->renderer, &area);
+  SDL_SetRenderScale(state->renderer, scale, scale);
+
+  x = ( (w / scale) - ((SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + CHIP8_SDL_PIXELS_BETWEEN_DEBUG_CHARS) * 16)) / 2; //center horizontally
+  //
+  chip8_sdl_draw_debug_keys(state, frame->keys, x, keys_y);
+
+  chip8_sdl_present(state);
+}
+
 /* This function runs once per frame, and is the heart of the program. */
 SDL_AppResult chip8_sdl_app_iterate(void *appstate) {
   struct chip8_sdl_app_state *state = appstate;
 
 
-  //update our timers
-  uint64_t time_elapsed_millis = SDL_GetTicks();
-  uint64_t delta = time_elapsed_millis - state->last_frame_elapsed_millis;
-  state->last_frame_elapsed_millis = time_elapsed_millis;
+  //--low-power sleeps until the next 60Hz frame instead
+  if(!state->low_power) {
+    chip8_sdl_wait_for_refresh(state);
+  }
 
-  
+  if(state->show_grid) {
+    //the grid runs on this thread, so it is emulated first, with every frame that is owed
+    const Uint64 now = SDL_GetTicksNS();
+    uint32_t frames_run = 0;
+    if(state->paused) {
+      chip8_pacer_restart(&state->pacer, now);
+    } else {
+      frames_run = chip8_sdl_grid_update(&state->grid, chip8_pacer_frames_due(&state->pacer, now));
+    }
 
-  //only update Chip8 when ROM is actually loaded 
+    if(!state->low_power || chip8_sdl_window_changed(state) || frames_run != 0) {
+      //if that left the grid behind, presenting would only make it fall further behind
+      if(chip8_pacer_should_present(&state->pacer, SDL_GetTicksNS())) {
+        chip8_sdl_grid_draw(&state->grid, state->renderer);
+        chip8_sdl_present(state);
+      } else {
+        state->redraw = 1;
+      }
+    }
 
-  for(uint8_t num_times = 0; num_times < 3; num_times++) {
-    if(!chip8_wrapper_process_instruction(&state->chip)) {
-      SDL_Log("Cannot process instruction at address %d", state->chip.core.ram[state->chip.core.pc]);
-      return SDL_APP_FAILURE;
+    if(state->low_power) {
+      chip8_sdl_wait_for_next_frame(state);
     }
+    return SDL_APP_CONTINUE;
   }
-
-  chip8_wrapper_update_timer(&state->chip, delta);
   
 
-  if(state->chip.core.sound_timer != 0) {
+  //the emulation thread already logged which instruction it could not process
+  if(atomic_load(&state->emu.failed)) {
+    return SDL_APP_FAILURE;
+  }
+
+  //the game runs on the emulation thread, this only shows the newest frame it finished
+  const struct chip8_sdl_frame *frame = chip8_sdl_emu_newest_frame(&state->emu);
+
+  if(frame->sound_on) {
     SDL_ResumeAudioStreamDevice(state->stream);
   } else {
     SDL_PauseAudioStreamDevice(state->stream);
@@ -384,42 +543,31 @@ SDL_AppResult chip8_sdl_app_iterate(void *appstate) {
 
 
 
-  //render
-  const char *message = "RYCE8";
-  int w = 0, h = 0;
-  float x, y;
-  const float scale = 4.0f;
-
-
-  /* Center the message and scale it up */
-  SDL_GetRenderOutputSize(state->renderer, &w, &h);
-  SDL_SetRenderScale(state->renderer, scale, scale);
-
-  x = ((w / scale) - SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE * SDL_strlen(message)) / 2;
-  y = ((h / scale) - SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE) / 8; // top 1/8th of screen
-
-  /* Draw the message */
-  SDL_SetRenderDrawColor(state->renderer, 0, 0, 0, 255);
-  SDL_RenderClear(state->renderer); //clear entire screen using the draw color 
-  SDL_SetRenderDrawColor(state->renderer, 255, 255, 255, 255);
-  SDL_RenderDebugText(state->renderer, x, y, message);
-
-  // draw chip8 framebuffer
-  x = ( (w / scale) - (CHIP8_WIDTH * CHIP8_SDL_PIXEL_SIZE)) / 2; //center horizontally
-  y = ( (h / scale) - (CHIP8_HEIGHT * CHIP8_SDL_PIXEL_SIZE)) / 2; //center veritcally
-
-  chip8_sdl_draw_chip8(state, x, y);
-
-  x = ( (w / scale) - ((SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + CHIP8_SDL_PIXELS_BETWEEN_DEBUG_CHARS) * 16)) / 2; //center horizontally
-  y = 7 * ( (h / scale) - (SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + CHIP8_SDL_PIXELS_BETWEEN_DEBUG_CHARS)) / 8; //top 3/4th of screen
-  //
-  chip8_sdl_draw_debug_keys(state, x, y);
-
-  SDL_RenderPresent(state->renderer);
+  //render (with --low-power, only when something on the window changed). The game runs on its
+  //own thread, so presenting never holds it back, and no present has to be skipped.
+  if(!state->low_power || chip8_sdl_display_changed(state, frame)) {
+    chip8_sdl_draw_window(state, frame);
+  }
 
+  if(state->low_power) {
+    chip8_sdl_wait_for_next_frame(state);
+  }
 
   return SDL_APP_CONTINUE;
 }
 
 /* This function runs once at shutdown. */
-void chip8_sdl_app_quit(void *appstate, SDL_AppResult result) {}
+void chip8_sdl_app_quit(void *appstate, SDL_AppResult result) {
+  struct chip8_sdl_app_state *state = appstate;
+  if(state != NULL) {
+    chip8_sdl_emu_stop(&state->emu);
+
+    //waits for the encoder to write the rest of the recording
+    if(state->recording && !chip8_recorder_destroy(&state->recorder)) {
+      printf("Error, Failed to write the recording!\n");
+    }
+    chip8_sdl_grid_free(&state->grid);
+    chip8_sdl_screen_free(&state->screen);
+    chip8_destroy(state->chip);
+  }
+}
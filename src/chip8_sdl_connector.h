@@ -2,15 +2,49 @@
 #define CHIP8_SDL_CONNECTOR_H
 
 #include <SDL3/SDL.h>
+#include <stdio.h>
 #include "chip8.h"
+#include "chip8_sdl_emu.h"
+#include "chip8_sdl_grid.h"
+#include "chip8_sdl_render.h"
 
 
 // stores the state of our GUI application
 struct chip8_sdl_app_state {
 
-  struct chip8 chip;
+  //the loaded ROM. Once the single display is running, chip belongs to the emulation thread and this is NULL.
+  struct chip8 *chip;
 
-  Uint64 last_frame_elapsed_millis;
+  //runs chip on its own thread, along with the debugger and save states
+  struct chip8_sdl_emu emu;
+
+  //with --record, encodes what the emulation thread shows on a thread of its own
+  uint8_t recording;
+  struct chip8_recorder recorder;
+
+  //keeps the grid at 60 emulated frames per second, and paces presents (see chip8_pacer.h)
+  struct chip8_pacer pacer;
+  uint8_t paused;
+
+  //texture that the display is drawn with
+  struct chip8_sdl_screen screen;
+
+  //with --grid, many copies of the ROM are shown instead of chip (which then stays at the start of the ROM).
+  //The grid runs on the thread that draws the window. The debugger and save states only work on the single display.
+  uint8_t show_grid;
+  struct chip8_sdl_grid grid;
+
+  //with --low-power, the window is only presented again once something on it changed,
+  //and the thread that draws it sleeps until the next 60Hz frame in between.
+  uint8_t low_power;
+  Uint64 next_frame_nanos;
+
+  //what the last presented window showed. redraw is set when the window has to be drawn again anyway.
+  uint8_t redraw;
+  uint64_t presented_generation;
+  uint16_t presented_keys;
+  int presented_w;
+  int presented_h;
 
   SDL_Window *window; 
   SDL_Renderer *renderer; 
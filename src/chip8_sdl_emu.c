@@ -0,0 +1,309 @@
+#include "chip8_sdl_emu.h"
+#include <string.h>
+
+#include "chip8_state.h"
+
+_Static_assert((CHIP8_SDL_EMU_QUEUE_SIZE & (CHIP8_SDL_EMU_QUEUE_SIZE - 1)) == 0, "the queue size must be a power of 2");
+
+// Save the state of the emulator next to the ROM file.
+static void chip8_sdl_emu_save_state(struct chip8_sdl_emu *emu) {
+  FILE *f = fopen(emu->state_file, "wb");
+  if(f == NULL) {
+    SDL_Log("Could not open %s to save state", emu->state_file);
+    return;
+  }
+
+  if(!chip8_state_save_file(emu->chip, f)) {
+    SDL_Log("Failed to save state to %s", emu->state_file);
+  }
+  fclose(f);
+}
+
+static void chip8_sdl_emu_load_state(struct chip8_sdl_emu *emu) {
+  FILE *f = fopen(emu->state_file, "rb");
+  if(f == NULL) {
+    SDL_Log("No save state found at %s", emu->state_file);
+    return;
+  }
+
+  //load into a copy so that a broken save state does not corrupt the running game.
+  //The recording cannot go back past the loaded state, so it starts over from there. It
+  //is started before anything is replaced, so running out of memory keeps the old game and recording.
+  struct chip8 *loaded = chip8_create(emu->chip->emu);
+  struct chip8_rewind rewind;
+
+  if(loaded != NULL && chip8_state_load_file(loaded, f) && chip8_rewind_init(&rewind, loaded)) {
+    chip8_destroy(emu->chip);
+    emu->chip = loaded;
+
+    chip8_rewind_free(&emu->rewind);
+    emu->rewind = rewind;
+
+    //the new VM counts its framebuffer changes from scratch, so the next frame is always treated as changed
+    emu->seen_fb_generation = emu->chip->core.fb_generation;
+    emu->generation++;
+
+    //do not blend the loaded display with the one from before
+    if(emu->use_phosphor) {
+      chip8_phosphor_reset(&emu->phosphor, emu->chip->core.fb);
+    }
+    if(emu->recording != NULL) {
+      chip8_recording_force_frame(emu->recording);
+    }
+  } else {
+    chip8_destroy(loaded);
+    SDL_Log("Failed to load state from %s", emu->state_file);
+  }
+  fclose(f);
+}
+
+static void chip8_sdl_emu_log_debug_state(struct chip8_sdl_emu *emu) {
+  struct chip8_core *core = &emu->chip->core;
+  SDL_Log("Instruction %llu: PC=%03X I=%03X SP=%d DT=%d ST=%d V=%02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X",
+    (unsigned long long) emu->rewind.ins, core->pc, core->I, core->sp, core->delay_timer, core->sound_timer,
+    core->V[0], core->V[1], core->V[2], core->V[3], core->V[4], core->V[5], core->V[6], core->V[7],
+    core->V[8], core->V[9], core->V[10], core->V[11], core->V[12], core->V[13], core->V[14], core->V[15]);
+}
+
+static void chip8_sdl_emu_run_command(struct chip8_sdl_emu *emu, const struct chip8_sdl_command *cmd) {
+  switch(cmd->type) {
+    case CHIP8_SDL_COMMAND_KEY_DOWN: chip8_rewind_set_key(&emu->rewind, emu->chip, cmd->key); return;
+    case CHIP8_SDL_COMMAND_KEY_UP: chip8_rewind_remove_key(&emu->rewind, emu->chip, cmd->key); return;
+    case CHIP8_SDL_COMMAND_SAVE_STATE: chip8_sdl_emu_save_state(emu); return;
+    case CHIP8_SDL_COMMAND_LOAD_STATE: chip8_sdl_emu_load_state(emu); return;
+
+    //pause or resume emulation
+    case CHIP8_SDL_COMMAND_PAUSE: {
+      emu->paused = !emu->paused;
+      SDL_Log(emu->paused ? "Paused" : "Resumed");
+      break;
+    }
+
+    //step back 1 instruction
+    case CHIP8_SDL_COMMAND_STEP_BACK: {
+      emu->paused = 1;
+      chip8_rewind_step_back(&emu->rewind, emu->chip, 1);
+      break;
+    }
+
+    //step forward 1 instruction
+    case CHIP8_SDL_COMMAND_STEP_FORWARD: {
+      emu->paused = 1;
+      if(!chip8_rewind_process_instruction(&emu->rewind, emu->chip)) {
+        SDL_Log("Cannot process instruction at address %d", emu->chip->core.pc);
+      }
+      break;
+    }
+
+    //run back to the last instruction that wrote to the address in I
+    case CHIP8_SDL_COMMAND_RUN_TO_LAST_WRITE: {
+      emu->paused = 1;
+      if(!chip8_rewind_to_last_write(&emu->rewind, emu->chip, emu->chip->core.I)) {
+        SDL_Log("No write to address %03X found", emu->chip->core.I);
+      }
+      break;
+    }
+  }
+
+  chip8_sdl_emu_log_debug_state(emu);
+}
+
+// Run every command the render thread sent since the last frame.
+static void chip8_sdl_emu_run_commands(struct chip8_sdl_emu *emu) {
+  uint32_t head = atomic_load_explicit(&emu->queue_head, memory_order_relaxed);
+  const uint32_t tail = atomic_load_explicit(&emu->queue_tail, memory_order_acquire);
+
+  for(; head != tail; head++) {
+    chip8_sdl_emu_run_command(emu, &emu->queue[head & (CHIP8_SDL_EMU_QUEUE_SIZE - 1)]);
+  }
+
+  //hand the slots back to the render thread
+  atomic_store_explicit(&emu->queue_head, head, memory_order_release);
+}
+
+// Run the next emulated frame. Returns 0 if the VM ran into an instruction it cannot process.
+static int chip8_sdl_emu_run_frame(struct chip8_sdl_emu *emu) {
+  for(uint32_t i = 0; i < CHIP8_SDL_EMU_INSTRUCTIONS_PER_FRAME; i++) {
+    if(!chip8_rewind_process_instruction(&emu->rewind, emu->chip)) {
+      SDL_Log("Cannot process instruction at address %d", emu->chip->core.pc);
+      return 0;
+    }
+  }
+
+  //the timers count emulated frames, so they keep in step with the game even when frames are caught up on
+  chip8_rewind_tick_timers(&emu->rewind, emu->chip);
+
+  //only copies the framebuffer if it changed, the encoding happens on a thread of its own
+  if(emu->recording != NULL) {
+    chip8_recording_add_frame(emu->recording, &emu->chip->core);
+  }
+
+  //the phosphor moves on with every emulated frame, even if the framebuffer stayed the same
+  if(emu->use_phosphor && chip8_phosphor_update(&emu->phosphor, emu->chip->core.fb)) {
+    emu->generation++;
+  }
+  return 1;
+}
+
+static void chip8_sdl_emu_write_frame(struct chip8_sdl_emu *emu, struct chip8_sdl_frame *frame) {
+  const struct chip8_core *core = &emu->chip->core;
+
+  if(core->fb_generation != emu->seen_fb_generation) {
+    emu->seen_fb_generation = core->fb_generation;
+
+    if(!emu->use_phosphor) {
+      emu->generation++;
+    } else if(emu->paused) {
+      //show exactly what the debugger did, instead of blending it with older frames
+      chip8_phosphor_reset(&emu->phosphor, core->fb);
+      emu->generation++;
+    }
+  }
+
+  if(emu->use_phosphor) {
+    memcpy(frame->fb, emu->phosphor.blended, core->fb_size);
+  } else {
+    memcpy(frame->fb, core->fb, core->fb_size);
+  }
+
+  frame->shaded = emu->use_phosphor && emu->phosphor.decay != 0;
+  if(frame->shaded) {
+    memcpy(frame->intensity, emu->phosphor.intensity, (size_t)core->fb_size * 8);
+  }
+
+  frame->generation = emu->generation;
+  frame->keys = core->keyboard_inputs;
+  frame->sound_on = core->sound_timer != 0;
+}
+
+static int SDLCALL chip8_sdl_emu_thread(void *data) {
+  struct chip8_sdl_emu *emu = data;
+
+  //only the emulated clock is used here, presenting is up to the render thread
+  struct chip8_pacer pacer;
+  chip8_pacer_init(&pacer, SDL_GetTicksNS(), 0, 0);
+
+  while(!atomic_load_explicit(&emu->stop, memory_order_relaxed)) {
+    chip8_sdl_emu_run_commands(emu);
+
+    const Uint64 now = SDL_GetTicksNS();
+
+    //while paused, the emulator is only moved by the debugger commands, and no time is owed
+    const uint8_t idle = emu->paused || atomic_load_explicit(&emu->failed, memory_order_relaxed);
+    if(idle) {
+      chip8_pacer_restart(&pacer, now);
+    } else {
+      //every frame that is owed is run, so the game never slows down, even if this thread was held up
+      const uint32_t num_frames = chip8_pacer_frames_due(&pacer, now);
+      for(uint32_t f = 0; f < num_frames; f++) {
+        if(!chip8_sdl_emu_run_frame(emu)) {
+          atomic_store(&emu->failed, 1);
+          break;
+        }
+      }
+    }
+
+    chip8_sdl_emu_write_frame(emu, &emu->frames[chip8_triple_buffer_back(&emu->frames_handoff)]);
+    chip8_triple_buffer_publish(&emu->frames_handoff);
+
+    //while paused, wake up every frame to look for commands
+    const Uint64 next = idle ? now + CHIP8_SDL_EMU_NANOS_PER_FRAME : chip8_pacer_next_frame(&pacer);
+    const Uint64 after = SDL_GetTicksNS();
+    if(next > after) {
+      SDL_DelayPrecise(next - after);
+    }
+  }
+
+  return 0;
+}
+
+// Start running chip (which must already be reset) on its own thread. On success, the
+// emulation thread owns chip until chip8_sdl_emu_stop(). Returns 0 if the thread could not be started.
+// blend_frames and decay set up the phosphor (see chip8_phosphor.h). It is not used if blend_frames
+// is at most 1 and decay is 0. If recording is not NULL, every frame is added to it. On success,
+// chip8_sdl_emu_stop() closes it.
+int chip8_sdl_emu_start(struct chip8_sdl_emu *emu, struct chip8 *chip, const char *state_file, uint8_t blend_frames, uint8_t decay,
+  struct chip8_recording *recording) {
+  atomic_init(&emu->queue_tail, 0);
+  atomic_init(&emu->queue_head, 0);
+  atomic_init(&emu->failed, 0);
+  atomic_init(&emu->stop, 0);
+
+  emu->chip = chip;
+  emu->paused = 0;
+  emu->generation = 0;
+  emu->seen_fb_generation = chip->core.fb_generation;
+  emu->recording = NULL;
+  snprintf(emu->state_file, sizeof(emu->state_file), "%s", state_file);
+
+  emu->use_phosphor = blend_frames > 1 || decay != 0;
+  if(emu->use_phosphor) {
+    chip8_phosphor_init(&emu->phosphor, chip8_fb_width(chip), chip8_fb_height(chip), blend_frames > 1 ? blend_frames : 1, decay);
+    chip8_phosphor_reset(&emu->phosphor, chip->core.fb);
+  }
+
+  if(!chip8_rewind_init(&emu->rewind, chip)) {
+    emu->chip = NULL;
+    return 0;
+  }
+
+  //every buffer starts with the first frame, so the render thread has something to show right away
+  chip8_triple_buffer_init(&emu->frames_handoff);
+  for(uint32_t i = 0; i < 3; i++) {
+    chip8_sdl_emu_write_frame(emu, &emu->frames[i]);
+  }
+
+  emu->recording = recording;
+  emu->thread = SDL_CreateThread(chip8_sdl_emu_thread, "chip8 emulation", emu);
+  if(emu->thread == NULL) {
+    SDL_Log("Couldn't start the emulation thread: %s", SDL_GetError());
+    chip8_rewind_free(&emu->rewind);
+    emu->chip = NULL;
+    emu->recording = NULL;
+    return 0;
+  }
+  return 1;
+}
+
+// Stop the emulation thread, and destroy the VM it was running.
+void chip8_sdl_emu_stop(struct chip8_sdl_emu *emu) {
+  if(emu->thread == NULL) {
+    return;
+  }
+
+  atomic_store(&emu->stop, 1);
+  SDL_WaitThread(emu->thread, NULL);
+  emu->thread = NULL;
+
+  if(emu->recording != NULL) {
+    chip8_recording_close(emu->recording);
+    emu->recording = NULL;
+  }
+
+  chip8_rewind_free(&emu->rewind);
+  chip8_destroy(emu->chip);
+  emu->chip = NULL;
+}
+
+// Send a command to the emulation thread. It runs before the next frame.
+// Returns 0 if the queue is full and the command was dropped.
+int chip8_sdl_emu_send(struct chip8_sdl_emu *emu, enum chip8_sdl_command_type type, enum chip8_key key) {
+  const uint32_t tail = atomic_load_explicit(&emu->queue_tail, memory_order_relaxed);
+  const uint32_t head = atomic_load_explicit(&emu->queue_head, memory_order_acquire);
+
+  if(tail - head == CHIP8_SDL_EMU_QUEUE_SIZE) {
+    return 0;
+  }
+
+  struct chip8_sdl_command *cmd = &emu->queue[tail & (CHIP8_SDL_EMU_QUEUE_SIZE - 1)];
+  cmd->type = type;
+  cmd->key = key;
+
+  atomic_store_explicit(&emu->queue_tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+// The newest frame the emulation thread finished. It stays valid until the next call.
+const struct chip8_sdl_frame *chip8_sdl_emu_newest_frame(struct chip8_sdl_emu *emu) {
+  return &emu->frames[chip8_triple_buffer_read(&emu->frames_handoff)];
+}
@@ -0,0 +1,104 @@
+#ifndef CHIP8_SDL_EMU_H
+#define CHIP8_SDL_EMU_H
+
+#include <SDL3/SDL.h>
+#include <stdio.h>
+#include <stdatomic.h>
+
+#include "chip8.h"
+#include "chip8_rewind.h"
+#include "chip8_pacer.h"
+#include "chip8_phosphor.h"
+#include "chip8_recorder.h"
+#include "chip8_triple_buffer.h"
+
+// Runs the VM on a thread of its own, paced by its own clock at 60 frames per second (see
+// chip8_pacer.h), so a slow SDL_RenderPresent() (or waiting for vsync) never slows down the game.
+//
+// The emulation thread owns the VM and everything that touches it (the rewind recording,
+// save states and the debugger). The two threads only talk through:
+//  - a queue of commands (key presses, debugger keys, ...) going to the emulation thread.
+//    It has a single writer and a single reader, so it needs no locks.
+//  - a triple buffer of finished frames going to the render thread, which always gets the
+//    newest frame without waiting (see chip8_triple_buffer.h).
+
+#define CHIP8_SDL_EMU_INSTRUCTIONS_PER_FRAME 10
+#define CHIP8_SDL_EMU_NANOS_PER_FRAME (SDL_NS_PER_SECOND / 60)
+
+//must be a power of 2
+#define CHIP8_SDL_EMU_QUEUE_SIZE 256
+
+//large enough for the biggest framebuffer (SUPER-CHIP, 128x64)
+#define CHIP8_SDL_EMU_FB_WORDS 128
+
+enum chip8_sdl_command_type {
+  CHIP8_SDL_COMMAND_KEY_DOWN,
+  CHIP8_SDL_COMMAND_KEY_UP,
+  CHIP8_SDL_COMMAND_PAUSE, //pause or resume
+  CHIP8_SDL_COMMAND_STEP_BACK,
+  CHIP8_SDL_COMMAND_STEP_FORWARD,
+  CHIP8_SDL_COMMAND_RUN_TO_LAST_WRITE, //run back to the last write to the address in I
+  CHIP8_SDL_COMMAND_SAVE_STATE,
+  CHIP8_SDL_COMMAND_LOAD_STATE,
+};
+
+struct chip8_sdl_command {
+  uint16_t type; //enum chip8_sdl_command_type
+  uint16_t key; //enum chip8_key, for key presses
+};
+
+// Everything the render thread needs to show a frame.
+struct chip8_sdl_frame {
+  uint64_t fb[CHIP8_SDL_EMU_FB_WORDS];
+
+  //with phosphor decay, the intensity of every pixel is shown instead of fb
+  uint8_t shaded;
+  _Alignas(CHIP8_CACHE_LINE) uint8_t intensity[CHIP8_PHOSPHOR_MAX_PIXELS];
+
+  //goes up whenever fb (or intensity) changes (also when a save state is loaded)
+  uint64_t generation;
+  uint16_t keys;
+  uint8_t sound_on;
+};
+
+struct chip8_sdl_emu {
+  //the command queue. tail is only written by the render thread, and head by the emulation thread.
+  _Alignas(CHIP8_CACHE_LINE) _Atomic uint32_t queue_tail;
+  _Alignas(CHIP8_CACHE_LINE) _Atomic uint32_t queue_head;
+  struct chip8_sdl_command queue[CHIP8_SDL_EMU_QUEUE_SIZE];
+
+  struct chip8_triple_buffer frames_handoff;
+  struct chip8_sdl_frame frames[3];
+
+  //set by the emulation thread once the VM ran into an instruction it cannot process
+  _Atomic uint8_t failed;
+  _Atomic uint8_t stop;
+
+  //only used by the emulation thread
+  struct chip8 *chip;
+  struct chip8_rewind rewind;
+  uint8_t paused;
+  uint64_t generation;
+  uint64_t seen_fb_generation;
+
+  //blends frames together and fades pixels out, to hide flicker (see chip8_phosphor.h)
+  uint8_t use_phosphor;
+  struct chip8_phosphor phosphor;
+
+  //with --record, every emulated frame is added to this recording. NULL otherwise.
+  struct chip8_recording *recording;
+
+  //where save states for the current ROM are written to and read from.
+  char state_file[FILENAME_MAX];
+
+  SDL_Thread *thread;
+};
+
+int chip8_sdl_emu_start(struct chip8_sdl_emu *emu, struct chip8 *chip, const char *state_file, uint8_t blend_frames, uint8_t decay,
+  struct chip8_recording *recording);
+void chip8_sdl_emu_stop(struct chip8_sdl_emu *emu);
+
+int chip8_sdl_emu_send(struct chip8_sdl_emu *emu, enum chip8_sdl_command_type type, enum chip8_key key);
+const struct chip8_sdl_frame *chip8_sdl_emu_newest_frame(struct chip8_sdl_emu *emu);
+
+#endif// CHIP8_SDL_EMU_H
@@ -0,0 +1,216 @@
+#include "chip8_sdl_grid.h"
+#include <stdlib.h>
+#include <string.h>
+
+//the other colors are the same as the single display
+#define CHIP8_SDL_GRID_COLOR_HALTED 0x00FF0000
+#define CHIP8_SDL_GRID_COLOR_GAP 0x000000FF
+
+#define CHIP8_SDL_GRID_INSTRUCTIONS_PER_FRAME 10
+
+struct chip8_sdl_grid_job {
+  struct chip8_sdl_grid *grid;
+  uint32_t num_frames;
+
+  //the locked atlas
+  uint8_t *pixels;
+  int pitch;
+};
+
+// Write the display of VM i into its cell of the atlas.
+static void chip8_sdl_grid_write_cell(struct chip8_sdl_grid_job *job, uint32_t i) {
+  struct chip8_sdl_grid *grid = job->grid;
+  const struct chip8 *vm = chip8_array_at(grid->vms, i);
+
+  const uint32_t x = CHIP8_SDL_GRID_GAP + (i % grid->cols) * (grid->cell_w + CHIP8_SDL_GRID_GAP);
+  const uint32_t y = CHIP8_SDL_GRID_GAP + (i / grid->cols) * (grid->cell_h + CHIP8_SDL_GRID_GAP);
+  uint8_t *out = job->pixels + (size_t)y * job->pitch + x * sizeof(uint32_t);
+
+  chip8_sdl_expand_fb(&grid->palettes[grid->halted[i]], vm->core.fb, grid->cell_w, grid->cell_h, out, job->pitch);
+}
+
+// Run the next frames of VMs [begin, end), and draw them into the atlas.
+static void chip8_sdl_grid_run(void *ctx, uint32_t begin, uint32_t end) {
+  struct chip8_sdl_grid_job *job = ctx;
+  struct chip8_sdl_grid *grid = job->grid;
+
+  for(uint32_t i = begin; i < end; i++) {
+    struct chip8 *vm = chip8_array_at(grid->vms, i);
+
+    for(uint32_t f = 0; f < job->num_frames && !grid->halted[i] && !chip8_wrapper_has_exited(vm); f++) {
+      chip8_set_keyboard(&vm->core, grid->keys);
+
+      if(!chip8_wrapper_run_frame(vm, grid->instructions_per_frame)) {
+        grid->halted[i] = 1;
+      }
+    }
+
+    chip8_sdl_grid_write_cell(job, i);
+  }
+}
+
+// Run num_frames frames on every VM, and upload all of their displays in one go.
+static int chip8_sdl_grid_upload(struct chip8_sdl_grid *grid, uint32_t num_frames) {
+  struct chip8_sdl_grid_job job;
+  job.grid = grid;
+  job.num_frames = num_frames;
+
+  void *pixels;
+  if(!SDL_LockTexture(grid->atlas, NULL, &pixels, &job.pitch)) {
+    return 0;
+  }
+  job.pixels = pixels;
+
+  //the locked texture does not keep its old contents, so the gaps between displays are drawn every time
+  for(uint32_t y = 0; y < grid->atlas_h; y++) {
+    uint32_t *row = (uint32_t*)(job.pixels + (size_t)y * job.pitch);
+
+    if(y % (grid->cell_h + CHIP8_SDL_GRID_GAP) < CHIP8_SDL_GRID_GAP) {
+      for(uint32_t x = 0; x < grid->atlas_w; x++) {
+        row[x] = CHIP8_SDL_GRID_COLOR_GAP;
+      }
+    } else {
+      for(uint32_t x = 0; x < grid->atlas_w; x += grid->cell_w + CHIP8_SDL_GRID_GAP) {
+        for(uint32_t g = 0; g < CHIP8_SDL_GRID_GAP; g++) {
+          row[x + g] = CHIP8_SDL_GRID_COLOR_GAP;
+        }
+      }
+    }
+  }
+
+  chip8_thread_pool_run(&grid->pool, grid->num_vms, 1, chip8_sdl_grid_run, &job);
+
+  SDL_UnlockTexture(grid->atlas);
+  return 1;
+}
+
+// Set up cols x rows copies of vm, which should be freshly reset, drawn with colors (see chip8_sdl_palette).
+// If quirks is not NULL, the copies are given quirks[0], quirks[1], ... in order (starting over
+// after num_quirks copies). Otherwise, every copy keeps the quirks of vm but gets its own seed.
+int chip8_sdl_grid_init(struct chip8_sdl_grid *grid, SDL_Renderer *renderer, struct chip8 *vm, uint16_t cols, uint16_t rows, const uint16_t *quirks, uint32_t num_quirks,
+  const uint32_t colors[CHIP8_SDL_PALETTE_SIZE]) {
+  memset(grid, 0, sizeof(*grid));
+
+  grid->cols = cols;
+  grid->rows = rows;
+  grid->num_vms = (uint32_t)cols * rows;
+  grid->instructions_per_frame = CHIP8_SDL_GRID_INSTRUCTIONS_PER_FRAME;
+
+  grid->cell_w = chip8_fb_width(vm);
+  grid->cell_h = chip8_fb_height(vm);
+  grid->atlas_w = CHIP8_SDL_GRID_GAP + (uint32_t)cols * (grid->cell_w + CHIP8_SDL_GRID_GAP);
+  grid->atlas_h = CHIP8_SDL_GRID_GAP + (uint32_t)rows * (grid->cell_h + CHIP8_SDL_GRID_GAP);
+
+  //halted VMs show every pixel that is on in the same color
+  uint32_t halted_colors[CHIP8_SDL_PALETTE_SIZE];
+  for(uint32_t i = 0; i < CHIP8_SDL_PALETTE_SIZE; i++) {
+    halted_colors[i] = i == 0 ? colors[0] : CHIP8_SDL_GRID_COLOR_HALTED;
+  }
+  chip8_sdl_palette_init(&grid->palettes[0], colors);
+  chip8_sdl_palette_init(&grid->palettes[1], halted_colors);
+
+  grid->vms = chip8_create_array(vm->emu, grid->num_vms);
+  grid->halted = calloc(grid->num_vms, 1);
+  if(grid->vms == NULL || grid->halted == NULL) {
+    chip8_destroy_array(grid->vms, grid->num_vms);
+    free(grid->halted);
+    memset(grid, 0, sizeof(*grid));
+    return 0;
+  }
+
+  //the copies share the RAM of vm until they write to it
+  for(uint32_t i = 0; i < grid->num_vms; i++) {
+    struct chip8 *dst = chip8_array_at(grid->vms, i);
+
+    if(!chip8_fork(vm, dst)) {
+      chip8_destroy_array(grid->vms, grid->num_vms);
+      free(grid->halted);
+      memset(grid, 0, sizeof(*grid));
+      return 0;
+    }
+
+    if(quirks != NULL) {
+      dst->core.quirks = quirks[i % num_quirks];
+    } else {
+      chip8_wrapper_set_seed(dst, vm->core.rng_seed + i);
+    }
+  }
+
+  if(!chip8_thread_pool_init(&grid->pool, SDL_GetNumLogicalCPUCores())) {
+    chip8_destroy_array(grid->vms, grid->num_vms);
+    free(grid->halted);
+    memset(grid, 0, sizeof(*grid));
+    return 0;
+  }
+
+  grid->atlas = SDL_CreateTexture(renderer, CHIP8_SDL_PIXEL_FORMAT, SDL_TEXTUREACCESS_STREAMING, grid->atlas_w, grid->atlas_h);
+  if(grid->atlas == NULL) {
+    SDL_Log("Couldn't create a %ux%u texture for the grid: %s", grid->atlas_w, grid->atlas_h, SDL_GetError());
+    chip8_sdl_grid_free(grid);
+    return 0;
+  }
+  SDL_SetTextureScaleMode(grid->atlas, SDL_SCALEMODE_NEAREST);
+
+  //show the starting screens until the first frame is run
+  return chip8_sdl_grid_upload(grid, 0);
+}
+
+void chip8_sdl_grid_free(struct chip8_sdl_grid *grid) {
+  if(grid->atlas != NULL) {
+    SDL_DestroyTexture(grid->atlas);
+    grid->atlas = NULL;
+  }
+  if(grid->vms != NULL) {
+    chip8_thread_pool_destroy(&grid->pool);
+    chip8_destroy_array(grid->vms, grid->num_vms);
+    grid->vms = NULL;
+  }
+  free(grid->halted);
+  grid->halted = NULL;
+}
+
+void chip8_sdl_grid_set_key(struct chip8_sdl_grid *grid, enum chip8_key key) {
+  grid->keys |= key;
+}
+
+void chip8_sdl_grid_remove_key(struct chip8_sdl_grid *grid, enum chip8_key key) {
+  grid->keys &= ~key;
+}
+
+// Run every VM for num_frames 60Hz frames (as many as the pacer says are owed, see chip8_pacer.h).
+// The atlas is only uploaded when at least one frame was run. Returns the number of frames that were run.
+uint32_t chip8_sdl_grid_update(struct chip8_sdl_grid *grid, uint32_t num_frames) {
+  if(num_frames == 0) {
+    return 0;
+  }
+
+  if(!chip8_sdl_grid_upload(grid, num_frames)) {
+    SDL_Log("Couldn't lock the grid texture: %s", SDL_GetError());
+  }
+  return num_frames;
+}
+
+// Draw the atlas as large as it fits in the window, keeping pixels square.
+// Whole-number scales are used whenever the atlas fits at least once, so every pixel is the same size.
+void chip8_sdl_grid_draw(struct chip8_sdl_grid *grid, SDL_Renderer *renderer) {
+  int w = 0, h = 0;
+  SDL_SetRenderScale(renderer, 1.0f, 1.0f);
+  SDL_GetRenderOutputSize(renderer, &w, &h);
+
+  float scale_x = (float)w / grid->atlas_w;
+  float scale_y = (float)h / grid->atlas_h;
+  float scale = scale_x < scale_y ? scale_x : scale_y;
+  if(scale >= 1.0f) {
+    scale = (float)(int)scale;
+  }
+
+  SDL_FRect dst;
+  dst.w = grid->atlas_w * scale;
+  dst.h = grid->atlas_h * scale;
+  dst.x = (w - dst.w) / 2;
+  dst.y = (h - dst.h) / 2;
+
+  chip8_sdl_set_draw_color(renderer, grid->palettes[0].colors[0]);
+  SDL_RenderClear(renderer);
+  SDL_RenderTexture(renderer, grid->atlas, NULL, &dst);
+}
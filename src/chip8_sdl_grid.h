@@ -0,0 +1,58 @@
+#ifndef CHIP8_SDL_GRID_H
+#define CHIP8_SDL_GRID_H
+
+#include <SDL3/SDL.h>
+#include "chip8.h"
+#include "chip8_thread_pool.h"
+#include "chip8_sdl_render.h"
+
+// Runs many copies of a ROM at once and shows them side by side in one window, for example
+// to compare different seeds, or every quirk combination tried by chip8_quirks_detect().
+//
+// Drawing every pixel as its own rectangle would take 2048 (or 8192) draw calls per VM, so
+// instead all displays are written into one streaming texture (the atlas), which is uploaded
+// and drawn once per frame no matter how many VMs there are.
+// The VMs run on a thread pool, and every worker writes the displays of its own VMs into the atlas.
+
+//number of atlas pixels between neighbouring displays
+#define CHIP8_SDL_GRID_GAP 1
+
+struct chip8_sdl_grid {
+  struct chip8 *vms;
+  uint32_t num_vms;
+  uint16_t cols;
+  uint16_t rows;
+
+  //1 once a VM hit an invalid instruction. Its last screen stays up in another color.
+  uint8_t *halted;
+
+  //the keys held down, sent to every VM
+  uint16_t keys;
+
+  uint32_t instructions_per_frame;
+
+  struct chip8_thread_pool pool;
+
+  SDL_Texture *atlas;
+  uint32_t atlas_w;
+  uint32_t atlas_h;
+
+  //size of a single display in the atlas
+  uint16_t cell_w;
+  uint16_t cell_h;
+
+  //colors of running and halted VMs
+  struct chip8_sdl_palette palettes[2];
+};
+
+int chip8_sdl_grid_init(struct chip8_sdl_grid *grid, SDL_Renderer *renderer, struct chip8 *vm, uint16_t cols, uint16_t rows, const uint16_t *quirks, uint32_t num_quirks,
+  const uint32_t colors[CHIP8_SDL_PALETTE_SIZE]);
+void chip8_sdl_grid_free(struct chip8_sdl_grid *grid);
+
+void chip8_sdl_grid_set_key(struct chip8_sdl_grid *grid, enum chip8_key key);
+void chip8_sdl_grid_remove_key(struct chip8_sdl_grid *grid, enum chip8_key key);
+
+uint32_t chip8_sdl_grid_update(struct chip8_sdl_grid *grid, uint32_t num_frames);
+void chip8_sdl_grid_draw(struct chip8_sdl_grid *grid, SDL_Renderer *renderer);
+
+#endif// CHIP8_SDL_GRID_H
@@ -0,0 +1,241 @@
+#include "chip8_sdl_render.h"
+#include <string.h>
+
+const uint32_t CHIP8_SDL_DEFAULT_COLORS[CHIP8_SDL_PALETTE_SIZE] = {
+  0x00000000, 0x0000FF00, 0x00FF8000, 0x00FFFF00,
+  0x000080FF, 0x0000FFFF, 0x00FF00FF, 0x00FFFFFF,
+  0x00800000, 0x00008000, 0x00804000, 0x00808000,
+  0x00000080, 0x00008080, 0x00800080, 0x00808080,
+};
+
+// Build the lookup tables for colors (CHIP8_SDL_PALETTE_SIZE colors, see chip8_sdl_palette).
+void chip8_sdl_palette_init(struct chip8_sdl_palette *palette, const uint32_t colors[CHIP8_SDL_PALETTE_SIZE]) {
+  const uint32_t off = colors[0];
+  const uint32_t on = colors[1];
+  memcpy(palette->colors, colors, sizeof(palette->colors));
+
+  for(uint32_t b = 0; b < 256; b++) {
+    palette->spread[b] = 0;
+    for(uint32_t i = 0; i < 8; i++) {
+      const uint32_t bit = (b >> (7 - i)) & 1;
+      palette->expand[b][i] = bit ? on : off;
+      palette->spread[b] |= bit << (4 * i);
+    }
+  }
+
+  //fade every color channel from off to on
+  for(uint32_t s = 0; s < 256; s++) {
+    uint32_t color = 0;
+    for(uint32_t shift = 0; shift < 24; shift += 8) {
+      const uint32_t a = (off >> shift) & 0xFF;
+      const uint32_t b = (on >> shift) & 0xFF;
+      color |= ((a * (255 - s) + b * s + 127) / 255) << shift;
+    }
+    palette->shades[s] = color;
+  }
+}
+
+// Write a framebuffer of width x height pixels (width is a multiple of 64) as texture pixels
+// into out, where every row starts pitch bytes after the one before it.
+void chip8_sdl_expand_fb(const struct chip8_sdl_palette *palette, const uint64_t *fb, uint32_t width, uint32_t height, uint8_t *out, int pitch) {
+  const uint32_t (*expand)[8] = palette->expand;
+  const uint32_t words_per_row = width / 64;
+
+  for(uint32_t r = 0; r < height; r++, out += pitch) {
+    uint32_t *row = (uint32_t*)out;
+
+    for(uint32_t w = 0; w < words_per_row; w++, fb++, row += 64) {
+      const uint64_t v = *fb;
+      memcpy(row, expand[v >> 56], 32);
+      memcpy(row + 8, expand[(v >> 48) & 0xFF], 32);
+      memcpy(row + 16, expand[(v >> 40) & 0xFF], 32);
+      memcpy(row + 24, expand[(v >> 32) & 0xFF], 32);
+      memcpy(row + 32, expand[(v >> 24) & 0xFF], 32);
+      memcpy(row + 40, expand[(v >> 16) & 0xFF], 32);
+      memcpy(row + 48, expand[(v >> 8) & 0xFF], 32);
+      memcpy(row + 56, expand[v & 0xFF], 32);
+    }
+  }
+}
+
+// Write the 8 pixels whose palette indices are the nibbles of index (leftmost pixel in the lowest one).
+static inline void chip8_sdl_composite_byte(const uint32_t *colors, uint32_t index, uint32_t *row) {
+  row[0] = colors[index & 0xF];
+  row[1] = colors[(index >> 4) & 0xF];
+  row[2] = colors[(index >> 8) & 0xF];
+  row[3] = colors[(index >> 12) & 0xF];
+  row[4] = colors[(index >> 16) & 0xF];
+  row[5] = colors[(index >> 20) & 0xF];
+  row[6] = colors[(index >> 24) & 0xF];
+  row[7] = colors[index >> 28];
+}
+
+// Like chip8_sdl_expand_fb(), for a display made of num_planes (1 to CHIP8_SDL_MAX_PLANES)
+// framebuffers of the same size. The color of a pixel is the palette entry whose bit p is the
+// pixel of plane p. A single plane is drawn with chip8_sdl_expand_fb(), which is faster.
+void chip8_sdl_composite(const struct chip8_sdl_palette *palette, const uint64_t *const *planes, uint32_t num_planes,
+  uint32_t width, uint32_t height, uint8_t *out, int pitch) {
+  if(num_planes == 1) {
+    chip8_sdl_expand_fb(palette, planes[0], width, height, out, pitch);
+    return;
+  }
+
+  const uint32_t *spread = palette->spread;
+  const uint32_t *colors = palette->colors;
+  const uint32_t words_per_row = width / 64;
+
+  //planes that are not there are read as all off, so every byte takes the same 4 lookups
+  static const uint64_t none[CHIP8_FILTER_MAX_OUT_WORDS] = {0};
+  const uint64_t *p[CHIP8_SDL_MAX_PLANES];
+  for(uint32_t i = 0; i < CHIP8_SDL_MAX_PLANES; i++) {
+    p[i] = i < num_planes ? planes[i] : none;
+  }
+
+  size_t word = 0;
+  for(uint32_t r = 0; r < height; r++, out += pitch) {
+    uint32_t *row = (uint32_t*)out;
+
+    for(uint32_t w = 0; w < words_per_row; w++, word++, row += 64) {
+      const uint64_t v0 = p[0][word], v1 = p[1][word], v2 = p[2][word], v3 = p[3][word];
+
+      //the shifts are constants once the loop is unrolled
+      for(int shift = 56, x = 0; shift >= 0; shift -= 8, x += 8) {
+        const uint32_t index = spread[(v0 >> shift) & 0xFF]
+                            | (spread[(v1 >> shift) & 0xFF] << 1)
+                            | (spread[(v2 >> shift) & 0xFF] << 2)
+                            | (spread[(v3 >> shift) & 0xFF] << 3);
+        chip8_sdl_composite_byte(colors, index, row + x);
+      }
+    }
+  }
+}
+
+// Like chip8_sdl_expand_fb(), for a display with one intensity (0 to 255) per pixel.
+void chip8_sdl_expand_shades(const struct chip8_sdl_palette *palette, const uint8_t *intensity, uint32_t width, uint32_t height, uint8_t *out, int pitch) {
+  const uint32_t *shades = palette->shades;
+
+  for(uint32_t r = 0; r < height; r++, out += pitch) {
+    uint32_t *row = (uint32_t*)out;
+    for(uint32_t x = 0; x < width; x++) {
+      row[x] = shades[*intensity++];
+    }
+  }
+}
+
+// Set the color of the lines and rectangles that are drawn next (0x00RRGGBB, like the palette).
+void chip8_sdl_set_draw_color(SDL_Renderer *renderer, uint32_t color) {
+  SDL_SetRenderDrawColor(renderer, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF, 255);
+}
+
+// Create a texture the size of vm's display (times the scale of filter), drawn with colors (see
+// chip8_sdl_palette). Returns 0 if it could not be created.
+int chip8_sdl_screen_init(struct chip8_sdl_screen *screen, SDL_Renderer *renderer, const struct chip8 *vm, enum chip8_filter filter,
+  const uint32_t colors[CHIP8_SDL_PALETTE_SIZE]) {
+  screen->filter = filter;
+  screen->fb_width = chip8_fb_width(vm);
+  screen->fb_height = chip8_fb_height(vm);
+  screen->width = screen->fb_width * chip8_filter_scale(filter);
+  screen->height = screen->fb_height * chip8_filter_scale(filter);
+  chip8_sdl_palette_init(&screen->palette, colors);
+  screen->uploaded = 0;
+
+  screen->texture = SDL_CreateTexture(renderer, CHIP8_SDL_PIXEL_FORMAT, SDL_TEXTUREACCESS_STREAMING, screen->width, screen->height);
+  if(screen->texture == NULL) {
+    SDL_Log("Couldn't create the display texture: %s", SDL_GetError());
+    return 0;
+  }
+
+  //keep the pixels sharp when the texture is scaled up
+  SDL_SetTextureScaleMode(screen->texture, SDL_SCALEMODE_NEAREST);
+  return 1;
+}
+
+void chip8_sdl_screen_free(struct chip8_sdl_screen *screen) {
+  if(screen->texture != NULL) {
+    SDL_DestroyTexture(screen->texture);
+    screen->texture = NULL;
+  }
+}
+
+// Copy a framebuffer into the texture. generation must change whenever the framebuffer does
+// (like chip8_core.fb_generation), and nothing is done if it is the same as last time.
+int chip8_sdl_screen_update(struct chip8_sdl_screen *screen, const uint64_t *fb, uint64_t generation) {
+  return chip8_sdl_screen_update_planes(screen, &fb, 1, generation);
+}
+
+// Like chip8_sdl_screen_update(), for a display made of num_planes framebuffers (see chip8_sdl_composite()).
+int chip8_sdl_screen_update_planes(struct chip8_sdl_screen *screen, const uint64_t *const *planes, uint32_t num_planes, uint64_t generation) {
+  void *pixels;
+  int pitch;
+
+  if(screen->uploaded && screen->generation == generation) {
+    return 1;
+  }
+
+  if(!SDL_LockTexture(screen->texture, NULL, &pixels, &pitch)) {
+    return 0;
+  }
+
+  //the filter writes a framebuffer the size of the texture, which is then drawn like any other.
+  //Every plane is filtered on its own.
+  const uint64_t *filtered[CHIP8_SDL_MAX_PLANES];
+  for(uint32_t p = 0; p < num_planes; p++) {
+    filtered[p] = planes[p];
+    if(chip8_filter_run(screen->filter, planes[p], screen->fb_width, screen->fb_height, screen->filtered[p])) {
+      filtered[p] = screen->filtered[p];
+    }
+  }
+
+  chip8_sdl_composite(&screen->palette, filtered, num_planes, screen->width, screen->height, pixels, pitch);
+  SDL_UnlockTexture(screen->texture);
+
+  screen->generation = generation;
+  screen->uploaded = 1;
+  return 1;
+}
+
+// Copy the intensity of every pixel into the texture, see chip8_sdl_screen_update().
+// The filter is not used, since it only works on pixels that are on or off.
+int chip8_sdl_screen_update_shades(struct chip8_sdl_screen *screen, const uint8_t *intensity, uint64_t generation) {
+  void *pixels;
+  int pitch;
+
+  if(screen->uploaded && screen->generation == generation) {
+    return 1;
+  }
+
+  if(!SDL_LockTexture(screen->texture, NULL, &pixels, &pitch)) {
+    return 0;
+  }
+
+  chip8_sdl_expand_shades(&screen->palette, intensity, screen->fb_width, screen->fb_height, pixels, pitch);
+  SDL_UnlockTexture(screen->texture);
+
+  screen->generation = generation;
+  screen->uploaded = 1;
+  return 1;
+}
+
+// Draw the display as large as it fits in area (in window pixels), centered, with a frame
+// around it. Every texture pixel becomes the same whole number of window pixels.
+void chip8_sdl_screen_draw(struct chip8_sdl_screen *screen, SDL_Renderer *renderer, const SDL_FRect *area) {
+  int scale_x = (int)(area->w - 2) / screen->width;
+  int scale_y = (int)(area->h - 2) / screen->height;
+  int scale = scale_x < scale_y ? scale_x : scale_y;
+  if(scale < 1) {
+    scale = 1;
+  }
+
+  SDL_FRect dst;
+  dst.w = (float)screen->width * scale;
+  dst.h = (float)screen->height * scale;
+  dst.x = (float)(int)(area->x + (area->w - dst.w) / 2);
+  dst.y = (float)(int)(area->y + (area->h - dst.h) / 2);
+
+  //the frame is 1 pixel thick, right outside of the display
+  SDL_FRect frame = {dst.x - 1, dst.y - 1, dst.w + 2, dst.h + 2};
+  SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255);
+  SDL_RenderRect(renderer, &frame);
+
+  SDL_RenderTexture(renderer, screen->texture, NULL, &dst);
+}
@@ -0,0 +1,79 @@
+#ifndef CHIP8_SDL_RENDER_H
+#define CHIP8_SDL_RENDER_H
+
+#include <SDL3/SDL.h>
+#include "chip8.h"
+#include "chip8_filter.h"
+
+// Draws CHIP-8 displays with streaming textures instead of a rectangle per pixel.
+//
+// The framebuffer stores 8 pixels per byte, so a table with the 8 texture pixels of every
+// possible byte turns each row into texture pixels with one lookup per 8 pixels. A whole
+// display is written into its texture with a single SDL_LockTexture(), and drawn with a
+// single SDL_RenderTexture().
+//
+// Colors come from a palette of 16 entries, so displays with up to 4 bit planes (one framebuffer
+// per plane, like XO-CHIP) can be drawn too. There, a second table turns a byte of a plane into
+// 8 nibbles, one bit per pixel. Shifting the nibbles of every plane by its number and ORing them
+// together gives the palette index of 8 pixels with one lookup per plane, and each of the 8
+// pixels then takes one lookup in the palette.
+
+//texture format used for every display. Pixels are 0x00RRGGBB.
+#define CHIP8_SDL_PIXEL_FORMAT SDL_PIXELFORMAT_XRGB8888
+
+#define CHIP8_SDL_MAX_PLANES 4
+#define CHIP8_SDL_PALETTE_SIZE CHIP8_NUM_COLORS
+
+//the colors the emulator has always used (green on black), followed by colors for more planes
+extern const uint32_t CHIP8_SDL_DEFAULT_COLORS[CHIP8_SDL_PALETTE_SIZE];
+
+struct chip8_sdl_palette {
+  //color of every combination of planes, where bit p of the index is set if plane p is on.
+  //With a single plane, 0 is off and 1 is on.
+  uint32_t colors[CHIP8_SDL_PALETTE_SIZE];
+
+  //the 8 pixels of every byte of a framebuffer row, leftmost (highest) bit first (single plane)
+  uint32_t expand[256][8];
+
+  //the 8 pixels of every byte of a plane as nibbles that are 0 or 1, leftmost pixel in the lowest nibble
+  uint32_t spread[256];
+
+  //color of every intensity, from off (0) to on (255)
+  uint32_t shades[256];
+};
+
+// The display of a single VM.
+struct chip8_sdl_screen {
+  SDL_Texture *texture;
+
+  //size of the texture. With a filter, this is larger than the display of the VM.
+  uint16_t width;
+  uint16_t height;
+  struct chip8_sdl_palette palette;
+
+  enum chip8_filter filter;
+  uint16_t fb_width;
+  uint16_t fb_height;
+  uint64_t filtered[CHIP8_SDL_MAX_PLANES][CHIP8_FILTER_MAX_OUT_WORDS];
+
+  //generation of the framebuffer when the texture was last written, so unchanged frames are not uploaded again
+  uint64_t generation;
+  uint8_t uploaded;
+};
+
+void chip8_sdl_palette_init(struct chip8_sdl_palette *palette, const uint32_t colors[CHIP8_SDL_PALETTE_SIZE]);
+void chip8_sdl_expand_fb(const struct chip8_sdl_palette *palette, const uint64_t *fb, uint32_t width, uint32_t height, uint8_t *out, int pitch);
+void chip8_sdl_composite(const struct chip8_sdl_palette *palette, const uint64_t *const *planes, uint32_t num_planes,
+  uint32_t width, uint32_t height, uint8_t *out, int pitch);
+void chip8_sdl_expand_shades(const struct chip8_sdl_palette *palette, const uint8_t *intensity, uint32_t width, uint32_t height, uint8_t *out, int pitch);
+void chip8_sdl_set_draw_color(SDL_Renderer *renderer, uint32_t color);
+
+int chip8_sdl_screen_init(struct chip8_sdl_screen *screen, SDL_Renderer *renderer, const struct chip8 *vm, enum chip8_filter filter,
+  const uint32_t colors[CHIP8_SDL_PALETTE_SIZE]);
+void chip8_sdl_screen_free(struct chip8_sdl_screen *screen);
+int chip8_sdl_screen_update(struct chip8_sdl_screen *screen, const uint64_t *fb, uint64_t generation);
+int chip8_sdl_screen_update_planes(struct chip8_sdl_screen *screen, const uint64_t *const *planes, uint32_t num_planes, uint64_t generation);
+int chip8_sdl_screen_update_shades(struct chip8_sdl_screen *screen, const uint8_t *intensity, uint64_t generation);
+void chip8_sdl_screen_draw(struct chip8_sdl_screen *screen, SDL_Renderer *renderer, const SDL_FRect *area);
+
+#endif// CHIP8_SDL_RENDER_H
@@ -0,0 +1,121 @@
+#ifndef CHIP8_SIMD_H
+#define CHIP8_SIMD_H
+
+#include <stdint.h>
+
+// Small set of vector operations, so code that works on many bytes or words at once is written
+// once for AVX2, SSE2 and plain C, using the widest one the compiler is allowed to use.
+//
+// vec8 holds VEC8_LANES unsigned bytes. A mask has every bit of a lane set (0xFF) if the lane is selected.
+// vec64 holds VEC64_LANES 64-bit words. Stores must be aligned to the size of the vector,
+// and so must vec8 loads. vec64 loads do not have to be.
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define VEC8_LANES 32
+typedef __m256i vec8;
+#define vec8_load(p)         _mm256_load_si256((const __m256i*)(p))
+#define vec8_store(p, a)     _mm256_store_si256((__m256i*)(p), a)
+#define vec8_set1(x)         _mm256_set1_epi8((char)(x))
+#define vec8_zero()          _mm256_setzero_si256()
+#define vec8_add(a, b)       _mm256_add_epi8(a, b)
+#define vec8_sub(a, b)       _mm256_sub_epi8(a, b)
+#define vec8_adds(a, b)      _mm256_adds_epu8(a, b)
+#define vec8_subs(a, b)      _mm256_subs_epu8(a, b)
+#define vec8_min(a, b)       _mm256_min_epu8(a, b)
+#define vec8_max(a, b)       _mm256_max_epu8(a, b)
+#define vec8_and(a, b)       _mm256_and_si256(a, b)
+#define vec8_or(a, b)        _mm256_or_si256(a, b)
+#define vec8_xor(a, b)       _mm256_xor_si256(a, b)
+#define vec8_eq(a, b)        _mm256_cmpeq_epi8(a, b)
+#define vec8_shr1(a)         _mm256_and_si256(_mm256_srli_epi16(a, 1), vec8_set1(0x7F))
+#define vec8_shr7(a)         _mm256_and_si256(_mm256_srli_epi16(a, 7), vec8_set1(0x01))
+#define vec8_select(m, a, b) _mm256_blendv_epi8(a, b, m)
+#define vec8_movemask(m)     ((uint32_t)_mm256_movemask_epi8(m))
+
+#define VEC64_LANES 4
+typedef __m256i vec64;
+#define vec64_load(p)        _mm256_loadu_si256((const __m256i*)(p))
+#define vec64_store(p, a)    _mm256_store_si256((__m256i*)(p), a)
+#define vec64_set1(x)        _mm256_set1_epi64x((long long)(x))
+#define vec64_and(a, b)      _mm256_and_si256(a, b)
+#define vec64_or(a, b)       _mm256_or_si256(a, b)
+#define vec64_xor(a, b)      _mm256_xor_si256(a, b)
+#define vec64_andnot(a, b)   _mm256_andnot_si256(a, b)
+#define vec64_shl(a, n)      _mm256_slli_epi64(a, n)
+#define vec64_shr(a, n)      _mm256_srli_epi64(a, n)
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+#define VEC8_LANES 16
+typedef __m128i vec8;
+#define vec8_load(p)         _mm_load_si128((const __m128i*)(p))
+#define vec8_store(p, a)     _mm_store_si128((__m128i*)(p), a)
+#define vec8_set1(x)         _mm_set1_epi8((char)(x))
+#define vec8_zero()          _mm_setzero_si128()
+#define vec8_add(a, b)       _mm_add_epi8(a, b)
+#define vec8_sub(a, b)       _mm_sub_epi8(a, b)
+#define vec8_adds(a, b)      _mm_adds_epu8(a, b)
+#define vec8_subs(a, b)      _mm_subs_epu8(a, b)
+#define vec8_min(a, b)       _mm_min_epu8(a, b)
+#define vec8_max(a, b)       _mm_max_epu8(a, b)
+#define vec8_and(a, b)       _mm_and_si128(a, b)
+#define vec8_or(a, b)        _mm_or_si128(a, b)
+#define vec8_xor(a, b)       _mm_xor_si128(a, b)
+#define vec8_eq(a, b)        _mm_cmpeq_epi8(a, b)
+#define vec8_shr1(a)         _mm_and_si128(_mm_srli_epi16(a, 1), vec8_set1(0x7F))
+#define vec8_shr7(a)         _mm_and_si128(_mm_srli_epi16(a, 7), vec8_set1(0x01))
+#define vec8_select(m, a, b) _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a))
+#define vec8_movemask(m)     ((uint32_t)_mm_movemask_epi8(m))
+
+#define VEC64_LANES 2
+typedef __m128i vec64;
+#define vec64_load(p)        _mm_loadu_si128((const __m128i*)(p))
+#define vec64_store(p, a)    _mm_store_si128((__m128i*)(p), a)
+#define vec64_set1(x)        _mm_set1_epi64x((long long)(x))
+#define vec64_and(a, b)      _mm_and_si128(a, b)
+#define vec64_or(a, b)       _mm_or_si128(a, b)
+#define vec64_xor(a, b)      _mm_xor_si128(a, b)
+#define vec64_andnot(a, b)   _mm_andnot_si128(a, b)
+#define vec64_shl(a, n)      _mm_slli_epi64(a, n)
+#define vec64_shr(a, n)      _mm_srli_epi64(a, n)
+
+#else
+
+#define VEC8_LANES 1
+typedef uint8_t vec8;
+#define vec8_load(p)         (*(const uint8_t*)(p))
+#define vec8_store(p, a)     (*(uint8_t*)(p) = (a))
+#define vec8_set1(x)         ((uint8_t)(x))
+#define vec8_zero()          ((uint8_t)0)
+#define vec8_add(a, b)       ((uint8_t)((a) + (b)))
+#define vec8_sub(a, b)       ((uint8_t)((a) - (b)))
+#define vec8_adds(a, b)      ((uint8_t)((a) + (b) > 0xFF ? 0xFF : (a) + (b)))
+#define vec8_subs(a, b)      ((uint8_t)((a) > (b) ? (a) - (b) : 0))
+#define vec8_min(a, b)       ((a) < (b) ? (a) : (b))
+#define vec8_max(a, b)       ((a) > (b) ? (a) : (b))
+#define vec8_and(a, b)       ((uint8_t)((a) & (b)))
+#define vec8_or(a, b)        ((uint8_t)((a) | (b)))
+#define vec8_xor(a, b)       ((uint8_t)((a) ^ (b)))
+#define vec8_eq(a, b)        ((uint8_t)((a) == (b) ? 0xFF : 0))
+#define vec8_shr1(a)         ((uint8_t)((a) >> 1))
+#define vec8_shr7(a)         ((uint8_t)((a) >> 7))
+#define vec8_select(m, a, b) ((m) ? (b) : (a))
+#define vec8_movemask(m)     ((uint32_t)(m) >> 7)
+
+#define VEC64_LANES 1
+typedef uint64_t vec64;
+#define vec64_load(p)        (*(const uint64_t*)(p))
+#define vec64_store(p, a)    (*(uint64_t*)(p) = (a))
+#define vec64_set1(x)        ((uint64_t)(x))
+#define vec64_and(a, b)      ((a) & (b))
+#define vec64_or(a, b)       ((a) | (b))
+#define vec64_xor(a, b)      ((a) ^ (b))
+#define vec64_andnot(a, b)   (~(a) & (b))
+#define vec64_shl(a, n)      ((a) << (n))
+#define vec64_shr(a, n)      ((a) >> (n))
+
+#endif
+
+#endif// CHIP8_SIMD_H
@@ -0,0 +1,245 @@
+#include "chip8_state.h"
+#include "lz.h"
+#include <string.h>
+
+#define CHIP8_STATE_MAGIC "RYC8"
+#define CHIP8_STATE_VERSION 1
+
+
+// A cursor used to write or read the fields of a save state.
+struct chip8_state_cursor {
+  uint8_t *buf;
+  size_t len;
+  size_t pos;
+  uint8_t overflow;
+};
+
+static void chip8_state_put(struct chip8_state_cursor *c, const void *data, size_t len) {
+  if(c->len - c->pos < len) {
+    c->overflow = 1;
+    return;
+  }
+  memcpy(c->buf + c->pos, data, len);
+  c->pos += len;
+}
+
+static void chip8_state_get(struct chip8_state_cursor *c, void *data, size_t len) {
+  if(c->len - c->pos < len) {
+    c->overflow = 1;
+    memset(data, 0, len);
+    return;
+  }
+  memcpy(data, c->buf + c->pos, len);
+  c->pos += len;
+}
+
+// Integers are always stored in little-endian order.
+static void chip8_state_put_uint(struct chip8_state_cursor *c, uint64_t val, uint8_t num_bytes) {
+  uint8_t bytes[8];
+  for(uint8_t i = 0; i < num_bytes; i++) {
+    bytes[i] = val >> (8*i);
+  }
+  chip8_state_put(c, bytes, num_bytes);
+}
+
+static uint64_t chip8_state_get_uint(struct chip8_state_cursor *c, uint8_t num_bytes) {
+  uint8_t bytes[8];
+  uint64_t val = 0;
+  chip8_state_get(c, bytes, num_bytes);
+  for(uint8_t i = 0; i < num_bytes; i++) {
+    val |= (uint64_t)bytes[i] << (8*i);
+  }
+  return val;
+}
+
+static void chip8_state_put_fb(struct chip8_state_cursor *c, const struct chip8_core *core) {
+  for(uint16_t i = 0; i < core->fb_size / sizeof(uint64_t); i++) {
+    chip8_state_put_uint(c, core->fb[i], 8);
+  }
+}
+
+static void chip8_state_get_fb(struct chip8_state_cursor *c, struct chip8_core *core) {
+  for(uint16_t i = 0; i < core->fb_size / sizeof(uint64_t); i++) {
+    core->fb[i] = chip8_state_get_uint(c, 8);
+  }
+}
+
+// Save states can come from anywhere, so every field that the interpreter uses as an index or
+// only expects a few values in is checked before the VM runs again.
+static int chip8_state_is_valid(const struct chip8 *vm) {
+  const struct chip8_core *core = &vm->core;
+
+  //pc has to point at a full instruction
+  if(core->pc >= core->ram_size - 1 || core->I > core->ram_size || core->sp > core->stack_size) {
+    return 0;
+  }
+
+  //no key, or exactly one
+  const uint32_t key = core->last_released_key;
+  if((core->key_interrupt_flags & ~(CHIP8_KEY_INT_FLAG_WAITING | CHIP8_KEY_INT_FLAG_RELEASED)) != 0 || (key & (key - 1)) != 0 || key > CHIP8_KEY_F) {
+    return 0;
+  }
+
+  switch(vm->emu) {
+    case CHIP8_VARIANT_VIP: return 1;
+    case CHIP8_VARIANT_SUPER: {
+      const struct schip8 *super = chip8_super(vm);
+      return (super->res == SCHIP_DISPLAY_HIRES || super->res == SCHIP_DISPLAY_LORES) && super->will_exit <= 1;
+    }
+    case CHIP8_VARIANT_XO: return 0;
+  }
+  return 0;
+}
+
+// Write the state of the VM into buf. Returns the size of the save state, or 0 if
+// buf is too small.
+size_t chip8_state_save(const struct chip8 *vm, uint8_t *buf, size_t cap) {
+  const struct chip8_core *core = &vm->core;
+  struct chip8_state_cursor c = {buf, cap, 0, 0};
+
+  chip8_state_put(&c, CHIP8_STATE_MAGIC, 4);
+  chip8_state_put_uint(&c, CHIP8_STATE_VERSION, 1);
+  chip8_state_put_uint(&c, vm->emu, 1);
+
+  chip8_state_put(&c, core->V, sizeof(core->V));
+  chip8_state_put_uint(&c, core->I, 2);
+  chip8_state_put_uint(&c, core->pc, 2);
+  chip8_state_put_uint(&c, core->sp, 1);
+  chip8_state_put_uint(&c, core->delay_timer, 1);
+  chip8_state_put_uint(&c, core->sound_timer, 1);
+  chip8_state_put_uint(&c, core->keyboard_inputs, 2);
+  chip8_state_put_uint(&c, core->key_interrupt_flags, 1);
+  chip8_state_put_uint(&c, core->last_released_key, 2);
+  chip8_state_put_uint(&c, core->millis_timer60hz, 8);
+  chip8_state_put_uint(&c, core->quirks, 2);
+
+  for(uint8_t i = 0; i < 4; i++) {
+    chip8_state_put_uint(&c, core->rng.s[i], 8);
+  }
+  chip8_state_put_uint(&c, core->rng_seed, 8);
+
+  for(uint8_t i = 0; i < core->stack_size; i++) {
+    chip8_state_put_uint(&c, core->stack[i], 2);
+  }
+
+  chip8_state_put(&c, core->ram, core->ram_size);
+  chip8_state_put_fb(&c, core);
+
+  switch(vm->emu) {
+    case CHIP8_VARIANT_VIP: break;
+    case CHIP8_VARIANT_SUPER: {
+      chip8_state_put(&c, chip8_super(vm)->rpl_flags, sizeof(chip8_super(vm)->rpl_flags));
+      chip8_state_put_uint(&c, chip8_super(vm)->will_exit, 1);
+      chip8_state_put_uint(&c, chip8_super(vm)->res, 1);
+      break;
+    }
+    case CHIP8_VARIANT_XO: return 0;
+  }
+
+  return c.overflow ? 0 : c.pos;
+}
+
+// Restore a save state into vm. vm must have been made with chip8_create() (or chip8_create_array())
+// for the same variant as the save state.
+// Returns 0 if the save state is invalid. In that case, vm must be reset before it is used again.
+int chip8_state_load(struct chip8 *vm, const uint8_t *buf, size_t len) {
+  struct chip8_state_cursor c = {(uint8_t*) buf, len, 0, 0};
+
+  char magic[4];
+  chip8_state_get(&c, magic, 4);
+  if(c.overflow || memcmp(magic, CHIP8_STATE_MAGIC, 4) != 0) {
+    return 0;
+  }
+
+  if(chip8_state_get_uint(&c, 1) != CHIP8_STATE_VERSION) {
+    return 0;
+  }
+
+  enum chip8_emu_type emu = chip8_state_get_uint(&c, 1);
+  //a VM only has room for its own variant, so it can't be turned into another one
+  if(emu != vm->emu) {
+    return 0;
+  }
+
+  chip8_wrapper_release(vm);
+  chip8_wrapper_init(vm, emu);
+
+  struct chip8_core *core = &vm->core;
+
+  chip8_state_get(&c, core->V, sizeof(core->V));
+  core->I = chip8_state_get_uint(&c, 2);
+  core->pc = chip8_state_get_uint(&c, 2);
+  core->sp = chip8_state_get_uint(&c, 1);
+  core->delay_timer = chip8_state_get_uint(&c, 1);
+  core->sound_timer = chip8_state_get_uint(&c, 1);
+  core->keyboard_inputs = chip8_state_get_uint(&c, 2);
+  core->key_interrupt_flags = chip8_state_get_uint(&c, 1);
+  core->last_released_key = chip8_state_get_uint(&c, 2);
+  core->millis_timer60hz = chip8_state_get_uint(&c, 8);
+  core->quirks = chip8_state_get_uint(&c, 2);
+
+  for(uint8_t i = 0; i < 4; i++) {
+    core->rng.s[i] = chip8_state_get_uint(&c, 8);
+  }
+  core->rng_seed = chip8_state_get_uint(&c, 8);
+
+  for(uint8_t i = 0; i < core->stack_size; i++) {
+    core->stack[i] = chip8_state_get_uint(&c, 2);
+  }
+
+  chip8_state_get(&c, core->ram, core->ram_size);
+  chip8_state_get_fb(&c, core);
+
+  switch(vm->emu) {
+    case CHIP8_VARIANT_VIP: break;
+    case CHIP8_VARIANT_SUPER: {
+      chip8_state_get(&c, chip8_super(vm)->rpl_flags, sizeof(chip8_super(vm)->rpl_flags));
+      chip8_super(vm)->will_exit = chip8_state_get_uint(&c, 1);
+      chip8_super(vm)->res = chip8_state_get_uint(&c, 1);
+      break;
+    }
+    case CHIP8_VARIANT_XO: return 0;
+  }
+
+  //hashes are not stored in the save state, since they can be rebuilt from RAM and the framebuffer
+  chip8_rehash(core);
+
+  return !c.overflow && chip8_state_is_valid(vm);
+}
+
+// Write a compressed save state into a file.
+int chip8_state_save_file(const struct chip8 *vm, FILE *file) {
+  uint8_t buf[CHIP8_STATE_MAX_SIZE];
+  size_t len = chip8_state_save(vm, buf, sizeof(buf));
+  if(len == 0) {
+    return 0;
+  }
+
+  struct lz_writer w;
+  if(!lz_writer_open(&w, file)) {
+    return 0;
+  }
+
+  lz_write(&w, buf, len);
+  return lz_writer_close(&w);
+}
+
+// Load a compressed save state from a file.
+int chip8_state_load_file(struct chip8 *vm, FILE *file) {
+  uint8_t buf[CHIP8_STATE_MAX_SIZE];
+
+  struct lz_reader r;
+  if(!lz_reader_open(&r, file)) {
+    return 0;
+  }
+
+  size_t len = lz_read(&r, buf, sizeof(buf));
+  uint8_t error = r.error;
+  lz_reader_close(&r);
+
+  if(error) {
+    return 0;
+  }
+
+  return chip8_state_load(vm, buf, len);
+}
@@ -0,0 +1,21 @@
+#ifndef CHIP8_STATE_H
+#define CHIP8_STATE_H
+
+#include "chip8.h"
+
+// Save states store the entire state of a VM, so that it can be restored later.
+//
+// The state is written field by field in a fixed byte order (rather than copying
+// struct chip8 directly), so save states do not contain pointers and can be loaded
+// on other machines.
+
+//large enough for the state of every supported variant
+#define CHIP8_STATE_MAX_SIZE 8192
+
+size_t chip8_state_save(const struct chip8 *vm, uint8_t *buf, size_t cap);
+int chip8_state_load(struct chip8 *vm, const uint8_t *buf, size_t len);
+
+int chip8_state_save_file(const struct chip8 *vm, FILE *file);
+int chip8_state_load_file(struct chip8 *vm, FILE *file);
+
+#endif// CHIP8_STATE_H
@@ -0,0 +1,150 @@
+#include "chip8_term.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+//if only this many unchanged cells sit between two changed ones, they are written again
+//instead of moving the cursor past them, since a cursor move takes more bytes than a few glyphs
+#define CHIP8_TERM_MAX_GAP 2
+
+void chip8_term_init(struct chip8_term *term, enum chip8_term_mode mode, uint16_t fb_width, uint16_t fb_height) {
+  term->mode = mode;
+  term->fb_width = fb_width;
+  term->fb_height = fb_height;
+
+  if(mode == CHIP8_TERM_BRAILLE) {
+    term->cols = fb_width / 2;
+    term->pixel_rows = 4;
+  } else {
+    term->cols = fb_width;
+    term->pixel_rows = 2;
+  }
+  term->rows = fb_height / term->pixel_rows;
+  assert((uint32_t)term->cols * term->rows <= CHIP8_TERM_MAX_CELLS);
+
+  term->out_len = 0;
+  chip8_term_invalidate(term);
+}
+
+// Write the whole display again on the next chip8_term_draw(), for example after the terminal was resized.
+void chip8_term_invalidate(struct chip8_term *term) {
+  term->drawn = 0;
+}
+
+// The pixels of one row of cells. For half blocks, bit 0 is the top pixel and bit 1 the bottom one.
+// For braille, bits are the dots of the braille pattern (U+2800 + bits), which are numbered
+// down the left column first, with the bottom row last:
+//   0 3
+//   1 4
+//   2 5
+//   6 7
+static void chip8_term_cell_row(const struct chip8_term *term, const uint64_t *fb, uint32_t cell_row, uint8_t *cells) {
+  const uint32_t words_per_row = term->fb_width / 64;
+  const uint64_t *row = fb + (size_t)cell_row * term->pixel_rows * words_per_row;
+
+  if(term->mode == CHIP8_TERM_HALF_BLOCKS) {
+    for(uint32_t w = 0; w < words_per_row; w++, cells += 64) {
+      const uint64_t top = row[w];
+      const uint64_t bottom = row[words_per_row + w];
+
+      for(uint32_t x = 0; x < 64; x++) {
+        cells[x] = ((top >> (63 - x)) & 1) | (((bottom >> (63 - x)) & 1) << 1);
+      }
+    }
+    return;
+  }
+
+  static const uint8_t left_dots[4] = {0x01, 0x02, 0x04, 0x40};
+  static const uint8_t right_dots[4] = {0x08, 0x10, 0x20, 0x80};
+
+  for(uint32_t w = 0; w < words_per_row; w++, cells += 32) {
+    memset(cells, 0, 32);
+
+    for(uint32_t y = 0; y < 4; y++) {
+      const uint64_t v = row[y * words_per_row + w];
+      if(v == 0) {
+        continue;
+      }
+
+      for(uint32_t x = 0; x < 32; x++) {
+        const uint32_t pair = (v >> (62 - 2 * x)) & 3;
+        cells[x] |= (pair & 2 ? left_dots[y] : 0) | (pair & 1 ? right_dots[y] : 0);
+      }
+    }
+  }
+}
+
+// Append the UTF-8 glyph for a cell.
+static char *chip8_term_put_glyph(const struct chip8_term *term, char *out, uint8_t cell) {
+  if(term->mode == CHIP8_TERM_BRAILLE) {
+    *out++ = (char)0xE2;
+    *out++ = (char)(0xA0 | (cell >> 6));
+    *out++ = (char)(0x80 | (cell & 0x3F));
+    return out;
+  }
+
+  //' ', U+2580 (upper half), U+2584 (lower half), U+2588 (full block)
+  static const uint8_t half_blocks[4] = {0, 0x80, 0x84, 0x88};
+  if(cell == 0) {
+    *out++ = ' ';
+  } else {
+    *out++ = (char)0xE2;
+    *out++ = (char)0x96;
+    *out++ = (char)half_blocks[cell];
+  }
+  return out;
+}
+
+// Build what has to be written to the terminal to go from the last frame to fb, where bit r of
+// dirty_rows is set if framebuffer row r changed (see chip8_take_fb_dirty()). The display is drawn
+// in the top left corner of the terminal. Returns the number of bytes in term->out, which is 0
+// if nothing on the terminal changed.
+size_t chip8_term_draw(struct chip8_term *term, const uint64_t *fb, uint64_t dirty_rows) {
+  char *out = term->out;
+  const uint64_t row_mask = ((uint64_t)1 << term->pixel_rows) - 1;
+
+  if(!term->drawn) {
+    //clear the screen, so every cell is blank, and hide the cursor
+    static const char clear[] = "\x1b[?25l\x1b[H\x1b[2J";
+    memcpy(out, clear, sizeof(clear) - 1);
+    out += sizeof(clear) - 1;
+
+    memset(term->cells, 0, (size_t)term->cols * term->rows);
+    dirty_rows = UINT64_MAX;
+    term->drawn = 1;
+  }
+
+  for(uint32_t r = 0; r < term->rows; r++) {
+    if(((dirty_rows >> (r * term->pixel_rows)) & row_mask) == 0) {
+      continue;
+    }
+
+    uint8_t cells[CHIP8_TERM_MAX_COLS];
+    uint8_t *old = &term->cells[r * term->cols];
+    chip8_term_cell_row(term, fb, r, cells);
+
+    //the column the cursor is at, if it is on this row
+    uint32_t cursor = UINT32_MAX;
+
+    for(uint32_t c = 0; c < term->cols; c++) {
+      if(cells[c] == old[c]) {
+        continue;
+      }
+
+      if(cursor != UINT32_MAX && c - cursor <= CHIP8_TERM_MAX_GAP) {
+        for(; cursor < c; cursor++) {
+          out = chip8_term_put_glyph(term, out, old[cursor]);
+        }
+      } else if(cursor != c) {
+        out += sprintf(out, "\x1b[%u;%uH", r + 1, c + 1);
+      }
+
+      out = chip8_term_put_glyph(term, out, cells[c]);
+      old[c] = cells[c];
+      cursor = c + 1;
+    }
+  }
+
+  term->out_len = out - term->out;
+  return term->out_len;
+}
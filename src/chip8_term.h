@@ -0,0 +1,54 @@
+#ifndef CHIP8_TERM_H
+#define CHIP8_TERM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Draws CHIP-8 displays in a terminal with Unicode characters, without SDL, so the emulator
+// can be watched over SSH on machines with no display.
+//
+// Every character cell shows several pixels:
+//  - half blocks (▀ ▄ █) show 1x2 pixels, so a 64x32 display takes 64x16 cells.
+//  - braille (⠿) shows 2x4 pixels, so a 64x32 display takes 32x8 cells.
+// Only the cell rows that cover changed framebuffer rows (chip8_core.fb_dirty) are looked at,
+// and only the cells that changed since the last frame are written, so an unchanged display
+// costs nothing and a moving sprite costs a few bytes.
+
+enum chip8_term_mode {
+  CHIP8_TERM_HALF_BLOCKS,
+  CHIP8_TERM_BRAILLE,
+};
+
+//largest display (SUPER-CHIP, 128x64) in half blocks
+#define CHIP8_TERM_MAX_COLS 128
+#define CHIP8_TERM_MAX_CELLS (CHIP8_TERM_MAX_COLS * 32)
+
+//a cursor move and a glyph for every cell, plus room for clearing the screen
+#define CHIP8_TERM_MAX_OUT (CHIP8_TERM_MAX_CELLS * 16 + 64)
+
+struct chip8_term {
+  enum chip8_term_mode mode;
+  uint16_t fb_width;
+  uint16_t fb_height;
+
+  //size of the display in character cells, and how many framebuffer rows every cell row covers
+  uint16_t cols;
+  uint16_t rows;
+  uint8_t pixel_rows;
+
+  //the pixels of every cell as it is on the terminal right now (see chip8_term_cell_glyph())
+  uint8_t cells[CHIP8_TERM_MAX_CELLS];
+
+  //0 until the whole display was written once, or after chip8_term_invalidate()
+  uint8_t drawn;
+
+  //what to write to the terminal for the last frame
+  char out[CHIP8_TERM_MAX_OUT];
+  size_t out_len;
+};
+
+void chip8_term_init(struct chip8_term *term, enum chip8_term_mode mode, uint16_t fb_width, uint16_t fb_height);
+void chip8_term_invalidate(struct chip8_term *term);
+size_t chip8_term_draw(struct chip8_term *term, const uint64_t *fb, uint64_t dirty_rows);
+
+#endif// CHIP8_TERM_H
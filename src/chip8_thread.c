@@ -0,0 +1,117 @@
+#include "chip8_thread.h"
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// The thread functions of pthreads and Win32 take different arguments, so every thread
+// starts out in a trampoline that calls the real function.
+struct chip8_thread_start {
+  chip8_thread_fn fn;
+  void *arg;
+};
+
+#ifdef _WIN32
+
+static DWORD WINAPI chip8_thread_trampoline(LPVOID param) {
+  struct chip8_thread_start start = *(struct chip8_thread_start*)param;
+  free(param);
+  start.fn(start.arg);
+  return 0;
+}
+
+int chip8_thread_create(chip8_thread *thread, chip8_thread_fn fn, void *arg) {
+  struct chip8_thread_start *start = malloc(sizeof(*start));
+  if(start == NULL) {
+    return 0;
+  }
+  start->fn = fn;
+  start->arg = arg;
+
+  *thread = CreateThread(NULL, 0, chip8_thread_trampoline, start, 0, NULL);
+  if(*thread == NULL) {
+    free(start);
+    return 0;
+  }
+  return 1;
+}
+
+void chip8_thread_join(chip8_thread thread) {
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+}
+
+uint32_t chip8_thread_num_cpus(void) {
+  DWORD n = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+  return n == 0 ? 1 : n;
+}
+
+void chip8_thread_sleep(uint64_t nanos) {
+  Sleep((DWORD)((nanos + 999999) / 1000000));
+}
+
+void chip8_mutex_init(chip8_mutex *m) { InitializeSRWLock(m); }
+void chip8_mutex_destroy(chip8_mutex *m) { (void)m; }
+void chip8_mutex_lock(chip8_mutex *m) { AcquireSRWLockExclusive(m); }
+void chip8_mutex_unlock(chip8_mutex *m) { ReleaseSRWLockExclusive(m); }
+int chip8_mutex_trylock(chip8_mutex *m) { return TryAcquireSRWLockExclusive(m) != 0; }
+
+void chip8_cond_init(chip8_cond *c) { InitializeConditionVariable(c); }
+void chip8_cond_destroy(chip8_cond *c) { (void)c; }
+void chip8_cond_wait(chip8_cond *c, chip8_mutex *m) { SleepConditionVariableSRW(c, m, INFINITE, 0); }
+void chip8_cond_signal(chip8_cond *c) { WakeConditionVariable(c); }
+void chip8_cond_broadcast(chip8_cond *c) { WakeAllConditionVariable(c); }
+
+#else
+
+static void *chip8_thread_trampoline(void *param) {
+  struct chip8_thread_start start = *(struct chip8_thread_start*)param;
+  free(param);
+  start.fn(start.arg);
+  return NULL;
+}
+
+int chip8_thread_create(chip8_thread *thread, chip8_thread_fn fn, void *arg) {
+  struct chip8_thread_start *start = malloc(sizeof(*start));
+  if(start == NULL) {
+    return 0;
+  }
+  start->fn = fn;
+  start->arg = arg;
+
+  if(pthread_create(thread, NULL, chip8_thread_trampoline, start) != 0) {
+    free(start);
+    return 0;
+  }
+  return 1;
+}
+
+void chip8_thread_join(chip8_thread thread) {
+  pthread_join(thread, NULL);
+}
+
+uint32_t chip8_thread_num_cpus(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n < 1 ? 1 : (uint32_t)n;
+}
+
+void chip8_thread_sleep(uint64_t nanos) {
+  struct timespec ts = {(time_t)(nanos / 1000000000), (long)(nanos % 1000000000)};
+  nanosleep(&ts, NULL);
+}
+
+void chip8_mutex_init(chip8_mutex *m) { pthread_mutex_init(m, NULL); }
+void chip8_mutex_destroy(chip8_mutex *m) { pthread_mutex_destroy(m); }
+void chip8_mutex_lock(chip8_mutex *m) { pthread_mutex_lock(m); }
+void chip8_mutex_unlock(chip8_mutex *m) { pthread_mutex_unlock(m); }
+int chip8_mutex_trylock(chip8_mutex *m) { return pthread_mutex_trylock(m) == 0; }
+
+void chip8_cond_init(chip8_cond *c) { pthread_cond_init(c, NULL); }
+void chip8_cond_destroy(chip8_cond *c) { pthread_cond_destroy(c); }
+void chip8_cond_wait(chip8_cond *c, chip8_mutex *m) { pthread_cond_wait(c, m); }
+void chip8_cond_signal(chip8_cond *c) { pthread_cond_signal(c); }
+void chip8_cond_broadcast(chip8_cond *c) { pthread_cond_broadcast(c); }
+
+#endif
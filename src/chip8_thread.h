@@ -0,0 +1,58 @@
+#ifndef CHIP8_THREAD_H
+#define CHIP8_THREAD_H
+
+#include <stdint.h>
+
+// Threads, locks and condition variables for the code that runs VMs (or encodes recordings)
+// on several threads, without SDL. This is pthreads everywhere but Windows, where the
+// threads, slim reader/writer locks and condition variables of Win32 are used instead.
+//
+// None of these can fail once they are set up, except creating a thread.
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+typedef HANDLE chip8_thread;
+typedef SRWLOCK chip8_mutex;
+typedef CONDITION_VARIABLE chip8_cond;
+#else
+#include <pthread.h>
+
+typedef pthread_t chip8_thread;
+typedef pthread_mutex_t chip8_mutex;
+typedef pthread_cond_t chip8_cond;
+#endif
+
+typedef void (*chip8_thread_fn)(void *arg);
+
+// Start a thread that runs fn(arg). Returns 0 if it could not be started.
+int chip8_thread_create(chip8_thread *thread, chip8_thread_fn fn, void *arg);
+void chip8_thread_join(chip8_thread thread);
+
+// Number of CPU cores that can run threads (at least 1).
+uint32_t chip8_thread_num_cpus(void);
+
+// Put the calling thread to sleep for about nanos nanoseconds.
+void chip8_thread_sleep(uint64_t nanos);
+
+void chip8_mutex_init(chip8_mutex *m);
+void chip8_mutex_destroy(chip8_mutex *m);
+void chip8_mutex_lock(chip8_mutex *m);
+void chip8_mutex_unlock(chip8_mutex *m);
+
+// Lock m only if no one else holds it. Returns 1 if it was locked.
+int chip8_mutex_trylock(chip8_mutex *m);
+
+void chip8_cond_init(chip8_cond *c);
+void chip8_cond_destroy(chip8_cond *c);
+
+// Unlock m, wait until c is signalled, and lock m again. Like every condition variable, this
+// can also wake up without being signalled, so the caller has to check what it waits for in a loop.
+void chip8_cond_wait(chip8_cond *c, chip8_mutex *m);
+void chip8_cond_signal(chip8_cond *c);
+void chip8_cond_broadcast(chip8_cond *c);
+
+#endif// CHIP8_THREAD_H
@@ -0,0 +1,325 @@
+#include "chip8_thread_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+static uint64_t chip8_thread_pool_nanos(void) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Make sure the queue of a worker can hold every job. Only called between runs.
+static int chip8_worker_reserve(struct chip8_worker *w, uint32_t count) {
+  if(count <= w->capacity) {
+    return 1;
+  }
+
+  uint32_t *jobs = realloc(w->jobs, (size_t)count * sizeof(uint32_t));
+  if(jobs == NULL) {
+    return 0;
+  }
+
+  w->jobs = jobs;
+  w->capacity = count;
+  return 1;
+}
+
+static void chip8_worker_push(struct chip8_worker *w, uint32_t job) {
+  chip8_mutex_lock(&w->lock);
+  w->jobs[(w->head + w->size) % w->capacity] = job;
+  w->size++;
+  atomic_fetch_add_explicit(&w->pool->num_queued, 1, memory_order_relaxed);
+  chip8_mutex_unlock(&w->lock);
+
+  //wake up a worker that ran out of jobs, it can steal this one
+  chip8_mutex_lock(&w->pool->lock);
+  chip8_cond_signal(&w->pool->job_queued);
+  chip8_mutex_unlock(&w->pool->lock);
+}
+
+// The owner takes the job it pushed last, which is the one most likely to still be in its cache.
+static int chip8_worker_pop(struct chip8_worker *w, uint32_t *job) {
+  int found = 0;
+
+  chip8_mutex_lock(&w->lock);
+  if(w->size > 0) {
+    w->size--;
+    *job = w->jobs[(w->head + w->size) % w->capacity];
+    atomic_fetch_sub_explicit(&w->pool->num_queued, 1, memory_order_relaxed);
+    found = 1;
+  }
+  chip8_mutex_unlock(&w->lock);
+
+  return found;
+}
+
+// Thieves take the job that has been waiting the longest.
+static int chip8_worker_steal(struct chip8_worker *w, uint32_t *job) {
+  int found = 0;
+
+  //don't wait on a queue that someone else is using, just move on to the next one.
+  if(!chip8_mutex_trylock(&w->lock)) {
+    return 0;
+  }
+
+  if(w->size > 0) {
+    *job = w->jobs[w->head];
+    w->head = (w->head + 1) % w->capacity;
+    w->size--;
+    atomic_fetch_sub_explicit(&w->pool->num_queued, 1, memory_order_relaxed);
+    found = 1;
+  }
+  chip8_mutex_unlock(&w->lock);
+
+  return found;
+}
+
+// Run jobs until every job of the current work is done.
+static void chip8_thread_pool_work(struct chip8_worker *w) {
+  struct chip8_thread_pool *pool = w->pool;
+  uint64_t idle_start = chip8_thread_pool_nanos();
+
+  while(atomic_load_explicit(&pool->num_left, memory_order_acquire) > 0) {
+    uint32_t job;
+    int found = chip8_worker_pop(w, &job);
+
+    for(uint32_t i = 1; !found && i < pool->num_workers; i++) {
+      found = chip8_worker_steal(&pool->workers[(w->index + i) % pool->num_workers], &job);
+      w->stats.num_steals += found;
+    }
+
+    if(!found) {
+      //every job left is being run by another worker right now. Wait until one of them puts
+      //its job back, or the last one is done. Both happen under the lock, so neither is missed.
+      chip8_mutex_lock(&pool->lock);
+      while(atomic_load_explicit(&pool->num_left, memory_order_acquire) > 0 &&
+            atomic_load_explicit(&pool->num_queued, memory_order_relaxed) == 0) {
+        chip8_cond_wait(&pool->job_queued, &pool->lock);
+      }
+      chip8_mutex_unlock(&pool->lock);
+      continue;
+    }
+
+    uint64_t start = chip8_thread_pool_nanos();
+    int has_more = pool->fn(pool->ctx, job);
+    uint64_t end = chip8_thread_pool_nanos();
+
+    w->stats.idle_nanos += start - idle_start;
+    w->stats.busy_nanos += end - start;
+    w->stats.num_slices++;
+    idle_start = end;
+
+    if(has_more == CHIP8_THREAD_POOL_PARKED) {
+      //whoever resumes the job puts it back, it may even be running again already
+    } else if(has_more) {
+      chip8_worker_push(w, job);
+    } else if(atomic_fetch_sub_explicit(&pool->num_left, 1, memory_order_acq_rel) == 1) {
+      //the waiting workers can go back to sleep until the next run
+      chip8_mutex_lock(&pool->lock);
+      chip8_cond_broadcast(&pool->job_queued);
+      chip8_mutex_unlock(&pool->lock);
+    }
+  }
+
+  w->stats.idle_nanos += chip8_thread_pool_nanos() - idle_start;
+}
+
+static void chip8_thread_pool_worker(void *arg) {
+  struct chip8_worker *w = arg;
+  struct chip8_thread_pool *pool = w->pool;
+  uint64_t seen_generation = 0;
+
+  chip8_mutex_lock(&pool->lock);
+  while(1) {
+    while(!pool->stop && pool->generation == seen_generation) {
+      chip8_cond_wait(&pool->work_ready, &pool->lock);
+    }
+    if(pool->stop) {
+      break;
+    }
+    seen_generation = pool->generation;
+    chip8_mutex_unlock(&pool->lock);
+
+    chip8_thread_pool_work(w);
+
+    chip8_mutex_lock(&pool->lock);
+    pool->num_busy--;
+    if(pool->num_busy == 0) {
+      chip8_cond_signal(&pool->work_done);
+    }
+  }
+  chip8_mutex_unlock(&pool->lock);
+}
+
+// Create a pool with num_threads threads in total. The thread that calls chip8_thread_pool_run_jobs()
+// also does work, so only (num_threads - 1) threads get created.
+int chip8_thread_pool_init(struct chip8_thread_pool *pool, uint32_t num_threads) {
+  if(num_threads == 0) num_threads = 1;
+
+  pool->num_threads = 0;
+  pool->num_workers = num_threads;
+  pool->generation = 0;
+  pool->stop = 0;
+  pool->run_inline = 0;
+  pool->num_busy = 0;
+  atomic_init(&pool->num_left, 0);
+  atomic_init(&pool->num_queued, 0);
+  pool->threads = malloc(num_threads * sizeof(chip8_thread));
+  pool->workers = aligned_malloc(CHIP8_CACHE_LINE, num_threads * sizeof(struct chip8_worker));
+  if(pool->threads == NULL || pool->workers == NULL) {
+    free(pool->threads);
+    aligned_free(pool->workers);
+    return 0;
+  }
+
+  chip8_mutex_init(&pool->lock);
+  chip8_cond_init(&pool->work_ready);
+  chip8_cond_init(&pool->work_done);
+  chip8_cond_init(&pool->job_queued);
+
+  for(uint32_t i = 0; i < num_threads; i++) {
+    struct chip8_worker *w = &pool->workers[i];
+    memset(w, 0, sizeof(*w));
+    chip8_mutex_init(&w->lock);
+    w->pool = pool;
+    w->index = i;
+  }
+
+  for(uint32_t i = 0; i < num_threads - 1; i++) {
+    if(!chip8_thread_create(&pool->threads[i], chip8_thread_pool_worker, &pool->workers[i + 1])) {
+      chip8_thread_pool_destroy(pool);
+      return 0;
+    }
+    pool->num_threads++;
+  }
+
+  return 1;
+}
+
+void chip8_thread_pool_destroy(struct chip8_thread_pool *pool) {
+  chip8_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  chip8_cond_broadcast(&pool->work_ready);
+  chip8_mutex_unlock(&pool->lock);
+
+  for(uint32_t i = 0; i < pool->num_threads; i++) {
+    chip8_thread_join(pool->threads[i]);
+  }
+
+  for(uint32_t i = 0; i < pool->num_workers; i++) {
+    chip8_mutex_destroy(&pool->workers[i].lock);
+    free(pool->workers[i].jobs);
+  }
+
+  chip8_mutex_destroy(&pool->lock);
+  chip8_cond_destroy(&pool->work_ready);
+  chip8_cond_destroy(&pool->work_done);
+  chip8_cond_destroy(&pool->job_queued);
+  free(pool->threads);
+  aligned_free(pool->workers);
+  pool->threads = NULL;
+  pool->workers = NULL;
+  pool->num_threads = 0;
+  pool->num_workers = 0;
+}
+
+// Run jobs [0, count) on all threads of the pool, and wait until all of them are done. 
+// fn is called for each job until it returns 0. Only one thread may call this at a time.
+void chip8_thread_pool_run_jobs(struct chip8_thread_pool *pool, uint32_t count, chip8_thread_pool_job_fn fn, void *ctx) {
+  uint32_t num_workers = pool->num_workers;
+
+  //a job goes back into the queue of whichever worker ran it last, so every 
+  //queue must be able to hold all of the jobs.
+  for(uint32_t i = 0; i < num_workers; i++) {
+    if(!chip8_worker_reserve(&pool->workers[i], count)) {
+      //out of memory, just run every job on this thread. A parked job is run again until it can go on.
+      pool->run_inline = 1;
+      for(uint32_t job = 0; job < count; job++) {
+        while(fn(ctx, job));
+      }
+      pool->run_inline = 0;
+      return;
+    }
+  }
+
+  //give every worker an even share of the jobs to start with.
+  uint32_t first_job = 0;
+  for(uint32_t i = 0; i < num_workers; i++) {
+    struct chip8_worker *w = &pool->workers[i];
+    uint32_t last_job = (uint32_t)((uint64_t)count * (i + 1) / num_workers);
+
+    w->head = 0;
+    w->size = 0;
+    for(uint32_t job = first_job; job < last_job; job++) {
+      w->jobs[w->size++] = job;
+    }
+    first_job = last_job;
+  }
+
+  chip8_mutex_lock(&pool->lock);
+  pool->fn = fn;
+  pool->ctx = ctx;
+  atomic_store_explicit(&pool->num_left, count, memory_order_relaxed);
+  atomic_store_explicit(&pool->num_queued, count, memory_order_relaxed);
+  pool->num_busy = pool->num_threads;
+  pool->generation++;
+  chip8_cond_broadcast(&pool->work_ready);
+  chip8_mutex_unlock(&pool->lock);
+
+  chip8_thread_pool_work(&pool->workers[0]);
+
+  chip8_mutex_lock(&pool->lock);
+  while(pool->num_busy != 0) {
+    chip8_cond_wait(&pool->work_done, &pool->lock);
+  }
+  chip8_mutex_unlock(&pool->lock);
+}
+
+
+// Put a job that returned CHIP8_THREAD_POOL_PARKED back into a queue, so that a worker runs its next
+// slice. Can be called from any thread, even before the slice that parked the job has returned.
+void chip8_thread_pool_resume(struct chip8_thread_pool *pool, uint32_t job) {
+  if(pool->run_inline) {
+    return;
+  }
+  chip8_worker_push(&pool->workers[job % pool->num_workers], job);
+}
+
+
+struct chip8_thread_pool_range {
+  chip8_thread_pool_fn fn;
+  void *ctx;
+  uint32_t count;
+  uint32_t chunk_size;
+};
+
+static int chip8_thread_pool_run_chunk(void *ctx, uint32_t job) {
+  struct chip8_thread_pool_range *range = ctx;
+  uint32_t begin = job * range->chunk_size;
+  uint32_t end = begin + range->chunk_size;
+  if(end > range->count || end < begin) end = range->count;
+
+  range->fn(range->ctx, begin, end);
+  return 0;
+}
+
+// Call fn on every chunk of [0, count) using all threads of the pool, and wait until 
+// all chunks are done. Only one thread may call this at a time.
+void chip8_thread_pool_run(struct chip8_thread_pool *pool, uint32_t count, uint32_t chunk_size, chip8_thread_pool_fn fn, void *ctx) {
+  if(chunk_size == 0) chunk_size = 1;
+
+  struct chip8_thread_pool_range range = {fn, ctx, count, chunk_size};
+  uint32_t num_chunks = count / chunk_size + (count % chunk_size != 0);
+
+  chip8_thread_pool_run_jobs(pool, num_chunks, chip8_thread_pool_run_chunk, &range);
+}
+
+// Set the stats of every worker back to 0. Stats are only updated while work is 
+// running, so they can be read (pool->workers[i].stats) between runs.
+void chip8_thread_pool_reset_stats(struct chip8_thread_pool *pool) {
+  for(uint32_t i = 0; i < pool->num_workers; i++) {
+    memset(&pool->workers[i].stats, 0, sizeof(struct chip8_worker_stats));
+  }
+}
@@ -0,0 +1,104 @@
+#ifndef CHIP8_THREAD_POOL_H
+#define CHIP8_THREAD_POOL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "chip8_thread.h"
+
+#include "chip8_core.h"
+
+// A work-stealing pool of worker threads used to run many VMs at the same time.
+// 
+// Work is given to the pool as a list of jobs [0, count). Each worker has its own queue 
+// of jobs, and the jobs are spread evenly across the queues. Workers take jobs from the back
+// of their own queue, and once it is empty, steal jobs from the front of another worker's 
+// queue, so workers that got fast jobs are not left idle while others are still working.
+//
+// A job can be split into slices (for example, a few frames at a time). After each slice, 
+// the job goes back into the queue of the worker that ran it, so a long job can be stolen 
+// and continued by another worker between slices.
+
+// A job can also be parked when it has to wait for something (like room in the queue of a recording).
+// It then stays out of every queue, and the workers run other jobs, until chip8_thread_pool_resume()
+// puts it back.
+
+// Returned by a job that was parked.
+#define CHIP8_THREAD_POOL_PARKED 2
+
+// Runs the next slice of a job. Returns 1 if the job has more work left, 0 once it is done, or
+// CHIP8_THREAD_POOL_PARKED if it cannot go on until chip8_thread_pool_resume() is called for it.
+typedef int (*chip8_thread_pool_job_fn)(void *ctx, uint32_t job);
+
+// Runs the work for indices [begin, end).
+typedef void (*chip8_thread_pool_fn)(void *ctx, uint32_t begin, uint32_t end);
+
+struct chip8_worker_stats {
+  uint64_t busy_nanos; //time spent running jobs
+  uint64_t idle_nanos; //time spent looking for jobs
+  uint64_t num_slices;
+  uint64_t num_steals;
+};
+
+struct chip8_worker {
+  //every worker starts on its own cache line, since its queue and stats are written to all the time
+  _Alignas(CHIP8_CACHE_LINE) chip8_mutex lock;
+
+  //ring buffer of the jobs in this worker's queue. 
+  //The owner pushes and pops at the back (tail), thieves steal from the front (head).
+  uint32_t *jobs;
+  uint32_t capacity;
+  uint32_t head;
+  uint32_t size;
+
+  struct chip8_worker_stats stats;
+
+  struct chip8_thread_pool *pool;
+  uint32_t index;
+};
+
+struct chip8_thread_pool {
+  chip8_thread *threads;
+  uint32_t num_threads;
+
+  //one worker per thread, plus worker 0 for the thread that calls chip8_thread_pool_run_jobs()
+  struct chip8_worker *workers;
+  uint32_t num_workers;
+
+  chip8_mutex lock;
+  chip8_cond work_ready;
+  chip8_cond work_done;
+
+  //signalled when a job is put back into a queue, or the last job is done, so 
+  //workers that found nothing to steal can wait for that instead of spinning.
+  chip8_cond job_queued;
+
+  //the work currently being run
+  chip8_thread_pool_job_fn fn;
+  void *ctx;
+
+  //number of jobs that are not done yet
+  _Atomic uint32_t num_left;
+
+  //number of jobs sitting in the queues, waiting for a worker
+  _Atomic uint32_t num_queued;
+
+  //number of workers still running the current work
+  uint32_t num_busy;
+
+  //incremented every time new work is given to the pool, so that workers
+  //know when to wake up.
+  uint64_t generation;
+  uint8_t stop;
+
+  //set while the jobs run on the calling thread alone (when the queues could not be allocated)
+  uint8_t run_inline;
+};
+
+int chip8_thread_pool_init(struct chip8_thread_pool *pool, uint32_t num_threads);
+void chip8_thread_pool_destroy(struct chip8_thread_pool *pool);
+void chip8_thread_pool_run_jobs(struct chip8_thread_pool *pool, uint32_t count, chip8_thread_pool_job_fn fn, void *ctx);
+void chip8_thread_pool_resume(struct chip8_thread_pool *pool, uint32_t job);
+void chip8_thread_pool_run(struct chip8_thread_pool *pool, uint32_t count, uint32_t chunk_size, chip8_thread_pool_fn fn, void *ctx);
+void chip8_thread_pool_reset_stats(struct chip8_thread_pool *pool);
+
+#endif// CHIP8_THREAD_POOL_H
@@ -0,0 +1,59 @@
+#ifndef CHIP8_TRIPLE_BUFFER_H
+#define CHIP8_TRIPLE_BUFFER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "chip8_core.h"
+
+// Hands the newest of a stream of buffers (for example finished frames) from one writer
+// thread to one reader thread, without locks, and without either side ever waiting.
+//
+// There are 3 buffers. The writer fills the back buffer and the reader reads the front buffer,
+// while the middle one holds the newest buffer that was published. Publishing swaps the back
+// and middle buffers, and reading swaps the middle and front buffers if the middle one is newer.
+// A reader that is slower than the writer simply skips the buffers it missed.
+//
+// The buffers themselves belong to the caller. This only keeps track of their indices (0 to 2).
+
+//set in middle when it holds a buffer that the reader has not seen yet
+#define CHIP8_TRIPLE_BUFFER_NEW 4
+
+struct chip8_triple_buffer {
+  _Alignas(CHIP8_CACHE_LINE) _Atomic uint8_t middle;
+
+  //only used by the writer and by the reader, so they are kept on cache lines of their own
+  _Alignas(CHIP8_CACHE_LINE) uint8_t back;
+  _Alignas(CHIP8_CACHE_LINE) uint8_t front;
+};
+
+static inline void chip8_triple_buffer_init(struct chip8_triple_buffer *tb) {
+  tb->back = 0;
+  atomic_init(&tb->middle, 1);
+  tb->front = 2;
+}
+
+// Index of the buffer the writer should fill next.
+static inline uint8_t chip8_triple_buffer_back(const struct chip8_triple_buffer *tb) {
+  return tb->back;
+}
+
+// Make the back buffer the newest one. Returns the index of the buffer to fill next.
+static inline uint8_t chip8_triple_buffer_publish(struct chip8_triple_buffer *tb) {
+  //release, so the reader sees everything that was written to the buffer
+  const uint8_t old = atomic_exchange_explicit(&tb->middle, tb->back | CHIP8_TRIPLE_BUFFER_NEW, memory_order_acq_rel);
+  tb->back = old & 3;
+  return tb->back;
+}
+
+// Index of the newest buffer that was published. It stays valid until the next call.
+static inline uint8_t chip8_triple_buffer_read(struct chip8_triple_buffer *tb) {
+  //only swap if something new was published, so a reader that polls often does not write to the shared cache line
+  if(atomic_load_explicit(&tb->middle, memory_order_relaxed) & CHIP8_TRIPLE_BUFFER_NEW) {
+    const uint8_t old = atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel);
+    tb->front = old & 3;
+  }
+  return tb->front;
+}
+
+#endif// CHIP8_TRIPLE_BUFFER_H
@@ -0,0 +1,227 @@
+#include "chip8_vec_env.h"
+#include <stdlib.h>
+#include <string.h>
+
+//number of envs each thread takes at a time, which are run by the same batch
+#define CHIP8_VEC_ENV_CHUNK CHIP8_BATCH_VEC_LANES
+
+static void chip8_vec_env_free_batches(struct chip8_vec_env *env) {
+  for(uint32_t i = 0; env->batches != NULL && i < env->num_batches; i++) {
+    chip8_batch_free(&env->batches[i]);
+  }
+  free(env->batches);
+  env->batches = NULL;
+  env->num_batches = 0;
+}
+
+static int chip8_vec_env_init_batches(struct chip8_vec_env *env) {
+  //a batch counts instructions in 16 bits
+  if(env->instructions_per_frame > UINT16_MAX) {
+    return 1;
+  }
+
+  env->num_batches = (env->num_envs + CHIP8_VEC_ENV_CHUNK - 1) / CHIP8_VEC_ENV_CHUNK;
+  env->batches = calloc(env->num_batches, sizeof(*env->batches));
+  if(env->batches == NULL) {
+    return 0;
+  }
+
+  for(uint32_t i = 0; i < env->num_batches; i++) {
+    uint32_t begin = i * CHIP8_VEC_ENV_CHUNK;
+    uint32_t count = env->num_envs - begin < CHIP8_VEC_ENV_CHUNK ? env->num_envs - begin : CHIP8_VEC_ENV_CHUNK;
+
+    if(!chip8_batch_init_lanes(&env->batches[i], chip8_array_at(env->envs, begin), count)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+
+int chip8_vec_env_init(struct chip8_vec_env *env, enum chip8_emu_type type, uint32_t num_envs, uint32_t num_threads, uint32_t instructions_per_frame) {
+  env->type = type;
+  env->num_envs = num_envs;
+  env->instructions_per_frame = instructions_per_frame;
+  env->seed = 0;
+  env->image = NULL;
+  env->obs_format = CHIP8_OBS_PACKED;
+  env->obs_pool_frames = 1;
+  env->obs_history = NULL;
+  env->batches = NULL;
+  env->num_batches = 0;
+
+  //one extra slot for the VM that holds the settings of the variant
+  env->start = chip8_create_array(type, num_envs + 1);
+  env->halted = calloc(num_envs, 1);
+
+  if(env->start == NULL || env->halted == NULL || !chip8_thread_pool_init(&env->pool, num_threads)) {
+    chip8_destroy_array(env->start, num_envs + 1);
+    free(env->halted);
+    return 0;
+  }
+
+  env->envs = chip8_array_at(env->start, 1);
+
+  if(!chip8_vec_env_init_batches(env)) {
+    chip8_vec_env_free(env);
+    return 0;
+  }
+  return 1;
+}
+
+void chip8_vec_env_free(struct chip8_vec_env *env) {
+  chip8_thread_pool_destroy(&env->pool);
+  chip8_vec_env_free_batches(env);
+
+  chip8_destroy_array(env->start, env->num_envs + 1);
+  if(env->image != NULL) {
+    chip8_release_image(env->image);
+  }
+
+  free(env->halted);
+  free(env->obs_history);
+  env->obs_history = NULL;
+  env->start = NULL;
+  env->envs = NULL;
+  env->halted = NULL;
+  env->num_envs = 0;
+}
+
+// Make image the ROM every env is reset from, and reset every env. Takes over the reference to image.
+static int chip8_vec_env_set_image(struct chip8_vec_env *env, struct chip8_shared_ram *image, uint64_t seed) {
+  if(image == NULL) {
+    return 0;
+  }
+
+  env->seed = seed;
+  if(env->image != NULL) {
+    chip8_release_image(env->image);
+  }
+  env->image = image;
+  chip8_wrapper_reset_from_image(env->start, image);
+
+  for(uint32_t i = 0; i < env->num_envs; i++) {
+    if(!chip8_vec_env_reset(env, i)) {
+      return 0;
+    }
+  }
+
+  for(uint32_t i = 0; i < env->num_batches; i++) {
+    chip8_batch_set_image(&env->batches[i], image);
+  }
+  return 1;
+}
+
+// Load a ROM and reset every env. Env i uses the RNG seed (seed + i), so that envs
+// do not all see the same random numbers.
+int chip8_vec_env_load(struct chip8_vec_env *env, FILE *rom, uint64_t seed) {
+  return chip8_vec_env_set_image(env, chip8_load_image(&env->start->core, rom), seed);
+}
+
+// Same as chip8_vec_env_load(), but the ROM is already in memory. rom is not used after this returns.
+int chip8_vec_env_load_from_buffer(struct chip8_vec_env *env, const uint8_t *rom, size_t len, uint64_t seed) {
+  return chip8_vec_env_set_image(env, chip8_load_image_from_buffer(&env->start->core, rom, len), seed);
+}
+
+// Reset a single env back to the start of the ROM (for example once it is done).
+int chip8_vec_env_reset(struct chip8_vec_env *env, uint32_t i) {
+  struct chip8 *vm = chip8_array_at(env->envs, i);
+
+  if(!chip8_wrapper_reset_from_image(vm, env->image)) {
+    return 0;
+  }
+
+  chip8_set_seed(&vm->core, env->seed + i);
+  env->halted[i] = 0;
+  if(env->obs_history != NULL) {
+    chip8_obs_history_clear(&env->obs_history[i]);
+  }
+  return 1;
+}
+
+// Choose the format of the framebuffers written by chip8_vec_env_step() (CHIP8_OBS_PACKED by default).
+// If pool_frames is more than 1, a pixel is lit if it was lit in any of the last pool_frames frames,
+// which hides sprites that flicker. Returns 0 if pool_frames is out of range or there is not enough memory.
+int chip8_vec_env_set_obs(struct chip8_vec_env *env, enum chip8_obs_format format, uint8_t pool_frames) {
+  if(pool_frames == 0 || pool_frames > CHIP8_OBS_MAX_POOL) {
+    return 0;
+  }
+
+  if(pool_frames > 1 && env->obs_history == NULL) {
+    env->obs_history = calloc(env->num_envs, sizeof(*env->obs_history));
+    if(env->obs_history == NULL) {
+      return 0;
+    }
+  }
+
+  env->obs_format = format;
+  env->obs_pool_frames = pool_frames;
+  return 1;
+}
+
+// The number of bytes of framebuffer written for each env by chip8_vec_env_step().
+size_t chip8_vec_env_fb_size(const struct chip8_vec_env *env) {
+  return chip8_obs_size(env->start, env->obs_format);
+}
+
+static void chip8_vec_env_step_range(void *ctx, uint32_t begin, uint32_t end) {
+  struct chip8_vec_env *env = ctx;
+  size_t fb_size = chip8_vec_env_fb_size(env);
+
+  if(env->batches != NULL) {
+    //chunks start at a multiple of CHIP8_VEC_ENV_CHUNK, so the range is exactly the lanes of one batch
+    struct chip8_batch *b = &env->batches[begin / CHIP8_VEC_ENV_CHUNK];
+
+    for(uint32_t i = begin; i < end; i++) {
+      if(!env->halted[i]) {
+        chip8_batch_set_keyboard(b, i - begin, env->inputs[i]);
+      }
+      b->halted[i - begin] = env->halted[i];
+    }
+
+    chip8_batch_run_frame(b, (uint16_t)env->instructions_per_frame);
+
+    for(uint32_t i = begin; i < end; i++) {
+      env->halted[i] = b->halted[i - begin];
+    }
+  } else {
+    for(uint32_t i = begin; i < end; i++) {
+      struct chip8 *vm = chip8_array_at(env->envs, i);
+
+      if(!env->halted[i]) {
+        chip8_set_keyboard(&vm->core, env->inputs[i]);
+
+        if(!chip8_wrapper_run_frame(vm, env->instructions_per_frame) || chip8_wrapper_has_exited(vm)) {
+          env->halted[i] = 1;
+        }
+      }
+    }
+  }
+
+  for(uint32_t i = begin; i < end; i++) {
+    struct chip8 *vm = chip8_array_at(env->envs, i);
+
+    uint8_t *fb = env->fbs + i * fb_size;
+    if(env->obs_pool_frames > 1) {
+      chip8_obs_write_pooled(vm, &env->obs_history[i], env->obs_pool_frames, env->obs_format, fb, fb_size);
+    } else {
+      chip8_obs_write(vm, env->obs_format, fb, fb_size);
+    }
+    env->dones[i] = env->halted[i];
+  }
+}
+
+// Run one frame on every env.
+//
+// inputs  - num_envs keyboard states, in the same format as chip8_core.keyboard_inputs.
+// fbs     - receives num_envs framebuffers of chip8_vec_env_fb_size() bytes each, in the format
+//           chosen with chip8_vec_env_set_obs().
+// dones   - receives num_envs flags. A flag is 1 if the env hit an instruction it could 
+//           not process, or if the program exited (SCHIP 00FD). Done envs stop running until they are reset.
+void chip8_vec_env_step(struct chip8_vec_env *env, const uint16_t *inputs, uint8_t *fbs, uint8_t *dones) {
+  env->inputs = inputs;
+  env->fbs = fbs;
+  env->dones = dones;
+
+  chip8_thread_pool_run(&env->pool, env->num_envs, CHIP8_VEC_ENV_CHUNK, chip8_vec_env_step_range, env);
+}
@@ -0,0 +1,68 @@
+#ifndef CHIP8_VEC_ENV_H
+#define CHIP8_VEC_ENV_H
+
+#include "chip8.h"
+#include "chip8_thread_pool.h"
+#include "chip8_obs.h"
+#include "chip8_batch.h"
+
+// Runs many independent VMs of the same variant in lockstep, one emulated frame at a time.
+// This is meant for training agents on CHIP-8 games, where thousands of copies of
+// the same game are stepped together.
+//
+// The ROM is loaded once into an image that every env is reset from, so they all share
+// the ROM's RAM until they write to it.
+//
+// The envs are split into chunks of CHIP8_VEC_ENV_CHUNK that the threads take one at a time.
+// Each chunk is run by a chip8_batch, so envs that are at the same instruction run it together
+// with SIMD instructions (see chip8_batch.h).
+struct chip8_vec_env {
+  enum chip8_emu_type type;
+
+  struct chip8 *envs;
+  uint32_t num_envs;
+
+  //font and ROM that every env is reset from, and a VM reset from it that holds
+  //the settings of the variant.
+  struct chip8_shared_ram *image;
+  struct chip8 *start;
+  uint64_t seed;
+
+  //set when an env runs into an instruction it cannot process, or when its program exits. 
+  //Such an env stops running until it is reset.
+  uint8_t *halted;
+
+  //number of instructions run by each env per frame
+  uint32_t instructions_per_frame;
+
+  //format of the framebuffers written by chip8_vec_env_step(), and the number of frames
+  //each one is max-pooled over (see chip8_vec_env_set_obs()).
+  enum chip8_obs_format obs_format;
+  uint8_t obs_pool_frames;
+  struct chip8_obs_history *obs_history;
+
+  //one batch for every chunk of envs. NULL if instructions_per_frame is too large for a batch,
+  //then every env runs on its own.
+  struct chip8_batch *batches;
+  uint32_t num_batches;
+
+  struct chip8_thread_pool pool;
+
+  //arguments of the step currently being run
+  const uint16_t *inputs;
+  uint8_t *fbs;
+  uint8_t *dones;
+};
+
+int chip8_vec_env_init(struct chip8_vec_env *env, enum chip8_emu_type type, uint32_t num_envs, uint32_t num_threads, uint32_t instructions_per_frame);
+void chip8_vec_env_free(struct chip8_vec_env *env);
+
+int chip8_vec_env_load(struct chip8_vec_env *env, FILE *rom, uint64_t seed);
+int chip8_vec_env_load_from_buffer(struct chip8_vec_env *env, const uint8_t *rom, size_t len, uint64_t seed);
+int chip8_vec_env_reset(struct chip8_vec_env *env, uint32_t i);
+
+int chip8_vec_env_set_obs(struct chip8_vec_env *env, enum chip8_obs_format format, uint8_t pool_frames);
+size_t chip8_vec_env_fb_size(const struct chip8_vec_env *env);
+void chip8_vec_env_step(struct chip8_vec_env *env, const uint16_t *inputs, uint8_t *fbs, uint8_t *dones);
+
+#endif// CHIP8_VEC_ENV_H
@@ -0,0 +1,276 @@
+// Shared memory farm of VMs (see chip8_farm.h). The VMs are created once, then run by a set
+// of worker processes that are restarted if they crash. Controllers (like `status`, or any
+// other program that maps the region) read screens and set keys while the workers run.
+//
+// Usage:
+//   ryce8-farm create <NAME> <ROM_FILE_PATH> <VIP | SUPER> <SLOTS> [INSTRUCTIONS_PER_FRAME] [SEED]
+//   ryce8-farm run <NAME> [--workers <N>]
+//   ryce8-farm status <NAME>
+//   ryce8-farm destroy <NAME>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "chip8_farm.h"
+
+#define FARM_DEFAULT_INSTRUCTIONS_PER_FRAME 10
+
+//how long a worker sleeps when none of its VMs have frames left to run
+#define FARM_IDLE_SLEEP_NANOS 1000000
+
+static volatile sig_atomic_t farm_stop = 0;
+
+static void farm_on_signal(int sig) {
+  (void)sig;
+  farm_stop = 1;
+}
+
+static int farm_parse_uint(const char *str, uint64_t max, uint64_t *out) {
+  char *end = NULL;
+  *out = strtoull(str, &end, 0);
+  return *str != '\0' && *str != '-' && *end == '\0' && *out <= max;
+}
+
+static int farm_create(int argc, char **argv) {
+  uint64_t num_slots;
+  uint64_t ipf = FARM_DEFAULT_INSTRUCTIONS_PER_FRAME;
+  uint64_t seed = 0;
+  enum chip8_emu_type type;
+
+  if(argc < 6 || argc > 8) {
+    printf("Usage: ryce8-farm create <NAME> <ROM_FILE_PATH> <VIP | SUPER> <SLOTS> [INSTRUCTIONS_PER_FRAME] [SEED]\n");
+    return 1;
+  }
+
+  if(strcmp(argv[4], "VIP") == 0) {
+    type = CHIP8_VARIANT_VIP;
+  } else if(strcmp(argv[4], "SUPER") == 0) {
+    type = CHIP8_VARIANT_SUPER;
+  } else {
+    printf("Error: Invalid type %s! Type must be VIP or SUPER.\n", argv[4]);
+    return 1;
+  }
+
+  if(!farm_parse_uint(argv[5], UINT32_MAX, &num_slots) || num_slots == 0 ||
+     (argc > 6 && !farm_parse_uint(argv[6], UINT32_MAX, &ipf)) ||
+     (argc > 7 && !farm_parse_uint(argv[7], UINT64_MAX, &seed))) {
+    printf("Error: SLOTS, INSTRUCTIONS_PER_FRAME and SEED must be non-negative integers, and there must be at least 1 slot.\n");
+    return 1;
+  }
+
+  FILE *rom = fopen(argv[3], "rb");
+  if(rom == NULL) {
+    printf("Error: Cannot open ROM %s!\n", argv[3]);
+    return 1;
+  }
+
+  struct chip8_farm farm;
+  int res = chip8_farm_create(&farm, argv[2], type, num_slots, ipf, rom, seed);
+  fclose(rom);
+
+  if(!res) {
+    printf("Error: Cannot create farm %s! It may already exist.\n", argv[2]);
+    return 1;
+  }
+
+  printf("Created farm %s: %u %s VMs, %zu bytes\n", argv[2], farm.header->num_slots, CHIP8_VARIANTS[type].name, farm.size);
+  chip8_farm_close(&farm);
+  return 0;
+}
+
+// Run every VM i where i % num_workers == index, until asked to stop.
+static int farm_worker(struct chip8_farm *farm, uint32_t index, uint32_t num_workers) {
+  const uint64_t owner = chip8_farm_owner_id(getpid());
+  const uint32_t num_slots = farm->header->num_slots;
+
+  uint8_t *owned = calloc(num_slots, 1);
+  if(owned == NULL) {
+    return 1;
+  }
+
+  while(!farm_stop) {
+    uint8_t ran = 0;
+
+    for(uint32_t i = index; i < num_slots; i += num_workers) {
+      if(owned[i]) {
+        ran |= chip8_farm_run_frame(farm, i);
+      }
+    }
+
+    if(!ran) {
+      //pick up VMs that belonged to a worker that is gone
+      for(uint32_t i = index; i < num_slots; i += num_workers) {
+        if(!owned[i]) {
+          owned[i] = chip8_farm_claim(farm, i, owner);
+        }
+      }
+
+      struct timespec idle = {0, FARM_IDLE_SLEEP_NANOS};
+      nanosleep(&idle, NULL);
+    }
+  }
+
+  for(uint32_t i = index; i < num_slots; i += num_workers) {
+    if(owned[i]) {
+      chip8_farm_release(farm, i, owner);
+    }
+  }
+  free(owned);
+  return 0;
+}
+
+static pid_t farm_start_worker(struct chip8_farm *farm, uint32_t index, uint32_t num_workers) {
+  //otherwise the worker would print whatever is still buffered a second time
+  fflush(stdout);
+
+  pid_t pid = fork();
+  if(pid == 0) {
+    exit(farm_worker(farm, index, num_workers));
+  }
+  return pid;
+}
+
+// Start the workers, and restart any worker that dies until asked to stop.
+static int farm_run(int argc, char **argv) {
+  uint64_t num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if(argc == 5 && strcmp(argv[3], "--workers") == 0) {
+    if(!farm_parse_uint(argv[4], 1024, &num_workers) || num_workers == 0) {
+      printf("Error: Invalid argument after --workers! Argument must be an integer between 1 and 1024.\n");
+      return 1;
+    }
+  } else if(argc != 3) {
+    printf("Usage: ryce8-farm run <NAME> [--workers <N>]\n");
+    return 1;
+  }
+
+  struct chip8_farm farm;
+  if(!chip8_farm_open(&farm, argv[2])) {
+    printf("Error: Cannot open farm %s!\n", argv[2]);
+    return 1;
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = farm_on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  pid_t *workers = calloc(num_workers, sizeof(pid_t));
+  if(workers == NULL) {
+    chip8_farm_close(&farm);
+    return 1;
+  }
+
+  for(uint32_t k = 0; k < num_workers; k++) {
+    workers[k] = farm_start_worker(&farm, k, num_workers);
+  }
+  printf("Running farm %s with %u workers\n", argv[2], (uint32_t)num_workers);
+
+  uint32_t num_running = num_workers;
+  while(num_running > 0) {
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+
+    if(pid < 0) {
+      if(errno != EINTR) {
+        break;
+      }
+
+      //pass the signal on, in case it was not sent to the whole process group
+      for(uint32_t k = 0; k < num_workers; k++) {
+        if(workers[k] > 0) {
+          kill(workers[k], SIGTERM);
+        }
+      }
+      continue;
+    }
+
+    for(uint32_t k = 0; k < num_workers; k++) {
+      if(workers[k] != pid) {
+        continue;
+      }
+
+      if(farm_stop || (WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+        workers[k] = 0;
+        num_running--;
+      } else {
+        //the VMs are still in the region, so the new worker continues where this one stopped
+        printf("Worker %u (pid %d) died, restarting it\n", k, (int)pid);
+        workers[k] = farm_start_worker(&farm, k, num_workers);
+      }
+    }
+  }
+
+  free(workers);
+  chip8_farm_close(&farm);
+  return 0;
+}
+
+// A small controller: print where every VM is, along with a hash of its screen.
+static int farm_status(int argc, char **argv) {
+  if(argc != 3) {
+    printf("Usage: ryce8-farm status <NAME>\n");
+    return 1;
+  }
+
+  struct chip8_farm farm;
+  if(!chip8_farm_open(&farm, argv[2])) {
+    printf("Error: Cannot open farm %s!\n", argv[2]);
+    return 1;
+  }
+
+  const char *names[] = {"running", "halted", "exited"};
+  uint64_t fb[CHIP8_FARM_MAX_FB_SIZE / sizeof(uint64_t)];
+
+  for(uint32_t i = 0; i < farm.header->num_slots; i++) {
+    struct chip8_farm_slot *slot = chip8_farm_slot(&farm, i);
+    uint64_t frame;
+
+    if(!chip8_farm_read_fb(&farm, i, fb, &frame)) {
+      printf("slot %u: stuck in frame %llu\n", i, (unsigned long long)atomic_load(&slot->frame));
+      continue;
+    }
+
+    uint64_t hash = 0;
+    for(uint32_t w = 0; w < farm.header->fb_size / sizeof(uint64_t); w++) {
+      hash = mix64(hash ^ fb[w]);
+    }
+
+    uint32_t status = atomic_load(&slot->status);
+    printf("slot %u: frame=%llu %s owner=%d screen=%016llx\n", i, (unsigned long long)frame,
+      status < 3 ? names[status] : "?", (int)chip8_farm_owner_pid(atomic_load(&slot->owner)), (unsigned long long)hash);
+  }
+
+  chip8_farm_close(&farm);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if(argc >= 3 && strcmp(argv[1], "create") == 0) {
+    return farm_create(argc, argv);
+  } else if(argc >= 3 && strcmp(argv[1], "run") == 0) {
+    return farm_run(argc, argv);
+  } else if(argc >= 3 && strcmp(argv[1], "status") == 0) {
+    return farm_status(argc, argv);
+  } else if(argc == 3 && strcmp(argv[1], "destroy") == 0) {
+    if(!chip8_farm_unlink(argv[2])) {
+      printf("Error: Cannot remove farm %s!\n", argv[2]);
+      return 1;
+    }
+    return 0;
+  }
+
+  printf("Usage:\n");
+  printf("  ryce8-farm create <NAME> <ROM_FILE_PATH> <VIP | SUPER> <SLOTS> [INSTRUCTIONS_PER_FRAME] [SEED]\n");
+  printf("  ryce8-farm run <NAME> [--workers <N>]\n");
+  printf("  ryce8-farm status <NAME>\n");
+  printf("  ryce8-farm destroy <NAME>\n");
+  return 1;
+}
@@ -0,0 +1,335 @@
+#include "lz.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+
+//if the highest bit of a block's compressed size is set, the block could not be
+//compressed and is stored as-is.
+#define LZ_BLOCK_STORED 0x80000000u
+
+
+static inline uint32_t lz_read32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void lz_write32(uint8_t *p, uint32_t v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static inline uint32_t lz_hash(uint32_t v) {
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Write the extra bytes of a length that did not fit into its 4 bits of the token.
+static inline uint8_t *lz_write_length(uint8_t *op, size_t len) {
+  while(len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = len;
+  return op;
+}
+
+// The max size of the compressed data for an input of len bytes.
+size_t lz_compress_bound(size_t len) {
+  return len + len / 255 + 16;
+}
+
+static uint8_t *lz_write_sequence(uint8_t *op, const uint8_t *literals, size_t num_literals, size_t offset, size_t match_len) {
+  uint8_t *token = op++;
+  uint8_t lit_nibble = num_literals < 15 ? num_literals : 15;
+  *token = lit_nibble << 4;
+
+  if(lit_nibble == 15) op = lz_write_length(op, num_literals - 15);
+  memcpy(op, literals, num_literals);
+  op += num_literals;
+
+  //the last sequence has no match
+  if(match_len == 0) return op;
+
+  *op++ = offset;
+  *op++ = offset >> 8;
+
+  match_len -= LZ_MIN_MATCH;
+  uint8_t match_nibble = match_len < 15 ? match_len : 15;
+  *token |= match_nibble;
+  if(match_nibble == 15) op = lz_write_length(op, match_len - 15);
+
+  return op;
+}
+
+// Compress len bytes of src into dst. Returns the size of the compressed data,
+// or 0 if dst is smaller than lz_compress_bound(len).
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+  if(cap < lz_compress_bound(len)) {
+    return 0;
+  }
+
+  //positions (+1) of the last time every hashed group of 4 bytes was seen. 0 means never seen.
+  uint32_t table[1 << LZ_HASH_BITS];
+  memset(table, 0, sizeof(table));
+
+  uint8_t *op = dst;
+  size_t anchor = 0; //start of the literals that have not been written yet
+  size_t pos = 0;
+
+  //leave room at the end so that we can always read 4 bytes ahead
+  const size_t match_limit = len >= LZ_MIN_MATCH ? len - LZ_MIN_MATCH : 0;
+
+  while(pos < match_limit) {
+    uint32_t seq = lz_read32(src + pos);
+    uint32_t h = lz_hash(seq);
+    size_t candidate = table[h];
+    table[h] = pos + 1;
+
+    //runs of the same byte are matched against the byte right before them
+    if(pos > 0 && src[pos - 1] == src[pos] && seq == lz_read32(src + pos - 1)) {
+      candidate = pos;
+    }
+
+    if(candidate == 0 || pos + 1 - candidate > LZ_MAX_OFFSET || lz_read32(src + candidate - 1) != seq) {
+      pos++;
+      continue;
+    }
+    candidate--;
+
+    size_t match_len = LZ_MIN_MATCH;
+    while(pos + match_len < len && src[candidate + match_len] == src[pos + match_len]) {
+      match_len++;
+    }
+
+    op = lz_write_sequence(op, src + anchor, pos - anchor, pos - candidate, match_len);
+
+    pos += match_len;
+    anchor = pos;
+
+    //remember the end of the match so that the next repeat of it can be found
+    if(pos - 2 < match_limit) {
+      table[lz_hash(lz_read32(src + pos - 2))] = pos - 2 + 1;
+    }
+  }
+
+  op = lz_write_sequence(op, src + anchor, len - anchor, 0, 0);
+
+  return op - dst;
+}
+
+// Read the extra bytes of a length. Returns 0 if the input ends early.
+static inline int lz_read_length(const uint8_t **ip, const uint8_t *end, size_t *len) {
+  uint8_t b;
+  do {
+    if(*ip >= end) return 0;
+    b = *(*ip)++;
+    *len += b;
+  } while(b == 255);
+  return 1;
+}
+
+// Decompress len bytes of src into dst. The size of the decompressed data is stored in out_len.
+// Returns 0 if the data is corrupted or does not fit into dst.
+int lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap, size_t *out_len) {
+  const uint8_t *ip = src;
+  const uint8_t *end = src + len;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + cap;
+
+  while(ip < end) {
+    uint8_t token = *ip++;
+
+    size_t num_literals = token >> 4;
+    if(num_literals == 15 && !lz_read_length(&ip, end, &num_literals)) return 0;
+
+    if((size_t)(end - ip) < num_literals || (size_t)(op_end - op) < num_literals) return 0;
+    memcpy(op, ip, num_literals);
+    ip += num_literals;
+    op += num_literals;
+
+    //the last sequence does not have a match
+    if(ip == end) break;
+
+    if(end - ip < 2) return 0;
+    size_t offset = ip[0] | (size_t)ip[1] << 8;
+    ip += 2;
+
+    size_t match_len = token & 0x0F;
+    if(match_len == 15 && !lz_read_length(&ip, end, &match_len)) return 0;
+    match_len += LZ_MIN_MATCH;
+
+    if(offset == 0 || offset > (size_t)(op - dst) || (size_t)(op_end - op) < match_len) return 0;
+
+    //copy byte by byte, since the match may overlap the bytes being written
+    const uint8_t *match = op - offset;
+    for(size_t i = 0; i < match_len; i++) {
+      op[i] = match[i];
+    }
+    op += match_len;
+  }
+
+  *out_len = op - dst;
+  return 1;
+}
+
+
+
+int lz_writer_open(struct lz_writer *w, FILE *file) {
+  w->file = file;
+  w->in_len = 0;
+  w->error = 0;
+  w->in = malloc(LZ_BLOCK_SIZE);
+  w->out = malloc(lz_compress_bound(LZ_BLOCK_SIZE));
+
+  if(w->in == NULL || w->out == NULL) {
+    free(w->in);
+    free(w->out);
+    return 0;
+  }
+  return 1;
+}
+
+static int lz_writer_flush_block(struct lz_writer *w) {
+  if(w->in_len == 0) return 1;
+
+  uint8_t header[8];
+  size_t size = lz_compress(w->in, w->in_len, w->out, lz_compress_bound(LZ_BLOCK_SIZE));
+  const uint8_t *data = w->out;
+
+  //don't let incompressible data grow
+  if(size >= w->in_len) {
+    size = w->in_len;
+    data = w->in;
+    lz_write32(header, size | LZ_BLOCK_STORED);
+  } else {
+    lz_write32(header, size);
+  }
+  lz_write32(header + 4, w->in_len);
+
+  if(fwrite(header, sizeof(header), 1, w->file) != 1 || fwrite(data, size, 1, w->file) != 1) {
+    w->error = 1;
+    return 0;
+  }
+
+  w->in_len = 0;
+  return 1;
+}
+
+int lz_write(struct lz_writer *w, const void *data, size_t len) {
+  const uint8_t *bytes = data;
+
+  while(len > 0 && !w->error) {
+    size_t n = LZ_BLOCK_SIZE - w->in_len;
+    if(n > len) n = len;
+
+    memcpy(w->in + w->in_len, bytes, n);
+    w->in_len += n;
+    bytes += n;
+    len -= n;
+
+    if(w->in_len == LZ_BLOCK_SIZE) lz_writer_flush_block(w);
+  }
+
+  return !w->error;
+}
+
+// Write the rest of the data and the end of the stream. Note that this does not close the file.
+int lz_writer_close(struct lz_writer *w) {
+  uint8_t end[8] = {0};
+
+  if(!w->error && lz_writer_flush_block(w) && fwrite(end, sizeof(end), 1, w->file) != 1) {
+    w->error = 1;
+  }
+
+  free(w->in);
+  free(w->out);
+  w->in = NULL;
+  w->out = NULL;
+
+  return !w->error;
+}
+
+
+
+int lz_reader_open(struct lz_reader *r, FILE *file) {
+  r->file = file;
+  r->out_len = 0;
+  r->out_pos = 0;
+  r->done = 0;
+  r->error = 0;
+  r->in = malloc(lz_compress_bound(LZ_BLOCK_SIZE));
+  r->out = malloc(LZ_BLOCK_SIZE);
+
+  if(r->in == NULL || r->out == NULL) {
+    free(r->in);
+    free(r->out);
+    return 0;
+  }
+  return 1;
+}
+
+static int lz_reader_next_block(struct lz_reader *r) {
+  uint8_t header[8];
+  if(fread(header, sizeof(header), 1, r->file) != 1) {
+    r->error = 1;
+    return 0;
+  }
+
+  uint32_t size = lz_read32(header);
+  uint32_t raw_size = lz_read32(header + 4);
+  uint8_t stored = (size & LZ_BLOCK_STORED) != 0;
+  size &= ~LZ_BLOCK_STORED;
+
+  if(size == 0) {
+    r->done = 1;
+    return 0;
+  }
+
+  if(raw_size > LZ_BLOCK_SIZE || size > lz_compress_bound(LZ_BLOCK_SIZE) || (stored && size != raw_size)) {
+    r->error = 1;
+    return 0;
+  }
+
+  if(fread(stored ? r->out : r->in, size, 1, r->file) != 1) {
+    r->error = 1;
+    return 0;
+  }
+
+  size_t out_len = size;
+  if(!stored && (!lz_decompress(r->in, size, r->out, LZ_BLOCK_SIZE, &out_len) || out_len != raw_size)) {
+    r->error = 1;
+    return 0;
+  }
+
+  r->out_len = out_len;
+  r->out_pos = 0;
+  return 1;
+}
+
+// Read up to len bytes. Returns the number of bytes read, which is less than len
+// at the end of the stream or if the stream is corrupted (check r->error).
+size_t lz_read(struct lz_reader *r, void *data, size_t len) {
+  uint8_t *bytes = data;
+  size_t total = 0;
+
+  while(total < len) {
+    if(r->out_pos == r->out_len && (r->done || r->error || !lz_reader_next_block(r))) {
+      break;
+    }
+
+    size_t n = r->out_len - r->out_pos;
+    if(n > len - total) n = len - total;
+
+    memcpy(bytes + total, r->out + r->out_pos, n);
+    r->out_pos += n;
+    total += n;
+  }
+
+  return total;
+}
+
+void lz_reader_close(struct lz_reader *r) {
+  free(r->in);
+  free(r->out);
+  r->in = NULL;
+  r->out = NULL;
+}
@@ -0,0 +1,63 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// A small LZ77 codec in the style of LZ4, so that we do not need an external
+// compression library.
+//
+// Compressed data is a list of sequences. Each sequence is:
+//   token       - 1 byte. High 4 bits are the number of literals, low 4 bits are the match length - 4.
+//                 A value of 15 means that more length bytes follow.
+//   literals    - bytes copied directly to the output
+//   offset      - 2 bytes (little-endian), how far back the match starts. 
+//   match       - copy (match length) bytes starting (offset) bytes back in the output.
+//
+// The last sequence only contains literals. Matches may overlap the bytes they produce,
+// so long runs of the same byte (like the empty parts of CHIP-8 RAM and framebuffers) 
+// compress down to a few bytes.
+
+#define LZ_MIN_MATCH 4
+
+// The size of the blocks used by lz_writer and lz_reader. 
+#define LZ_BLOCK_SIZE (64 * 1024)
+
+size_t lz_compress_bound(size_t len);
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+int lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap, size_t *out_len);
+
+
+// Streams data into a file as a list of independently compressed blocks. Each block
+// starts with its compressed size and its original size (both 4 bytes, little-endian).
+// The stream ends with a block with a compressed size of 0.
+struct lz_writer {
+  FILE *file;
+  uint8_t *in;
+  size_t in_len;
+  uint8_t *out;
+  uint8_t error;
+};
+
+int lz_writer_open(struct lz_writer *w, FILE *file);
+int lz_write(struct lz_writer *w, const void *data, size_t len);
+int lz_writer_close(struct lz_writer *w);
+
+
+// Reads back a stream written by lz_writer.
+struct lz_reader {
+  FILE *file;
+  uint8_t *in;
+  uint8_t *out;
+  size_t out_len;
+  size_t out_pos;
+  uint8_t done;
+  uint8_t error;
+};
+
+int lz_reader_open(struct lz_reader *r, FILE *file);
+size_t lz_read(struct lz_reader *r, void *data, size_t len);
+void lz_reader_close(struct lz_reader *r);
+
+#endif// LZ_H
@@ -24,6 +24,40 @@
 
 #include "chip8_sdl_connector.h"
 
+//the most columns or rows allowed for --grid
+#define CHIP8_MAX_GRID_SIZE 64
+
+
+// Parse a comma separated list of up to CHIP8_NUM_COLORS colors (RRGGBB, with or without a #)
+// into the first entries of colors. Returns 0 if the list is not valid.
+static int parse_colors(const char *str, uint32_t *colors) {
+  for(uint32_t n = 0; n < CHIP8_NUM_COLORS; n++) {
+    if(*str == '#') {
+      str++;
+    }
+
+    uint32_t color = 0;
+    for(uint32_t d = 0; d < 6; d++, str++) {
+      const char c = *str;
+      if(c >= '0' && c <= '9')      color = color << 4 | (c - '0');
+      else if(c >= 'a' && c <= 'f') color = color << 4 | (c - 'a' + 10);
+      else if(c >= 'A' && c <= 'F') color = color << 4 | (c - 'A' + 10);
+      else return 0;
+    }
+    colors[n] = color;
+
+    if(*str == '\0') {
+      return 1;
+    }
+    if(*str != ',') {
+      return 0;
+    }
+    str++;
+  }
+
+  //too many colors
+  return 0;
+}
 
 int parse_command_line_args(struct chip8_init *init, int argc, char **argv) {
   char *chip_rom = NULL;
@@ -31,6 +65,18 @@ int parse_command_line_args(struct chip8_init *init, int argc, char **argv) {
 
   uint8_t emu_selected = 0;
 
+  init->has_seed = 0;
+  init->seed = 0;
+  init->detect_quirks = 0;
+  init->grid_cols = 0;
+  init->grid_rows = 0;
+  init->low_power = 0;
+  init->filter = CHIP8_FILTER_NONE;
+  init->blend_frames = 0;
+  init->phosphor_decay = 0;
+  init->record_file = NULL;
+  memcpy(init->colors, CHIP8_SDL_DEFAULT_COLORS, sizeof(init->colors));
+
   for(uint32_t i = 1; i < argc; i++) {
     if(strcmp(argv[i], "--type") == 0) {
       if(emu_selected) {
@@ -59,6 +105,106 @@ int parse_command_line_args(struct chip8_init *init, int argc, char **argv) {
         printf("Error: Invalid argument after --type! Argument must be VIP, SUPER, or XO. \n");
         return 0;
       }
+    } else if(strcmp(argv[i], "--seed") == 0) {
+      i++;
+
+      if(i >= argc) {
+        printf("Error: Missing argument after --seed! Argument must be a non-negative integer. \n");
+        return 0;
+      }
+
+      char *end = NULL;
+      init->seed = strtoull(argv[i], &end, 0);
+
+      if(*argv[i] == '\0' || *end != '\0') {
+        printf("Error: Invalid argument after --seed! Argument must be a non-negative integer. \n");
+        return 0;
+      }
+
+      init->has_seed = 1;
+    } else if(strcmp(argv[i], "--detect-quirks") == 0) {
+      init->detect_quirks = 1;
+    } else if(strcmp(argv[i], "--grid") == 0) {
+      i++;
+
+      if(i >= argc) {
+        printf("Error: Missing argument after --grid! Argument must be COLUMNSxROWS, for example 8x8. \n");
+        return 0;
+      }
+
+      char *end = NULL;
+      unsigned long cols = strtoul(argv[i], &end, 10);
+      unsigned long rows = 0;
+      if(*end == 'x') {
+        rows = strtoul(end + 1, &end, 10);
+      }
+
+      if(cols == 0 || rows == 0 || cols > CHIP8_MAX_GRID_SIZE || rows > CHIP8_MAX_GRID_SIZE || *end != '\0') {
+        printf("Error: Invalid argument after --grid! Argument must be COLUMNSxROWS, for example 8x8. \n");
+        return 0;
+      }
+
+      init->grid_cols = cols;
+      init->grid_rows = rows;
+    } else if(strcmp(argv[i], "--low-power") == 0) {
+      init->low_power = 1;
+    } else if(strcmp(argv[i], "--filter") == 0) {
+      i++;
+
+      if(i >= argc) {
+        printf("Error: Missing argument after --filter! Argument must be none, scale2x, epx, or scale3x. \n");
+        return 0;
+      }
+
+      //EPX and Scale2x give the same result
+      if(strcmp(argv[i], "none") == 0) {
+        init->filter = CHIP8_FILTER_NONE;
+      } else if(strcmp(argv[i], "scale2x") == 0 || strcmp(argv[i], "epx") == 0) {
+        init->filter = CHIP8_FILTER_SCALE2X;
+      } else if(strcmp(argv[i], "scale3x") == 0) {
+        init->filter = CHIP8_FILTER_SCALE3X;
+      } else {
+        printf("Error: Invalid argument after --filter! Argument must be none, scale2x, epx, or scale3x. \n");
+        return 0;
+      }
+    } else if(strcmp(argv[i], "--phosphor") == 0) {
+      i++;
+
+      char *end = NULL;
+      unsigned long decay = i < argc ? strtoul(argv[i], &end, 10) : 0;
+      if(decay == 0 || decay > 255 || *end != '\0') {
+        printf("Error: Invalid argument after --phosphor! Argument must be the intensity lost every frame, from 1 to 255. \n");
+        return 0;
+      }
+
+      init->phosphor_decay = decay;
+    } else if(strcmp(argv[i], "--blend-frames") == 0) {
+      i++;
+
+      char *end = NULL;
+      unsigned long frames = i < argc ? strtoul(argv[i], &end, 10) : 0;
+      if(frames < 2 || frames > CHIP8_PHOSPHOR_MAX_FRAMES || *end != '\0') {
+        printf("Error: Invalid argument after --blend-frames! Argument must be from 2 to %d. \n", CHIP8_PHOSPHOR_MAX_FRAMES);
+        return 0;
+      }
+
+      init->blend_frames = frames;
+    } else if(strcmp(argv[i], "--record") == 0) {
+      i++;
+
+      if(i >= argc) {
+        printf("Error: Missing argument after --record! Argument must be the GIF (or .png for APNG) file to record to. \n");
+        return 0;
+      }
+
+      init->record_file = argv[i];
+    } else if(strcmp(argv[i], "--colors") == 0) {
+      i++;
+
+      if(i >= argc || !parse_colors(argv[i], init->colors)) {
+        printf("Error: Invalid argument after --colors! Argument must be up to %d colors separated by commas, like 000000,00FF00. \n", CHIP8_NUM_COLORS);
+        return 0;
+      }
     } else {
 
       if(chip_rom != NULL) {
@@ -70,6 +216,26 @@ int parse_command_line_args(struct chip8_init *init, int argc, char **argv) {
     }
   }
 
+  //the filter needs pixels that are either on or off
+  if(init->phosphor_decay != 0 && init->filter != CHIP8_FILTER_NONE) {
+    printf("Error: --phosphor cannot be used together with --filter!\n");
+    return 0;
+  }
+
+  //the grid draws every copy as plain pixels, and has no single display to record
+  if(init->grid_cols != 0) {
+    const char *option = NULL;
+    if(init->filter != CHIP8_FILTER_NONE) option = "--filter";
+    else if(init->phosphor_decay != 0) option = "--phosphor";
+    else if(init->blend_frames != 0) option = "--blend-frames";
+    else if(init->record_file != NULL) option = "--record";
+
+    if(option != NULL) {
+      printf("Error: %s cannot be used together with --grid!\n", option);
+      return 0;
+    }
+  }
+
   init->rom_file = chip_rom;
   init->type = type;
 
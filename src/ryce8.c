@@ -0,0 +1,221 @@
+#include "ryce8.h"
+#include "chip8.h"
+#include "chip8_state.h"
+#include "chip8_obs.h"
+#include "chip8_vec_env.h"
+#include "chip8_pool.h"
+#include <stdlib.h>
+
+// struct ryce8 is never defined. A struct ryce8 pointer is just a struct chip8 pointer
+// that programs outside of the library can't look into. The same goes for struct ryce8_env
+// and struct chip8_vec_env, and for struct ryce8_pool and struct chip8_pool.
+
+_Static_assert((int)RYCE8_OBS_PACKED == (int)CHIP8_OBS_PACKED && (int)RYCE8_OBS_U8 == (int)CHIP8_OBS_U8 &&
+  (int)RYCE8_OBS_U8_64X32 == (int)CHIP8_OBS_U8_64X32 && (int)RYCE8_OBS_U8_128X64 == (int)CHIP8_OBS_U8_128X64,
+  "enum ryce8_obs_format does not match enum chip8_obs_format");
+_Static_assert(RYCE8_STATE_MAX_SIZE == CHIP8_STATE_MAX_SIZE, "RYCE8_STATE_MAX_SIZE is out of date");
+_Static_assert((int)RYCE8_VARIANT_VIP == (int)CHIP8_VARIANT_VIP && (int)RYCE8_VARIANT_SUPER == (int)CHIP8_VARIANT_SUPER,
+  "enum ryce8_variant does not match enum chip8_emu_type");
+
+static inline struct chip8 *ryce8_vm(struct ryce8 *vm) {
+  return (struct chip8*)vm;
+}
+
+static inline const struct chip8 *ryce8_const_vm(const struct ryce8 *vm) {
+  return (const struct chip8*)vm;
+}
+
+static inline struct chip8_vec_env *ryce8_vec_env(struct ryce8_env *env) {
+  return (struct chip8_vec_env*)env;
+}
+
+static inline struct chip8_pool *ryce8_chip8_pool(struct ryce8_pool *pool) {
+  return (struct chip8_pool*)pool;
+}
+
+uint32_t ryce8_api_version(void) {
+  return RYCE8_API_VERSION;
+}
+
+struct ryce8 *ryce8_create(enum ryce8_variant variant, uint64_t seed) {
+  if(variant != RYCE8_VARIANT_VIP && variant != RYCE8_VARIANT_SUPER) {
+    return NULL;
+  }
+
+  struct chip8 *vm = chip8_create((enum chip8_emu_type)variant);
+  if(vm == NULL) {
+    return NULL;
+  }
+
+  chip8_wrapper_set_seed(vm, seed);
+  return (struct ryce8*)vm;
+}
+
+void ryce8_destroy(struct ryce8 *vm) {
+  if(vm != NULL) {
+    chip8_destroy(ryce8_vm(vm));
+  }
+}
+
+int ryce8_reset(struct ryce8 *vm, const uint8_t *rom, size_t len) {
+  return chip8_wrapper_reset_from_buffer(ryce8_vm(vm), rom, len);
+}
+
+int ryce8_step(struct ryce8 *vm) {
+  return chip8_wrapper_process_instruction(ryce8_vm(vm));
+}
+
+int ryce8_run_frame(struct ryce8 *vm, uint32_t num_instructions) {
+  return chip8_wrapper_run_frame(ryce8_vm(vm), num_instructions);
+}
+
+int ryce8_has_exited(const struct ryce8 *vm) {
+  return chip8_wrapper_has_exited(ryce8_const_vm(vm));
+}
+
+int ryce8_is_sound_on(const struct ryce8 *vm) {
+  return ryce8_const_vm(vm)->core.sound_timer != 0;
+}
+
+void ryce8_set_keys(struct ryce8 *vm, uint16_t keys) {
+  chip8_set_keyboard(&ryce8_vm(vm)->core, keys);
+}
+
+uint32_t ryce8_width(const struct ryce8 *vm) {
+  return chip8_fb_width(ryce8_const_vm(vm));
+}
+
+uint32_t ryce8_height(const struct ryce8 *vm) {
+  return chip8_fb_height(ryce8_const_vm(vm));
+}
+
+int ryce8_read_pixels(const struct ryce8 *vm, uint8_t *out, size_t cap) {
+  return chip8_obs_write(ryce8_const_vm(vm), CHIP8_OBS_U8, out, cap) != 0;
+}
+
+size_t ryce8_obs_size(const struct ryce8 *vm, enum ryce8_obs_format format) {
+  if((uint32_t)format > RYCE8_OBS_U8_128X64) {
+    return 0;
+  }
+  return chip8_obs_size(ryce8_const_vm(vm), (enum chip8_obs_format)format);
+}
+
+size_t ryce8_read_obs(const struct ryce8 *vm, enum ryce8_obs_format format, uint8_t *out, size_t cap) {
+  if((uint32_t)format > RYCE8_OBS_U8_128X64) {
+    return 0;
+  }
+  return chip8_obs_write(ryce8_const_vm(vm), (enum chip8_obs_format)format, out, cap);
+}
+
+size_t ryce8_save_state(const struct ryce8 *vm, uint8_t *buf, size_t cap) {
+  return chip8_state_save(ryce8_const_vm(vm), buf, cap);
+}
+
+int ryce8_load_state(struct ryce8 *vm, const uint8_t *buf, size_t len) {
+  return chip8_state_load(ryce8_vm(vm), buf, len);
+}
+
+uint64_t ryce8_state_hash(const struct ryce8 *vm) {
+  return chip8_wrapper_state_hash(ryce8_const_vm(vm));
+}
+
+struct ryce8_env *ryce8_env_create(enum ryce8_variant variant, uint32_t num_envs, uint32_t num_threads,
+                                   uint32_t instructions_per_frame) {
+  if((variant != RYCE8_VARIANT_VIP && variant != RYCE8_VARIANT_SUPER) || num_envs == 0) {
+    return NULL;
+  }
+
+  struct chip8_vec_env *env = malloc(sizeof(*env));
+  if(env == NULL) {
+    return NULL;
+  }
+
+  if(num_threads == 0) {
+    num_threads = chip8_thread_num_cpus();
+  }
+
+  if(!chip8_vec_env_init(env, (enum chip8_emu_type)variant, num_envs, num_threads, instructions_per_frame)) {
+    free(env);
+    return NULL;
+  }
+  return (struct ryce8_env*)env;
+}
+
+void ryce8_env_destroy(struct ryce8_env *env) {
+  if(env != NULL) {
+    chip8_vec_env_free(ryce8_vec_env(env));
+    free(env);
+  }
+}
+
+int ryce8_env_load(struct ryce8_env *env, const uint8_t *rom, size_t len, uint64_t seed) {
+  return chip8_vec_env_load_from_buffer(ryce8_vec_env(env), rom, len, seed);
+}
+
+int ryce8_env_reset(struct ryce8_env *env, uint32_t i) {
+  struct chip8_vec_env *e = ryce8_vec_env(env);
+  if(i >= e->num_envs || e->image == NULL) {
+    return 0;
+  }
+  return chip8_vec_env_reset(e, i);
+}
+
+int ryce8_env_set_obs(struct ryce8_env *env, enum ryce8_obs_format format, uint32_t pool_frames) {
+  if((uint32_t)format > RYCE8_OBS_U8_128X64 || pool_frames > CHIP8_OBS_MAX_POOL) {
+    return 0;
+  }
+  return chip8_vec_env_set_obs(ryce8_vec_env(env), (enum chip8_obs_format)format, (uint8_t)pool_frames);
+}
+
+size_t ryce8_env_obs_size(const struct ryce8_env *env) {
+  return chip8_vec_env_fb_size((const struct chip8_vec_env*)env);
+}
+
+void ryce8_env_step(struct ryce8_env *env, const uint16_t *keys, uint8_t *obs, uint8_t *dones) {
+  chip8_vec_env_step(ryce8_vec_env(env), keys, obs, dones);
+}
+
+struct ryce8_pool *ryce8_pool_create(enum ryce8_variant variant, uint32_t capacity) {
+  if((variant != RYCE8_VARIANT_VIP && variant != RYCE8_VARIANT_SUPER) || capacity == 0) {
+    return NULL;
+  }
+
+  struct chip8_pool *pool = malloc(sizeof(*pool));
+  if(pool == NULL) {
+    return NULL;
+  }
+
+  if(!chip8_pool_init(pool, (enum chip8_emu_type)variant, capacity)) {
+    free(pool);
+    return NULL;
+  }
+  return (struct ryce8_pool*)pool;
+}
+
+void ryce8_pool_destroy(struct ryce8_pool *pool) {
+  if(pool != NULL) {
+    chip8_pool_destroy(ryce8_chip8_pool(pool));
+    free(pool);
+  }
+}
+
+struct ryce8 *ryce8_pool_acquire(struct ryce8_pool *pool, uint64_t seed) {
+  struct chip8 *vm = chip8_pool_acquire(ryce8_chip8_pool(pool));
+  if(vm == NULL) {
+    return NULL;
+  }
+
+  chip8_wrapper_set_seed(vm, seed);
+  return (struct ryce8*)vm;
+}
+
+struct ryce8 *ryce8_pool_fork(struct ryce8_pool *pool, struct ryce8 *src) {
+  if(ryce8_vm(src)->emu != ryce8_chip8_pool(pool)->type) {
+    return NULL;
+  }
+  return (struct ryce8*)chip8_pool_fork(ryce8_chip8_pool(pool), ryce8_vm(src));
+}
+
+void ryce8_pool_release(struct ryce8_pool *pool, struct ryce8 *vm) {
+  chip8_release(ryce8_chip8_pool(pool), ryce8_vm(vm));
+}
@@ -0,0 +1,176 @@
+#ifndef RYCE8_H
+#define RYCE8_H
+
+// Public C API of the RYCE8 emulator core (libryce8).
+//
+// This is the only header programs that embed the emulator need. It does not pull in SDL
+// or any of the emulator's internal headers, and a VM is only ever handed out as a pointer
+// to an opaque struct ryce8, so the internals can change without breaking programs built
+// against an older version of the library.
+//
+// Every function that can fail returns 1 on success and 0 on failure.
+// A single VM is not thread-safe, but different VMs can be used from different threads.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32) && defined(RYCE8_SHARED)
+  #ifdef RYCE8_BUILDING
+    #define RYCE8_API __declspec(dllexport)
+  #else
+    #define RYCE8_API __declspec(dllimport)
+  #endif
+#elif defined(__GNUC__) && defined(RYCE8_BUILDING)
+  #define RYCE8_API __attribute__((visibility("default")))
+#else
+  #define RYCE8_API
+#endif
+
+// Bumped whenever a function is added to the API. Existing functions never change.
+#define RYCE8_API_VERSION 4
+
+//large enough for a save state of every variant
+#define RYCE8_STATE_MAX_SIZE 8192
+
+// These match the values of enum chip8_emu_type.
+enum ryce8_variant {
+  RYCE8_VARIANT_VIP = 0,
+  RYCE8_VARIANT_SUPER = 1,
+};
+
+// Formats for ryce8_read_obs(). These match the values of enum chip8_obs_format.
+enum ryce8_obs_format {
+  //1 bit per pixel at the resolution of the VM, 8 pixels per byte, with the leftmost pixel in the highest bit.
+  RYCE8_OBS_PACKED = 0,
+
+  //1 byte per pixel (0 or 1) at the resolution of the VM.
+  RYCE8_OBS_U8 = 1,
+
+  //1 byte per pixel at 64x32. A 128x64 display is max-pooled down.
+  RYCE8_OBS_U8_64X32 = 2,
+
+  //1 byte per pixel at 128x64. A 64x32 display is scaled up.
+  RYCE8_OBS_U8_128X64 = 3,
+};
+
+struct ryce8;
+
+RYCE8_API uint32_t ryce8_api_version(void);
+
+// Create a VM. It must be reset with a ROM before it can run.
+// Returns NULL if the variant is not supported or there is not enough memory.
+RYCE8_API struct ryce8 *ryce8_create(enum ryce8_variant variant, uint64_t seed);
+RYCE8_API void ryce8_destroy(struct ryce8 *vm);
+
+// Load a ROM from memory and start running it from the beginning. rom is not used after this returns.
+RYCE8_API int ryce8_reset(struct ryce8 *vm, const uint8_t *rom, size_t len);
+
+// Run a single instruction. Returns 0 if the instruction could not be processed.
+RYCE8_API int ryce8_step(struct ryce8 *vm);
+
+// Run a single 60Hz frame: num_instructions instructions, then one tick of the timers.
+RYCE8_API int ryce8_run_frame(struct ryce8 *vm, uint32_t num_instructions);
+
+// Returns 1 if the program asked to exit (SUPER-CHIP 00FD).
+RYCE8_API int ryce8_has_exited(const struct ryce8 *vm);
+
+// Returns 1 while the sound timer is running, meaning a tone should be played.
+RYCE8_API int ryce8_is_sound_on(const struct ryce8 *vm);
+
+// Set which of the 16 keys are held down. Bit k is set if key k (0-F) is down.
+RYCE8_API void ryce8_set_keys(struct ryce8 *vm, uint16_t keys);
+
+// Size of the display in pixels.
+RYCE8_API uint32_t ryce8_width(const struct ryce8 *vm);
+RYCE8_API uint32_t ryce8_height(const struct ryce8 *vm);
+
+// Write one byte per pixel (0 or 1) into out, row by row. out must hold
+// ryce8_width() * ryce8_height() bytes. Returns 0 if it does not.
+RYCE8_API int ryce8_read_pixels(const struct ryce8 *vm, uint8_t *out, size_t cap);
+
+// Write the display into out in the given format (added in API version 2).
+// Returns the number of bytes written, or 0 if out is smaller than ryce8_obs_size().
+RYCE8_API size_t ryce8_obs_size(const struct ryce8 *vm, enum ryce8_obs_format format);
+RYCE8_API size_t ryce8_read_obs(const struct ryce8 *vm, enum ryce8_obs_format format, uint8_t *out, size_t cap);
+
+// Save the full state of the VM into buf. Returns the number of bytes written,
+// or 0 if buf is too small (RYCE8_STATE_MAX_SIZE is always large enough).
+RYCE8_API size_t ryce8_save_state(const struct ryce8 *vm, uint8_t *buf, size_t cap);
+
+// Restore a state saved with ryce8_save_state() by a VM of the same variant.
+// If this fails, the VM must be reset before it is used again.
+RYCE8_API int ryce8_load_state(struct ryce8 *vm, const uint8_t *buf, size_t len);
+
+// 64-bit hash of the full state of the VM. VMs in the same state have the same hash.
+RYCE8_API uint64_t ryce8_state_hash(const struct ryce8 *vm);
+
+
+// Many VMs of the same variant that run the same ROM and are stepped together, one frame
+// at a time, on a pool of threads (added in API version 3). This is meant for training agents,
+// where thousands of copies of a game are played at once. Every env shares the ROM's memory
+// until it writes to it. An env is not thread-safe; step it from one thread at a time.
+struct ryce8_env;
+
+// Create num_envs VMs that run instructions_per_frame instructions every frame, on num_threads
+// threads (0 for one per CPU core). Returns NULL if there is not enough memory or the threads
+// could not be started. The envs must be loaded with a ROM before they can be stepped.
+RYCE8_API struct ryce8_env *ryce8_env_create(enum ryce8_variant variant, uint32_t num_envs, uint32_t num_threads,
+                                             uint32_t instructions_per_frame);
+RYCE8_API void ryce8_env_destroy(struct ryce8_env *env);
+
+// Load a ROM from memory and reset every env to its start. Env i uses the seed (seed + i).
+// rom is not used after this returns.
+RYCE8_API int ryce8_env_load(struct ryce8_env *env, const uint8_t *rom, size_t len, uint64_t seed);
+
+// Reset env i back to the start of the ROM, for example once it is done.
+RYCE8_API int ryce8_env_reset(struct ryce8_env *env, uint32_t i);
+
+// Choose the format of the displays written by ryce8_env_step() (RYCE8_OBS_PACKED by default).
+// If pool_frames (1 to 4) is more than 1, a pixel is lit if it was lit in any of the last
+// pool_frames frames, which hides sprites that flicker.
+RYCE8_API int ryce8_env_set_obs(struct ryce8_env *env, enum ryce8_obs_format format, uint32_t pool_frames);
+
+// Number of bytes of display written for every env by ryce8_env_step().
+RYCE8_API size_t ryce8_env_obs_size(const struct ryce8_env *env);
+
+// Run one frame on every env that is not done.
+//   keys  - num_envs key states, in the format of ryce8_set_keys().
+//   obs   - receives num_envs displays of ryce8_env_obs_size() bytes each.
+//   dones - receives num_envs flags. A flag is 1 once the env ran into an instruction it could not
+//           process, or its program exited. Such an env stops running until it is reset.
+RYCE8_API void ryce8_env_step(struct ryce8_env *env, const uint16_t *keys, uint8_t *obs, uint8_t *dones);
+
+
+// A fixed number of VM slots of one variant in a single block of memory (added in API version 4).
+// Taking a VM from a pool and giving it back never allocates, so VMs can be forked and thrown
+// away very quickly, for example when searching a game tree. A pool is not thread-safe.
+struct ryce8_pool;
+
+// Returns NULL if the variant is not supported or there is not enough memory.
+RYCE8_API struct ryce8_pool *ryce8_pool_create(enum ryce8_variant variant, uint32_t capacity);
+
+// Free the pool and every VM in it. VMs from the pool must not be used after this.
+RYCE8_API void ryce8_pool_destroy(struct ryce8_pool *pool);
+
+// Take a VM from the pool. It must be reset with a ROM before it can run, like a VM from ryce8_create().
+// Returns NULL if every slot is in use.
+RYCE8_API struct ryce8 *ryce8_pool_acquire(struct ryce8_pool *pool, uint64_t seed);
+
+// Take a VM from the pool that continues from the exact state of src, which must be of the same
+// variant. Both VMs share their memory until one of them writes to it, so this is cheap.
+// Returns NULL if every slot is in use, src is of another variant, or there is not enough memory.
+RYCE8_API struct ryce8 *ryce8_pool_fork(struct ryce8_pool *pool, struct ryce8 *src);
+
+// Give a VM from ryce8_pool_acquire() or ryce8_pool_fork() back to the pool.
+// It must not be passed to ryce8_destroy().
+RYCE8_API void ryce8_pool_release(struct ryce8_pool *pool, struct ryce8 *vm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif// RYCE8_H
@@ -26,21 +26,35 @@ const uint8_t SCHIP_HEX_FONT[10*16] = {
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 };
 
+// Point the Chip8 Core at the memory owned by this VM. This is also used
+// after a VM is copied, since the copy still points at the memory of the original.
+void schip8_bind(struct schip8 *vm) {
+  vm->core->private_ram = vm->alloc_ram;
+  vm->core->stack = vm->alloc_stack;
+  vm->core->fb = vm->fb.x64_32;
+
+  //shared RAM lives outside of the VM, so it does not need to be moved.
+  if(vm->core->shared_ram == NULL) {
+    vm->core->ram = vm->alloc_ram;
+  }
+}
+
 void schip8_init(struct schip8 *vm) {
   //set pointers to allocated memory
-  vm->core->ram = vm->alloc_ram;
-  vm->core->stack = (uint16_t*) (vm->alloc_ram + CHIP8_STACK_START);
-  vm->core->fb = vm->fb.x64_32;
+  vm->core->shared_ram = NULL;
+  schip8_bind(vm);
 
   //initialize sizes
   vm->core->ram_size = sizeof(vm->alloc_ram);
   vm->core->stack_size = 16;
   vm->core->fb_size = sizeof(vm->fb.x128_64);
+  vm->core->fb_row_shift = 1;
 
   //start at lores by default
   vm->res = SCHIP_DISPLAY_LORES;
 
   memset(vm->rpl_flags, 0, sizeof(vm->rpl_flags));
+  vm->will_exit = 0;
 
   vm->core->quirks = CHIP8_QUIRK_BXNN 
   | CHIP8_QUIRK_CLR_SCN_ON_LORES
@@ -49,6 +63,13 @@ void schip8_init(struct schip8 *vm) {
 
 }
 
+// All writes to the framebuffer must go through here so that the framebuffer hash
+// in the Chip8 Core stays up to date. Each 128-bit row is stored as 2 64-bit words (MSB first).
+static inline void schip8_write_row(struct schip8 *vm, uint8_t row, struct uint128 val) {
+  chip8_write_fb(vm->core, 2*row, val.msb);
+  chip8_write_fb(vm->core, 2*row + 1, val.lsb);
+}
+
 /* Note that scrolling instructions will NOT WRAP sprites. */
 static inline int schip8_ins_00(struct schip8 *vm, uint8_t low) {
   //00CN*    Scroll display N lines down
@@ -68,9 +89,10 @@ static inline int schip8_ins_00(struct schip8 *vm, uint8_t low) {
     for(uint8_t num_rows_from_bottom = n; num_rows_from_bottom < SCHIP8_HEIGHT; num_rows_from_bottom++) {
       uint8_t move_from = SCHIP8_HEIGHT-1 - num_rows_from_bottom;
       uint8_t move_to = move_from + n;
-      vm->fb.x128_64[move_to] = vm->fb.x128_64[move_from];
+      const struct uint128 empty_row = {0, 0};
+      schip8_write_row(vm, move_to, vm->fb.x128_64[move_from]);
       //make sure to clear row being moved from
-      memset(&vm->fb.x128_64[move_from], 0, sizeof(vm->fb.x128_64[move_from]));
+      schip8_write_row(vm, move_from, empty_row);
     }
 
     return 1;
@@ -90,7 +112,7 @@ static inline int schip8_ins_00(struct schip8 *vm, uint8_t low) {
       }
 
       for(uint8_t r = 0; r < SCHIP8_HEIGHT; r++) {
-        vm->fb.x128_64[r] = uint128_logical_right_shift(vm->fb.x128_64[r], shift_amount);
+        schip8_write_row(vm, r, uint128_logical_right_shift(vm->fb.x128_64[r], shift_amount));
       }
       break;
     }
@@ -107,7 +129,7 @@ static inline int schip8_ins_00(struct schip8 *vm, uint8_t low) {
       }
 
       for(uint8_t r = 0; r < SCHIP8_HEIGHT; r++) {
-        vm->fb.x128_64[r] = uint128_left_shift(vm->fb.x128_64[r], shift_amount);
+        schip8_write_row(vm, r, uint128_left_shift(vm->fb.x128_64[r], shift_amount));
       }
 
       break;
@@ -265,7 +287,7 @@ void schip8_draw_64x32(struct schip8 *vm, uint8_t high, uint8_t low) {
 
     //create a empty 64-bit row, get an 8-bit row from our sprite, and
     //shift our sprite's row into the empty row
-    uint8_t sprite_row_data_raw = vm->core->ram[vm->core->I + i];
+    uint8_t sprite_row_data_raw = chip8_read_ram(vm->core, vm->core->I + i);
 
     //for every pixel, repeat its value on 2 columns so that it can be rendered as a 2x2 pixel
     // on a 128x64 framebuffer.
@@ -309,8 +331,8 @@ void schip8_draw_64x32(struct schip8 *vm, uint8_t high, uint8_t low) {
 
 
     //draw row to framebuffer
-    vm->fb.x128_64[fby] = uint128_xor(vm->fb.x128_64[fby], sprite_row1);
-    vm->fb.x128_64[fby+1] = uint128_xor(vm->fb.x128_64[fby+1], sprite_row2);
+    schip8_write_row(vm, fby, uint128_xor(vm->fb.x128_64[fby], sprite_row1));
+    schip8_write_row(vm, fby+1, uint128_xor(vm->fb.x128_64[fby+1], sprite_row2));
 
 
 
@@ -388,7 +410,7 @@ void schip8_draw_128x64(struct schip8 *vm, uint8_t high, uint8_t low) {
 
       //create a empty 64-bit row, get an 8-bit row from our sprite, and
       //shift our sprite's row into the empty row
-      uint8_t sprite_row_data = vm->core->ram[vm->core->I + i];
+      uint8_t sprite_row_data = chip8_read_ram(vm->core, vm->core->I + i);
       
       struct uint128 sprite_row;
       sprite_row.msb = (uint64_t)sprite_row_data << 48;
@@ -409,7 +431,7 @@ void schip8_draw_128x64(struct schip8 *vm, uint8_t high, uint8_t low) {
 
 
       //draw row to framebuffer
-      vm->fb.x128_64[fby] = uint128_xor(vm->fb.x128_64[fby], sprite_row);
+      schip8_write_row(vm, fby, uint128_xor(vm->fb.x128_64[fby], sprite_row));
 
 
 
@@ -450,7 +472,7 @@ void schip8_draw_128x64(struct schip8 *vm, uint8_t high, uint8_t low) {
 
       //create a empty 64-bit row, get an 8-bit row from our sprite, and
       //shift our sprite's row into the empty row
-      uint8_t sprite_row_data = vm->core->ram[vm->core->I + i];
+      uint8_t sprite_row_data = chip8_read_ram(vm->core, vm->core->I + i);
       
       struct uint128 sprite_row;
       sprite_row.msb = (uint64_t)sprite_row_data << 56;
@@ -470,7 +492,7 @@ void schip8_draw_128x64(struct schip8 *vm, uint8_t high, uint8_t low) {
 
 
       //draw row to framebuffer
-      vm->fb.x128_64[fby] = uint128_xor(vm->fb.x128_64[fby], sprite_row);
+      schip8_write_row(vm, fby, uint128_xor(vm->fb.x128_64[fby], sprite_row));
 
 
 
@@ -508,7 +530,7 @@ static inline int schip8_ins_F(struct schip8 *vm, uint8_t high, uint8_t low) {
   switch(low) {
     //FX30*    Point I to 10-byte font sprite for digit VX (0..9)
     case 0x30: {
-      vm->core->I = vm->core->ram[SCHIP_LARGE_FONT_LOC + vm->core->V[x]];
+      vm->core->I = chip8_read_ram(vm->core, SCHIP_LARGE_FONT_LOC + vm->core->V[x]);
       break;
     }
 
@@ -531,14 +553,28 @@ static inline int schip8_ins_F(struct schip8 *vm, uint8_t high, uint8_t low) {
 }
 
 
-int schip8_reset(struct schip8 *vm, FILE *file) {
-  memset(&vm->fb, 0, sizeof(vm->fb));
+//reset the state that only SCHIP has
+static void schip8_reset_state(struct schip8 *vm) {
+  chip8_clear_fb(vm->core);
   vm->res = SCHIP_DISPLAY_LORES;
+  vm->will_exit = 0;
+}
+
+int schip8_reset(struct schip8 *vm, FILE *file) {
+  schip8_reset_state(vm);
   return chip8_reset(vm->core, file);
 
 }
 
+int schip8_reset_from_image(struct schip8 *vm, struct chip8_shared_ram *image) {
+  schip8_reset_state(vm);
+  return chip8_reset_from_image(vm->core, image);
+}
+
 int schip8_process_new_instruction(struct schip8 *vm) {
+  if(vm->core->pc >= vm->core->ram_size - 1) {
+    return 0;
+  }
 
   uint8_t high = vm->core->ram[vm->core->pc];
   uint8_t low = vm->core->ram[vm->core->pc+1];
@@ -15,11 +15,12 @@ enum schip_display_res {
 extern const uint8_t SCHIP_HEX_FONT[10*16];
 
 
+// Buffers start on their own cache lines, and RAM comes last, so that
+// copying a VM whose RAM is shared can stop right before it (see chip8_fork()).
 struct schip8 {
   struct chip8_core *core;
 
-  uint16_t alloc_stack[16];
-  uint8_t alloc_ram[4096];
+  uint16_t alloc_stack[CHIP8_MAX_STACK_SIZE];
 
   uint8_t rpl_flags[8];
 
@@ -28,15 +29,19 @@ struct schip8 {
   enum schip_display_res res;
 
 
-  union {
+  _Alignas(CHIP8_CACHE_LINE) union {
     struct uint128 x128_64 [64];
     uint64_t x64_32[32];
   } fb;
+
+  _Alignas(CHIP8_CACHE_LINE) uint8_t alloc_ram[4096];
 };
 
 void schip8_init(struct schip8 *vm);
+void schip8_bind(struct schip8 *vm);
 int schip8_process_instruction(struct schip8 *vm);
 int schip8_reset(struct schip8 *vm, FILE *file);
+int schip8_reset_from_image(struct schip8 *vm, struct chip8_shared_ram *image);
 
 #endif// SCHIP_H
 
@@ -0,0 +1,307 @@
+// Checks save states and the LZ codec they are stored with. Runs a ROM, saves its state every
+// few frames, loads it into another VM (from memory and through a compressed file) and checks
+// that both VMs stay the same from then on. Also checks that broken save states are rejected,
+// and that LZ gives back what it was given.
+//
+// Usage: ryce8-state-check [--frames <N>] [--ipf <N>] [--seed <N>] <ROM_FILE_PATH> <VIP | SUPER>
+//
+// Exits with 1 if any check fails.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_state.h"
+#include "lz.h"
+
+#define CHECK_DEFAULT_FRAMES 600
+#define CHECK_DEFAULT_INSTRUCTIONS_PER_FRAME 20
+
+//how often the state is saved and loaded again
+#define CHECK_SAVE_EVERY_FRAMES 50
+
+//where fields live in a save state: after the magic, version, variant and the 16 registers
+#define CHECK_STATE_I_OFFSET 22
+#define CHECK_STATE_PC_OFFSET 24
+
+
+static int check_parse_uint(const char *str, uint64_t max, uint64_t *out) {
+  char *end = NULL;
+  *out = strtoull(str, &end, 0);
+  return *str != '\0' && *str != '-' && *end == '\0' && *out <= max;
+}
+
+static uint64_t check_random(uint64_t *rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+  return *rng;
+}
+
+// Compress len bytes of src in memory and through a file, and check that both come back the same.
+static int check_lz_round_trip(const char *name, const uint8_t *src, size_t len) {
+  int ok = 1;
+  size_t cap = lz_compress_bound(len);
+  uint8_t *packed = malloc(cap);
+  uint8_t *unpacked = malloc(len + 1);
+  if(packed == NULL || unpacked == NULL) {
+    free(packed);
+    free(unpacked);
+    printf("LZ %s: not enough memory\n", name);
+    return 0;
+  }
+
+  size_t packed_len = lz_compress(src, len, packed, cap);
+  size_t unpacked_len = 0;
+  if(packed_len == 0 || !lz_decompress(packed, packed_len, unpacked, len + 1, &unpacked_len) ||
+     unpacked_len != len || memcmp(src, unpacked, len) != 0) {
+    printf("LZ %s: %zu bytes do not come back from memory\n", name, len);
+    ok = 0;
+  }
+
+  //cutting off the compressed data must not read or write out of bounds
+  for(size_t cut = 0; cut < packed_len; cut += 1 + packed_len / 16) {
+    lz_decompress(packed, cut, unpacked, len + 1, &unpacked_len);
+  }
+
+  FILE *file = tmpfile();
+  if(file == NULL) {
+    printf("LZ %s: cannot create a temporary file\n", name);
+    ok = 0;
+  } else {
+    struct lz_writer w;
+    struct lz_reader r;
+    int written = lz_writer_open(&w, file) && lz_write(&w, src, len);
+    written = lz_writer_close(&w) && written;
+    rewind(file);
+
+    if(!written || !lz_reader_open(&r, file)) {
+      printf("LZ %s: cannot write %zu bytes to a file\n", name, len);
+      ok = 0;
+    } else {
+      unpacked_len = lz_read(&r, unpacked, len + 1);
+      if(r.error || unpacked_len != len || memcmp(src, unpacked, len) != 0) {
+        printf("LZ %s: %zu bytes do not come back from a file\n", name, len);
+        ok = 0;
+      }
+      lz_reader_close(&r);
+    }
+    fclose(file);
+  }
+
+  free(packed);
+  free(unpacked);
+  return ok;
+}
+
+// Data that does not compress, runs that compress well, and a mix of both. Larger than a
+// block of lz_writer, so the stream holds more than one block.
+static int check_lz(uint64_t seed) {
+  const size_t len = LZ_BLOCK_SIZE * 2 + 1234;
+  uint8_t *data = malloc(len);
+  if(data == NULL) {
+    printf("LZ: not enough memory\n");
+    return 0;
+  }
+
+  int ok = check_lz_round_trip("empty", data, 0);
+
+  uint64_t rng = seed * 2654435761ULL + 1;
+  for(size_t i = 0; i < len; i++) {
+    data[i] = (uint8_t)check_random(&rng);
+  }
+  ok = check_lz_round_trip("noise", data, len) && ok;
+
+  memset(data, 0xAA, len);
+  ok = check_lz_round_trip("run", data, len) && ok;
+
+  for(size_t i = 0; i < len; i++) {
+    data[i] = (check_random(&rng) & 3) == 0 ? (uint8_t)check_random(&rng) : (uint8_t)(i / 64);
+  }
+  ok = check_lz_round_trip("mixed", data, len) && ok;
+
+  free(data);
+  return ok;
+}
+
+// Copy the state of src into dst through a compressed file.
+static int check_state_through_file(const struct chip8 *src, struct chip8 *dst) {
+  FILE *file = tmpfile();
+  if(file == NULL) {
+    return 0;
+  }
+
+  int res = chip8_state_save_file(src, file);
+  rewind(file);
+  res = res && chip8_state_load_file(dst, file);
+  fclose(file);
+  return res;
+}
+
+// Change one byte (or two, for a 16-bit field) of a save state and check that it is not loaded.
+static int check_state_rejects(struct chip8 *vm, const uint8_t *state, size_t len, size_t offset, uint16_t val, uint8_t num_bytes, const char *what) {
+  uint8_t broken[CHIP8_STATE_MAX_SIZE];
+  memcpy(broken, state, len);
+  broken[offset] = val & 0xFF;
+  if(num_bytes == 2) {
+    broken[offset + 1] = val >> 8;
+  }
+
+  if(chip8_state_load(vm, broken, len)) {
+    printf("A save state with %s was loaded\n", what);
+    return 0;
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  uint64_t num_frames = CHECK_DEFAULT_FRAMES;
+  uint64_t instructions_per_frame = CHECK_DEFAULT_INSTRUCTIONS_PER_FRAME;
+  uint64_t seed = 0;
+  char *rom_file = NULL;
+  char *type_name = NULL;
+
+  for(int i = 1; i < argc; i++) {
+    uint64_t *value = NULL;
+    uint64_t max = UINT32_MAX;
+    if(strcmp(argv[i], "--frames") == 0) {
+      value = &num_frames;
+    } else if(strcmp(argv[i], "--ipf") == 0) {
+      value = &instructions_per_frame;
+      max = UINT16_MAX;
+    } else if(strcmp(argv[i], "--seed") == 0) {
+      value = &seed;
+      max = UINT64_MAX;
+    } else if(rom_file == NULL) {
+      rom_file = argv[i];
+      continue;
+    } else if(type_name == NULL) {
+      type_name = argv[i];
+      continue;
+    } else {
+      printf("Error: Too many arguments!\n");
+      return 1;
+    }
+
+    i++;
+    uint64_t min = value == &seed ? 0 : 1;
+    if(i >= argc || !check_parse_uint(argv[i], max, value) || *value < min) {
+      printf("Error: Invalid argument after %s! Argument must be an integer between %llu and %llu.\n", argv[i - 1], (unsigned long long)min, (unsigned long long)max);
+      return 1;
+    }
+  }
+
+  enum chip8_emu_type type;
+  if(rom_file == NULL || type_name == NULL) {
+    printf("Usage: ryce8-state-check [--frames <N>] [--ipf <N>] [--seed <N>] <ROM_FILE_PATH> <VIP | SUPER>\n");
+    return 1;
+  } else if(strcmp(type_name, "VIP") == 0) {
+    type = CHIP8_VARIANT_VIP;
+  } else if(strcmp(type_name, "SUPER") == 0) {
+    type = CHIP8_VARIANT_SUPER;
+  } else {
+    printf("Error: Invalid variant %s! Variant must be VIP or SUPER.\n", type_name);
+    return 1;
+  }
+
+  int ok = check_lz(seed);
+
+  FILE *rom = fopen(rom_file, "rb");
+  if(rom == NULL) {
+    printf("Error: Cannot open ROM file %s!\n", rom_file);
+    return 1;
+  }
+
+  //vm runs the whole time. copy gets its state from memory, and file through a compressed file.
+  struct chip8 *vm = chip8_create(type);
+  struct chip8 *copy = chip8_create(type);
+  struct chip8 *file = chip8_create(type);
+  if(vm == NULL || copy == NULL || file == NULL) {
+    printf("Error: Not enough memory!\n");
+    fclose(rom);
+    chip8_destroy(vm);
+    chip8_destroy(copy);
+    chip8_destroy(file);
+    return 1;
+  }
+
+  chip8_wrapper_set_seed(vm, seed);
+  int res = chip8_wrapper_reset(vm, rom);
+  fclose(rom);
+  if(!res) {
+    printf("Error: Cannot load ROM file %s!\n", rom_file);
+    chip8_destroy(vm);
+    chip8_destroy(copy);
+    chip8_destroy(file);
+    return 1;
+  }
+
+  uint8_t state[CHIP8_STATE_MAX_SIZE];
+  uint8_t resaved[CHIP8_STATE_MAX_SIZE];
+  uint64_t rng = seed * 2654435761ULL + 1;
+  uint8_t in_sync = 0;
+  uint8_t halted = 0;
+
+  for(uint64_t frame = 0; frame < num_frames && ok && !halted; frame++) {
+    if(frame % CHECK_SAVE_EVERY_FRAMES == 0) {
+      size_t len = chip8_state_save(vm, state, sizeof(state));
+      if(len == 0 || !chip8_state_load(copy, state, len) || !check_state_through_file(vm, file)) {
+        printf("Frame %llu: the state cannot be saved and loaded again\n", (unsigned long long)frame);
+        ok = 0;
+        break;
+      }
+
+      //saving a loaded state gives the same bytes again
+      if(chip8_state_save(copy, resaved, sizeof(resaved)) != len || memcmp(state, resaved, len) != 0) {
+        printf("Frame %llu: a loaded state is saved differently\n", (unsigned long long)frame);
+        ok = 0;
+      }
+      in_sync = 1;
+    }
+
+    uint16_t keys = (check_random(&rng) & 7) == 0 ? (uint16_t)(1 << (rng >> 3 & 0xF)) : 0;
+    chip8_set_keyboard(&vm->core, keys);
+    chip8_set_keyboard(&copy->core, keys);
+    chip8_set_keyboard(&file->core, keys);
+
+    halted = !chip8_wrapper_run_frame(vm, (uint32_t)instructions_per_frame) || chip8_wrapper_has_exited(vm);
+    if(in_sync) {
+      uint8_t copy_halted = !chip8_wrapper_run_frame(copy, (uint32_t)instructions_per_frame) || chip8_wrapper_has_exited(copy);
+      uint8_t file_halted = !chip8_wrapper_run_frame(file, (uint32_t)instructions_per_frame) || chip8_wrapper_has_exited(file);
+
+      const uint64_t hash = chip8_wrapper_state_hash(vm);
+      if(copy_halted != halted || file_halted != halted || chip8_wrapper_state_hash(copy) != hash || chip8_wrapper_state_hash(file) != hash) {
+        printf("Frame %llu: a VM loaded from a save state ran differently\n", (unsigned long long)frame);
+        ok = 0;
+      }
+    }
+  }
+
+  //states that would make the interpreter read outside of the VM must not load
+  size_t len = chip8_state_save(vm, state, sizeof(state));
+  if(len == 0) {
+    printf("The final state cannot be saved\n");
+    ok = 0;
+  } else {
+    ok = check_state_rejects(copy, state, len, CHECK_STATE_PC_OFFSET, vm->core.ram_size - 1, 2, "pc at the last byte of RAM") && ok;
+    ok = check_state_rejects(copy, state, len, CHECK_STATE_PC_OFFSET, 0xFFFE, 2, "pc past the end of RAM") && ok;
+    ok = check_state_rejects(copy, state, len, CHECK_STATE_I_OFFSET, 0xFFFF, 2, "I past the end of RAM") && ok;
+    if(type == CHIP8_VARIANT_SUPER) {
+      ok = check_state_rejects(copy, state, len, len - 1, 0xFF, 1, "an unknown resolution") && ok;
+      ok = check_state_rejects(copy, state, len, len - 2, 2, 1, "will_exit set to 2") && ok;
+    }
+
+    if(chip8_state_load(copy, state, len - 1)) {
+      printf("A save state that was cut short was loaded\n");
+      ok = 0;
+    }
+  }
+
+  printf("%s: %s\n", rom_file, ok ? "save states and LZ are fine" : "FAILED");
+
+  chip8_destroy(vm);
+  chip8_destroy(copy);
+  chip8_destroy(file);
+  return ok ? 0 : 1;
+}
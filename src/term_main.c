@@ -0,0 +1,352 @@
+// Terminal frontend. Runs a ROM and draws it in the terminal it was started from (see chip8_term.h),
+// so it works over SSH on machines without a display or GPU. Needs a POSIX terminal.
+//
+// Usage: ryce8-term --type <VIP | SUPER> [--seed <N>] [--braille] [--fps <N>] [--ipf <N>] <ROM_FILE_PATH>
+//
+// Keys are the same as in the SDL frontend (1234/QWER/ASDF/ZXCV). Space pauses, and Ctrl-C quits.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "chip8.h"
+#include "chip8_pacer.h"
+#include "chip8_term.h"
+
+#define TERM_DEFAULT_INSTRUCTIONS_PER_FRAME 10
+
+//terminals only send key presses, never key releases. A key counts as held down for this many
+//frames after it was last seen, which is long enough to last until the key starts repeating.
+#define TERM_KEY_HOLD_FRAMES 30
+
+struct term_options {
+  char *rom_file;
+  enum chip8_emu_type type;
+  uint8_t has_seed;
+  uint64_t seed;
+  enum chip8_term_mode mode;
+  uint32_t fps;
+  uint32_t instructions_per_frame;
+};
+
+static volatile sig_atomic_t term_stop = 0;
+static volatile sig_atomic_t term_resized = 0;
+
+static struct termios term_saved;
+static uint8_t term_raw = 0;
+static struct chip8_term term;
+
+static void term_on_signal(int sig) {
+  if(sig == SIGWINCH) {
+    term_resized = 1;
+  } else {
+    term_stop = 1;
+  }
+}
+
+static int term_parse_uint(const char *str, uint64_t max, uint64_t *out) {
+  char *end = NULL;
+  *out = strtoull(str, &end, 0);
+  return *str != '\0' && *str != '-' && *end == '\0' && *out <= max;
+}
+
+static int term_parse_args(struct term_options *opt, int argc, char **argv) {
+  uint8_t emu_selected = 0;
+  uint64_t n;
+
+  opt->rom_file = NULL;
+  opt->has_seed = 0;
+  opt->seed = 0;
+  opt->mode = CHIP8_TERM_HALF_BLOCKS;
+  opt->fps = 60;
+  opt->instructions_per_frame = TERM_DEFAULT_INSTRUCTIONS_PER_FRAME;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--type") == 0) {
+      i++;
+
+      if(i < argc && strcmp(argv[i], "VIP") == 0) {
+        opt->type = CHIP8_VARIANT_VIP;
+      } else if(i < argc && strcmp(argv[i], "SUPER") == 0) {
+        opt->type = CHIP8_VARIANT_SUPER;
+      } else {
+        printf("Error: Invalid argument after --type! Argument must be VIP or SUPER.\n");
+        return 0;
+      }
+      emu_selected = 1;
+    } else if(strcmp(argv[i], "--seed") == 0) {
+      i++;
+
+      if(i >= argc || !term_parse_uint(argv[i], UINT64_MAX, &opt->seed)) {
+        printf("Error: Invalid argument after --seed! Argument must be a non-negative integer.\n");
+        return 0;
+      }
+      opt->has_seed = 1;
+    } else if(strcmp(argv[i], "--braille") == 0) {
+      opt->mode = CHIP8_TERM_BRAILLE;
+    } else if(strcmp(argv[i], "--fps") == 0) {
+      i++;
+
+      if(i >= argc || !term_parse_uint(argv[i], 60, &n) || n == 0) {
+        printf("Error: Invalid argument after --fps! Argument must be an integer between 1 and 60.\n");
+        return 0;
+      }
+      opt->fps = n;
+    } else if(strcmp(argv[i], "--ipf") == 0) {
+      i++;
+
+      if(i >= argc || !term_parse_uint(argv[i], 100000, &n) || n == 0) {
+        printf("Error: Invalid argument after --ipf! Argument must be an integer between 1 and 100000.\n");
+        return 0;
+      }
+      opt->instructions_per_frame = n;
+    } else if(opt->rom_file == NULL) {
+      opt->rom_file = argv[i];
+    } else {
+      printf("Error: You cannot run multiple CHIP-8 ROMs!\n");
+      return 0;
+    }
+  }
+
+  if(!emu_selected || opt->rom_file == NULL) {
+    printf("Usage: ryce8-term --type <VIP | SUPER> [--seed <N>] [--braille] [--fps <N>] [--ipf <N>] <ROM_FILE_PATH>\n");
+    return 0;
+  }
+  return 1;
+}
+
+static void term_write(const char *buf, size_t len) {
+  while(len > 0) {
+    ssize_t n = write(STDOUT_FILENO, buf, len);
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+// Put the terminal back the way it was, and the cursor below the display.
+static void term_restore(void) {
+  if(!term_raw) {
+    return;
+  }
+  term_raw = 0;
+
+  char buf[64];
+  int len = snprintf(buf, sizeof(buf), "\x1b[%u;1H\x1b[?25h\n", term.rows + 2);
+  term_write(buf, len);
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &term_saved);
+}
+
+// Read keys without waiting for enter, and without showing them. Ctrl-C still sends SIGINT.
+static int term_enter_raw_mode(void) {
+  if(tcgetattr(STDIN_FILENO, &term_saved) != 0) {
+    return 0;
+  }
+
+  struct termios raw = term_saved;
+  raw.c_iflag &= ~(IXON | ICRNL | INPCK | ISTRIP);
+  raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+  raw.c_cc[VMIN] = 0;
+  raw.c_cc[VTIME] = 0;
+
+  if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) {
+    return 0;
+  }
+
+  term_raw = 1;
+  atexit(term_restore);
+  return 1;
+}
+
+// Index (0x0-0xF) of the CHIP-8 key that c is mapped to, or -1 if c is not a key.
+static int term_map_key(char c) {
+  switch(c) {
+    case '1': return 0x1;
+    case '2': return 0x2;
+    case '3': return 0x3;
+    case '4': return 0xC;
+    case 'q': return 0x4;
+    case 'w': return 0x5;
+    case 'e': return 0x6;
+    case 'r': return 0xD;
+    case 'a': return 0x7;
+    case 's': return 0x8;
+    case 'd': return 0x9;
+    case 'f': return 0xE;
+    case 'z': return 0xA;
+    case 'x': return 0x0;
+    case 'c': return 0xB;
+    case 'v': return 0xF;
+    default: return -1;
+  }
+}
+
+// Read every key that was pressed since the last frame. hold counts down the frames every key stays held.
+static void term_read_keys(uint8_t hold[16], uint8_t *paused) {
+  char buf[64];
+  ssize_t n;
+
+  while((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+    for(ssize_t i = 0; i < n; i++) {
+      char c = buf[i] >= 'A' && buf[i] <= 'Z' ? buf[i] - 'A' + 'a' : buf[i];
+
+      if(c == ' ') {
+        *paused = !*paused;
+      } else {
+        const int k = term_map_key(c);
+        if(k >= 0) {
+          hold[k] = TERM_KEY_HOLD_FRAMES;
+        }
+      }
+    }
+  }
+}
+
+static uint64_t term_now_nanos(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+  struct term_options opt;
+  if(!term_parse_args(&opt, argc, argv)) {
+    return 1;
+  }
+
+  FILE *f = fopen(opt.rom_file, "rb");
+  if(f == NULL) {
+    printf("Error: Cannot open ROM %s!\n", opt.rom_file);
+    return 1;
+  }
+
+  struct chip8 *vm = chip8_create(opt.type);
+  if(vm == NULL) {
+    fclose(f);
+    return 1;
+  }
+
+  chip8_wrapper_set_seed(vm, opt.has_seed ? opt.seed : (uint64_t) time(NULL));
+  int res = chip8_wrapper_reset(vm, f);
+  fclose(f);
+
+  if(!res) {
+    printf("Error: Cannot load ROM %s!\n", opt.rom_file);
+    chip8_destroy(vm);
+    return 1;
+  }
+
+  if(!isatty(STDIN_FILENO) || !term_enter_raw_mode()) {
+    printf("Error: ryce8-term must be run in a terminal!\n");
+    chip8_destroy(vm);
+    return 1;
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = term_on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGHUP, &sa, NULL);
+  sigaction(SIGWINCH, &sa, NULL);
+
+  chip8_term_init(&term, opt.mode, chip8_fb_width(vm), chip8_fb_height(vm));
+
+  uint8_t hold[16] = {0};
+  uint8_t paused = 0;
+  uint8_t sound_on = 0;
+  int exit_code = 0;
+
+  //rows that changed since the display was last written. With --fps, changes pile up in between.
+  uint64_t dirty = 0;
+  uint32_t frames_since_draw = 0;
+  const uint32_t frames_per_draw = 60 / opt.fps;
+
+  //writing to the terminal never waits for the display, so only the emulated clock is used
+  struct chip8_pacer pacer;
+  chip8_pacer_init(&pacer, term_now_nanos(), 0, 0);
+
+  while(!term_stop) {
+    term_read_keys(hold, &paused);
+
+    const uint64_t now = term_now_nanos();
+    uint32_t num_frames = 0;
+    if(paused) {
+      chip8_pacer_restart(&pacer, now);
+    } else {
+      num_frames = chip8_pacer_frames_due(&pacer, now);
+    }
+
+    for(uint32_t i = 0; i < num_frames; i++) {
+      uint16_t keys = 0;
+      for(uint32_t k = 0; k < 16; k++) {
+        if(hold[k] != 0) {
+          hold[k]--;
+          keys |= 1 << k;
+        }
+      }
+      chip8_set_keyboard(&vm->core, keys);
+
+      if(!chip8_wrapper_run_frame(vm, opt.instructions_per_frame)) {
+        exit_code = 1;
+        term_stop = 1;
+        break;
+      }
+
+      if(chip8_wrapper_has_exited(vm)) {
+        term_stop = 1;
+        break;
+      }
+    }
+
+    //ring the terminal bell whenever the sound starts
+    const uint8_t sound = vm->core.sound_timer != 0;
+    if(sound && !sound_on) {
+      term_write("\a", 1);
+    }
+    sound_on = sound;
+
+    if(term_resized) {
+      term_resized = 0;
+      chip8_term_invalidate(&term);
+    }
+
+    dirty |= chip8_take_fb_dirty(&vm->core);
+    frames_since_draw += num_frames;
+
+    if(frames_since_draw >= frames_per_draw && (dirty != 0 || !term.drawn)) {
+      if(chip8_term_draw(&term, vm->core.fb, dirty) != 0) {
+        term_write(term.out, term.out_len);
+      }
+      dirty = 0;
+      frames_since_draw = 0;
+    }
+
+    //while paused, keys are still read every frame
+    const uint64_t next = paused ? now + CHIP8_PACER_NANOS_PER_FRAME : chip8_pacer_next_frame(&pacer);
+    const uint64_t after = term_now_nanos();
+    if(next > after) {
+      struct timespec ts = {(next - after) / CHIP8_PACER_NANOS_PER_SECOND, (next - after) % CHIP8_PACER_NANOS_PER_SECOND};
+      nanosleep(&ts, NULL);
+    }
+  }
+
+  if(exit_code != 0) {
+    term_restore();
+    printf("Cannot process instruction at address %d\n", vm->core.pc);
+    fflush(stdout);
+  }
+
+  chip8_destroy(vm);
+  return exit_code;
+}
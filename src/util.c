@@ -1,4 +1,9 @@
 #include "util.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 
 struct uint128 uint128_left_shift(struct uint128 val, uint8_t shift_by) {
@@ -105,3 +110,64 @@ struct uint128 uint128_xor(struct uint128 a, struct uint128 b) {
   res.msb = a.msb ^ b.msb;
   return res; 
 }
+
+
+
+static inline uint64_t rotl64(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+//splitmix64 is used to expand the 64-bit seed into the 256 bits of state that
+//xoshiro needs. This is the seeding method recommended by the xoshiro authors, and it
+//guarantees that the state is never all zeros.
+static uint64_t splitmix64(uint64_t *x) {
+  uint64_t z = (*x += 0x9E3779B97F4A7C15);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  return z ^ (z >> 31);
+}
+
+void xoshiro256_seed(struct xoshiro256 *rng, uint64_t seed) {
+  for(uint8_t i = 0; i < 4; i++) {
+    rng->s[i] = splitmix64(&seed);
+  }
+}
+
+uint64_t xoshiro256_next(struct xoshiro256 *rng) {
+  uint64_t *s = rng->s;
+  const uint64_t result = rotl64(s[1] * 5, 7) * 9;
+  const uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+
+  s[2] ^= t;
+
+  s[3] = rotl64(s[3], 45);
+
+  return result;
+}
+
+void *aligned_malloc(size_t alignment, size_t size) {
+  //aligned_alloc() only takes sizes that are a multiple of the alignment
+  size = (size + alignment - 1) / alignment * alignment;
+  if(size == 0) {
+    return NULL;
+  }
+
+#ifdef _WIN32
+  return _aligned_malloc(size, alignment);
+#else
+  return aligned_alloc(alignment, size);
+#endif
+}
+
+void aligned_free(void *ptr) {
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
@@ -2,6 +2,13 @@
 #define UTIL_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <stdatomic.h>
+#endif
 
 //note that there exists a __uint128_t type in GCC, but this is a compiler extension.
 //I want to avoid using compiler extensions and stick to what ISO C provides,
@@ -20,6 +27,77 @@ struct uint128 uint128_or(struct uint128 a, struct uint128 b);
 void uint128_set(struct uint128 *a, uint8_t pos, uint8_t val);
 
 
+//a small, fast PRNG (xoshiro256** by David Blackman and Sebastiano Vigna).
+//https://prng.di.unimi.it/
+//The whole generator state lives in this struct, so each CHIP-8 instance can own
+//one without touching the global rand()/srand() state shared by the C library.
+struct xoshiro256 {
+  uint64_t s[4];
+};
+
+//the splitmix64 finalizer. Scrambles all 64 bits of x so that similar inputs give
+//very different outputs. Used to build the hash keys of the machine state.
+static inline uint64_t mix64(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+  return x ^ (x >> 31);
+}
+
+void xoshiro256_seed(struct xoshiro256 *rng, uint64_t seed);
+uint64_t xoshiro256_next(struct xoshiro256 *rng);
+
+//number of bits set in x. Compilers turn this into a single instruction if the CPU has one.
+static inline uint32_t popcount32(uint32_t x) {
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0F0F0F0F;
+  return (x * 0x01010101) >> 24;
+}
+
+static inline uint32_t popcount64(uint64_t x) {
+  return popcount32((uint32_t)x) + popcount32((uint32_t)(x >> 32));
+}
+
+
+// Allocate size bytes starting at a multiple of alignment (a power of 2), since aligned_alloc()
+// is not available on Windows. Memory from this must be freed with aligned_free().
+void *aligned_malloc(size_t alignment, size_t size);
+void aligned_free(void *ptr);
+
+
+//a reference count that can be changed from several threads at once.
+//MSVC only has C11 atomics behind an experimental switch, so it uses its Interlocked functions.
+#if defined(_MSC_VER) && !defined(__clang__)
+typedef volatile long refcount_t;
+
+static inline void refcount_init(refcount_t *r, uint32_t count) {
+  *r = (long)count;
+}
+
+static inline void refcount_add(refcount_t *r) {
+  _InterlockedIncrement(r);
+}
+
+//returns 1 if that was the last reference.
+static inline int refcount_sub(refcount_t *r) {
+  return _InterlockedDecrement(r) == 0;
+}
+#else
+typedef _Atomic uint32_t refcount_t;
+
+static inline void refcount_init(refcount_t *r, uint32_t count) {
+  atomic_init(r, count);
+}
+
+static inline void refcount_add(refcount_t *r) {
+  atomic_fetch_add_explicit(r, 1, memory_order_relaxed);
+}
+
+//returns 1 if that was the last reference.
+static inline int refcount_sub(refcount_t *r) {
+  return atomic_fetch_sub_explicit(r, 1, memory_order_acq_rel) == 1;
+}
+#endif
 
 
 #endif// UTIL_H
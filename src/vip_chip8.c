@@ -1,13 +1,26 @@
 #include "vip_chip8.h"
 
 
+// Point the Chip8 Core at the memory owned by this VM. This is also used
+// after a VM is copied, since the copy still points at the memory of the original.
+void vip_chip8_bind(struct vip_chip8 *vm) {
+  vm->core->private_ram = vm->alloc_ram;
+  vm->core->fb = vm->alloc_fb;
+  vm->core->stack = vm->alloc_stack;
+
+  //shared RAM lives outside of the VM, so it does not need to be moved.
+  if(vm->core->shared_ram == NULL) {
+    vm->core->ram = vm->alloc_ram;
+  }
+}
+
 void vip_chip8_init(struct vip_chip8 *vm) {
   //pass our COSMAC VIP CHIP8 specifications to Chip8 Core.
-  vm->core->ram = vm->alloc_ram;
-  vm->core->fb = vm->alloc_fb;
-  vm->core->stack = (uint16_t*) (vm->alloc_ram + CHIP8_STACK_START);
+  vm->core->shared_ram = NULL;
+  vip_chip8_bind(vm);
 
   vm->core->fb_size = sizeof(vm->alloc_fb);  
+  vm->core->fb_row_shift = 0;
   vm->core->ram_size = sizeof(vm->alloc_ram);
   vm->core->stack_size = 12;
 
@@ -24,4 +37,8 @@ int vip_chip8_process_instruction(struct vip_chip8 *vm) {
 
 int vip_chip8_reset(struct vip_chip8 *vm, FILE *file) {
   return chip8_reset(vm->core, file);
+}
+
+int vip_chip8_reset_from_image(struct vip_chip8 *vm, struct chip8_shared_ram *image) {
+  return chip8_reset_from_image(vm->core, image);
 }
\ No newline at end of file
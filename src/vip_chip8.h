@@ -3,19 +3,22 @@
 
 #include "chip8_core.h"
 
+// Buffers start on their own cache lines, and RAM comes last, so that
+// copying a VM whose RAM is shared can stop right before it (see chip8_fork()).
 struct vip_chip8 {
   struct chip8_core *core;
 
-  uint8_t alloc_ram[4096];
-  uint64_t alloc_fb[32];
-
-
+  uint16_t alloc_stack[CHIP8_MAX_STACK_SIZE];
+  _Alignas(CHIP8_CACHE_LINE) uint64_t alloc_fb[32];
+  _Alignas(CHIP8_CACHE_LINE) uint8_t alloc_ram[4096];
 };
 
 
 void vip_chip8_init(struct vip_chip8 *vm);
+void vip_chip8_bind(struct vip_chip8 *vm);
 int vip_chip8_process_instruction(struct vip_chip8 *vm);
 int vip_chip8_reset(struct vip_chip8 *vm, FILE *file);
+int vip_chip8_reset_from_image(struct vip_chip8 *vm, struct chip8_shared_ram *image);
 
 #endif// VIP_CHIP8_H
 